@@ -0,0 +1,37 @@
+#ifndef OCH8S_CHIP8_ASSEMBLER_H
+#define OCH8S_CHIP8_ASSEMBLER_H
+
+// The test ROMs are assembled by the compiler from these mnemonics, every opcode word is a constant expression. A
+// program is an array of opcode words, `AT()` gives the address of one of them to jump to.
+#define AT(index) (0x200 + 2 * (index))
+
+#define CLS 0x00E0
+#define RET 0x00EE
+#define SCD(n) (0x00C0 | (n))
+#define SCU(n) (0x00D0 | (n))
+#define SCR 0x00FB
+#define SCL 0x00FC
+#define EXIT 0x00FD
+#define LOW 0x00FE
+#define HIGH 0x00FF
+#define JP(address) (0x1000 | (address))
+#define CALL(address) (0x2000 | (address))
+#define SE(x, byte) (0x3000 | (x) << 8 | (byte))
+#define SNE(x, byte) (0x4000 | (x) << 8 | (byte))
+#define SE_V(x, y) (0x5000 | (x) << 8 | (y) << 4)
+#define SAVE(x, y) (0x5002 | (x) << 8 | (y) << 4)
+#define LOAD(x, y) (0x5003 | (x) << 8 | (y) << 4)
+#define LD(x, byte) (0x6000 | (x) << 8 | (byte))
+#define ADD(x, byte) (0x7000 | (x) << 8 | (byte))
+#define ALU(x, y, operation) (0x8000 | (x) << 8 | (y) << 4 | (operation))
+#define SNE_V(x, y) (0x9000 | (x) << 8 | (y) << 4)
+#define LD_I(address) (0xA000 | (address))
+#define JP_V0(address) (0xB000 | (address))
+#define RND(x, byte) (0xC000 | (x) << 8 | (byte))
+#define DRW(x, y, n) (0xD000 | (x) << 8 | (y) << 4 | (n))
+#define SKP(x) (0xE09E | (x) << 8)
+#define SKNP(x) (0xE0A1 | (x) << 8)
+#define FX(x, byte) (0xF000 | (x) << 8 | (byte))
+#define LD_LONG_I(address) 0xF000, (address)
+
+#endif
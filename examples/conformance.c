@@ -0,0 +1,426 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chip8-assembler.h"
+#include "quirks.h"
+#include "screen.h"
+#include "virtual-machine.h"
+
+// Stores all the registers at the address, so the flags of every operation end up in the hash
+#define DUMP(address) LD_I(address), FX(0xF, 0x55)
+
+static constexpr uint32_t CONFORMANCE_FRAMES = 30;
+static constexpr size_t CONFORMANCE_STEPS_PER_FRAME = 1000;
+
+/**
+ * @brief A ROM run for a fixed number of frames, its state at the end must hash to the golden value.
+ */
+struct ConformanceCase {
+    const char* name;
+    enum QuirkProfile quirk_profile;
+    const uint16_t* program;
+    size_t length;
+
+    // When not -1 the key is held on the frames where `frame / 4` is odd, so programs see presses and releases
+    int8_t key;
+
+    // If the interpreter must fail, the state is hashed where it stopped
+    bool faults;
+
+    uint64_t golden;
+};
+
+static const uint16_t alu_program[] = {
+    LD(0, 0xF0), LD(1, 0x20), LD(0xF, 0x77), ALU(0, 1, 4), DUMP(0x300), // Carry
+    LD(2, 0x10), ALU(2, 1, 4), DUMP(0x310), // No carry
+    LD(3, 0x10), ALU(3, 1, 5), DUMP(0x320), // Borrow
+    LD(4, 0x30), ALU(4, 1, 5), DUMP(0x330), // No borrow
+    LD(5, 0x10), ALU(5, 1, 7), DUMP(0x340), // Reverse subtraction
+    LD(6, 0x81), LD(7, 0x03), ALU(6, 7, 6), DUMP(0x350), // Shift right, vX or vY depending on the quirks
+    LD(8, 0x81), ALU(8, 7, 0xE), DUMP(0x360), // Shift left
+    LD(0xF, 0x55), ALU(9, 1, 1), DUMP(0x370), // vF reset quirk on OR, AND and XOR
+    LD(0xF, 0x55), ALU(9, 1, 2), DUMP(0x380),
+    LD(0xF, 0x55), ALU(9, 1, 3), DUMP(0x390),
+    ALU(0xA, 1, 0), ADD(0xA, 0xFF), DUMP(0x3A0), // 7XNN never touches vF
+    ALU(0xF, 1, 4), DUMP(0x3B0), // The flag wins over the result when vF is the target
+    JP(AT(50)),
+};
+
+static const uint16_t flow_program[] = {
+    LD(0, 5), SE(0, 5), LD(1, 0xEE), SNE(0, 5), LD(2, 0x22),
+    LD(3, 5), SE_V(0, 3), LD(4, 0xEE), SNE_V(0, 3), LD(5, 0x55),
+    CALL(AT(20)), LD(7, 0x77), LD(0, 4), JP_V0(AT(13)), LD(8, 0xEE),
+    LD(9, 0x99), JP(AT(16)), 0, 0, 0,
+    LD(6, 0x66), CALL(AT(23)), RET, ADD(6, 1), RET, // Nested subroutines
+};
+
+static const uint16_t jump_offset_program[] = {
+    LD(2, 4), LD(0, 0), JP_V0(AT(10)), 0, 0, 0, 0, 0, 0, 0,
+    LD(0xA, 0x0A), JP(AT(11)), // Reached with NNN + v0
+    LD(0xB, 0x0B), JP(AT(13)), // Reached with XNN + vX
+};
+
+static const uint16_t draw_program[] = {
+    CLS, LD(0, 2), LD(1, 3), LD(2, 0xA), FX(2, 0x29),
+    DRW(0, 1, 5), ALU(0xE, 0xF, 0), // No collision
+    DRW(0, 1, 5), ALU(0xD, 0xF, 0), // Erased, collision
+    LD(0, 62), LD(1, 30), DRW(0, 1, 5), // Clipped or wrapped at the edges
+    LD(0, 70), DRW(0, 1, 5), // The coordinates themselves always wrap
+    JP(AT(14)),
+};
+
+static const uint16_t keys_program[] = {
+    LD(0, 7), SKP(0), JP(AT(1)), LD(1, 0x11), // Wait for the press
+    SKNP(0), JP(AT(4)), LD(2, 0x22), // Wait for the release
+    FX(3, 0x0A), LD(4, 0x44), // Wait for a whole press and release
+    JP(AT(9)),
+};
+
+static const uint16_t timers_program[] = {
+    LD(0, 10), FX(0, 0x15), LD(1, 3), FX(1, 0x18),
+    FX(2, 0x07), SE(2, 0), JP(AT(4)), // The delay timer wait, detected as idle
+    LD(3, 0x33), FX(4, 0x07), JP(AT(9)),
+};
+
+static const uint16_t memory_program[] = {
+    LD(5, 0xF), FX(5, 0x29), // Font character
+    LD_I(0x300), LD(0, 254), FX(0, 0x33), // Binary coded decimal
+    LD(1, 0x30), FX(1, 0x1E), // I + vX
+    LD(0, 1), LD(1, 2), LD(2, 3), FX(2, 0x55),
+    LD_I(0x300), FX(3, 0x65), // I left incremented depending on the quirks
+    JP(AT(13)),
+};
+
+static const uint16_t wrap_program[] = {
+    LD_I(0xFFE), LD(0, 0xAA), LD(1, 0xBB), LD(2, 0xCC), FX(2, 0x55), FX(3, 0x65), // Past the end of the 4KB
+    LD(5, 0xFF), LD_I(0xFFF), FX(5, 0x33), LD(6, 0), DRW(6, 6, 5), // The sprite wraps too
+    JP(AT(11)),
+};
+
+static const uint16_t xo_chip_wrap_program[] = {
+    LD_LONG_I(0xFFFE), LD(0, 0xAA), LD(1, 0xBB), LD(2, 0xCC), FX(2, 0x55), FX(3, 0x65), // Past the end of the 64KB
+    LD(5, 0xFF), LD_LONG_I(0xFFFF), FX(5, 0x33), LD(6, 0), DRW(6, 6, 5),
+    JP(AT(13)),
+};
+
+static const uint16_t random_program[] = {
+    LD_I(0x300), RND(0, 0xFF), RND(1, 0x0F), RND(2, 0xF0), FX(2, 0x55),
+    JP(AT(5)),
+};
+
+static const uint16_t schip_program[] = {
+    HIGH, LD(0, 1), LD(1, 2), LD(2, 8), FX(2, 0x30), DRW(0, 1, 0), // Big font, 16x16 sprite
+    LD(2, 3), FX(2, 0x29), LD(0, 100), LD(1, 60), DRW(0, 1, 5), ALU(0xE, 0xF, 0), // Rows clipped at the bottom
+    SCD(3), SCR, SCL,
+    LD(0, 0x12), LD(1, 0x34), FX(1, 0x75), LD(0, 0), LD(1, 0), FX(1, 0x85), // RPL user flags
+    LOW, LD(0, 0), DRW(0, 0, 5),
+    JP(AT(24)),
+};
+
+static const uint16_t xo_chip_program[] = {
+    FX(3, 0x01), LD(0, 5), LD(1, 5), LD(2, 0xC), FX(2, 0x29), DRW(0, 1, 5), // Both planes
+    FX(2, 0x01), LD(0, 8), DRW(0, 1, 5), SCU(2), // Second plane only
+    LD_LONG_I(0x1234),
+    LD(3, 0xA), LD(4, 0xB), LD(5, 0xC), SAVE(3, 5), LOAD(5, 3), // Register ranges, loaded back reversed
+    SE(3, 0xC), LD_LONG_I(0x0300), // The skip jumps over the whole long load
+    LD(6, 0x66), FX(0, 0x02),
+    JP(AT(22)),
+};
+
+static const uint16_t xo_chip_only_program[] = {
+    LD(2, 0xC), FX(2, 0x29), LD(0, 1), DRW(0, 0, 5), SCU(2), FX(2, 0x01), DRW(0, 0, 5), // Neither scrolled nor plane 2
+    LD(3, 0xA), LD(4, 0xA), LD_I(0x300), SAVE(3, 4), LD(5, 0x55), DUMP(0x310), // The range is a skip if equal
+    JP(AT(14)),
+};
+
+static const uint16_t exit_program[] = {
+    LD(0, 1), EXIT, LD(1, 1),
+};
+
+static const uint16_t stack_overflow_program[] = {
+    ADD(0, 1), CALL(AT(0)), // Recurses until the stack is full
+};
+
+static const uint16_t stack_underflow_program[] = {
+    LD(0, 1), RET, LD(1, 1),
+};
+
+#define PROGRAM(program) program, sizeof(program) / sizeof(program[0])
+
+static const struct ConformanceCase cases[] = {
+    { "alu-vip", QUIRK_PROFILE_COSMAC_VIP, PROGRAM(alu_program), -1, false, 0xFA868096E51B8A04 },
+    { "alu-schip-modern", QUIRK_PROFILE_SCHIP_MODERN, PROGRAM(alu_program), -1, false, 0xFA91D431F68BC98B },
+    { "alu-xo-chip", QUIRK_PROFILE_XO_CHIP, PROGRAM(alu_program), -1, false, 0x54E225B4C120ACCC },
+    { "flow-vip", QUIRK_PROFILE_COSMAC_VIP, PROGRAM(flow_program), -1, false, 0x1E453AD0BFAF9AAD },
+    { "jump-offset-vip", QUIRK_PROFILE_COSMAC_VIP, PROGRAM(jump_offset_program), -1, false, 0x9D5464DBCADEBEE7 },
+    { "jump-offset-schip-modern", QUIRK_PROFILE_SCHIP_MODERN, PROGRAM(jump_offset_program), -1, false, 0x54F97B81B70C93EC },
+    { "draw-vip", QUIRK_PROFILE_COSMAC_VIP, PROGRAM(draw_program), -1, false, 0x75F8E5B912262301 },
+    { "draw-xo-chip", QUIRK_PROFILE_XO_CHIP, PROGRAM(draw_program), -1, false, 0xDAE97AFBE30B8AE3 },
+    { "keys-vip", QUIRK_PROFILE_COSMAC_VIP, PROGRAM(keys_program), 7, false, 0xA14FDBA78DF7C405 },
+    { "timers-vip", QUIRK_PROFILE_COSMAC_VIP, PROGRAM(timers_program), -1, false, 0x99630AB637295A39 },
+    { "memory-vip", QUIRK_PROFILE_COSMAC_VIP, PROGRAM(memory_program), -1, false, 0x0D3E147C5488EA72 },
+    { "memory-schip-modern", QUIRK_PROFILE_SCHIP_MODERN, PROGRAM(memory_program), -1, false, 0xE16D401DB1B6D0E6 },
+    { "wrap-vip", QUIRK_PROFILE_COSMAC_VIP, PROGRAM(wrap_program), -1, false, 0xFAD0C8FD1029180D },
+    { "wrap-xo-chip", QUIRK_PROFILE_XO_CHIP, PROGRAM(xo_chip_wrap_program), -1, false, 0xFC0EEE8198DE66B5 },
+    { "random-vip", QUIRK_PROFILE_COSMAC_VIP, PROGRAM(random_program), -1, false, 0x0BBE335F3F485EB8 },
+    { "schip-legacy", QUIRK_PROFILE_SCHIP_LEGACY, PROGRAM(schip_program), -1, false, 0xB334F2594EB87978 },
+    { "schip-modern", QUIRK_PROFILE_SCHIP_MODERN, PROGRAM(schip_program), -1, false, 0x56E1CF45B8112091 },
+    { "xo-chip", QUIRK_PROFILE_XO_CHIP, PROGRAM(xo_chip_program), -1, false, 0x30DC47B3592BE0DB },
+    { "xo-chip-only-schip-modern", QUIRK_PROFILE_SCHIP_MODERN, PROGRAM(xo_chip_only_program), -1, false, 0xB554AB841FB4C701 },
+    { "exit-schip-modern", QUIRK_PROFILE_SCHIP_MODERN, PROGRAM(exit_program), -1, false, 0x045C01AF06E8629D },
+    { "stack-overflow-vip", QUIRK_PROFILE_COSMAC_VIP, PROGRAM(stack_overflow_program), -1, true, 0x2B07950F5ADD746D },
+    { "stack-underflow-vip", QUIRK_PROFILE_COSMAC_VIP, PROGRAM(stack_underflow_program), -1, true, 0x9626C3D29DB8DB43 },
+};
+
+static constexpr size_t CASE_COUNT = sizeof(cases) / sizeof(cases[0]);
+
+/**
+ * @brief The result of every case, filled by the workers.
+ */
+struct ConformanceRun {
+    _Atomic size_t next_case;
+    uint64_t hashes[CASE_COUNT];
+    bool failed[CASE_COUNT];
+};
+
+/**
+ * @brief Add bytes to a 64 bits FNV-1a hash.
+ *
+ * @param hash The hash so far.
+ * @param data The bytes to add.
+ * @param size The number of bytes.
+ * @return The updated hash.
+ */
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Hash everything a program can change: the screen, the registers, the stack and the whole memory.
+ *
+ * @param vm The virtual machine after the run.
+ * @param screen Its screen.
+ * @return The hash of the state.
+ */
+static uint64_t hash_state(const struct VirtualMachine* vm, const struct Screen* screen)
+{
+    uint64_t hash = 0xCBF29CE484222325;
+
+    uint8_t resolution[] = { screen->high_resolution, screen->selected_planes };
+    hash = hash_bytes(hash, resolution, sizeof(resolution));
+
+    // The packed rows are hashed big endian, so the golden values are the same on every host
+    const uint64_t* words = &screen->buffer[0][0][0];
+
+    for (size_t i = 0; i < sizeof(screen->buffer) / sizeof(uint64_t); i++) {
+        uint8_t bytes[8];
+
+        for (size_t byte = 0; byte < 8; byte++) {
+            bytes[byte] = words[i] >> (56 - 8 * byte);
+        }
+
+        hash = hash_bytes(hash, bytes, sizeof(bytes));
+    }
+
+    // The 16 bits registers are hashed big endian as well
+    uint8_t registers[] = { vm->pc >> 8, vm->pc & 0xFF, vm->index_register >> 8, vm->index_register & 0xFF,
+        vm->delay_timer, vm->sound_timer, vm->exited };
+    hash = hash_bytes(hash, registers, sizeof(registers));
+    hash = hash_bytes(hash, vm->v_registers, sizeof(vm->v_registers));
+    hash = hash_bytes(hash, vm->rpl_flags, sizeof(vm->rpl_flags));
+
+    for (size_t i = 0; i < vm->pc_stack_index; i++) {
+        uint8_t address[] = { vm->pc_stack[i] >> 8, vm->pc_stack[i] & 0xFF };
+        hash = hash_bytes(hash, address, sizeof(address));
+    }
+
+    hash = hash_bytes(hash, vm->memory, XO_CHIP_MEMORY_SIZE);
+
+    return hash;
+}
+
+/**
+ * @brief Run a case the same way the emulation thread runs a frame: the timers tick and then the CPU runs.
+ *
+ * @param conformance_case The case to run.
+ * @param hash Where the hash of the final state is stored.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t run_case(const struct ConformanceCase* conformance_case, uint64_t* hash)
+{
+    // An empty ROM, the program is written straight into the memory
+    struct VirtualMachine* vm = create_virtual_machine("/dev/null", conformance_case->quirk_profile);
+    if (vm == NULL) {
+        return 1;
+    }
+
+    struct Screen* screen = create_screen();
+    if (screen == NULL) {
+        free(vm);
+        return 2;
+    }
+
+    for (size_t i = 0; i < conformance_case->length; i++) {
+        vm->memory[0x200 + 2 * i] = conformance_case->program[i] >> 8;
+        vm->memory[0x200 + 2 * i + 1] = conformance_case->program[i] & 0xFF;
+    }
+
+    // The random numbers must be the same on every run
+    vm->random_state = 0x2545F491;
+
+    uint8_t result = 0;
+
+    for (uint32_t frame = 0; frame < CONFORMANCE_FRAMES && !vm->exited; frame++) {
+        if (conformance_case->key != -1) {
+            set_key_state(vm, conformance_case->key, frame / 4 % 2 == 1);
+        }
+
+        if (vm->delay_timer > 0) {
+            vm->delay_timer--;
+        }
+
+        if (vm->sound_timer > 0) {
+            vm->sound_timer--;
+        }
+
+        if (vm->run_cpu(vm, screen, CONFORMANCE_STEPS_PER_FRAME) != 0) {
+            result = 3;
+            break;
+        }
+    }
+
+    if (conformance_case->faults) {
+        result = result == 3 ? 0 : 4;
+    }
+
+    *hash = hash_state(vm, screen);
+
+    delete_screen(screen);
+    free(vm);
+
+    return result;
+}
+
+/**
+ * @brief Run the cases that are left until there are none, it is the entry point of every worker thread.
+ *
+ * @param data The `struct ConformanceRun` shared by the workers.
+ * @return Always NULL.
+ */
+static void* run_worker(void* data)
+{
+    struct ConformanceRun* run = data;
+
+    size_t index;
+    while ((index = atomic_fetch_add(&run->next_case, 1)) < CASE_COUNT) {
+        run->failed[index] = run_case(&cases[index], &run->hashes[index]) != 0;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Print the help menu
+ *
+ * @param argv The list of arguments to get the name of the program from.
+ */
+static void print_help(char* argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    puts("Runs the conformance ROMs through the interpreters and checks the hash of their final state.");
+    puts("Options:");
+    puts("  -t <threads> Number of threads (default the online CPUs)");
+    puts("  -u Print the hashes as the golden values to paste in the cases, after an intended change of behaviour");
+    puts("  -h Show this info message");
+}
+
+int main(int argc, char* argv[])
+{
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool update = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "t:uh")) != -1) {
+        switch (option) {
+        case 't':
+            threads = strtol(optarg, NULL, 10);
+            break;
+        case 'u':
+            update = true;
+            break;
+        case 'h':
+            print_help(argv);
+            return 0;
+        default:
+            print_help(argv);
+            return 1;
+        }
+    }
+
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    if ((size_t)threads > CASE_COUNT) {
+        threads = CASE_COUNT;
+    }
+
+    struct ConformanceRun run = { 0 };
+    atomic_init(&run.next_case, 0);
+
+    pthread_t workers[CASE_COUNT];
+    long started = 0;
+
+    for (; started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, run_worker, &run) != 0) {
+            fprintf(stderr, "Couldn't start the worker %ld\n", started);
+            break;
+        }
+    }
+
+    // The main thread helps too, so the run finishes even if no worker could start
+    run_worker(&run);
+
+    for (long i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    size_t failures = 0;
+
+    for (size_t i = 0; i < CASE_COUNT; i++) {
+        if (update) {
+            printf("%-28s 0x%016lX\n", cases[i].name, run.hashes[i]);
+            continue;
+        }
+
+        if (run.failed[i]) {
+            printf("FAIL %s: %s\n", cases[i].name,
+                cases[i].faults ? "the interpreter didn't fail" : "the interpreter failed");
+            failures++;
+        } else if (run.hashes[i] != cases[i].golden) {
+            printf("FAIL %s: hash 0x%016lX, expected 0x%016lX\n", cases[i].name, run.hashes[i], cases[i].golden);
+            failures++;
+        } else {
+            printf("ok   %s\n", cases[i].name);
+        }
+    }
+
+    if (!update) {
+        printf("%zu/%zu cases passed\n", CASE_COUNT - failures, CASE_COUNT);
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,898 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "quirks.h"
+#include "rom-analysis.h"
+#include "virtual-machine.h"
+
+static constexpr uint16_t ROM_START = 0x200;
+
+// Data bytes printed on each `.byte` line
+static constexpr size_t DATA_BYTES_PER_LINE = 8;
+
+// The extensions of the ROMs picked from a directory
+static const char* const rom_extensions[] = { ".ch8", ".c8", ".sc8", ".xo8" };
+
+/**
+ * @brief A ROM loaded into a virtual machine, only to decode its memory, and its analysis.
+ */
+struct Disassembly {
+    const char* name;
+    struct VirtualMachine* vm;
+    const struct RomAnalysis* analysis;
+
+    // Leaders called by 2NNN, they are labelled as subroutines
+    uint64_t subroutines[ROM_ANALYSIS_BITMAP_WORDS];
+};
+
+/**
+ * @brief What is printed about each ROM of a library.
+ */
+struct DisassemblySummary {
+    bool failed;
+    enum QuirkProfile quirk_profile;
+    uint32_t rom_size;
+    uint32_t instruction_count;
+    uint32_t block_count;
+    uint32_t idle_loop_count;
+
+    // Edges going back to the same block or an earlier one, the loops worth looking at first
+    uint32_t loop_count;
+
+    // Reachable 0NNN, skipped by the emulator as it can't run the machine code of the COSMAC VIP
+    uint32_t machine_routine_count;
+};
+
+/**
+ * @brief The ROMs of a library, shared by the workers that disassemble them.
+ */
+struct DisassemblyRun {
+    char** paths;
+    size_t path_count;
+    const char* output_directory;
+
+    struct DisassemblySummary* summaries;
+    atomic_size_t next_path;
+};
+
+/**
+ * @brief Get the opcode at an address through the decoder of the core.
+ */
+static struct Opcode opcode_at(struct VirtualMachine* vm, uint16_t address)
+{
+    vm->pc = address;
+    return get_opcode(vm);
+}
+
+/**
+ * @brief Get the length of the instruction at an address, F000 NNNN is the only one of 4 bytes.
+ */
+static uint8_t instruction_length(const struct VirtualMachine* vm, uint16_t address)
+{
+    return read_memory(vm, address) == 0xF0 && read_memory(vm, address + 1) == 0x00 ? 4 : 2;
+}
+
+/**
+ * @brief Check if an opcode is a 0NNN that isn't any of the known 00XX instructions.
+ */
+static bool is_machine_routine(struct Opcode opcode)
+{
+    if (opcode.nibble_1 != 0x0) {
+        return false;
+    }
+
+    if (opcode.nibble_2 != 0x0) {
+        return true;
+    }
+
+    return opcode.nibble_3 != 0xC && opcode.nibble_3 != 0xD && opcode.byte_2 != 0xE0 && opcode.byte_2 != 0xEE
+        && opcode.byte_2 < 0xFB;
+}
+
+/**
+ * @brief Write the label of an address: subroutines, other basic blocks, data loaded on I or the bare address.
+ *
+ * @param disassembly The disassembly.
+ * @param address The address.
+ * @param label Where the label will be written.
+ * @param size The size of `label` in bytes.
+ */
+static void format_label(const struct Disassembly* disassembly, uint16_t address, char* label, size_t size)
+{
+    const struct RomAnalysis* analysis = disassembly->analysis;
+
+    if (test_analysis_bit(disassembly->subroutines, address)) {
+        snprintf(label, size, "sub_%04X", address);
+    } else if (test_analysis_bit(analysis->leaders, address) && test_analysis_bit(analysis->instructions, address)) {
+        snprintf(label, size, "block_%04X", address);
+    } else if (test_analysis_bit(analysis->data, address)) {
+        snprintf(label, size, "data_%04X", address);
+    } else {
+        snprintf(label, size, "0x%03X", address);
+    }
+}
+
+/**
+ * @brief Write the mnemonic and operands of the instruction at an address.
+ *
+ * @param disassembly The disassembly.
+ * @param address The address of the instruction.
+ * @param text Where the instruction will be written.
+ * @param size The size of `text` in bytes.
+ */
+static void format_instruction(struct Disassembly* disassembly, uint16_t address, char* text, size_t size)
+{
+    struct VirtualMachine* vm = disassembly->vm;
+    struct Opcode opcode = opcode_at(vm, address);
+
+    uint8_t x = opcode.nibble_2;
+    uint8_t y = opcode.nibble_3;
+
+    char label[16];
+    format_label(disassembly, opcode.nibbles_2_3_4, label, sizeof(label));
+
+    static const char* const alu_mnemonics[16] = {
+        [0x0] = "LD", [0x1] = "OR", [0x2] = "AND", [0x3] = "XOR", [0x4] = "ADD",
+        [0x5] = "SUB", [0x6] = "SHR", [0x7] = "SUBN", [0xE] = "SHL",
+    };
+
+    switch (opcode.nibble_1) {
+    case 0x0:
+        if (x == 0x0 && y == 0xC) {
+            snprintf(text, size, "SCD  %u", opcode.nibble_4);
+        } else if (x == 0x0 && y == 0xD) {
+            snprintf(text, size, "SCU  %u", opcode.nibble_4);
+        } else if (opcode.nibbles_2_3_4 == 0x0E0) {
+            snprintf(text, size, "CLS");
+        } else if (opcode.nibbles_2_3_4 == 0x0EE) {
+            snprintf(text, size, "RET");
+        } else if (opcode.nibbles_2_3_4 == 0x0FB) {
+            snprintf(text, size, "SCR");
+        } else if (opcode.nibbles_2_3_4 == 0x0FC) {
+            snprintf(text, size, "SCL");
+        } else if (opcode.nibbles_2_3_4 == 0x0FD) {
+            snprintf(text, size, "EXIT");
+        } else if (opcode.nibbles_2_3_4 == 0x0FE) {
+            snprintf(text, size, "LOW");
+        } else if (opcode.nibbles_2_3_4 == 0x0FF) {
+            snprintf(text, size, "HIGH");
+        } else {
+            snprintf(text, size, "SYS  0x%03X ; machine language routine, skipped by the emulator",
+                opcode.nibbles_2_3_4);
+        }
+        return;
+
+    case 0x1:
+        snprintf(text, size, "JP   %s", label);
+        return;
+
+    case 0x2:
+        snprintf(text, size, "CALL %s", label);
+        return;
+
+    case 0x3:
+        snprintf(text, size, "SE   v%X, 0x%02X", x, opcode.byte_2);
+        return;
+
+    case 0x4:
+        snprintf(text, size, "SNE  v%X, 0x%02X", x, opcode.byte_2);
+        return;
+
+    case 0x5:
+        if (opcode.nibble_4 == 0x0) {
+            snprintf(text, size, "SE   v%X, v%X", x, y);
+            return;
+        }
+
+        if (opcode.nibble_4 == 0x2 || opcode.nibble_4 == 0x3) {
+            snprintf(text, size, "%s v%X-v%X", opcode.nibble_4 == 0x2 ? "SAVE" : "LOAD", x, y);
+            return;
+        }
+
+        break;
+
+    case 0x6:
+        snprintf(text, size, "LD   v%X, 0x%02X", x, opcode.byte_2);
+        return;
+
+    case 0x7:
+        snprintf(text, size, "ADD  v%X, 0x%02X", x, opcode.byte_2);
+        return;
+
+    case 0x8:
+        if (alu_mnemonics[opcode.nibble_4] != NULL) {
+            snprintf(text, size, "%-4s v%X, v%X", alu_mnemonics[opcode.nibble_4], x, y);
+            return;
+        }
+
+        break;
+
+    case 0x9:
+        if (opcode.nibble_4 == 0x0) {
+            snprintf(text, size, "SNE  v%X, v%X", x, y);
+            return;
+        }
+
+        break;
+
+    case 0xA:
+        snprintf(text, size, "LD   I, %s", label);
+        return;
+
+    case 0xB:
+        snprintf(text, size, "JP   v0, 0x%03X", opcode.nibbles_2_3_4);
+        return;
+
+    case 0xC:
+        snprintf(text, size, "RND  v%X, 0x%02X", x, opcode.byte_2);
+        return;
+
+    case 0xD:
+        snprintf(text, size, "DRW  v%X, v%X, %u", x, y, opcode.nibble_4);
+        return;
+
+    case 0xE:
+        if (opcode.byte_2 == 0x9E || opcode.byte_2 == 0xA1) {
+            snprintf(text, size, "%s v%X", opcode.byte_2 == 0x9E ? "SKP " : "SKNP", x);
+            return;
+        }
+
+        break;
+
+    case 0xF:
+        switch (opcode.byte_2) {
+        case 0x00:
+            if (x == 0x0) {
+                uint16_t target = read_memory(vm, address + 2) << 8 | read_memory(vm, address + 3);
+                format_label(disassembly, target, label, sizeof(label));
+                snprintf(text, size, "LD   I, long %s", label);
+                return;
+            }
+            break;
+        case 0x01:
+            snprintf(text, size, "PLANE %u", x);
+            return;
+        case 0x02:
+            if (x == 0x0) {
+                snprintf(text, size, "AUDIO");
+                return;
+            }
+            break;
+        case 0x07:
+            snprintf(text, size, "LD   v%X, DT", x);
+            return;
+        case 0x0A:
+            snprintf(text, size, "LD   v%X, K", x);
+            return;
+        case 0x15:
+            snprintf(text, size, "LD   DT, v%X", x);
+            return;
+        case 0x18:
+            snprintf(text, size, "LD   ST, v%X", x);
+            return;
+        case 0x1E:
+            snprintf(text, size, "ADD  I, v%X", x);
+            return;
+        case 0x29:
+            snprintf(text, size, "LD   F, v%X", x);
+            return;
+        case 0x30:
+            snprintf(text, size, "LD   HF, v%X", x);
+            return;
+        case 0x33:
+            snprintf(text, size, "LD   B, v%X", x);
+            return;
+        case 0x3A:
+            snprintf(text, size, "PITCH v%X", x);
+            return;
+        case 0x55:
+            snprintf(text, size, "LD   [I], v%X", x);
+            return;
+        case 0x65:
+            snprintf(text, size, "LD   v%X, [I]", x);
+            return;
+        case 0x75:
+            snprintf(text, size, "LD   R, v%X", x);
+            return;
+        case 0x85:
+            snprintf(text, size, "LD   v%X, R", x);
+            return;
+        }
+
+        break;
+    }
+
+    snprintf(text, size, ".word 0x%X%X%02X", opcode.nibble_1, x, opcode.byte_2);
+}
+
+/**
+ * @brief Count the instructions of a basic block.
+ */
+static uint32_t count_block_instructions(const struct VirtualMachine* vm, const struct BasicBlock* block)
+{
+    uint32_t count = 0;
+
+    for (uint16_t address = block->start; address != block->end; address += instruction_length(vm, address)) {
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * @brief Check if an edge of the graph goes back to its own block or an earlier one, closing a loop.
+ */
+static bool is_back_edge(const struct BasicBlock* block, uint8_t successor)
+{
+    // A call to an earlier subroutine returns, it doesn't loop
+    if ((block->flags & BASIC_BLOCK_CALL) && successor == 0) {
+        return false;
+    }
+
+    return block->successors[successor] <= block->start;
+}
+
+/**
+ * @brief Write the data bytes from an address until the next instruction or label, at most a line of them.
+ *
+ * @param out Where the listing is written.
+ * @param disassembly The disassembly.
+ * @param address The first data byte.
+ * @param end The end of the ROM.
+ * @return The address after the last byte written.
+ */
+static uint32_t write_data_line(FILE* out, const struct Disassembly* disassembly, uint32_t address, uint32_t end)
+{
+    const struct RomAnalysis* analysis = disassembly->analysis;
+
+    if (test_analysis_bit(analysis->data, address)) {
+        fprintf(out, "\ndata_%04X:\n", address);
+    }
+
+    fprintf(out, "%04X          .byte", address);
+
+    uint32_t first = address;
+    do {
+        fprintf(out, "%s0x%02X", address == first ? " " : ", ", read_memory(disassembly->vm, address));
+        address++;
+    } while (address < end && address - first < DATA_BYTES_PER_LINE && !test_analysis_bit(analysis->code, address)
+        && !test_analysis_bit(analysis->data, address));
+
+    fputc('\n', out);
+
+    return address;
+}
+
+/**
+ * @brief Write the labelled assembly of a ROM: every basic block with its instruction count and successors, and the
+ *  bytes that aren't reachable code as data.
+ *
+ * @param out Where the listing is written.
+ * @param disassembly The disassembly.
+ */
+static void write_listing(FILE* out, struct Disassembly* disassembly)
+{
+    const struct RomAnalysis* analysis = disassembly->analysis;
+    uint32_t end = ROM_START + analysis->rom_size;
+
+    fprintf(out, "; %s: %u bytes, hash 0x%016llX, detected profile %s\n", disassembly->name, analysis->rom_size,
+        (unsigned long long)analysis->rom_hash, get_quirk_profile_name(analysis->quirk_profile));
+    fprintf(out, "; %u instructions in %u basic blocks, %u idle loops\n", analysis->instruction_count,
+        analysis->block_count, analysis->idle_loop_count);
+
+    size_t block_index = 0;
+    uint32_t address = ROM_START;
+
+    while (address < end) {
+        // Blocks starting on the middle of another instruction are listed apart on their address
+        while (block_index < analysis->block_count && analysis->blocks[block_index].start < address) {
+            block_index++;
+        }
+
+        if (block_index == analysis->block_count || analysis->blocks[block_index].start != address) {
+            address = write_data_line(out, disassembly, address, end);
+            continue;
+        }
+
+        const struct BasicBlock* block = &analysis->blocks[block_index];
+        char label[16];
+        format_label(disassembly, block->start, label, sizeof(label));
+
+        fprintf(out, "\n%s: ; %u instructions", label, count_block_instructions(disassembly->vm, block));
+
+        if (block->flags & BASIC_BLOCK_IDLE_LOOP) {
+            fputs(", idle loop", out);
+        }
+
+        for (uint8_t i = 0; i < block->successor_count; i++) {
+            if (is_back_edge(block, i)) {
+                fputs(", loop", out);
+                break;
+            }
+        }
+
+        if (block->flags & BASIC_BLOCK_INDIRECT) {
+            fputs(", indirect jump", out);
+        }
+
+        if (block->flags & BASIC_BLOCK_EXTERNAL) {
+            fputs(", leaves the ROM", out);
+        }
+
+        fputc('\n', out);
+
+        for (uint16_t instruction = block->start; instruction != block->end;) {
+            uint8_t length = instruction_length(disassembly->vm, instruction);
+            char text[96];
+            format_instruction(disassembly, instruction, text, sizeof(text));
+
+            fprintf(out, "%04X  ", instruction);
+            for (uint8_t i = 0; i < 4; i++) {
+                if (i < length) {
+                    fprintf(out, "%02X", read_memory(disassembly->vm, instruction + i));
+                } else {
+                    fputs("  ", out);
+                }
+            }
+            fprintf(out, "    %s\n", text);
+
+            instruction += length;
+        }
+
+        address = block->end;
+    }
+}
+
+/**
+ * @brief Write the control flow graph of a ROM in the Graphviz DOT language. Calls are dashed, loops are red and
+ *  idle loops are filled.
+ *
+ * @param out Where the graph is written.
+ * @param disassembly The disassembly.
+ */
+static void write_graph(FILE* out, struct Disassembly* disassembly)
+{
+    const struct RomAnalysis* analysis = disassembly->analysis;
+
+    fprintf(out, "digraph \"%s\" {\n", disassembly->name);
+    fputs("    node [shape=box, fontname=\"monospace\"];\n", out);
+
+    for (size_t i = 0; i < analysis->block_count; i++) {
+        const struct BasicBlock* block = &analysis->blocks[i];
+        char label[16];
+        format_label(disassembly, block->start, label, sizeof(label));
+
+        fprintf(out, "    \"%04X\" [label=\"%s\\n%u instructions\"", block->start, label,
+            count_block_instructions(disassembly->vm, block));
+
+        if (block->flags & BASIC_BLOCK_IDLE_LOOP) {
+            fputs(", style=filled, fillcolor=lightgrey", out);
+        } else if (block->flags & (BASIC_BLOCK_RETURN | BASIC_BLOCK_EXIT | BASIC_BLOCK_INDIRECT)) {
+            fputs(", peripheries=2", out);
+        }
+
+        fputs("];\n", out);
+
+        for (uint8_t j = 0; j < block->successor_count; j++) {
+            uint16_t successor = block->successors[j];
+
+            if (successor < ROM_START || successor >= ROM_START + analysis->rom_size) {
+                fprintf(out, "    \"%04X\" [label=\"0x%03X\", shape=ellipse];\n", successor, successor);
+            }
+
+            fprintf(out, "    \"%04X\" -> \"%04X\"", block->start, successor);
+
+            if ((block->flags & BASIC_BLOCK_CALL) && j == 0) {
+                fputs(" [style=dashed]", out);
+            } else if (is_back_edge(block, j)) {
+                fputs(" [color=red]", out);
+            }
+
+            fputs(";\n", out);
+        }
+    }
+
+    fputs("}\n", out);
+}
+
+/**
+ * @brief Load a ROM into a virtual machine, only used to decode it, and analyze it.
+ *
+ * @param disassembly The disassembly to fill.
+ * @param path The path to the ROM.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t load_disassembly(struct Disassembly* disassembly, const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    disassembly->name = slash == NULL ? path : slash + 1;
+
+    // The XO-CHIP profile has the whole address space, so every ROM fits
+    disassembly->vm = create_virtual_machine((char*)path, QUIRK_PROFILE_XO_CHIP);
+    if (disassembly->vm == NULL) {
+        return 1;
+    }
+
+    FILE* rom = fopen(path, "rb");
+    if (rom == NULL) {
+        goto open_failed;
+    }
+
+    fseek(rom, 0, SEEK_END);
+    size_t size = (size_t)ftell(rom);
+    fclose(rom);
+
+    disassembly->analysis = analyze_rom(disassembly->vm->memory + ROM_START, size);
+    if (disassembly->analysis == NULL) {
+        goto open_failed;
+    }
+
+    memset(disassembly->subroutines, 0, sizeof(disassembly->subroutines));
+
+    for (size_t i = 0; i < disassembly->analysis->block_count; i++) {
+        const struct BasicBlock* block = &disassembly->analysis->blocks[i];
+
+        if (block->flags & BASIC_BLOCK_CALL) {
+            disassembly->subroutines[block->successors[0] / 64] |= (uint64_t)1 << (block->successors[0] % 64);
+        }
+    }
+
+    return 0;
+
+open_failed:
+    free(disassembly->vm);
+
+    return 1;
+}
+
+/**
+ * @brief Summarize a disassembly for the library table.
+ */
+static void summarize_disassembly(struct Disassembly* disassembly, struct DisassemblySummary* summary)
+{
+    const struct RomAnalysis* analysis = disassembly->analysis;
+
+    summary->quirk_profile = analysis->quirk_profile;
+    summary->rom_size = analysis->rom_size;
+    summary->instruction_count = analysis->instruction_count;
+    summary->block_count = analysis->block_count;
+    summary->idle_loop_count = analysis->idle_loop_count;
+
+    for (size_t i = 0; i < analysis->block_count; i++) {
+        const struct BasicBlock* block = &analysis->blocks[i];
+
+        for (uint8_t j = 0; j < block->successor_count; j++) {
+            summary->loop_count += is_back_edge(block, j);
+        }
+
+        for (uint16_t address = block->start; address != block->end; address += instruction_length(disassembly->vm, address)) {
+            summary->machine_routine_count += is_machine_routine(opcode_at(disassembly->vm, address));
+        }
+    }
+}
+
+/**
+ * @brief Write the output of a disassembly to a file of the output directory.
+ *
+ * @param disassembly The disassembly.
+ * @param directory The output directory.
+ * @param extension The extension that replaces the one of the ROM.
+ * @param write The writer of the output.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t write_output(struct Disassembly* disassembly, const char* directory, const char* extension,
+    void (*write)(FILE* out, struct Disassembly* disassembly))
+{
+    const char* dot = strrchr(disassembly->name, '.');
+    int stem = dot == NULL ? (int)strlen(disassembly->name) : (int)(dot - disassembly->name);
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%.*s%s", directory, stem, disassembly->name, extension);
+
+    FILE* out = fopen(path, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Couldn't create '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    write(out, disassembly);
+
+    return fclose(out) == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Disassemble the ROMs that are left until there are none, it is the entry point of every worker thread.
+ *
+ * @param data The `struct DisassemblyRun` shared by the workers.
+ * @return Always NULL.
+ */
+static void* run_worker(void* data)
+{
+    struct DisassemblyRun* run = data;
+
+    size_t index;
+    while ((index = atomic_fetch_add(&run->next_path, 1)) < run->path_count) {
+        struct DisassemblySummary* summary = &run->summaries[index];
+        struct Disassembly* disassembly = malloc(sizeof(struct Disassembly));
+
+        if (disassembly == NULL || load_disassembly(disassembly, run->paths[index]) != 0) {
+            summary->failed = true;
+            free(disassembly);
+            continue;
+        }
+
+        summarize_disassembly(disassembly, summary);
+
+        if (run->output_directory != NULL) {
+            summary->failed = write_output(disassembly, run->output_directory, ".asm", write_listing) != 0
+                || write_output(disassembly, run->output_directory, ".dot", write_graph) != 0;
+        }
+
+        free((void*)disassembly->analysis);
+        free(disassembly->vm);
+        free(disassembly);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Check if a file name has the extension of a ROM.
+ */
+static bool has_rom_extension(const char* name)
+{
+    const char* dot = strrchr(name, '.');
+    if (dot == NULL) {
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(rom_extensions) / sizeof(rom_extensions[0]); i++) {
+        if (strcmp(dot, rom_extensions[i]) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Add a path to a growing list.
+ *
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t add_path(struct DisassemblyRun* run, size_t* capacity, const char* path)
+{
+    if (run->path_count == *capacity) {
+        *capacity = *capacity == 0 ? 64 : *capacity * 2;
+
+        char** paths = realloc(run->paths, *capacity * sizeof(char*));
+        if (paths == NULL) {
+            return 1;
+        }
+
+        run->paths = paths;
+    }
+
+    run->paths[run->path_count] = strdup(path);
+    if (run->paths[run->path_count] == NULL) {
+        return 1;
+    }
+
+    run->path_count++;
+
+    return 0;
+}
+
+/**
+ * @brief Add a ROM, or every ROM inside of a directory, to the run.
+ *
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t add_roms(struct DisassemblyRun* run, size_t* capacity, const char* path)
+{
+    struct stat status;
+    if (stat(path, &status) != 0) {
+        fprintf(stderr, "Couldn't open '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    if (!S_ISDIR(status.st_mode)) {
+        return add_path(run, capacity, path);
+    }
+
+    DIR* directory = opendir(path);
+    if (directory == NULL) {
+        fprintf(stderr, "Couldn't open '%s': %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL) {
+        if (!has_rom_extension(entry->d_name)) {
+            continue;
+        }
+
+        char rom_path[4096];
+        snprintf(rom_path, sizeof(rom_path), "%s/%s", path, entry->d_name);
+
+        if (add_path(run, capacity, rom_path) != 0) {
+            closedir(directory);
+            return 1;
+        }
+    }
+
+    closedir(directory);
+
+    return 0;
+}
+
+/**
+ * @brief Compare two paths for `qsort()`.
+ */
+static int compare_paths(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * @brief Print the help menu
+ *
+ * @param argv The list of arguments to get the name of the program from.
+ */
+static void print_help(char* argv[])
+{
+    fprintf(stderr, "Usage: %s [options] <rom-or-directory>...\n", argv[0]);
+    puts("Disassembles ROMs following every reachable instruction. With a single ROM the listing is printed, with");
+    puts("several or with directories of ROMs a table of them is printed.");
+    puts("Options:");
+    puts("  -g Print the control flow graph of the single ROM in the Graphviz DOT language instead of the listing");
+    puts("  -o <directory> Write the listing (.asm) and the graph (.dot) of every ROM to the directory");
+    puts("  -t <threads> Number of threads (default the online CPUs)");
+    puts("  -h Show this info message");
+}
+
+int main(int argc, char* argv[])
+{
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    bool graph = false;
+
+    struct DisassemblyRun run = { 0 };
+    atomic_init(&run.next_path, 0);
+
+    int option;
+    while ((option = getopt(argc, argv, "go:t:h")) != -1) {
+        switch (option) {
+        case 'g':
+            graph = true;
+            break;
+        case 'o':
+            run.output_directory = optarg;
+            break;
+        case 't':
+            threads = strtol(optarg, NULL, 10);
+            break;
+        case 'h':
+            print_help(argv);
+            return 0;
+        default:
+            print_help(argv);
+            return 1;
+        }
+    }
+
+    if (optind == argc) {
+        print_help(argv);
+        return 1;
+    }
+
+    struct stat status;
+    bool single = optind == argc - 1 && run.output_directory == NULL && stat(argv[optind], &status) == 0
+        && !S_ISDIR(status.st_mode);
+
+    if (single) {
+        struct Disassembly* disassembly = malloc(sizeof(struct Disassembly));
+        if (disassembly == NULL || load_disassembly(disassembly, argv[optind]) != 0) {
+            fprintf(stderr, "Couldn't disassemble '%s'\n", argv[optind]);
+            free(disassembly);
+            return 1;
+        }
+
+        if (graph) {
+            write_graph(stdout, disassembly);
+        } else {
+            write_listing(stdout, disassembly);
+        }
+
+        free((void*)disassembly->analysis);
+        free(disassembly->vm);
+        free(disassembly);
+
+        return 0;
+    }
+
+    if (run.output_directory != NULL && mkdir(run.output_directory, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Couldn't create '%s': %s\n", run.output_directory, strerror(errno));
+        return 1;
+    }
+
+    uint8_t result = 0;
+    size_t capacity = 0;
+
+    for (int i = optind; i < argc; i++) {
+        if (add_roms(&run, &capacity, argv[i]) != 0) {
+            result = 1;
+            goto paths_failed;
+        }
+    }
+
+    qsort(run.paths, run.path_count, sizeof(char*), compare_paths);
+
+    run.summaries = calloc(run.path_count + 1, sizeof(struct DisassemblySummary));
+    if (run.summaries == NULL) {
+        result = 1;
+        goto paths_failed;
+    }
+
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    pthread_t* workers = malloc((size_t)threads * sizeof(pthread_t));
+    long started = 0;
+
+    for (; workers != NULL && started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, run_worker, &run) != 0) {
+            fprintf(stderr, "Couldn't start the worker %ld\n", started);
+            break;
+        }
+    }
+
+    // The main thread helps too, so the run finishes even if no worker could start
+    run_worker(&run);
+
+    for (long i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+
+    printf("%-32s %-12s %6s %6s %6s %6s %5s %4s\n", "ROM", "profile", "bytes", "instrs", "blocks", "loops", "idle",
+        "sys");
+
+    for (size_t i = 0; i < run.path_count; i++) {
+        const struct DisassemblySummary* summary = &run.summaries[i];
+        const char* slash = strrchr(run.paths[i], '/');
+        const char* name = slash == NULL ? run.paths[i] : slash + 1;
+
+        if (summary->failed) {
+            printf("%-32s failed\n", name);
+            result = 1;
+            continue;
+        }
+
+        printf("%-32s %-12s %6u %6u %6u %6u %5u %4u\n", name, get_quirk_profile_name(summary->quirk_profile),
+            summary->rom_size, summary->instruction_count, summary->block_count, summary->loop_count,
+            summary->idle_loop_count, summary->machine_routine_count);
+    }
+
+    free(run.summaries);
+
+paths_failed:
+    for (size_t i = 0; i < run.path_count; i++) {
+        free(run.paths[i]);
+    }
+
+    free(run.paths);
+
+    return result;
+}
@@ -0,0 +1,166 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "och8s-env.h"
+
+/**
+ * @brief Print the help menu
+ *
+ * @param argv The list of arguments to get the name of the program from.
+ */
+static void print_help(char* argv[])
+{
+    fprintf(stderr, "Usage: %s [options] <rom-path>\n", argv[0]);
+    puts("Steps a batch of environments with random keys and reports how many frames are emulated per second.");
+    puts("Options:");
+    puts("  -n <environments> Number of environments (default 1024)");
+    puts("  -t <threads> Number of threads (default the online CPUs)");
+    puts("  -f <frames> Frames of every step (default 4)");
+    puts("  -s <steps> Number of steps (default 1000)");
+    puts("  -q <profile> The quirk profile of the ROM");
+    puts("  -r <address> Reward the increases of the byte at the given hexadecimal address");
+    puts("  -h Show this info message");
+}
+
+/**
+ * @brief Get the current time of the monotonic clock.
+ *
+ * @return The time in seconds.
+ */
+static double get_seconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t environments = 1024;
+    uint32_t frames = 4;
+    uint64_t steps = 1000;
+    long reward_address = -1;
+
+    struct Och8sEnvOptions options = { 0 };
+
+    int option;
+    while ((option = getopt(argc, argv, "n:t:f:s:q:r:h")) != -1) {
+        switch (option) {
+        case 'n':
+            environments = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            options.threads = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            frames = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            steps = strtoull(optarg, NULL, 10);
+            break;
+        case 'q':
+            options.quirk_profile = optarg;
+            break;
+        case 'r':
+            reward_address = strtol(optarg, NULL, 16);
+            break;
+        case 'h':
+            print_help(argv);
+            return 0;
+        default:
+            print_help(argv);
+            return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        print_help(argv);
+        return 1;
+    }
+
+    struct Och8sEnv* env = och8s_env_create(environments, argv[optind], &options);
+    if (env == NULL) {
+        return 1;
+    }
+
+    uint8_t result = 1;
+
+    uint64_t* observations = malloc(environments * och8s_env_get_observation_words(env) * sizeof(uint64_t));
+    float* rewards = malloc(environments * sizeof(float));
+    uint8_t* dones = malloc(environments);
+    uint16_t* actions = malloc(environments * sizeof(uint16_t));
+
+    if (observations == NULL || rewards == NULL || dones == NULL || actions == NULL) {
+        fprintf(stderr, "Malloc of the buffers failed\n");
+        goto buffers_failed;
+    }
+
+    if (och8s_env_set_buffers(env, observations, rewards, dones) != 0) {
+        goto buffers_failed;
+    }
+
+    if (reward_address >= 0 && och8s_env_add_reward_watch(env, reward_address, 1, 1) != 0) {
+        goto buffers_failed;
+    }
+
+    if (och8s_env_reset(env, NULL) != 0) {
+        goto buffers_failed;
+    }
+
+    // Xorshift, only one key is pressed at a time as most games expect
+    uint32_t random = 0x2545F491;
+
+    double total_reward = 0;
+    uint64_t episodes = 0;
+
+    double start = get_seconds();
+
+    for (uint64_t step = 0; step < steps; step++) {
+        for (size_t i = 0; i < environments; i++) {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+
+            actions[i] = 1 << (random >> 28);
+        }
+
+        if (och8s_env_step(env, actions, frames) != 0) {
+            goto step_failed;
+        }
+
+        for (size_t i = 0; i < environments; i++) {
+            total_reward += rewards[i];
+            episodes += dones[i];
+        }
+
+        // The finished episodes start again, the others are left untouched
+        if (och8s_env_reset(env, dones) != 0) {
+            goto step_failed;
+        }
+    }
+
+    double elapsed = get_seconds() - start;
+    double emulated_frames = (double)environments * steps * frames;
+
+    printf("%zu environments, %lu steps of %u frames in %.3fs\n", environments, steps, frames, elapsed);
+    printf("%.0f frames/s (%.0fx real time per environment), %lu episodes finished, total reward %.0f\n",
+        emulated_frames / elapsed, emulated_frames / elapsed / 60.0 / environments, episodes, total_reward);
+
+    result = 0;
+
+step_failed:
+buffers_failed:
+    free(actions);
+    free(dones);
+    free(rewards);
+    free(observations);
+    och8s_env_delete(env);
+
+    return result;
+}
@@ -0,0 +1,47 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chip8-assembler.h"
+
+// Waits for the key 5, then adds 1 to vB and draws the 5 character so the press reaches the screen, and waits for the
+// release. The latency probe of `och8S -l` presses the key and watches vB and the presented frames.
+static const uint16_t latency_probe_program[] = {
+    LD(0xA, 5), FX(0xA, 0x29), LD(0, 0x1C), LD(1, 0x0D),
+    SKP(0xA), JP(AT(4)), // Wait for the press
+    ADD(0xB, 1), DRW(0, 1, 5),
+    SKNP(0xA), JP(AT(8)), // Wait for the release
+    JP(AT(4)),
+};
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <rom-path>\n", argv[0]);
+        puts("Assembles the ROM of the latency probe of `och8S -l` and writes it to the path.");
+        return 1;
+    }
+
+    FILE* rom = fopen(argv[1], "wb");
+    if (rom == NULL) {
+        fprintf(stderr, "The ROM '%s' can't be created\n", argv[1]);
+        return 1;
+    }
+
+    // The opcodes are stored big endian
+    for (size_t i = 0; i < sizeof(latency_probe_program) / sizeof(latency_probe_program[0]); i++) {
+        uint8_t bytes[] = { latency_probe_program[i] >> 8, latency_probe_program[i] & 0xFF };
+
+        if (fwrite(bytes, sizeof(bytes), 1, rom) < 1) {
+            fprintf(stderr, "The ROM '%s' wasn't able to be fully written\n", argv[1]);
+            fclose(rom);
+            return 1;
+        }
+    }
+
+    if (fclose(rom) != 0) {
+        fprintf(stderr, "The ROM '%s' wasn't able to be fully written\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
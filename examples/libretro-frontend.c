@@ -0,0 +1,492 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libretro.h"
+
+/**
+ * @brief The functions of the loaded core.
+ */
+struct Core {
+    void* handle;
+
+    void (*set_environment)(retro_environment_t);
+    void (*set_video_refresh)(retro_video_refresh_t);
+    void (*set_audio_sample)(retro_audio_sample_t);
+    void (*set_audio_sample_batch)(retro_audio_sample_batch_t);
+    void (*set_input_poll)(retro_input_poll_t);
+    void (*set_input_state)(retro_input_state_t);
+    void (*init)(void);
+    void (*deinit)(void);
+    unsigned (*api_version)(void);
+    void (*get_system_info)(struct retro_system_info*);
+    void (*get_system_av_info)(struct retro_system_av_info*);
+    void (*run)(void);
+    size_t (*serialize_size)(void);
+    bool (*serialize)(void*, size_t);
+    bool (*unserialize)(const void*, size_t);
+    bool (*load_game)(const struct retro_game_info*);
+    void (*unload_game)(void);
+    void* (*get_memory_data)(unsigned);
+    size_t (*get_memory_size)(unsigned);
+};
+
+/**
+ * @brief What the frontend saw from the core, checked after running it.
+ */
+struct Statistics {
+    // FNV-1a hash of the last frame sent by the core
+    uint64_t frame_hash;
+
+    uint64_t frames;
+    uint64_t duplicated_frames;
+    uint64_t audio_frames;
+
+    // Frames with any sample different from 0
+    uint64_t sound_frames;
+
+    bool shutdown;
+    bool wrong_frame_size;
+};
+
+static struct Statistics statistics;
+
+// The values of the core options, NULL to use the default of the core
+static const char* quirk_profile_option = NULL;
+static const char* clock_option = NULL;
+
+/**
+ * @brief Print the help menu
+ *
+ * @param argv The list of arguments to get the name of the program from.
+ */
+static void print_help(char* argv[])
+{
+    fprintf(stderr, "Usage: %s [options] <core-path> <rom-path>\n", argv[0]);
+    puts("Runs the och8S libretro core without video nor audio output and checks what it sends.");
+    puts("Options:");
+    puts("  -n <frames> Number of frames to run (default 600)");
+    puts("  -q <profile> Value of the quirk profile core option");
+    puts("  -c <opcodes-per-second> Value of the clock core option");
+    puts("  -h Show this info message");
+}
+
+/**
+ * @brief Answer the requests of the core like a frontend that only supports what the och8S core needs.
+ *
+ * @param cmd The `RETRO_ENVIRONMENT_*` request.
+ * @param data The data of the request.
+ * @return If the request is supported.
+ */
+static bool environment(unsigned cmd, void* data)
+{
+    if (cmd == RETRO_ENVIRONMENT_SET_PIXEL_FORMAT) {
+        return *(enum retro_pixel_format*)data == RETRO_PIXEL_FORMAT_XRGB8888;
+    }
+
+    if (cmd == RETRO_ENVIRONMENT_GET_CAN_DUPE) {
+        *(bool*)data = true;
+        return true;
+    }
+
+    if (cmd == RETRO_ENVIRONMENT_SET_VARIABLES) {
+        for (const struct retro_variable* variable = data; variable->key != NULL; variable++) {
+            printf("Core option %s: %s\n", variable->key, variable->value);
+        }
+
+        return true;
+    }
+
+    if (cmd == RETRO_ENVIRONMENT_GET_VARIABLE) {
+        struct retro_variable* variable = data;
+
+        if (strcmp(variable->key, "och8s_quirk_profile") == 0) {
+            variable->value = quirk_profile_option;
+        } else if (strcmp(variable->key, "och8s_clock") == 0) {
+            variable->value = clock_option;
+        } else {
+            variable->value = NULL;
+        }
+
+        return variable->value != NULL;
+    }
+
+    if (cmd == RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE) {
+        *(bool*)data = false;
+        return true;
+    }
+
+    if (cmd == RETRO_ENVIRONMENT_SHUTDOWN) {
+        statistics.shutdown = true;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Hash the frames sent by the core instead of showing them.
+ *
+ * @param data The XRGB8888 pixels or a NULL pointer to repeat the previous frame.
+ * @param width The width of the frame.
+ * @param height The height of the frame.
+ * @param pitch The bytes between the start of two rows.
+ */
+static void video_refresh(const void* data, unsigned width, unsigned height, size_t pitch)
+{
+    statistics.frames++;
+
+    if (data == NULL) {
+        statistics.duplicated_frames++;
+        return;
+    }
+
+    if (width != 128 || height != 64) {
+        statistics.wrong_frame_size = true;
+    }
+
+    uint64_t hash = 0xCBF29CE484222325;
+
+    for (unsigned y = 0; y < height; y++) {
+        const uint8_t* row = (const uint8_t*)data + y * pitch;
+
+        for (size_t i = 0; i < width * sizeof(uint32_t); i++) {
+            hash = (hash ^ row[i]) * 0x100000001B3;
+        }
+    }
+
+    statistics.frame_hash = hash;
+}
+
+/**
+ * @brief Count a single audio frame, the core is expected to use `audio_sample_batch()` instead.
+ *
+ * @param left The sample of the left channel.
+ * @param right The sample of the right channel.
+ */
+static void audio_sample(int16_t left, int16_t right)
+{
+    (void)left;
+    (void)right;
+
+    statistics.audio_frames++;
+}
+
+/**
+ * @brief Count the audio frames sent by the core instead of playing them.
+ *
+ * @param data The interleaved stereo samples.
+ * @param frames The number of audio frames.
+ * @return The number of audio frames consumed.
+ */
+static size_t audio_sample_batch(const int16_t* data, size_t frames)
+{
+    statistics.audio_frames += frames;
+
+    for (size_t i = 0; i < frames * 2; i++) {
+        if (data[i] != 0) {
+            statistics.sound_frames++;
+            break;
+        }
+    }
+
+    return frames;
+}
+
+/**
+ * @brief Nothing to poll, no key is ever pressed.
+ */
+static void input_poll(void)
+{
+}
+
+/**
+ * @brief Report every key and button as released.
+ *
+ * @return Always 0.
+ */
+static int16_t input_state(unsigned port, unsigned device, unsigned index, unsigned id)
+{
+    (void)port;
+    (void)device;
+    (void)index;
+    (void)id;
+
+    return 0;
+}
+
+/**
+ * @brief Load the core and find all its functions.
+ *
+ * @param path The path of the shared library of the core.
+ * @param core Where the functions are stored.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t load_core(const char* path, struct Core* core)
+{
+    core->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (core->handle == NULL) {
+        fprintf(stderr, "Couldn't load the core: %s\n", dlerror());
+        return 1;
+    }
+
+    struct {
+        const char* name;
+        void** function;
+    } symbols[] = {
+        { "retro_set_environment", (void**)&core->set_environment },
+        { "retro_set_video_refresh", (void**)&core->set_video_refresh },
+        { "retro_set_audio_sample", (void**)&core->set_audio_sample },
+        { "retro_set_audio_sample_batch", (void**)&core->set_audio_sample_batch },
+        { "retro_set_input_poll", (void**)&core->set_input_poll },
+        { "retro_set_input_state", (void**)&core->set_input_state },
+        { "retro_init", (void**)&core->init },
+        { "retro_deinit", (void**)&core->deinit },
+        { "retro_api_version", (void**)&core->api_version },
+        { "retro_get_system_info", (void**)&core->get_system_info },
+        { "retro_get_system_av_info", (void**)&core->get_system_av_info },
+        { "retro_run", (void**)&core->run },
+        { "retro_serialize_size", (void**)&core->serialize_size },
+        { "retro_serialize", (void**)&core->serialize },
+        { "retro_unserialize", (void**)&core->unserialize },
+        { "retro_load_game", (void**)&core->load_game },
+        { "retro_unload_game", (void**)&core->unload_game },
+        { "retro_get_memory_data", (void**)&core->get_memory_data },
+        { "retro_get_memory_size", (void**)&core->get_memory_size },
+    };
+
+    for (size_t i = 0; i < sizeof(symbols) / sizeof(symbols[0]); i++) {
+        // POSIX guarantees that object pointers returned by `dlsym()` can be used as function pointers
+        *symbols[i].function = dlsym(core->handle, symbols[i].name);
+
+        if (*symbols[i].function == NULL) {
+            fprintf(stderr, "The core doesn't export '%s'\n", symbols[i].name);
+            dlclose(core->handle);
+            return 2;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Run the core for some frames, stopping early if it asks to shutdown.
+ *
+ * @param core The loaded core.
+ * @param frames The number of frames to run.
+ */
+static void run_frames(struct Core* core, uint64_t frames)
+{
+    for (uint64_t i = 0; i < frames && !statistics.shutdown; i++) {
+        core->run();
+    }
+}
+
+/**
+ * @brief Check that a corrupted state is rejected without changing anything: the core must be serialized the same
+ *  before and after trying to load it.
+ *
+ * @param core The loaded core.
+ * @param state A valid state of the core, it is left as it was.
+ * @param size The size of the state.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t check_rejected_state(struct Core* core, uint8_t* state, size_t size)
+{
+    uint8_t* before = malloc(size);
+    uint8_t* after = malloc(size);
+    if (before == NULL || after == NULL) {
+        fprintf(stderr, "Malloc 'before' or 'after' failed\n");
+        goto rejection_failed;
+    }
+
+    if (!core->serialize(before, size)) {
+        fprintf(stderr, "The core failed to serialize its state\n");
+        goto rejection_failed;
+    }
+
+    // The magic at the start of the state no longer matches
+    state[0] ^= 0xFF;
+    bool loaded = core->unserialize(state, size);
+    state[0] ^= 0xFF;
+
+    if (loaded) {
+        fprintf(stderr, "Serialization: the core loaded a corrupted state\n");
+        goto rejection_failed;
+    }
+
+    if (!core->serialize(after, size) || memcmp(before, after, size) != 0) {
+        fprintf(stderr, "Serialization: rejecting a corrupted state changed the core\n");
+        goto rejection_failed;
+    }
+
+    free(after);
+    free(before);
+    return 0;
+
+rejection_failed:
+    free(after);
+    free(before);
+    return 1;
+}
+
+/**
+ * @brief Check that a saved state brings the core back to the same point: the frames run after saving and after
+ *  loading the state must end with the same screen.
+ *
+ * @param core The loaded core.
+ * @param frames The number of frames run after saving and after loading.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t check_serialization(struct Core* core, uint64_t frames)
+{
+    size_t size = core->serialize_size();
+
+    uint8_t* state = malloc(size);
+    if (state == NULL) {
+        fprintf(stderr, "Malloc 'state' failed\n");
+        return 1;
+    }
+
+    if (!core->serialize(state, size)) {
+        fprintf(stderr, "The core failed to serialize its state\n");
+        goto serialization_failed;
+    }
+
+    bool shutdown = statistics.shutdown;
+
+    run_frames(core, frames);
+    uint64_t expected_hash = statistics.frame_hash;
+
+    if (check_rejected_state(core, state, size) != 0) {
+        goto serialization_failed;
+    }
+
+    if (!core->unserialize(state, size)) {
+        fprintf(stderr, "The core failed to unserialize its state\n");
+        goto serialization_failed;
+    }
+
+    statistics.shutdown = shutdown;
+    run_frames(core, frames);
+
+    if (statistics.frame_hash != expected_hash) {
+        fprintf(stderr, "Serialization: the screen differs after loading the state (%016lX != %016lX)\n",
+            statistics.frame_hash, expected_hash);
+        goto serialization_failed;
+    }
+
+    printf("Serialization: %zu bytes, same screen after %lu frames, corrupted states rejected\n", size, frames);
+
+    free(state);
+    return 0;
+
+serialization_failed:
+    free(state);
+    return 2;
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t frames = 600;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:q:c:h")) != -1) {
+        switch (option) {
+        case 'n':
+            frames = strtoull(optarg, NULL, 10);
+            break;
+        case 'q':
+            quirk_profile_option = optarg;
+            break;
+        case 'c':
+            clock_option = optarg;
+            break;
+        case 'h':
+            print_help(argv);
+            return 0;
+        default:
+            print_help(argv);
+            return 1;
+        }
+    }
+
+    if (optind + 2 > argc) {
+        print_help(argv);
+        return 1;
+    }
+
+    struct Core core;
+    if (load_core(argv[optind], &core) != 0) {
+        return 1;
+    }
+
+    uint8_t result = 1;
+
+    if (core.api_version() != RETRO_API_VERSION) {
+        fprintf(stderr, "The core uses the libretro API version %u\n", core.api_version());
+        goto api_version_failed;
+    }
+
+    struct retro_system_info system_info;
+    core.get_system_info(&system_info);
+    printf("Core: %s %s (%s)\n", system_info.library_name, system_info.library_version, system_info.valid_extensions);
+
+    core.set_environment(environment);
+    core.set_video_refresh(video_refresh);
+    core.set_audio_sample(audio_sample);
+    core.set_audio_sample_batch(audio_sample_batch);
+    core.set_input_poll(input_poll);
+    core.set_input_state(input_state);
+
+    core.init();
+
+    struct retro_game_info game = { argv[optind + 1], NULL, 0, NULL };
+    if (!core.load_game(&game)) {
+        fprintf(stderr, "The core failed to load the ROM\n");
+        goto load_game_failed;
+    }
+
+    struct retro_system_av_info av_info;
+    core.get_system_av_info(&av_info);
+    printf("Video: %ux%u at %.0f frames/s, audio: %.0fHz\n", av_info.geometry.base_width,
+        av_info.geometry.base_height, av_info.timing.fps, av_info.timing.sample_rate);
+
+    run_frames(&core, frames / 2);
+
+    if (check_serialization(&core, frames - frames / 2) != 0) {
+        goto check_failed;
+    }
+
+    printf("Memory: %zu bytes\n", core.get_memory_size(RETRO_MEMORY_SYSTEM_RAM));
+    printf("Frames: %lu (%lu duplicated), audio frames: %lu, frames with sound: %lu%s\n", statistics.frames,
+        statistics.duplicated_frames, statistics.audio_frames, statistics.sound_frames,
+        statistics.shutdown ? ", the ROM exited" : "");
+    printf("Last frame hash: %016lX\n", statistics.frame_hash);
+
+    if (statistics.wrong_frame_size) {
+        fprintf(stderr, "The core sent frames with a wrong size\n");
+        goto check_failed;
+    }
+
+    if (statistics.audio_frames != statistics.frames * (uint64_t)(av_info.timing.sample_rate / av_info.timing.fps)) {
+        fprintf(stderr, "The core didn't send one frame worth of audio per frame\n");
+        goto check_failed;
+    }
+
+    result = 0;
+
+check_failed:
+    core.unload_game();
+load_game_failed:
+    core.deinit();
+api_version_failed:
+    dlclose(core.handle);
+
+    return result;
+}
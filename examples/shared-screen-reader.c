@@ -0,0 +1,260 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shared-screen.h"
+
+/**
+ * @brief The counters of one reader thread of the throughput mode.
+ */
+struct Reader {
+    pthread_t thread;
+    const struct SharedScreen* shared;
+    _Atomic bool* stop;
+
+    // Kept out of the stack so the compiler can't skip copying the parts of the state that are never read
+    struct SharedScreenState state;
+
+    uint64_t reads;
+    uint64_t retries;
+    uint64_t frames;
+};
+
+/**
+ * @brief Print the help menu
+ *
+ * @param argv The list of arguments to get the name of the program from.
+ */
+static void print_help(char* argv[])
+{
+    fprintf(stderr, "Usage: %s [options] <name>\n", argv[0]);
+    puts("Reads the screen exported by `och8S -o <name>`.");
+    puts("Options:");
+    puts("  -t <readers> Instead of printing the screen, read it as fast as possible from the given number of threads and report the throughput");
+    puts("  -s <seconds> Duration of the throughput mode (default 5)");
+    puts("  -h Show this info message");
+}
+
+/**
+ * @brief Map the shared screen exported by the emulator.
+ *
+ * @param name The name of the shared memory.
+ * @return The mapped shared screen or a NULL pointer if an error occurs.
+ */
+static const struct SharedScreen* map_shared_screen(const char* name)
+{
+    int file_descriptor = shm_open(name, O_RDONLY, 0);
+    if (file_descriptor == -1) {
+        fprintf(stderr, "Couldn't open the shared memory '%s', is the emulator running?\n", name);
+        return NULL;
+    }
+
+    const struct SharedScreen* shared = mmap(NULL, sizeof(struct SharedScreen), PROT_READ, MAP_SHARED,
+        file_descriptor, 0);
+
+    // The mapping stays valid after closing the file
+    close(file_descriptor);
+
+    if (shared == MAP_FAILED) {
+        fprintf(stderr, "Couldn't map the shared memory '%s'\n", name);
+        return NULL;
+    }
+
+    if (shared->magic != SHARED_SCREEN_MAGIC || shared->version != SHARED_SCREEN_VERSION) {
+        fprintf(stderr, "The shared memory '%s' isn't a version %u och8S screen\n", name, SHARED_SCREEN_VERSION);
+        munmap((void*)shared, sizeof(struct SharedScreen));
+        return NULL;
+    }
+
+    return shared;
+}
+
+/**
+ * @brief Print the registers and the first plane of the screen, every pixel as a character.
+ *
+ * @param state The state to be printed.
+ */
+static void print_state(const struct SharedScreenState* state)
+{
+    printf("\x1B[H");
+    printf("Frame %lu PC %03X I %03X DT %02X ST %02X\n", state->frame, state->pc, state->index_register,
+        state->delay_timer, state->sound_timer);
+
+    for (size_t i = 0; i < 16; i++) {
+        printf("V%zX %02X%s", i, state->v_registers[i], i == 15 ? "\n" : " ");
+    }
+
+    size_t width = state->high_resolution ? SCREEN_HIGH_RESOLUTION_WIDTH : SCREEN_LOW_RESOLUTION_WIDTH;
+    size_t height = state->high_resolution ? SCREEN_HIGH_RESOLUTION_HEIGHT : SCREEN_LOW_RESOLUTION_HEIGHT;
+
+    for (size_t y = 0; y < height; y++) {
+        for (size_t x = 0; x < width; x++) {
+            putchar((state->buffer[0][y][x / 64] >> (63 - x % 64)) & 1 ? '#' : ' ');
+        }
+
+        putchar('\n');
+    }
+
+    fflush(stdout);
+}
+
+/**
+ * @brief Print the screen every time a new frame is published, until the emulator exits.
+ *
+ * @param shared The mapped shared screen.
+ */
+static void watch_shared_screen(const struct SharedScreen* shared)
+{
+    struct SharedScreenState state;
+    uint64_t last_frame = UINT64_MAX;
+
+    struct timespec period = { 0, 1000000000 / 60 };
+
+    printf("\x1B[2J");
+
+    do {
+        read_shared_screen(shared, &state);
+
+        if (state.frame != last_frame) {
+            print_state(&state);
+            last_frame = state.frame;
+        }
+
+        nanosleep(&period, NULL);
+    } while (!state.exited);
+}
+
+/**
+ * @brief Read the shared screen in a loop until told to stop. It is the entry point of the reader threads.
+ *
+ * @param data The `struct Reader` of the thread.
+ * @return Always NULL.
+ */
+static void* run_reader(void* data)
+{
+    struct Reader* reader = data;
+    uint64_t last_frame = UINT64_MAX;
+
+    while (!atomic_load_explicit(reader->stop, memory_order_relaxed)) {
+        reader->retries += read_shared_screen(reader->shared, &reader->state);
+        reader->reads++;
+
+        if (reader->state.frame != last_frame) {
+            reader->frames++;
+            last_frame = reader->state.frame;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Read the shared screen from many threads at the same time and report how many consistent copies were made.
+ *
+ * @param shared The mapped shared screen.
+ * @param reader_count The number of reader threads.
+ * @param seconds For how long the threads read.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t measure_throughput(const struct SharedScreen* shared, size_t reader_count, unsigned int seconds)
+{
+    struct Reader* readers = calloc(reader_count, sizeof(struct Reader));
+    if (readers == NULL) {
+        fprintf(stderr, "Malloc 'readers' failed\n");
+        return 1;
+    }
+
+    _Atomic bool stop = false;
+    size_t started = 0;
+
+    for (; started < reader_count; started++) {
+        readers[started].shared = shared;
+        readers[started].stop = &stop;
+
+        if (pthread_create(&readers[started].thread, NULL, run_reader, &readers[started]) != 0) {
+            fprintf(stderr, "Couldn't create the reader thread %zu\n", started);
+            break;
+        }
+    }
+
+    sleep(seconds);
+    atomic_store(&stop, true);
+
+    uint64_t reads = 0;
+    uint64_t retries = 0;
+    uint64_t frames = 0;
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(readers[i].thread, NULL);
+
+        reads += readers[i].reads;
+        retries += readers[i].retries;
+        frames += readers[i].frames;
+    }
+
+    free(readers);
+
+    if (started != reader_count) {
+        return 2;
+    }
+
+    printf("%zu readers: %.0f reads/s (%.1f MB/s), %lu retries, %.1f frames seen per reader and second\n",
+        reader_count, (double)reads / seconds, (double)reads * sizeof(struct SharedScreenState) / seconds / 1e6,
+        retries, (double)frames / reader_count / seconds);
+
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t reader_count = 0;
+    unsigned int seconds = 5;
+
+    int option;
+    while ((option = getopt(argc, argv, "t:s:h")) != -1) {
+        switch (option) {
+        case 't':
+            reader_count = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seconds = strtoul(optarg, NULL, 10);
+            break;
+        case 'h':
+            print_help(argv);
+            return 0;
+        default:
+            print_help(argv);
+            return 1;
+        }
+    }
+
+    if (optind >= argc) {
+        print_help(argv);
+        return 1;
+    }
+
+    const struct SharedScreen* shared = map_shared_screen(argv[optind]);
+    if (shared == NULL) {
+        return 1;
+    }
+
+    uint8_t result = 0;
+
+    if (reader_count == 0) {
+        watch_shared_screen(shared);
+    } else {
+        result = measure_throughput(shared, reader_count, seconds);
+    }
+
+    munmap((void*)shared, sizeof(struct SharedScreen));
+
+    return result;
+}
@@ -0,0 +1,10 @@
+#ifndef OCH8S_ANALYSIS_CACHE_H
+#define OCH8S_ANALYSIS_CACHE_H
+
+#include "rom-analysis.h"
+
+const struct RomAnalysis* load_rom_analysis(const char* rom_path);
+
+void unload_rom_analysis(const struct RomAnalysis* analysis);
+
+#endif
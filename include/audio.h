@@ -1,8 +1,36 @@
 #ifndef OCH8S_AUDIO_H
 #define OCH8S_AUDIO_H
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-uint8_t setup_audio(uint32_t* audio_sample_counter);
+#include "beep.h"
+#include "metrics.h"
+#include "trace.h"
+
+// The most beepers a mixer sums
+static constexpr size_t AUDIO_MIXER_VOICES = 64;
+
+/**
+ * @brief The beepers of many virtual machines summed on a single audio device. The emulation thread turns the voices
+ *  on and off and the audio callback plays them, each one with its own progression.
+ */
+struct AudioMixer {
+    size_t voice_count;
+    _Atomic bool playing[AUDIO_MIXER_VOICES];
+
+    // Only touched by the audio callback, reset while the voice is off to mitigate random audio cracking
+    uint32_t sample_counters[AUDIO_MIXER_VOICES];
+
+    struct Metrics* metrics;
+    struct TraceBuffer* trace;
+};
+
+uint8_t setup_audio(uint32_t* audio_sample_counter, uint16_t buffer_samples, struct Metrics* metrics, struct TraceBuffer* trace);
+
+uint8_t setup_audio_mixer(struct AudioMixer* mixer, size_t voice_count, uint16_t buffer_samples, struct Metrics* metrics,
+    struct TraceBuffer* trace);
 
 #endif
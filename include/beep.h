@@ -0,0 +1,11 @@
+#ifndef OCH8S_BEEP_H
+#define OCH8S_BEEP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+static constexpr int AUDIO_SAMPLE_RATE = 44100;
+
+void generate_beep(int16_t* samples, size_t length, uint32_t* sample_counter);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef OCH8S_CAPTURE_H
+#define OCH8S_CAPTURE_H
+
+#include <SDL2/SDL.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "screen.h"
+
+// Frames that can be waiting to be encoded, around 4 seconds of emulation, it must be a power of two
+static constexpr size_t CAPTURE_RING_SIZE = 256;
+
+enum CaptureFormat {
+    CAPTURE_FORMAT_Y4M,
+    CAPTURE_FORMAT_GIF,
+};
+
+/**
+ * @brief A copy of the state needed to encode one emulated frame.
+ */
+struct CaptureFrame {
+    struct Screen screen;
+
+    // If the beep was playing during the frame
+    bool sound;
+};
+
+/**
+ * @brief State of the GIF encoder, frames equal to the previous one extend its delay and the rest only store the
+ *  rectangle that changed.
+ */
+struct GifEncoder {
+    // The last frame received, not written until a different one arrives so its delay is known
+    uint8_t image[SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_HIGH_RESOLUTION_WIDTH];
+    bool has_image;
+
+    // The rectangle of `image` that changed from the frame written before it
+    size_t left;
+    size_t top;
+    size_t right;
+    size_t bottom;
+
+    // Emulated frames received and the time written so far in hundredths of a second, used to avoid drifting
+    uint64_t frames;
+    uint64_t written_centiseconds;
+
+    // The LZW dictionary, the code of a string followed by a pixel or 0 if it isn't in the dictionary yet
+    uint16_t codes[4096][SCREEN_PALETTE_SIZE];
+};
+
+/**
+ * @brief Records the emulated frames to disk. The emulation thread only copies the frames into a ring buffer, the
+ *  encoding and the writes happen on a worker thread.
+ */
+struct Capture {
+    struct CaptureFrame* ring;
+
+    // Frames pushed by the emulation thread and frames consumed by the encoder thread, only ever incremented
+    _Atomic size_t written;
+    _Atomic size_t encoded;
+
+    // Frames lost because the ring was full when they were pushed
+    _Atomic uint64_t dropped_frames;
+
+    _Atomic bool stopping;
+
+    // Posted once per pushed frame and once more when stopping
+    SDL_sem* pending;
+    SDL_Thread* thread;
+
+    FILE* video;
+    enum CaptureFormat format;
+    uint8_t y4m_palette[SCREEN_PALETTE_SIZE][3];
+    struct GifEncoder* gif;
+
+    FILE* audio;
+    uint32_t audio_sample_counter;
+    uint64_t audio_samples;
+
+    uint8_t failed;
+};
+
+struct Capture* create_capture(const char* video_path, const char* audio_path);
+
+void capture_frame(struct Capture* capture, const struct Screen* screen, bool sound);
+
+uint8_t delete_capture(struct Capture* capture);
+
+#endif
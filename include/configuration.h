@@ -0,0 +1,47 @@
+#ifndef OCH8S_CONFIGURATION_H
+#define OCH8S_CONFIGURATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quirks.h"
+#include "scaler.h"
+
+static constexpr uint32_t DEFAULT_OPCODES_PER_SECOND = 700;
+static constexpr uint16_t DEFAULT_AUDIO_BUFFER_SAMPLES = 2048;
+
+// The number of SDL scancodes, checked against `SDL_NUM_SCANCODES` where SDL is included
+static constexpr size_t CONFIGURATION_SCANCODES = 512;
+
+// A scancode that isn't mapped to any key, ignored by `set_key_state()`
+static constexpr uint8_t CONFIGURATION_UNMAPPED_KEY = 0xFF;
+
+/**
+ * @brief The settings of a run, from the defaults, the lines of the configuration file for every ROM and the section
+ *  of the running ROM, in that order. It is filled once at startup, so nothing is looked up while running.
+ */
+struct Configuration {
+    uint32_t opcodes_per_second;
+
+    // Only used when set, otherwise the profile given by `-q` or detected by the analysis of the ROM is
+    bool quirk_profile_set;
+    enum QuirkProfile quirk_profile;
+
+    // The SDL render driver, like `opengl` or `software`, or empty for the default one
+    char renderer[32];
+
+    enum Scaler scaler;
+
+    // The number of emulated frames dropped after every presented one
+    uint32_t frame_skip;
+
+    uint16_t audio_buffer_samples;
+
+    // The SDL scancode of every CHIP-8 key, and the key of every scancode
+    uint16_t keymap[16];
+    uint8_t scancode_keys[CONFIGURATION_SCANCODES];
+};
+
+uint8_t load_configuration(struct Configuration* configuration, const char* path, uint64_t rom_hash);
+
+#endif
@@ -0,0 +1,162 @@
+#ifndef OCH8S_DEBUGGER_H
+#define OCH8S_DEBUGGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quirks.h"
+#include "screen.h"
+#include "virtual-machine.h"
+
+static constexpr size_t DEBUGGER_MAX_BREAKPOINTS = 64;
+
+// Marks a breakpoint without condition
+static constexpr int8_t DEBUGGER_NO_CONDITION = -1;
+
+// The condition register index of the register I, the ones below are the registers V
+static constexpr int8_t DEBUGGER_INDEX_REGISTER = 16;
+
+enum DebuggerComparison {
+    DEBUGGER_EQUAL,
+    DEBUGGER_NOT_EQUAL,
+    DEBUGGER_LESS,
+    DEBUGGER_GREATER,
+};
+
+enum DebuggerStopReason {
+    DEBUGGER_STOP_PAUSE,
+    DEBUGGER_STOP_BREAKPOINT,
+    DEBUGGER_STOP_WATCHPOINT,
+    DEBUGGER_STOP_STEP,
+};
+
+/**
+ * @brief A PC breakpoint, it stops the CPU before running the instruction at its address if its condition holds.
+ */
+struct Breakpoint {
+    uint16_t address;
+
+    // Register compared with the value, `DEBUGGER_NO_CONDITION` to always stop
+    int8_t register_index;
+    enum DebuggerComparison comparison;
+    uint16_t value;
+};
+
+struct Debugger {
+    // A bit per address of the 64KB address space, set if any breakpoint is at it. The CPU checks it with a single
+    // load per instruction and only looks at the breakpoints themselves when the bit is set.
+    uint64_t breakpoint_addresses[0x10000 / 64];
+    struct Breakpoint breakpoints[DEBUGGER_MAX_BREAKPOINTS];
+    size_t breakpoint_count;
+
+    // A bit per address, set if the memory byte is watched for writes
+    uint64_t watchpoint_addresses[0x10000 / 64];
+    size_t watchpoint_count;
+
+    // The CPU doesn't run while stopped, the timers are frozen too
+    bool stopped;
+    enum DebuggerStopReason stop_reason;
+
+    // The address written when stopped by a watchpoint
+    uint16_t watched_address;
+
+    // Set when the CPU starts again, so the breakpoint it stopped at doesn't stop it again
+    bool resuming;
+
+    // Instructions left to stop again after a step command, 0 when not stepping
+    uint64_t steps;
+
+    // Keeps the debugged interpreter while a GDB client is attached, so every instruction is counted in `executed`
+    bool traced;
+
+    // Instructions run by the debugged interpreter, it locates the snapshots of the reverse execution
+    uint64_t executed;
+
+    // The interpreters of the quirk profile, the debugged one only runs while anything is armed so the debugger costs
+    // nothing when unused
+    uint8_t (*fast_run_cpu)(struct VirtualMachine* vm, struct Screen* screen, size_t steps);
+    uint8_t (*debugged_run_cpu)(struct VirtualMachine* vm, struct Screen* screen, size_t steps);
+
+    // The commands are read from the terminal without blocking, a line at a time
+    bool console;
+    char line[256];
+    size_t line_length;
+};
+
+/**
+ * @brief Check if the debugger has a breakpoint at an address.
+ *
+ * @param debugger The debugger to check.
+ * @param address The address of the instruction.
+ * @return If any breakpoint is at the address.
+ */
+[[gnu::always_inline]] static inline bool is_breakpoint(const struct Debugger* debugger, uint16_t address)
+{
+    return (debugger->breakpoint_addresses[address / 64] >> (address % 64)) & 1;
+}
+
+/**
+ * @brief Check if the debugger watches the writes to a memory address.
+ *
+ * @param debugger The debugger to check.
+ * @param address The address of the memory byte.
+ * @return If the address is watched.
+ */
+[[gnu::always_inline]] static inline bool is_watchpoint(const struct Debugger* debugger, uint16_t address)
+{
+    return (debugger->watchpoint_addresses[address / 64] >> (address % 64)) & 1;
+}
+
+const struct Breakpoint* find_breakpoint(const struct Debugger* debugger, const struct VirtualMachine* vm);
+
+bool hit_breakpoint(struct Debugger* debugger, struct VirtualMachine* vm);
+
+void hit_watchpoint(struct Debugger* debugger, struct VirtualMachine* vm, uint16_t address);
+
+/**
+ * @brief Stop the CPU after the current instruction if it wrote to a watched memory address.
+ *
+ * @param vm The virtual machine that wrote the memory, with a debugger.
+ * @param address The first address written.
+ * @param length The number of bytes written.
+ * @param address_mask The mask applied to every written address, the writes past the end of the memory wrap around.
+ */
+[[gnu::always_inline]] static inline void check_watchpoints(struct VirtualMachine* vm, size_t address, size_t length,
+    size_t address_mask)
+{
+    for (size_t i = 0; i < length; i++) {
+        uint16_t written = (address + i) & address_mask;
+
+        if (is_watchpoint(vm->debugger, written)) {
+            hit_watchpoint(vm->debugger, vm, written);
+            return;
+        }
+    }
+}
+
+void finish_step(struct Debugger* debugger, struct VirtualMachine* vm);
+
+struct Debugger* create_debugger(struct VirtualMachine* vm, enum QuirkProfile quirk_profile);
+
+void retarget_debugger(struct Debugger* debugger, struct VirtualMachine* vm,
+    uint8_t (*fast_run_cpu)(struct VirtualMachine* vm, struct Screen* screen, size_t steps),
+    enum QuirkProfile quirk_profile);
+
+uint8_t add_breakpoint(struct Debugger* debugger, struct VirtualMachine* vm, struct Breakpoint breakpoint);
+
+void remove_breakpoints(struct Debugger* debugger, struct VirtualMachine* vm, uint16_t address);
+
+void set_watchpoints(struct Debugger* debugger, struct VirtualMachine* vm, uint16_t address, size_t length,
+    bool watched);
+
+void remove_all_breakpoints(struct Debugger* debugger, struct VirtualMachine* vm);
+
+void stop_debugger(struct Debugger* debugger, struct VirtualMachine* vm, enum DebuggerStopReason reason);
+
+void resume_debugger(struct Debugger* debugger, struct VirtualMachine* vm, uint64_t steps);
+
+void poll_debugger_console(struct Debugger* debugger, struct VirtualMachine* vm);
+
+void delete_debugger(struct Debugger* debugger, struct VirtualMachine* vm);
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef OCH8S_EMULATION_H
+#define OCH8S_EMULATION_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "capture.h"
+#include "frame-pacing.h"
+#include "gdb-stub.h"
+#include "latency-probe.h"
+#include "metrics.h"
+#include "perf-counters.h"
+#include "quirks.h"
+#include "screen.h"
+#include "shared-screen.h"
+#include "trace.h"
+#include "triple-buffer.h"
+#include "virtual-machine.h"
+
+/**
+ * @brief A ROM to load on the running virtual machine, requested by the window thread. Loading the same ROM again
+ *  resets it. The ROM is read when requested, so loading it on the emulation thread can't fail.
+ */
+struct RomSwap {
+    char* rom_path;
+    uint8_t* rom;
+    size_t rom_size;
+    enum QuirkProfile quirk_profile;
+    uint32_t opcodes_per_second;
+
+    // A copy of the idle loops found by the analysis of the ROM, NULL when it wasn't analyzed
+    uint64_t* idle_loops;
+};
+
+/**
+ * @brief State shared between the emulation thread and the window thread.
+ */
+struct Emulation {
+    struct VirtualMachine* vm;
+
+    // Only touched by the emulation thread, the window thread gets its copies through `frames`
+    struct Screen* screen;
+    struct TripleBuffer frames;
+
+    uint32_t opcodes_per_second;
+
+    // When not 0 run this number of frames as fast as possible without publishing them
+    uint64_t benchmark_frames;
+
+    uint32_t* audio_sample_counter;
+
+    // The audio device is only opened the first time the ROM plays a sound, most of them take a while to do it and
+    // opening it is one of the slowest parts of the startup
+    bool audio_opened;
+    uint16_t audio_buffer_samples;
+    struct TraceBuffer* audio_trace;
+
+    // When not NULL every emulated frame is pushed to it, including the benchmarked ones
+    struct Capture* capture;
+
+    // When not NULL the registers and the screen are published to it at the end of every frame
+    struct SharedScreenExport* shared_screen;
+
+    // When not NULL the executed instructions and the emulated frames are counted on it
+    struct Metrics* metrics;
+
+    // When not NULL the hardware counters are sampled around every run of the CPU, they are opened by the emulation
+    // thread
+    struct PerfCounters* perf_counters;
+
+    // When not NULL a GDB client can attach to the virtual machine, that has a debugger
+    struct GdbStub* gdb_stub;
+
+    // When not NULL the phases of every frame are recorded on it
+    struct TraceBuffer* trace;
+
+    // When not NULL the moment the ROM sees the pressed key is timestamped on it after every run of the CPU
+    struct LatencyProbe* latency_probe;
+
+    // Set by any of the threads to stop both of them
+    _Atomic bool quit;
+    _Atomic bool failed;
+
+    // Requests from the window thread, handled by the emulation thread between frames
+    _Atomic bool save_requested;
+    _Atomic bool load_requested;
+    _Atomic(struct RomSwap*) swap_requested;
+
+    struct FramePacer pacer;
+    uint64_t emulated_frames;
+    uint64_t requested_steps;
+    uint64_t benchmark_time;
+};
+
+void init_emulation(struct Emulation* emulation, struct VirtualMachine* vm, struct Screen* screen, uint32_t* audio_sample_counter);
+
+int run_emulation(void* emulation);
+
+void report_emulation(struct Emulation* emulation);
+
+uint8_t request_rom_swap(struct Emulation* emulation, const char* rom_path, enum QuirkProfile quirk_profile,
+    uint32_t opcodes_per_second, const uint64_t* idle_loops);
+
+void delete_rom_swap(struct RomSwap* swap);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef OCH8S_FRAME_PACING_H
+#define OCH8S_FRAME_PACING_H
+
+#include <stdint.h>
+
+struct FramePacer {
+    uint64_t frame_period;
+
+    // Absolute CLOCK_MONOTONIC time in nanoseconds when the next frame starts
+    uint64_t next_deadline;
+
+    // Let the presentation block on the display refresh instead of sleeping
+    bool vsync;
+
+    uint64_t frames;
+
+    // How late the loop woke up after each deadline, in nanoseconds
+    uint64_t total_jitter;
+    uint64_t max_jitter;
+
+    // Frames that were not started in time and had to be caught up
+    uint64_t missed_frames;
+};
+
+uint64_t get_monotonic_timestamp();
+
+uint8_t start_frame_pacer(struct FramePacer* pacer, uint32_t frames_per_second, bool vsync);
+
+uint32_t wait_next_frame(struct FramePacer* pacer);
+
+void report_frame_pacing(struct FramePacer* pacer);
+
+#endif
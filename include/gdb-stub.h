@@ -0,0 +1,62 @@
+#ifndef OCH8S_GDB_STUB_H
+#define OCH8S_GDB_STUB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "screen.h"
+#include "virtual-machine.h"
+
+// The largest packet accepted from the client, announced on `qSupported`
+static constexpr size_t GDB_PACKET_SIZE = 0x1000;
+
+// Frames of snapshots kept for the reverse execution, 5 seconds
+static constexpr size_t GDB_HISTORY_FRAMES = 300;
+
+/**
+ * @brief The state of the machine at the start of a frame, the reverse execution goes back to one of them and runs
+ *  forward again up to the wanted instruction.
+ */
+struct GdbSnapshot {
+    // The number of instructions executed by the debugger when it was taken
+    uint64_t executed;
+
+    struct VirtualMachine vm;
+    struct Screen screen;
+};
+
+/**
+ * @brief A GDB remote serial protocol server exposing the virtual machine as a target, one client at a time. It is
+ *  polled between frames by the emulation thread, so while no client is attached it only costs a `poll()` per frame.
+ */
+struct GdbStub {
+    int listener;
+
+    // Removed when the stub is deleted, NULL when listening on TCP
+    char* socket_path;
+
+    // -1 when no client is attached
+    int client;
+    bool no_acknowledgment;
+
+    // Set after a continue or a step, until the stop reply is sent
+    bool running;
+
+    char input[GDB_PACKET_SIZE * 2];
+    size_t input_length;
+
+    // Ring of snapshots, only filled while a client is attached
+    struct GdbSnapshot* history;
+    size_t history_start;
+    size_t history_count;
+};
+
+struct GdbStub* create_gdb_stub(const char* address);
+
+void record_gdb_snapshot(struct GdbStub* stub, const struct VirtualMachine* vm, const struct Screen* screen);
+
+void poll_gdb_stub(struct GdbStub* stub, struct VirtualMachine* vm, struct Screen* screen);
+
+void delete_gdb_stub(struct GdbStub* stub, struct VirtualMachine* vm);
+
+#endif
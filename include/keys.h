@@ -5,6 +5,4 @@
 
 extern const uint8_t chip8_key_to_sdl_scancode[];
 
-uint8_t sdl_scancode_to_chip8_key(uint8_t scancode);
-
 #endif
@@ -0,0 +1,67 @@
+#ifndef OCH8S_LATENCY_PROBE_H
+#define OCH8S_LATENCY_PROBE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "screen.h"
+#include "virtual-machine.h"
+
+// The probe follows the contract of `examples/latency-probe-rom.c`: the ROM polls this key, adds 1 to this register as
+// soon as it sees it pressed and then changes the screen
+static constexpr uint8_t LATENCY_PROBE_KEY = 0x5;
+static constexpr uint8_t LATENCY_PROBE_COUNTER = 0xB;
+
+// Time between releasing a key and pressing it again, a random part is added so the presses fall on every phase of
+// the frames
+static constexpr uint64_t LATENCY_PROBE_INTERVAL = 100000000;
+static constexpr uint64_t LATENCY_PROBE_JITTER = 17000000;
+
+// A press without a change presented after it is given up
+static constexpr uint64_t LATENCY_PROBE_TIMEOUT = 1000000000;
+
+enum LatencyProbeState {
+    LATENCY_PROBE_WAITING,
+    LATENCY_PROBE_PRESSED,
+    LATENCY_PROBE_DONE,
+};
+
+/**
+ * @brief Presses a key of the virtual machine from the window thread and measures when the emulation sees it and when
+ *  the change it makes on the screen is presented.
+ */
+struct LatencyProbe {
+    // Only touched by the window thread
+    enum LatencyProbeState state;
+    size_t presses;
+    size_t samples;
+    size_t lost;
+    uint64_t next_press;
+    uint64_t injected_at;
+
+    // The last presented screen before the press, a change from it is the answer of the ROM
+    uint64_t reference[SCREEN_PLANES][SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_ROW_WORDS];
+
+    // Nanoseconds from the press to the observation by the ROM and to the present, one per sample
+    uint64_t* observation_latencies;
+    uint64_t* present_latencies;
+
+    // Only written by the emulation thread
+    uint8_t observed_count;
+    _Atomic uint64_t observed_at;
+};
+
+struct LatencyProbe* create_latency_probe(size_t presses);
+
+void inject_latency_probe(struct LatencyProbe* probe, struct VirtualMachine* vm);
+
+void observe_latency_probe(struct LatencyProbe* probe, const struct VirtualMachine* vm);
+
+void present_latency_probe(struct LatencyProbe* probe, struct VirtualMachine* vm, const struct Screen* frame);
+
+uint8_t report_latency_probe(const struct LatencyProbe* probe, double budget);
+
+void delete_latency_probe(struct LatencyProbe* probe);
+
+#endif
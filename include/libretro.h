@@ -0,0 +1,150 @@
+#ifndef OCH8S_LIBRETRO_H
+#define OCH8S_LIBRETRO_H
+
+// The subset of the libretro API used by the och8S core, with the same values and layouts as the upstream
+// `libretro.h` (https://github.com/libretro/libretro-common) so the core works with any libretro frontend
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RETRO_API __attribute__((visibility("default")))
+
+static constexpr unsigned RETRO_API_VERSION = 1;
+
+static constexpr unsigned RETRO_DEVICE_JOYPAD = 1;
+static constexpr unsigned RETRO_DEVICE_KEYBOARD = 3;
+
+static constexpr unsigned RETRO_DEVICE_ID_JOYPAD_B = 0;
+static constexpr unsigned RETRO_DEVICE_ID_JOYPAD_Y = 1;
+static constexpr unsigned RETRO_DEVICE_ID_JOYPAD_SELECT = 2;
+static constexpr unsigned RETRO_DEVICE_ID_JOYPAD_START = 3;
+static constexpr unsigned RETRO_DEVICE_ID_JOYPAD_UP = 4;
+static constexpr unsigned RETRO_DEVICE_ID_JOYPAD_DOWN = 5;
+static constexpr unsigned RETRO_DEVICE_ID_JOYPAD_LEFT = 6;
+static constexpr unsigned RETRO_DEVICE_ID_JOYPAD_RIGHT = 7;
+static constexpr unsigned RETRO_DEVICE_ID_JOYPAD_A = 8;
+static constexpr unsigned RETRO_DEVICE_ID_JOYPAD_X = 9;
+static constexpr unsigned RETRO_DEVICE_ID_JOYPAD_L = 10;
+static constexpr unsigned RETRO_DEVICE_ID_JOYPAD_R = 11;
+
+static constexpr unsigned RETRO_REGION_NTSC = 0;
+
+static constexpr unsigned RETRO_MEMORY_SAVE_RAM = 0;
+static constexpr unsigned RETRO_MEMORY_SYSTEM_RAM = 2;
+
+// The keyboard keys are identified by their lowercase ASCII character
+static constexpr unsigned RETROK_0 = '0';
+static constexpr unsigned RETROK_1 = '1';
+static constexpr unsigned RETROK_2 = '2';
+static constexpr unsigned RETROK_3 = '3';
+static constexpr unsigned RETROK_4 = '4';
+static constexpr unsigned RETROK_a = 'a';
+static constexpr unsigned RETROK_c = 'c';
+static constexpr unsigned RETROK_d = 'd';
+static constexpr unsigned RETROK_e = 'e';
+static constexpr unsigned RETROK_f = 'f';
+static constexpr unsigned RETROK_q = 'q';
+static constexpr unsigned RETROK_r = 'r';
+static constexpr unsigned RETROK_s = 's';
+static constexpr unsigned RETROK_v = 'v';
+static constexpr unsigned RETROK_w = 'w';
+static constexpr unsigned RETROK_x = 'x';
+static constexpr unsigned RETROK_z = 'z';
+
+static constexpr unsigned RETRO_ENVIRONMENT_GET_CAN_DUPE = 3;
+static constexpr unsigned RETRO_ENVIRONMENT_SHUTDOWN = 7;
+static constexpr unsigned RETRO_ENVIRONMENT_SET_PIXEL_FORMAT = 10;
+static constexpr unsigned RETRO_ENVIRONMENT_GET_VARIABLE = 15;
+static constexpr unsigned RETRO_ENVIRONMENT_SET_VARIABLES = 16;
+static constexpr unsigned RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE = 17;
+
+enum retro_pixel_format {
+    RETRO_PIXEL_FORMAT_0RGB1555 = 0,
+    RETRO_PIXEL_FORMAT_XRGB8888 = 1,
+    RETRO_PIXEL_FORMAT_RGB565 = 2,
+    RETRO_PIXEL_FORMAT_UNKNOWN = INT32_MAX,
+};
+
+struct retro_system_info {
+    const char* library_name;
+    const char* library_version;
+    const char* valid_extensions;
+    bool need_fullpath;
+    bool block_extract;
+};
+
+struct retro_game_geometry {
+    unsigned base_width;
+    unsigned base_height;
+    unsigned max_width;
+    unsigned max_height;
+    float aspect_ratio;
+};
+
+struct retro_system_timing {
+    double fps;
+    double sample_rate;
+};
+
+struct retro_system_av_info {
+    struct retro_game_geometry geometry;
+    struct retro_system_timing timing;
+};
+
+struct retro_game_info {
+    const char* path;
+    const void* data;
+    size_t size;
+    const char* meta;
+};
+
+struct retro_variable {
+    const char* key;
+    const char* value;
+};
+
+typedef bool (*retro_environment_t)(unsigned cmd, void* data);
+typedef void (*retro_video_refresh_t)(const void* data, unsigned width, unsigned height, size_t pitch);
+typedef void (*retro_audio_sample_t)(int16_t left, int16_t right);
+typedef size_t (*retro_audio_sample_batch_t)(const int16_t* data, size_t frames);
+typedef void (*retro_input_poll_t)(void);
+typedef int16_t (*retro_input_state_t)(unsigned port, unsigned device, unsigned index, unsigned id);
+
+RETRO_API void retro_set_environment(retro_environment_t callback);
+RETRO_API void retro_set_video_refresh(retro_video_refresh_t callback);
+RETRO_API void retro_set_audio_sample(retro_audio_sample_t callback);
+RETRO_API void retro_set_audio_sample_batch(retro_audio_sample_batch_t callback);
+RETRO_API void retro_set_input_poll(retro_input_poll_t callback);
+RETRO_API void retro_set_input_state(retro_input_state_t callback);
+
+RETRO_API void retro_init(void);
+RETRO_API void retro_deinit(void);
+
+RETRO_API unsigned retro_api_version(void);
+
+RETRO_API void retro_get_system_info(struct retro_system_info* info);
+RETRO_API void retro_get_system_av_info(struct retro_system_av_info* info);
+
+RETRO_API void retro_set_controller_port_device(unsigned port, unsigned device);
+
+RETRO_API void retro_reset(void);
+RETRO_API void retro_run(void);
+
+RETRO_API size_t retro_serialize_size(void);
+RETRO_API bool retro_serialize(void* data, size_t size);
+RETRO_API bool retro_unserialize(const void* data, size_t size);
+
+RETRO_API void retro_cheat_reset(void);
+RETRO_API void retro_cheat_set(unsigned index, bool enabled, const char* code);
+
+RETRO_API bool retro_load_game(const struct retro_game_info* game);
+RETRO_API bool retro_load_game_special(unsigned game_type, const struct retro_game_info* info, size_t num_info);
+RETRO_API void retro_unload_game(void);
+
+RETRO_API unsigned retro_get_region(void);
+
+RETRO_API void* retro_get_memory_data(unsigned id);
+RETRO_API size_t retro_get_memory_size(unsigned id);
+
+#endif
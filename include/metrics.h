@@ -0,0 +1,124 @@
+#ifndef OCH8S_METRICS_H
+#define OCH8S_METRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Four buckets per power of two of microseconds, the last one collects everything above 1.8 seconds
+static constexpr size_t METRICS_HISTOGRAM_BUCKETS = 80;
+
+// Nanoseconds between two reports, one second
+static constexpr uint64_t METRICS_REPORT_PERIOD = 1000000000;
+
+// The longest text of the overlay, some short lines separated by newlines
+static constexpr size_t METRICS_OVERLAY_SIZE = 128;
+
+/**
+ * @brief A histogram of durations with logarithmic buckets. Any thread can add to it without locking and the
+ *  percentiles are read from the difference between two copies of it.
+ */
+struct LatencyHistogram {
+    _Atomic uint64_t buckets[METRICS_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * @brief The rates and latencies of the last report period.
+ */
+struct MetricsReport {
+    // Since the metrics were started
+    double uptime;
+
+    double instructions_per_second;
+    double emulated_frames_per_second;
+
+    // Iterations of the event loop and frames presented by it
+    double host_frames_per_second;
+    double presents_per_second;
+
+    // Milliseconds
+    double present_p50;
+    double present_p90;
+    double present_p99;
+    double event_loop_p50;
+    double event_loop_p90;
+    double event_loop_p99;
+
+    uint64_t audio_callbacks;
+    uint64_t audio_underruns;
+};
+
+/**
+ * @brief Counters updated by the emulation, window and audio threads, each of them only writing its own ones with
+ *  relaxed atomic operations, and the reports made from them by the window thread.
+ */
+struct Metrics {
+    // Written by the emulation thread
+    _Atomic uint64_t instructions;
+    _Atomic uint64_t emulated_frames;
+
+    // Written by the window thread
+    struct LatencyHistogram present_times;
+    struct LatencyHistogram event_loop_times;
+
+    // Written by the audio callback
+    _Atomic uint64_t audio_callbacks;
+    _Atomic uint64_t audio_underruns;
+    uint64_t last_audio_callback;
+
+    // Only touched by the window thread, the counters at the last report
+    uint64_t start_time;
+    uint64_t report_time;
+    uint64_t report_instructions;
+    uint64_t report_emulated_frames;
+    uint64_t report_present_times[METRICS_HISTOGRAM_BUCKETS];
+    uint64_t report_event_loop_times[METRICS_HISTOGRAM_BUCKETS];
+
+    struct MetricsReport report;
+
+    // Serves the last report as JSON to every client that connects, -1 when disabled
+    int listener;
+    char* socket_path;
+};
+
+/**
+ * @brief Add a duration to a histogram.
+ *
+ * @param histogram The histogram to add to.
+ * @param nanoseconds The duration.
+ */
+static inline void record_latency(struct LatencyHistogram* histogram, uint64_t nanoseconds)
+{
+    uint64_t microseconds = nanoseconds / 1000;
+    size_t bucket = microseconds;
+
+    // Below 4 microseconds every bucket is a single value, above it every power of two is split in 4 buckets
+    if (microseconds >= 4) {
+        size_t exponent = 63 - __builtin_clzll(microseconds);
+        bucket = (exponent - 1) * 4 + ((microseconds >> (exponent - 2)) & 3);
+    }
+
+    if (bucket >= METRICS_HISTOGRAM_BUCKETS) {
+        bucket = METRICS_HISTOGRAM_BUCKETS - 1;
+    }
+
+    atomic_fetch_add_explicit(&histogram->buckets[bucket], 1, memory_order_relaxed);
+}
+
+void init_metrics(struct Metrics* metrics);
+
+uint8_t open_metrics_socket(struct Metrics* metrics, const char* path);
+
+void record_audio_callback(struct Metrics* metrics, uint64_t buffer_period, bool resumed);
+
+bool update_metrics(struct Metrics* metrics);
+
+void format_metrics_line(const struct MetricsReport* report, char* text, size_t size);
+
+void format_metrics_overlay(const struct MetricsReport* report, char* text, size_t size);
+
+void serve_metrics_socket(struct Metrics* metrics);
+
+void close_metrics(struct Metrics* metrics);
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef OCH8S_ENV_H
+#define OCH8S_ENV_H
+
+// Batched environments for reinforcement learning, many virtual machines stepped together on a pool of threads
+// without SDL. Only this header is needed to use the library, so it doesn't include the headers of the emulator.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OCH8S_ENV_API __attribute__((visibility("default")))
+
+// The most reward and done watches that an environment batch can have
+static constexpr size_t OCH8S_ENV_MAX_WATCHES = 16;
+
+// The 64 bits words of a screen plane: 64 rows of 128 pixels, packed like `struct Screen` with the leftmost pixel being
+// the most significant bit of the first word of the row. Low resolution programs only use the top left 64x32 pixels.
+static constexpr size_t OCH8S_ENV_PLANE_WORDS = 64 * 2;
+
+/**
+ * @brief The settings of an environment batch, every zeroed field takes its default value.
+ */
+struct Och8sEnvOptions {
+    // Name of the quirk profile as given to `-q`, "vip" by default
+    const char* quirk_profile;
+
+    // 700 by default
+    uint32_t opcodes_per_second;
+
+    // Threads that step the environments, including the one calling the library. The online CPUs by default.
+    size_t threads;
+
+    // Screen planes copied into the observations, 1 by default. Only XO-CHIP programs draw on more than one.
+    uint8_t planes;
+
+    // Mixed with the index of the environment and its number of resets to seed the random numbers of CXNN, so
+    // every episode is different but the same seed repeats the same episodes
+    uint64_t seed;
+};
+
+struct Och8sEnv;
+
+OCH8S_ENV_API struct Och8sEnv* och8s_env_create(size_t environments, const char* rom_path,
+    const struct Och8sEnvOptions* options);
+
+OCH8S_ENV_API size_t och8s_env_get_observation_words(const struct Och8sEnv* env);
+
+OCH8S_ENV_API uint8_t och8s_env_set_buffers(struct Och8sEnv* env, uint64_t* observations, float* rewards,
+    uint8_t* dones);
+
+OCH8S_ENV_API uint8_t och8s_env_add_reward_watch(struct Och8sEnv* env, uint16_t address, uint8_t size, float weight);
+
+OCH8S_ENV_API uint8_t och8s_env_add_done_watch(struct Och8sEnv* env, uint16_t address, uint8_t value);
+
+OCH8S_ENV_API uint8_t och8s_env_reset(struct Och8sEnv* env, const uint8_t* mask);
+
+OCH8S_ENV_API uint8_t och8s_env_step(struct Och8sEnv* env, const uint16_t* actions, uint32_t frames);
+
+OCH8S_ENV_API void och8s_env_delete(struct Och8sEnv* env);
+
+#endif
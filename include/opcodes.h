@@ -3,19 +3,23 @@
 
 #include <stdint.h>
 
-#include "render.h"
+#include "screen.h"
 #include "virtual-machine.h"
 
-uint8_t opcode_0(struct Opcode opcode, struct VirtualMachine* vm, struct Screen* screen);
+uint8_t run_cpu_cosmac_vip(struct VirtualMachine* vm, struct Screen* screen, size_t steps);
 
-void opcode_3_4(struct Opcode opcode, struct VirtualMachine* vm, bool should_be_equal);
+uint8_t run_cpu_schip_legacy(struct VirtualMachine* vm, struct Screen* screen, size_t steps);
 
-void opcode_5_9(struct Opcode opcode, struct VirtualMachine* vm, bool should_be_equal);
+uint8_t run_cpu_schip_modern(struct VirtualMachine* vm, struct Screen* screen, size_t steps);
 
-void opcode_8(struct Opcode opcode, struct VirtualMachine* vm);
+uint8_t run_cpu_xo_chip(struct VirtualMachine* vm, struct Screen* screen, size_t steps);
 
-uint8_t opcode_d(struct Opcode opcode, struct VirtualMachine* vm, struct Screen* screen);
+uint8_t run_cpu_cosmac_vip_debugged(struct VirtualMachine* vm, struct Screen* screen, size_t steps);
 
-void opcode_f(struct Opcode opcode, struct VirtualMachine* vm);
+uint8_t run_cpu_schip_legacy_debugged(struct VirtualMachine* vm, struct Screen* screen, size_t steps);
+
+uint8_t run_cpu_schip_modern_debugged(struct VirtualMachine* vm, struct Screen* screen, size_t steps);
+
+uint8_t run_cpu_xo_chip_debugged(struct VirtualMachine* vm, struct Screen* screen, size_t steps);
 
 #endif
@@ -0,0 +1,57 @@
+#ifndef OCH8S_PERF_COUNTERS_H
+#define OCH8S_PERF_COUNTERS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+enum PerfEvent {
+    PERF_EVENT_CYCLES,
+    PERF_EVENT_INSTRUCTIONS,
+    PERF_EVENT_BRANCH_MISSES,
+    PERF_EVENT_L1D_MISSES,
+    PERF_EVENT_COUNT,
+};
+
+/**
+ * @brief Hardware counters of the thread that opened them, read before and after every run of a phase of the frame.
+ *  Without access to them (other systems, containers, a restrictive `perf_event_paranoid`) only the time is measured.
+ */
+struct PerfCounters {
+    // Name of the measured phase, like "emulation"
+    const char* phase;
+
+    // The leader of the counter group, read with a single system call, or -1 when only the clock is used
+    int group;
+
+    // -1 for the events the CPU doesn't count
+    int descriptors[PERF_EVENT_COUNT];
+
+    // When not NULL a line is written for every sample
+    FILE* log;
+
+    uint64_t start_time;
+    uint64_t start_values[PERF_EVENT_COUNT];
+
+    uint64_t samples;
+    uint64_t total_time;
+    uint64_t totals[PERF_EVENT_COUNT];
+
+    // What the totals are normalized by, the CHIP-8 instructions or the presented frames
+    uint64_t units;
+};
+
+FILE* create_perf_log(const char* path);
+
+void init_perf_counters(struct PerfCounters* counters, const char* phase, FILE* log);
+
+void open_perf_counters(struct PerfCounters* counters);
+
+void start_perf_sample(struct PerfCounters* counters);
+
+void finish_perf_sample(struct PerfCounters* counters, uint64_t frame, uint64_t units);
+
+void report_perf_counters(const struct PerfCounters* counters, const char* unit);
+
+void close_perf_counters(struct PerfCounters* counters);
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef OCH8S_QUIRKS_H
+#define OCH8S_QUIRKS_H
+
+#include <stdint.h>
+
+/**
+ * @brief The behaviours that differ between the CHIP-8 platforms.
+ */
+struct Quirks {
+    // 8XY1, 8XY2 and 8XY3 reset vF to 0
+    bool vf_reset;
+
+    // 8XY6 and 8XYE shift vX in place instead of shifting vY into vX
+    bool shift_vx;
+
+    // FX55 and FX65 leave I pointing after the last register
+    bool increment_index;
+
+    // Sprites are clipped at the edges of the screen instead of wrapping around
+    bool clip_sprites;
+
+    // BXNN jumps to XNN + vX instead of NNN + v0
+    bool jump_vx;
+
+    // On high resolution vF is set to the number of sprite rows that collided or were clipped at the bottom
+    bool count_collided_rows;
+
+    // XO-CHIP extensions: the 64KB address space and the 4 bytes long F000 NNNN instruction
+    bool xo_chip;
+};
+
+enum QuirkProfile {
+    QUIRK_PROFILE_COSMAC_VIP,
+    QUIRK_PROFILE_SCHIP_LEGACY,
+    QUIRK_PROFILE_SCHIP_MODERN,
+    QUIRK_PROFILE_XO_CHIP,
+};
+
+static constexpr struct Quirks COSMAC_VIP_QUIRKS = {
+    .vf_reset = true,
+    .shift_vx = false,
+    .increment_index = true,
+    .clip_sprites = true,
+    .jump_vx = false,
+    .count_collided_rows = false,
+    .xo_chip = false,
+};
+
+static constexpr struct Quirks SCHIP_LEGACY_QUIRKS = {
+    .vf_reset = false,
+    .shift_vx = true,
+    .increment_index = false,
+    .clip_sprites = true,
+    .jump_vx = true,
+    .count_collided_rows = true,
+    .xo_chip = false,
+};
+
+static constexpr struct Quirks SCHIP_MODERN_QUIRKS = {
+    .vf_reset = false,
+    .shift_vx = true,
+    .increment_index = false,
+    .clip_sprites = true,
+    .jump_vx = true,
+    .count_collided_rows = false,
+    .xo_chip = false,
+};
+
+static constexpr struct Quirks XO_CHIP_QUIRKS = {
+    .vf_reset = false,
+    .shift_vx = false,
+    .increment_index = true,
+    .clip_sprites = false,
+    .jump_vx = false,
+    .count_collided_rows = false,
+    .xo_chip = true,
+};
+
+uint8_t parse_quirk_profile(const char* name, enum QuirkProfile* profile);
+
+const char* get_quirk_profile_name(enum QuirkProfile profile);
+
+#endif
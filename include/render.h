@@ -3,21 +3,46 @@
 
 #include <SDL2/SDL.h>
 #include <stdbool.h>
+#include <stdint.h>
 
-struct Screen {
+#include "metrics.h"
+#include "scaler.h"
+#include "screen.h"
+#include "trace.h"
+
+struct Window {
     SDL_Window* window;
     SDL_Renderer* renderer;
+    SDL_Texture* texture;
 
-    size_t height;
+    // The filter used to upscale the screen, the texture is created big enough for its factor
+    enum Scaler scaler;
+
+    // The resolution of the last drawn screen, the logical size of the renderer is only updated when it changes
     size_t width;
+    size_t height;
 
-    bool** buffer;
+    // Lines of text drawn over the top left corner of the screen, hidden when empty
+    char overlay[METRICS_OVERLAY_SIZE];
+
+    // When not NULL the drawing and the present are recorded on it
+    struct TraceBuffer* trace;
+
+    // The pixels of the texture of a wall, a tile of high resolution for each screen on a grid of this size. Only the
+    // changed tiles are composed here and the whole atlas is uploaded once per frame. NULL on a single screen.
+    uint32_t* atlas;
+    size_t columns;
+    size_t rows;
 };
 
-uint8_t draw_screen(struct Screen* screen);
+uint8_t draw_screen(struct Window* window, const struct Screen* screen);
+
+uint8_t draw_wall(struct Window* window, const struct Screen** tiles, size_t count, size_t focused);
+
+struct Window* create_window(bool vsync, enum Scaler scaler);
 
-struct Screen* create_screen(size_t screen_height, size_t screen_width);
+struct Window* create_wall_window(bool vsync, size_t columns, size_t rows);
 
-void delete_screen(struct Screen* screen);
+void delete_window(struct Window* window);
 
 #endif
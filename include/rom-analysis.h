@@ -0,0 +1,103 @@
+#ifndef OCH8S_ROM_ANALYSIS_H
+#define OCH8S_ROM_ANALYSIS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quirks.h"
+
+// Changed whenever the layout of `struct RomAnalysis` or what it means changes, so old caches are rebuilt
+static constexpr uint32_t ROM_ANALYSIS_VERSION = 1;
+
+// One bit per address of the whole 64KB address space
+static constexpr size_t ROM_ANALYSIS_BITMAP_WORDS = 0x10000 / 64;
+
+enum BasicBlockFlag {
+    // Ends calling a subroutine, the successors are the subroutine and the return address
+    BASIC_BLOCK_CALL = 1 << 0,
+    BASIC_BLOCK_RETURN = 1 << 1,
+
+    // Ends with BNNN, the target depends on a register
+    BASIC_BLOCK_INDIRECT = 1 << 2,
+    BASIC_BLOCK_EXIT = 1 << 3,
+
+    // Ends with a jump to itself or closing a loop that waits for the delay timer, the interpreter idles on it
+    BASIC_BLOCK_IDLE_LOOP = 1 << 4,
+
+    // A successor is outside of the ROM, like the interpreter area, so it wasn't followed
+    BASIC_BLOCK_EXTERNAL = 1 << 5,
+};
+
+/**
+ * @brief A run of instructions only entered through the first one and only left through the last one.
+ */
+struct BasicBlock {
+    uint16_t start;
+
+    // The address right after the last instruction
+    uint16_t end;
+
+    uint16_t successors[2];
+    uint8_t successor_count;
+
+    // Bitmask of `enum BasicBlockFlag`
+    uint8_t flags;
+};
+
+/**
+ * @brief What can be known about a ROM without running it, found by following every reachable instruction from the
+ *  entry point. It is a single block of memory without pointers, so it can be saved and mapped back as it is.
+ */
+struct RomAnalysis {
+    char magic[8];
+    uint32_t version;
+    uint32_t rom_size;
+    uint64_t rom_hash;
+
+    // `enum QuirkProfile` of the most extended platform whose instructions are reachable
+    uint32_t quirk_profile;
+
+    uint32_t instruction_count;
+    uint32_t idle_loop_count;
+    uint32_t block_count;
+
+    // The first byte of every reachable instruction
+    uint64_t instructions[ROM_ANALYSIS_BITMAP_WORDS];
+
+    // Bytes of reachable instructions, the rest of the ROM is data
+    uint64_t code[ROM_ANALYSIS_BITMAP_WORDS];
+
+    // Addresses loaded on I by ANNN or F000 NNNN, the sprites and tables of the ROM
+    uint64_t data[ROM_ANALYSIS_BITMAP_WORDS];
+
+    // The first instruction of every basic block
+    uint64_t leaders[ROM_ANALYSIS_BITMAP_WORDS];
+
+    // Jumps to themselves or closing a loop that waits for the delay timer
+    uint64_t idle_loops[ROM_ANALYSIS_BITMAP_WORDS];
+
+    // Sorted by their start
+    struct BasicBlock blocks[];
+};
+
+/**
+ * @brief Check a bit of one of the bitmaps of an analysis.
+ *
+ * @param bitmap The bitmap.
+ * @param address The address of the bit.
+ * @return If the bit is set.
+ */
+static inline bool test_analysis_bit(const uint64_t bitmap[ROM_ANALYSIS_BITMAP_WORDS], uint16_t address)
+{
+    return (bitmap[address / 64] >> (address % 64)) & 1;
+}
+
+uint64_t hash_rom(const uint8_t* rom, size_t size);
+
+size_t get_rom_analysis_size(const struct RomAnalysis* analysis);
+
+bool is_rom_analysis_valid(const struct RomAnalysis* analysis, size_t size);
+
+struct RomAnalysis* analyze_rom(const uint8_t* rom, size_t size);
+
+#endif
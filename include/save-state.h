@@ -3,7 +3,7 @@
 
 #include <stdint.h>
 
-#include "render.h"
+#include "screen.h"
 #include "virtual-machine.h"
 
 uint8_t save_state(struct VirtualMachine* vm, struct Screen* screen);
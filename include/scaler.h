@@ -0,0 +1,32 @@
+#ifndef OCH8S_SCALER_H
+#define OCH8S_SCALER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "screen.h"
+
+/**
+ * @brief The filters that can be used to upscale the screen before uploading it to the texture.
+ */
+enum Scaler {
+    SCALER_NONE,
+    SCALER_SCALE2X,
+    SCALER_SCALE3X,
+    SCALER_EPX,
+    SCALER_SCANLINES,
+};
+
+// The biggest factor that any of the scalers upscales the screen by
+static constexpr size_t SCALER_MAX_FACTOR = 4;
+
+uint8_t parse_scaler(const char* name, enum Scaler* scaler);
+
+const char* get_scaler_name(enum Scaler scaler);
+
+size_t get_scaler_factor(enum Scaler scaler);
+
+void scale_screen(const struct Screen* screen, enum Scaler scaler, const uint32_t palette[SCREEN_PALETTE_SIZE],
+    uint32_t* pixels, size_t pitch);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef OCH8S_SCREEN_H
+#define OCH8S_SCREEN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+static constexpr size_t SCREEN_LOW_RESOLUTION_WIDTH = 64;
+static constexpr size_t SCREEN_LOW_RESOLUTION_HEIGHT = 32;
+
+static constexpr size_t SCREEN_HIGH_RESOLUTION_WIDTH = 128;
+static constexpr size_t SCREEN_HIGH_RESOLUTION_HEIGHT = 64;
+
+// Each row of the buffer is packed as 64 bits words, the leftmost pixel being the most significant bit of the first word
+static constexpr size_t SCREEN_ROW_WORDS = SCREEN_HIGH_RESOLUTION_WIDTH / 64;
+
+// XO-CHIP bitplanes, the color of a pixel is the palette entry indexed by its bits on all the planes
+static constexpr size_t SCREEN_PLANES = 4;
+static constexpr size_t SCREEN_PALETTE_SIZE = 1 << SCREEN_PLANES;
+
+// ARGB colors of the pixels, indexed by the bits of the pixel on every plane (the first plane being the least
+// significant bit)
+static constexpr uint32_t SCREEN_PALETTE[SCREEN_PALETTE_SIZE] = {
+    0xFF000000, 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555,
+    0xFFFF0000, 0xFF00FF00, 0xFF0000FF, 0xFFFFFF00,
+    0xFF880000, 0xFF008800, 0xFF000088, 0xFF888800,
+    0xFFFF00FF, 0xFF00FFFF, 0xFF880088, 0xFF008888,
+};
+
+struct Screen {
+    size_t height;
+    size_t width;
+
+    bool high_resolution;
+
+    // Bitmask of the planes affected by the draw, clear and scroll operations
+    uint8_t selected_planes;
+
+    // Set when the buffer has changed since the last call to `draw_screen()`
+    bool dirty;
+
+    uint64_t buffer[SCREEN_PLANES][SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_ROW_WORDS];
+};
+
+void clear_screen(struct Screen* screen);
+
+void set_screen_resolution(struct Screen* screen, bool high_resolution);
+
+void scroll_screen_down(struct Screen* screen, size_t rows);
+
+void scroll_screen_up(struct Screen* screen, size_t rows);
+
+void scroll_screen_right(struct Screen* screen);
+
+void scroll_screen_left(struct Screen* screen);
+
+size_t draw_sprite(struct Screen* screen, const uint8_t* sprite, size_t sprite_height, size_t sprite_width, size_t x, size_t y, bool wrap);
+
+void get_screen_palette_indexes(const struct Screen* screen,
+    uint8_t indexes[SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_HIGH_RESOLUTION_WIDTH]);
+
+struct Screen* create_screen();
+
+void reset_screen(struct Screen* screen);
+
+void delete_screen(struct Screen* screen);
+
+#endif
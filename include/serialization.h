@@ -0,0 +1,17 @@
+#ifndef OCH8S_SERIALIZATION_H
+#define OCH8S_SERIALIZATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "screen.h"
+#include "virtual-machine.h"
+
+size_t get_state_size();
+
+uint8_t write_state(struct VirtualMachine* vm, struct Screen* screen, FILE* f);
+
+uint8_t read_state(struct VirtualMachine* vm, struct Screen* screen, FILE* f);
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef OCH8S_SHARED_SCREEN_H
+#define OCH8S_SHARED_SCREEN_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "screen.h"
+
+// "och8" read as a little endian number, identifies the shared memory regions exported by the emulator
+static constexpr uint32_t SHARED_SCREEN_MAGIC = 0x3868636F;
+
+// Incremented every time the layout of `struct SharedScreen` changes
+static constexpr uint32_t SHARED_SCREEN_VERSION = 1;
+
+/**
+ * @brief The state of the emulator published at the end of every frame. Only fixed size types are used so other
+ *  processes can read it.
+ */
+struct SharedScreenState {
+    // Number of frames emulated when the state was published
+    uint64_t frame;
+
+    uint8_t high_resolution;
+    uint8_t exited;
+
+    uint16_t pc;
+    uint16_t index_register;
+    uint8_t v_registers[16];
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+
+    // The same packing as `struct Screen`
+    uint64_t buffer[SCREEN_PLANES][SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_ROW_WORDS];
+};
+
+/**
+ * @brief The layout of the shared memory region. The state is protected by a sequence lock: the writer makes the
+ *  sequence odd while it updates the state, so a reader that sees the same even sequence before and after copying
+ *  it got a consistent state. The writer never waits for the readers.
+ */
+struct SharedScreen {
+    uint32_t magic;
+    uint32_t version;
+
+    _Atomic uint64_t sequence;
+
+    struct SharedScreenState state;
+};
+
+/**
+ * @brief The writer side of an exported shared screen.
+ */
+struct SharedScreenExport {
+    char* name;
+    int file_descriptor;
+    struct SharedScreen* shared;
+};
+
+/**
+ * @brief Copy a consistent state out of a shared screen, retrying while the writer is updating it.
+ *  It can be used by any number of readers at the same time.
+ *
+ * @param shared The mapped shared screen.
+ * @param state Where the state is copied.
+ * @return The number of times the copy had to be retried.
+ */
+static inline uint32_t read_shared_screen(const struct SharedScreen* shared, struct SharedScreenState* state)
+{
+    uint32_t retries = 0;
+
+    while (true) {
+        uint64_t before = atomic_load_explicit(&shared->sequence, memory_order_acquire);
+
+        if ((before & 1) == 0) {
+            memcpy(state, &shared->state, sizeof(struct SharedScreenState));
+            atomic_thread_fence(memory_order_acquire);
+
+            if (atomic_load_explicit(&shared->sequence, memory_order_relaxed) == before) {
+                return retries;
+            }
+        }
+
+        retries++;
+    }
+}
+
+struct VirtualMachine;
+
+struct SharedScreenExport* create_shared_screen(const char* name);
+
+void publish_shared_screen(struct SharedScreenExport* export, const struct VirtualMachine* vm,
+    const struct Screen* screen, uint64_t frame);
+
+void delete_shared_screen(struct SharedScreenExport* export);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef OCH8S_TERMINAL_H
+#define OCH8S_TERMINAL_H
+
+#include <stdint.h>
+#include <termios.h>
+
+#include "screen.h"
+#include "virtual-machine.h"
+
+enum TerminalCharset {
+    // Every cell is 1x2 pixels, the upper half block colored with the top pixel over the bottom pixel as background
+    TERMINAL_CHARSET_HALF_BLOCK,
+
+    // Every cell is 2x4 pixels drawn as braille dots, with a single color per cell
+    TERMINAL_CHARSET_BRAILLE,
+};
+
+// The most cells that a screen can take, a high resolution screen drawn with half blocks
+static constexpr size_t TERMINAL_MAX_ROWS = SCREEN_HIGH_RESOLUTION_HEIGHT / 2;
+static constexpr size_t TERMINAL_MAX_COLUMNS = SCREEN_HIGH_RESOLUTION_WIDTH;
+
+/**
+ * @brief Renders the screen to the terminal with ANSI escape sequences, only rewriting the cells that changed.
+ */
+struct Terminal {
+    enum TerminalCharset charset;
+
+    // The contents of every cell as drawn in the terminal, compared with the next frame to find what changed
+    uint16_t cells[TERMINAL_MAX_ROWS][TERMINAL_MAX_COLUMNS];
+
+    // Forces a full redraw on the next frame, set at the start and when the resolution changes
+    bool invalidated;
+    bool high_resolution;
+
+    // The palette indexes of the colors currently set on the terminal, or -1 when unknown, they are only sent when
+    // they change
+    int16_t foreground;
+    int16_t background;
+
+    // The escape sequences of a frame, sent with a single `write()`
+    char* output;
+    size_t output_length;
+
+    // Frames left until each key is released, terminals don't report when keys are released so the key repeat of
+    // the terminal keeps them pressed
+    uint8_t key_frames[16];
+
+    bool raw_input;
+    struct termios original_attributes;
+
+    uint64_t frames;
+    uint64_t written_bytes;
+};
+
+uint8_t parse_terminal_charset(const char* name, enum TerminalCharset* charset);
+
+struct Terminal* create_terminal(enum TerminalCharset charset);
+
+uint8_t draw_terminal(struct Terminal* terminal, const struct Screen* screen);
+
+bool poll_terminal_keys(struct Terminal* terminal, struct VirtualMachine* vm);
+
+void delete_terminal(struct Terminal* terminal);
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef OCH8S_TRACE_H
+#define OCH8S_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "frame-pacing.h"
+
+// Events kept per thread, the oldest ones are overwritten. It must be a power of two, at 60 frames per second it
+// holds the last few minutes.
+static constexpr size_t TRACE_BUFFER_EVENTS = 1 << 16;
+
+enum TraceThread {
+    TRACE_THREAD_WINDOW,
+    TRACE_THREAD_EMULATION,
+    TRACE_THREAD_AUDIO,
+    TRACE_THREADS,
+};
+
+/**
+ * @brief A phase that ran on a thread.
+ */
+struct TraceEvent {
+    // A string literal, only its address is stored
+    const char* name;
+
+    // Nanoseconds of the monotonic clock
+    uint64_t start;
+    uint64_t duration;
+};
+
+/**
+ * @brief The events of one thread. Only that thread writes to it, so no locking is needed.
+ */
+struct TraceBuffer {
+    struct TraceEvent* events;
+
+    // Events recorded since the start, the buffer keeps the last `TRACE_BUFFER_EVENTS` of them
+    uint64_t count;
+};
+
+struct Trace {
+    struct TraceBuffer buffers[TRACE_THREADS];
+    uint64_t start_time;
+};
+
+/**
+ * @brief Start timing a phase.
+ *
+ * @param buffer The buffer of the calling thread or NULL when not tracing.
+ * @return The start of the phase, to be given to `finish_trace_event()`.
+ */
+static inline uint64_t start_trace_event(const struct TraceBuffer* buffer)
+{
+    return buffer != NULL ? get_monotonic_timestamp() : 0;
+}
+
+/**
+ * @brief Record a phase that has just finished.
+ *
+ * @param buffer The buffer of the calling thread or NULL when not tracing.
+ * @param name The name of the phase, a string literal.
+ * @param start What `start_trace_event()` returned when the phase started.
+ */
+static inline void finish_trace_event(struct TraceBuffer* buffer, const char* name, uint64_t start)
+{
+    if (buffer == NULL) {
+        return;
+    }
+
+    struct TraceEvent* event = &buffer->events[buffer->count++ & (TRACE_BUFFER_EVENTS - 1)];
+
+    event->name = name;
+    event->start = start;
+    event->duration = get_monotonic_timestamp() - start;
+}
+
+struct Trace* create_trace();
+
+uint8_t write_trace(const struct Trace* trace, const char* path);
+
+void delete_trace(struct Trace* trace);
+
+#endif
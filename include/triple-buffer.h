@@ -0,0 +1,31 @@
+#ifndef OCH8S_TRIPLE_BUFFER_H
+#define OCH8S_TRIPLE_BUFFER_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "screen.h"
+
+/**
+ * @brief Lock-free exchange of finished screens between one writer and one reader thread.
+ *  The writer and the reader always own one frame each and swap it with the shared one, so none of them ever waits for the other.
+ */
+struct TripleBuffer {
+    struct Screen frames[3];
+
+    // Index of the frame currently shared, with `TRIPLE_BUFFER_NEW_FRAME` set when it was published and not yet acquired
+    _Atomic uint8_t shared;
+
+    uint8_t writing;
+    uint8_t reading;
+};
+
+static constexpr uint8_t TRIPLE_BUFFER_NEW_FRAME = 0x80;
+
+void init_triple_buffer(struct TripleBuffer* buffer);
+
+void publish_frame(struct TripleBuffer* buffer, const struct Screen* screen);
+
+const struct Screen* acquire_frame(struct TripleBuffer* buffer, bool* new_frame);
+
+#endif
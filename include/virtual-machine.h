@@ -1,12 +1,33 @@
 #ifndef OCH8S_VIRTUAL_MACHINE_H
 #define OCH8S_VIRTUAL_MACHINE_H
 
-#include <render.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include "quirks.h"
+#include "screen.h"
+
+struct Debugger;
+
+static constexpr uint16_t FONT_ADDRESS = 0x50;
+static constexpr uint16_t BIG_FONT_ADDRESS = 0xA0;
+
+// The address spaces are powers of two, every address is masked so it wraps around like on the hardware without any
+// bounds check
+static constexpr size_t MEMORY_SIZE = 0x1000;
+static constexpr size_t XO_CHIP_MEMORY_SIZE = 0x10000;
+
+// Always 0, the instruction patterns read from a masked address near the end run into it instead of the registers
+static constexpr size_t MEMORY_GUARD_SIZE = 8;
+
 struct VirtualMachine {
-    uint8_t memory[4098];
+    // Big enough for the XO-CHIP 64KB address space, only the first 4KB are used by the other platforms. It should
+    // only be accessed through `read_memory()` and `get_memory()`.
+    uint8_t memory[XO_CHIP_MEMORY_SIZE + MEMORY_GUARD_SIZE];
+
+    // One bit per address of the jumps that the analysis of the ROM found closing idle loops, see `seed_idle_loops()`
+    uint64_t idle_jumps[XO_CHIP_MEMORY_SIZE / 64];
 
     uint16_t pc;
     uint16_t pc_stack[200];
@@ -19,6 +40,37 @@ struct VirtualMachine {
     uint8_t sound_timer;
 
     int8_t wait_key;
+
+    // Bitmask of the keypad keys, they are updated from the window thread
+    _Atomic uint16_t pressed_keys;
+    _Atomic uint16_t released_keys;
+
+    // The SUPER-CHIP "RPL user flags", kept by the HP48 calculators between programs
+    uint8_t rpl_flags[16];
+
+    // State of the xorshift generator of CXNN, kept in the machine so a loaded state generates the same numbers
+    uint32_t random_state;
+
+    // Set when the program asks to exit the interpreter (00FD)
+    bool exited;
+
+    // Set when the program is waiting in a loop that can't end before the next frame (the delay timer or a key)
+    bool idle;
+
+    // Steps skipped because the program was idle
+    uint64_t idle_steps;
+
+    // The quirk profile of the loaded ROM
+    enum QuirkProfile quirk_profile;
+
+    // The size of the address space of the quirk profile minus 1
+    uint16_t address_mask;
+
+    // When not NULL the debugger of the machine, it swaps `run_cpu` for a debugged interpreter while anything is armed
+    struct Debugger* debugger;
+
+    // The interpreter specialized for the quirk profile of the ROM
+    uint8_t (*run_cpu)(struct VirtualMachine* vm, struct Screen* screen, size_t steps);
 };
 
 struct Opcode {
@@ -33,9 +85,62 @@ struct Opcode {
     uint16_t nibbles_2_3_4;
 };
 
-struct Opcode get_opcode(struct VirtualMachine* vm);
+/**
+ * @brief Split the two bytes of an opcode into its fields.
+ *
+ * @param byte_1 The first byte of the opcode, the one at the lowest address.
+ * @param byte_2 The second byte of the opcode.
+ * @return The parsed opcode info.
+ */
+static inline struct Opcode decode_opcode(uint8_t byte_1, uint8_t byte_2)
+{
+    return (struct Opcode) {
+        .nibble_1 = byte_1 >> 4,
+        .nibble_2 = byte_1 & 0x0F,
+        .byte_2 = byte_2,
+        .nibble_3 = byte_2 >> 4,
+        .nibble_4 = byte_2 & 0x0F,
+        .nibbles_2_3_4 = (byte_1 & 0x0F) << 8 | byte_2,
+    };
+}
+
+/**
+ * @brief Read a byte of the memory, the address wraps around the address space of the machine.
+ *
+ * @param vm The virtual machine to read from.
+ * @param address Any address, only its bits inside the address space are used.
+ * @return The byte.
+ */
+static inline uint8_t read_memory(const struct VirtualMachine* vm, size_t address)
+{
+    return vm->memory[address & vm->address_mask];
+}
+
+/**
+ * @brief Get a byte of the memory to be written, the address wraps around the address space of the machine.
+ *
+ * @param vm The virtual machine to write to.
+ * @param address Any address, only its bits inside the address space are used.
+ * @return The pointer to the byte.
+ */
+static inline uint8_t* get_memory(struct VirtualMachine* vm, size_t address)
+{
+    return &vm->memory[address & vm->address_mask];
+}
+
+struct Opcode get_opcode(const struct VirtualMachine* vm);
+
+struct VirtualMachine* create_virtual_machine(char* rom_path, enum QuirkProfile quirk_profile);
+
+uint8_t* read_rom_file(const char* rom_path, enum QuirkProfile quirk_profile, size_t* size);
+
+void load_rom(struct VirtualMachine* vm, const uint8_t* rom, size_t size, enum QuirkProfile quirk_profile);
+
+uint8_t reset_virtual_machine(struct VirtualMachine* vm, char* rom_path, enum QuirkProfile quirk_profile);
+
+void seed_idle_loops(struct VirtualMachine* vm, const uint64_t* idle_loops);
 
-struct VirtualMachine* create_virtual_machine(char* rom_path);
+void set_key_state(struct VirtualMachine* vm, uint8_t key, bool pressed);
 
 uint8_t step_cpu(struct VirtualMachine* vm, struct Screen* screen);
 
@@ -0,0 +1,81 @@
+#ifndef OCH8S_WALL_H
+#define OCH8S_WALL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "configuration.h"
+#include "frame-pacing.h"
+#include "metrics.h"
+#include "quirks.h"
+#include "screen.h"
+#include "triple-buffer.h"
+#include "virtual-machine.h"
+
+// Every instance plays on its own voice of the mixer
+static constexpr size_t WALL_MAX_INSTANCES = AUDIO_MIXER_VOICES;
+
+/**
+ * @brief A virtual machine running on a tile of the wall.
+ */
+struct WallInstance {
+    char* rom_path;
+    struct VirtualMachine* vm;
+
+    // Only touched by the emulation thread, the window thread gets its copies through `frames`
+    struct Screen* screen;
+    struct TripleBuffer frames;
+
+    // The settings of the section of its ROM, the keys are mapped with the ones of the focused instance
+    struct Configuration configuration;
+
+    // Accumulates the fractions of opcode left when the clock isn't a multiple of 60
+    uint32_t pending_opcodes;
+
+    // Set when the ROM exits or fails, its last frame stays on the wall until it is reset
+    bool stopped;
+
+    // Requested by the window thread, handled by the emulation thread between frames
+    _Atomic bool reset_requested;
+};
+
+/**
+ * @brief Many virtual machines run by a single emulation thread, each one for its slice of every frame, and drawn on
+ *  a grid of a single window.
+ */
+struct Wall {
+    struct WallInstance* instances;
+    size_t count;
+
+    size_t columns;
+    size_t rows;
+
+    // The mixer is only set up the first time any of the ROMs plays a sound
+    struct AudioMixer mixer;
+    bool audio_opened;
+    bool audio_ready;
+    uint16_t audio_buffer_samples;
+
+    // When not NULL the executed instructions and the emulated frames of all the instances are counted on it
+    struct Metrics* metrics;
+
+    // Set by any of the threads to stop both of them
+    _Atomic bool quit;
+    _Atomic bool failed;
+
+    struct FramePacer pacer;
+    uint64_t emulated_frames;
+    uint64_t instructions;
+};
+
+struct Wall* create_wall(char** rom_paths, size_t count, const char* configuration_path,
+    const enum QuirkProfile* given_quirk_profile);
+
+int run_wall(void* wall);
+
+void delete_wall(struct Wall* wall);
+
+#endif
@@ -0,0 +1,252 @@
+#define _DEFAULT_SOURCE
+
+#include <SDL2/SDL.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "analysis-cache.h"
+#include "logging.h"
+#include "rom-analysis.h"
+#include "virtual-machine.h"
+
+/**
+ * @brief Get the path of the cached analysis of a ROM, named after its hash in the preferences directory.
+ *
+ * @param rom_hash The hash of the content of the ROM.
+ * @return A pointer to the path or a NULL pointer if an error occurs. It should be `freed` after its use.
+ */
+static char* get_analysis_path(uint64_t rom_hash)
+{
+    char* pref_path = SDL_GetPrefPath("kutu-dev", "och8S");
+    if (pref_path == NULL) {
+        error("The preferences directory can't be found: %s", SDL_GetError());
+        return NULL;
+    }
+
+    char analysis_filename[] = "analysis-0123456789abcdef.bin";
+    snprintf(analysis_filename, sizeof(analysis_filename), "analysis-%016llx.bin", (unsigned long long)rom_hash);
+
+    char* analysis_path = malloc(strlen(pref_path) + strlen(analysis_filename) + 1);
+    if (analysis_path == NULL) {
+        error("Malloc 'analysis_path' failed");
+        SDL_free(pref_path);
+        return NULL;
+    }
+
+    strcpy(analysis_path, pref_path);
+    strcat(analysis_path, analysis_filename);
+
+    SDL_free(pref_path);
+
+    return analysis_path;
+}
+
+/**
+ * @brief Read the whole content of a ROM file.
+ *
+ * @param rom_path The path to the ROM.
+ * @param size Where the size of the ROM in bytes will be stored.
+ * @return The content or a NULL pointer if an error occurs. It should be `freed` after its use.
+ */
+static uint8_t* read_rom(const char* rom_path, size_t* size)
+{
+    // Not reported here, the virtual machine reports it when loading the ROM
+    FILE* rom = fopen(rom_path, "rb");
+    if (rom == NULL) {
+        return NULL;
+    }
+
+    fseek(rom, 0, SEEK_END);
+    long length = ftell(rom);
+    rewind(rom);
+
+    if (length < 0 || (size_t)length > XO_CHIP_MEMORY_SIZE) {
+        error("ROM size too big for the memory! Are you sure it is valid for this system?");
+        goto length_failed;
+    }
+
+    // Room for at least a byte, so an empty ROM isn't mistaken for a failed allocation
+    uint8_t* content = malloc((size_t)length + 1);
+    if (content == NULL) {
+        error("Malloc 'content' failed");
+        goto length_failed;
+    }
+
+    if (fread(content, sizeof(uint8_t), (size_t)length, rom) != (size_t)length) {
+        error("Reading rom failed!");
+        goto read_failed;
+    }
+
+    fclose(rom);
+
+    *size = (size_t)length;
+    return content;
+
+read_failed:
+    free(content);
+length_failed:
+    fclose(rom);
+
+    return NULL;
+}
+
+/**
+ * @brief Map the cached analysis of a ROM, if there is one for its content made by this version.
+ *
+ * @param analysis_path The path of the cache file.
+ * @param rom_hash The hash of the content of the ROM.
+ * @param rom_size The size of the ROM in bytes.
+ * @return The mapped analysis or a NULL pointer if there is no valid one.
+ */
+static const struct RomAnalysis* map_cached_analysis(const char* analysis_path, uint64_t rom_hash, size_t rom_size)
+{
+    int fd = open(analysis_path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) == -1 || (size_t)status.st_size < sizeof(struct RomAnalysis)) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)status.st_size;
+
+    // The mapping stays valid after closing the file
+    const struct RomAnalysis* analysis = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (analysis == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (!is_rom_analysis_valid(analysis, size) || analysis->rom_hash != rom_hash || analysis->rom_size != rom_size) {
+        warning("The cached analysis at '%s' is stale, the ROM will be analyzed again", analysis_path);
+        munmap((void*)analysis, size);
+        return NULL;
+    }
+
+    return analysis;
+}
+
+/**
+ * @brief Save an analysis to the cache, written to a temporary file first so a launch running at the same time never
+ *  maps a half written one.
+ *
+ * @param analysis_path The path of the cache file.
+ * @param analysis The analysis to save.
+ */
+static void save_analysis(const char* analysis_path, const struct RomAnalysis* analysis)
+{
+    char* temporary_path = malloc(strlen(analysis_path) + strlen(".tmp") + 1);
+    if (temporary_path == NULL) {
+        error("Malloc 'temporary_path' failed");
+        return;
+    }
+
+    strcpy(temporary_path, analysis_path);
+    strcat(temporary_path, ".tmp");
+
+    FILE* f = fopen(temporary_path, "wb");
+    if (f == NULL) {
+        warning("The analysis cache file can't be created, the ROM will be analyzed again on the next launch");
+        free(temporary_path);
+        return;
+    }
+
+    bool written = fwrite(analysis, get_rom_analysis_size(analysis), 1, f) == 1;
+    written = fclose(f) == 0 && written;
+
+    if (!written || rename(temporary_path, analysis_path) != 0) {
+        warning("Writing the analysis cache file failed, the ROM will be analyzed again on the next launch");
+        remove(temporary_path);
+    } else {
+        debug("ROM analysis saved to '%s'", analysis_path);
+    }
+
+    free(temporary_path);
+}
+
+/**
+ * @brief Get the analysis of a ROM, mapped from the cache when the ROM was already analyzed or made and cached
+ *  otherwise.
+ *
+ * @param rom_path The path to the ROM.
+ * @return The analysis or a NULL pointer if an error occurs. It should be freed using the function
+ *  `unload_rom_analysis()`.
+ */
+const struct RomAnalysis* load_rom_analysis(const char* rom_path)
+{
+    size_t rom_size;
+    uint8_t* rom = read_rom(rom_path, &rom_size);
+    if (rom == NULL) {
+        return NULL;
+    }
+
+    uint64_t rom_hash = hash_rom(rom, rom_size);
+
+    // Without a cache the analysis is still made, only not kept for the next launch
+    char* analysis_path = get_analysis_path(rom_hash);
+
+    if (analysis_path != NULL) {
+        const struct RomAnalysis* cached = map_cached_analysis(analysis_path, rom_hash, rom_size);
+
+        if (cached != NULL) {
+            debug("ROM analysis mapped from '%s'", analysis_path);
+            free(analysis_path);
+            free(rom);
+            return cached;
+        }
+    }
+
+    struct RomAnalysis* analysis = analyze_rom(rom, rom_size);
+    free(rom);
+
+    if (analysis == NULL) {
+        goto analysis_failed;
+    }
+
+    if (analysis_path != NULL) {
+        save_analysis(analysis_path, analysis);
+    }
+
+    // Copied to an anonymous mapping so it is unloaded the same way as a cached one
+    size_t size = get_rom_analysis_size(analysis);
+    void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mapped == MAP_FAILED) {
+        error("Mapping the ROM analysis failed");
+        goto map_failed;
+    }
+
+    memcpy(mapped, analysis, size);
+
+    free(analysis);
+    free(analysis_path);
+
+    return mapped;
+
+map_failed:
+    free(analysis);
+analysis_failed:
+    free(analysis_path);
+
+    return NULL;
+}
+
+/**
+ * @brief Safely unmap an analysis.
+ *
+ * @param analysis The analysis to be unmapped.
+ */
+void unload_rom_analysis(const struct RomAnalysis* analysis)
+{
+    munmap((void*)analysis, get_rom_analysis_size(analysis));
+}
@@ -1,59 +1,132 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_audio.h>
-#include <math.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "audio.h"
 #include "logging.h"
+#include "metrics.h"
+#include "trace.h"
 
-static constexpr double PI = 3.14159265358979323846;
+/**
+ * @brief What the audio callback updates.
+ */
+struct AudioCallbackData {
+    uint32_t* sample_counter;
+    struct Metrics* metrics;
+    struct TraceBuffer* trace;
+};
 
-static constexpr int SAMPLE_RATE = 44100;
+// The mixer sums the voices in chunks of this number of samples, so the sums of any buffer size fit on the stack
+static constexpr size_t AUDIO_MIXER_CHUNK_LENGTH = 256;
+
+// `SDL_OpenAudio()` only opens one device, so there is a single callback
+static struct AudioCallbackData callback_data;
 
 /**
  * @brief Callback called when the SDL audio buffer needs to be filled. It expects a buffer with format `AUDIO_S16SYS`.
  *
- * @param user_data Expected to be a `uint32_t` that tracks the progression of the shound
+ * @param user_data Expected to be the `struct AudioCallbackData` with the progression of the sound
  * @param raw_buffer The audio buffer to be filled.
  * @param bytes The size in bytes of the audio buffer.
  */
 void audio_callback(void* user_data, Uint8* raw_buffer, int bytes)
 {
     // The buffer is format with 16 bits
-    Uint16* buffer = (Uint16*)raw_buffer;
+    int16_t* buffer = (int16_t*)raw_buffer;
 
     // 2 bytes per sample for AUDIO_S16SYS
     int buffer_length = bytes / 2;
 
-    uint32_t* audio_sample_counter = (uint32_t*)user_data;
+    struct AudioCallbackData* data = user_data;
+    uint64_t start = start_trace_event(data->trace);
+
+    // The counter is reset while the sound is paused, so the time since the previous call isn't an underrun
+    if (data->metrics != NULL) {
+        record_audio_callback(data->metrics, (uint64_t)buffer_length * 1000000000 / AUDIO_SAMPLE_RATE,
+            *data->sample_counter == 0);
+    }
+
+    generate_beep(buffer, buffer_length, data->sample_counter);
+
+    finish_trace_event(data->trace, "audio callback", start);
+}
+
+/**
+ * @brief Callback of the audio mixer, it sums the beep of every playing voice on a buffer with format `AUDIO_S16SYS`.
+ *
+ * @param user_data Expected to be the `struct AudioMixer` with the voices.
+ * @param raw_buffer The audio buffer to be filled.
+ * @param bytes The size in bytes of the audio buffer.
+ */
+static void audio_mixer_callback(void* user_data, Uint8* raw_buffer, int bytes)
+{
+    int16_t* buffer = (int16_t*)raw_buffer;
+    size_t buffer_length = (size_t)bytes / 2;
+
+    struct AudioMixer* mixer = user_data;
+    uint64_t start = start_trace_event(mixer->trace);
+
+    if (mixer->metrics != NULL) {
+        record_audio_callback(mixer->metrics, (uint64_t)buffer_length * 1000000000 / AUDIO_SAMPLE_RATE, false);
+    }
+
+    for (size_t offset = 0; offset < buffer_length; offset += AUDIO_MIXER_CHUNK_LENGTH) {
+        size_t length = buffer_length - offset;
+        if (length > AUDIO_MIXER_CHUNK_LENGTH) {
+            length = AUDIO_MIXER_CHUNK_LENGTH;
+        }
+
+        int32_t sums[AUDIO_MIXER_CHUNK_LENGTH];
+        int16_t voice_samples[AUDIO_MIXER_CHUNK_LENGTH];
+        memset(sums, 0, sizeof(sums));
 
-    constexpr uint16_t amplitude = 2000;
-    constexpr uint16_t frequency = 440;
+        for (size_t voice = 0; voice < mixer->voice_count; voice++) {
+            if (!atomic_load_explicit(&mixer->playing[voice], memory_order_relaxed)) {
+                mixer->sample_counters[voice] = 0;
+                continue;
+            }
 
-    for (int i = 0; i < buffer_length; i++, (*audio_sample_counter)++) {
-        // Time pass inside the sample from 0 to 1.
-        double time = (double)(*audio_sample_counter) / (double)SAMPLE_RATE;
+            generate_beep(voice_samples, length, &mixer->sample_counters[voice]);
 
-        // Sinusoidal equation
-        buffer[i] = (Uint16)(amplitude * sin(2 * PI * frequency * time));
+            for (size_t i = 0; i < length; i++) {
+                sums[i] += voice_samples[i];
+            }
+        }
+
+        // Many beepers in phase go over the range of the samples, they are clipped
+        for (size_t i = 0; i < length; i++) {
+            buffer[offset + i] = (int16_t)(sums[i] > INT16_MAX ? INT16_MAX : sums[i] < INT16_MIN ? INT16_MIN : sums[i]);
+        }
     }
+
+    finish_trace_event(mixer->trace, "audio callback", start);
 }
 
 /**
  * @brief Setup the SDL audio to generate a beep sound when `SDL_Pause(0)` is called. At the end of the execution `SDL_CloseAudio()`should be called.
  *
  * @param audio_sample_counter Variable were the progression of the sound will be stored, it should last up to the moment when the `SDL_CloseAudio()` function is called. It's recommended to be put to 0 when calling `SDL_Pause(1)` to mitigate random audio cracking.
+ * @param buffer_samples The number of samples generated on each call of the callback, a power of two. Smaller buffers
+ *  lower the latency of the sound and raise the chances of an underrun.
+ * @param metrics Where the calls of the callback and the underruns are counted, or NULL.
+ * @param trace Where the calls of the callback are recorded, or NULL.
  */
-uint8_t setup_audio(uint32_t* audio_sample_counter)
+uint8_t setup_audio(uint32_t* audio_sample_counter, uint16_t buffer_samples, struct Metrics* metrics, struct TraceBuffer* trace)
 {
+    callback_data.sample_counter = audio_sample_counter;
+    callback_data.metrics = metrics;
+    callback_data.trace = trace;
+
     SDL_AudioSpec desired;
 
-    desired.freq = SAMPLE_RATE;
+    desired.freq = AUDIO_SAMPLE_RATE;
     desired.format = AUDIO_S16SYS;
     desired.channels = 1;
-    desired.samples = 2048;
+    desired.samples = buffer_samples;
     desired.callback = audio_callback;
-    desired.userdata = audio_sample_counter;
+    desired.userdata = &callback_data;
 
     SDL_AudioSpec obtained;
 
@@ -69,3 +142,53 @@ uint8_t setup_audio(uint32_t* audio_sample_counter)
 
     return 0;
 }
+
+/**
+ * @brief Setup the SDL audio to sum the beepers of many virtual machines, it starts playing right away with every
+ *  voice off. At the end of the execution `SDL_CloseAudio()` should be called.
+ *
+ * @param mixer The mixer to be set up, it should last up to the moment when the `SDL_CloseAudio()` function is called.
+ * @param voice_count The number of voices, up to `AUDIO_MIXER_VOICES`.
+ * @param buffer_samples The number of samples generated on each call of the callback, a power of two.
+ * @param metrics Where the calls of the callback are counted, or NULL.
+ * @param trace Where the calls of the callback are recorded, or NULL.
+ * @return Return 0 on success or another number on failure.
+ */
+uint8_t setup_audio_mixer(struct AudioMixer* mixer, size_t voice_count, uint16_t buffer_samples, struct Metrics* metrics,
+    struct TraceBuffer* trace)
+{
+    mixer->voice_count = voice_count;
+    mixer->metrics = metrics;
+    mixer->trace = trace;
+
+    for (size_t voice = 0; voice < AUDIO_MIXER_VOICES; voice++) {
+        atomic_init(&mixer->playing[voice], false);
+        mixer->sample_counters[voice] = 0;
+    }
+
+    SDL_AudioSpec desired;
+
+    desired.freq = AUDIO_SAMPLE_RATE;
+    desired.format = AUDIO_S16SYS;
+    desired.channels = 1;
+    desired.samples = buffer_samples;
+    desired.callback = audio_mixer_callback;
+    desired.userdata = mixer;
+
+    SDL_AudioSpec obtained;
+
+    if (SDL_OpenAudio(&desired, &obtained) != 0) {
+        error("Failed to open audio: %s", SDL_GetError());
+        return 1;
+    }
+
+    if (desired.format != obtained.format) {
+        error("Failed to get the desired AudioSpec format");
+        SDL_CloseAudio();
+        return 2;
+    }
+
+    SDL_PauseAudio(0);
+
+    return 0;
+}
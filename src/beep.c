@@ -0,0 +1,28 @@
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "beep.h"
+
+static constexpr double PI = 3.14159265358979323846;
+
+/**
+ * @brief Generate the samples of the beep sound.
+ *
+ * @param samples Where the samples are stored.
+ * @param length The number of samples to generate.
+ * @param sample_counter The progression of the sound, advanced by the number of samples generated.
+ */
+void generate_beep(int16_t* samples, size_t length, uint32_t* sample_counter)
+{
+    constexpr uint16_t amplitude = 2000;
+    constexpr uint16_t frequency = 440;
+
+    for (size_t i = 0; i < length; i++, (*sample_counter)++) {
+        // Time pass inside the sample from 0 to 1.
+        double time = (double)(*sample_counter) / (double)AUDIO_SAMPLE_RATE;
+
+        // Sinusoidal equation
+        samples[i] = (int16_t)(amplitude * sin(2 * PI * frequency * time));
+    }
+}
@@ -0,0 +1,667 @@
+#include <SDL2/SDL.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "beep.h"
+#include "capture.h"
+#include "logging.h"
+#include "screen.h"
+
+// The emulation always runs at 60 frames per second
+static constexpr uint32_t CAPTURE_FRAMES_PER_SECOND = 60;
+static constexpr size_t AUDIO_SAMPLES_PER_FRAME = AUDIO_SAMPLE_RATE / CAPTURE_FRAMES_PER_SECOND;
+
+static constexpr size_t WAV_HEADER_SIZE = 44;
+
+// The pixels are 4 bits palette indexes, so the LZW codes start at 5 bits
+static constexpr uint8_t GIF_MIN_CODE_SIZE = 4;
+static constexpr uint16_t GIF_CLEAR_CODE = 1 << GIF_MIN_CODE_SIZE;
+static constexpr uint16_t GIF_END_CODE = GIF_CLEAR_CODE + 1;
+static constexpr uint16_t GIF_MAX_CODE = 4095;
+
+/**
+ * @brief Write a 16 bits number in little endian.
+ *
+ * @param file The file to write to.
+ * @param value The number to be written.
+ */
+static void write_le16(FILE* file, uint16_t value)
+{
+    fputc(value & 0xFF, file);
+    fputc(value >> 8, file);
+}
+
+/**
+ * @brief Write a 32 bits number in little endian.
+ *
+ * @param file The file to write to.
+ * @param value The number to be written.
+ */
+static void write_le32(FILE* file, uint32_t value)
+{
+    write_le16(file, value & 0xFFFF);
+    write_le16(file, value >> 16);
+}
+
+/**
+ * @brief Write the header of a mono 16 bits PCM WAV file, the sizes are fixed by `finish_wav()`.
+ *
+ * @param file The file to write to.
+ */
+static void start_wav(FILE* file)
+{
+    fwrite("RIFF", 1, 4, file);
+    write_le32(file, 0);
+    fwrite("WAVEfmt ", 1, 8, file);
+    write_le32(file, 16);
+    write_le16(file, 1);
+    write_le16(file, 1);
+    write_le32(file, AUDIO_SAMPLE_RATE);
+    write_le32(file, AUDIO_SAMPLE_RATE * sizeof(int16_t));
+    write_le16(file, sizeof(int16_t));
+    write_le16(file, 16);
+    fwrite("data", 1, 4, file);
+    write_le32(file, 0);
+}
+
+/**
+ * @brief Fix the sizes of the header of a WAV file once all the samples have been written.
+ *
+ * @param file The file to write to.
+ * @param samples The number of samples written.
+ */
+static void finish_wav(FILE* file, uint64_t samples)
+{
+    uint32_t data_size = samples * sizeof(int16_t);
+
+    fseek(file, 4, SEEK_SET);
+    write_le32(file, WAV_HEADER_SIZE - 8 + data_size);
+    fseek(file, WAV_HEADER_SIZE - 4, SEEK_SET);
+    write_le32(file, data_size);
+}
+
+/**
+ * @brief Write the audio of one frame, the beep while the sound timer was on and silence otherwise.
+ *
+ * @param capture The capture to write to.
+ * @param sound If the beep was playing during the frame.
+ */
+static void write_audio_frame(struct Capture* capture, bool sound)
+{
+    int16_t samples[AUDIO_SAMPLES_PER_FRAME];
+
+    if (sound) {
+        generate_beep(samples, AUDIO_SAMPLES_PER_FRAME, &capture->audio_sample_counter);
+    } else {
+        memset(samples, 0, sizeof(samples));
+
+        // Restart the wave like the SDL audio does when it is paused
+        capture->audio_sample_counter = 0;
+    }
+
+    uint8_t bytes[sizeof(samples)];
+    for (size_t i = 0; i < AUDIO_SAMPLES_PER_FRAME; i++) {
+        bytes[i * 2] = (uint16_t)samples[i] & 0xFF;
+        bytes[i * 2 + 1] = (uint16_t)samples[i] >> 8;
+    }
+
+    fwrite(bytes, 1, sizeof(bytes), capture->audio);
+    capture->audio_samples += AUDIO_SAMPLES_PER_FRAME;
+}
+
+/**
+ * @brief Write the header of a YUV4MPEG2 stream, always at high resolution with full chroma so no color is lost.
+ *
+ * @param capture The capture to write to.
+ */
+static void start_y4m(struct Capture* capture)
+{
+    fprintf(capture->video, "YUV4MPEG2 W%zu H%zu F%u:1 Ip A1:1 C444\n", SCREEN_HIGH_RESOLUTION_WIDTH,
+        SCREEN_HIGH_RESOLUTION_HEIGHT, CAPTURE_FRAMES_PER_SECOND);
+
+    // BT.601 limited range, what the players assume for Y4M
+    for (size_t i = 0; i < SCREEN_PALETTE_SIZE; i++) {
+        int32_t red = (SCREEN_PALETTE[i] >> 16) & 0xFF;
+        int32_t green = (SCREEN_PALETTE[i] >> 8) & 0xFF;
+        int32_t blue = SCREEN_PALETTE[i] & 0xFF;
+
+        capture->y4m_palette[i][0] = ((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16;
+        capture->y4m_palette[i][1] = ((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128;
+        capture->y4m_palette[i][2] = ((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128;
+    }
+}
+
+/**
+ * @brief Write one frame to a YUV4MPEG2 stream.
+ *
+ * @param capture The capture to write to.
+ * @param indexes The palette index of every pixel of the frame.
+ */
+static void write_y4m_frame(struct Capture* capture,
+    const uint8_t indexes[SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_HIGH_RESOLUTION_WIDTH])
+{
+    uint8_t planes[3][SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_HIGH_RESOLUTION_WIDTH];
+
+    for (size_t y = 0; y < SCREEN_HIGH_RESOLUTION_HEIGHT; y++) {
+        for (size_t x = 0; x < SCREEN_HIGH_RESOLUTION_WIDTH; x++) {
+            for (size_t plane = 0; plane < 3; plane++) {
+                planes[plane][y][x] = capture->y4m_palette[indexes[y][x]][plane];
+            }
+        }
+    }
+
+    fputs("FRAME\n", capture->video);
+    fwrite(planes, 1, sizeof(planes), capture->video);
+}
+
+/**
+ * @brief Write the header of an endlessly looping GIF with the palette as its global color table.
+ *
+ * @param capture The capture to write to.
+ */
+static void start_gif(struct Capture* capture)
+{
+    FILE* file = capture->video;
+
+    fwrite("GIF89a", 1, 6, file);
+    write_le16(file, SCREEN_HIGH_RESOLUTION_WIDTH);
+    write_le16(file, SCREEN_HIGH_RESOLUTION_HEIGHT);
+
+    // Global color table of 2^(3 + 1) entries with 8 bits per channel
+    fputc(0xF3, file);
+    fputc(0, file);
+    fputc(0, file);
+
+    for (size_t i = 0; i < SCREEN_PALETTE_SIZE; i++) {
+        fputc((SCREEN_PALETTE[i] >> 16) & 0xFF, file);
+        fputc((SCREEN_PALETTE[i] >> 8) & 0xFF, file);
+        fputc(SCREEN_PALETTE[i] & 0xFF, file);
+    }
+
+    // NETSCAPE2.0 application extension, loop forever
+    fwrite("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 1, 19, file);
+
+    capture->gif->has_image = false;
+    capture->gif->frames = 0;
+    capture->gif->written_centiseconds = 0;
+}
+
+/**
+ * @brief Packs the variable length LZW codes in the data sub-blocks of a GIF image.
+ */
+struct GifBitWriter {
+    FILE* file;
+    uint32_t bits;
+    uint8_t bit_count;
+    uint8_t block[255];
+    uint8_t block_length;
+};
+
+/**
+ * @brief Append a code to the image data, writing every full sub-block.
+ *
+ * @param writer The writer of the image.
+ * @param code The code to append.
+ * @param code_size The number of bits of the code.
+ */
+static void write_gif_code(struct GifBitWriter* writer, uint16_t code, uint8_t code_size)
+{
+    writer->bits |= (uint32_t)code << writer->bit_count;
+    writer->bit_count += code_size;
+
+    while (writer->bit_count >= 8) {
+        writer->block[writer->block_length++] = writer->bits & 0xFF;
+        writer->bits >>= 8;
+        writer->bit_count -= 8;
+
+        if (writer->block_length == sizeof(writer->block)) {
+            fputc(writer->block_length, writer->file);
+            fwrite(writer->block, 1, writer->block_length, writer->file);
+            writer->block_length = 0;
+        }
+    }
+}
+
+/**
+ * @brief Write the pending image of the GIF encoder as a frame covering only the rectangle that changed.
+ *
+ * @param capture The capture to write to.
+ */
+static void write_gif_frame(struct Capture* capture)
+{
+    struct GifEncoder* gif = capture->gif;
+    FILE* file = capture->video;
+
+    // GIF delays are in hundredths of a second, the rounding error is carried to the next frame. Most players slow
+    // down delays under 2 so that is the minimum
+    uint64_t end = gif->frames * 100 / CAPTURE_FRAMES_PER_SECOND;
+    uint64_t delay = end > gif->written_centiseconds + 2 ? end - gif->written_centiseconds : 2;
+    gif->written_centiseconds += delay;
+
+    // Graphic control extension, the frame is left in place for the next one to draw over it
+    fwrite("\x21\xF9\x04\x04", 1, 4, file);
+    write_le16(file, delay);
+    fputc(0, file);
+    fputc(0, file);
+
+    fputc(0x2C, file);
+    write_le16(file, gif->left);
+    write_le16(file, gif->top);
+    write_le16(file, gif->right - gif->left);
+    write_le16(file, gif->bottom - gif->top);
+    fputc(0, file);
+
+    fputc(GIF_MIN_CODE_SIZE, file);
+
+    struct GifBitWriter writer = { .file = file };
+
+    memset(gif->codes, 0, sizeof(gif->codes));
+    uint8_t code_size = GIF_MIN_CODE_SIZE + 1;
+    uint16_t last_code = GIF_END_CODE;
+
+    write_gif_code(&writer, GIF_CLEAR_CODE, code_size);
+
+    uint16_t prefix = gif->image[gif->top][gif->left];
+    bool first = true;
+
+    for (size_t y = gif->top; y < gif->bottom; y++) {
+        for (size_t x = gif->left; x < gif->right; x++) {
+            if (first) {
+                first = false;
+                continue;
+            }
+
+            uint8_t pixel = gif->image[y][x];
+
+            if (gif->codes[prefix][pixel] != 0) {
+                prefix = gif->codes[prefix][pixel];
+                continue;
+            }
+
+            write_gif_code(&writer, prefix, code_size);
+
+            gif->codes[prefix][pixel] = ++last_code;
+            if (last_code >= (1 << code_size)) {
+                code_size++;
+            }
+
+            // The dictionary is full, start over
+            if (last_code == GIF_MAX_CODE) {
+                write_gif_code(&writer, GIF_CLEAR_CODE, code_size);
+                memset(gif->codes, 0, sizeof(gif->codes));
+                code_size = GIF_MIN_CODE_SIZE + 1;
+                last_code = GIF_END_CODE;
+            }
+
+            prefix = pixel;
+        }
+    }
+
+    write_gif_code(&writer, prefix, code_size);
+    write_gif_code(&writer, GIF_END_CODE, code_size);
+
+    // Flush the remaining bits and the last sub-block, followed by the empty block terminator
+    if (writer.bit_count > 0) {
+        write_gif_code(&writer, 0, 8 - writer.bit_count);
+    }
+
+    if (writer.block_length > 0) {
+        fputc(writer.block_length, file);
+        fwrite(writer.block, 1, writer.block_length, file);
+    }
+
+    fputc(0, file);
+}
+
+/**
+ * @brief Give a frame to the GIF encoder, it is merged with the previous frame when nothing changed.
+ *
+ * @param capture The capture to write to.
+ * @param indexes The palette index of every pixel of the frame.
+ */
+static void add_gif_frame(struct Capture* capture,
+    const uint8_t indexes[SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_HIGH_RESOLUTION_WIDTH])
+{
+    struct GifEncoder* gif = capture->gif;
+
+    if (!gif->has_image) {
+        memcpy(gif->image, indexes, sizeof(gif->image));
+        gif->has_image = true;
+
+        gif->left = 0;
+        gif->top = 0;
+        gif->right = SCREEN_HIGH_RESOLUTION_WIDTH;
+        gif->bottom = SCREEN_HIGH_RESOLUTION_HEIGHT;
+
+        gif->frames++;
+        return;
+    }
+
+    size_t left = SCREEN_HIGH_RESOLUTION_WIDTH;
+    size_t top = SCREEN_HIGH_RESOLUTION_HEIGHT;
+    size_t right = 0;
+    size_t bottom = 0;
+
+    for (size_t y = 0; y < SCREEN_HIGH_RESOLUTION_HEIGHT; y++) {
+        if (memcmp(gif->image[y], indexes[y], SCREEN_HIGH_RESOLUTION_WIDTH) == 0) {
+            continue;
+        }
+
+        top = y < top ? y : top;
+        bottom = y + 1;
+
+        for (size_t x = 0; x < SCREEN_HIGH_RESOLUTION_WIDTH; x++) {
+            if (gif->image[y][x] != indexes[y][x]) {
+                left = x < left ? x : left;
+                right = x + 1 > right ? x + 1 : right;
+            }
+        }
+    }
+
+    // Nothing changed, the pending frame just lasts longer
+    if (bottom == 0) {
+        gif->frames++;
+        return;
+    }
+
+    write_gif_frame(capture);
+
+    memcpy(gif->image, indexes, sizeof(gif->image));
+    gif->left = left;
+    gif->top = top;
+    gif->right = right;
+    gif->bottom = bottom;
+
+    gif->frames++;
+}
+
+/**
+ * @brief Write the pending frame and the trailer of the GIF.
+ *
+ * @param capture The capture to write to.
+ */
+static void finish_gif(struct Capture* capture)
+{
+    if (capture->gif->has_image) {
+        write_gif_frame(capture);
+    }
+
+    fputc(0x3B, capture->video);
+}
+
+/**
+ * @brief Encode a captured frame to the video and audio files.
+ *
+ * @param capture The capture to write to.
+ * @param frame The frame to be encoded.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t encode_frame(struct Capture* capture, const struct CaptureFrame* frame)
+{
+    if (capture->video != NULL) {
+        uint8_t indexes[SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_HIGH_RESOLUTION_WIDTH];
+        get_screen_palette_indexes(&frame->screen, indexes);
+
+        switch (capture->format) {
+        case CAPTURE_FORMAT_Y4M:
+            write_y4m_frame(capture, indexes);
+            break;
+        case CAPTURE_FORMAT_GIF:
+            add_gif_frame(capture, indexes);
+            break;
+        }
+
+        if (ferror(capture->video)) {
+            error("Couldn't write the captured video");
+            return 1;
+        }
+    }
+
+    if (capture->audio != NULL) {
+        write_audio_frame(capture, frame->sound);
+
+        if (ferror(capture->audio)) {
+            error("Couldn't write the captured audio");
+            return 2;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Encode the frames pushed to the ring until the capture is stopped. It is the entry point of the encoder
+ *  thread.
+ *
+ * @param data The `struct Capture` to encode.
+ * @return Return 0 on success or another number on failure.
+ */
+static int run_capture_encoder(void* data)
+{
+    struct Capture* capture = data;
+
+    while (true) {
+        SDL_SemWait(capture->pending);
+
+        size_t encoded = atomic_load_explicit(&capture->encoded, memory_order_relaxed);
+        size_t written = atomic_load_explicit(&capture->written, memory_order_acquire);
+
+        if (encoded == written) {
+            if (atomic_load(&capture->stopping)) {
+                break;
+            }
+
+            continue;
+        }
+
+        // After a failure the frames are still consumed so the emulation keeps running, they are just not written
+        if (capture->failed == 0) {
+            capture->failed = encode_frame(capture, &capture->ring[encoded % CAPTURE_RING_SIZE]);
+        }
+
+        atomic_store_explicit(&capture->encoded, encoded + 1, memory_order_release);
+    }
+
+    return capture->failed;
+}
+
+/**
+ * @brief Get the video format of a capture from the extension of its path.
+ *
+ * @param path The path of the video.
+ * @param format Where the format will be stored.
+ * @return Return 0 on success or another number if the extension isn't supported.
+ */
+static uint8_t get_capture_format(const char* path, enum CaptureFormat* format)
+{
+    const char* extension = strrchr(path, '.');
+    if (extension == NULL) {
+        return 1;
+    }
+
+    if (strcmp(extension, ".y4m") == 0) {
+        *format = CAPTURE_FORMAT_Y4M;
+        return 0;
+    }
+
+    if (strcmp(extension, ".gif") == 0) {
+        *format = CAPTURE_FORMAT_GIF;
+        return 0;
+    }
+
+    return 2;
+}
+
+/**
+ * @brief Start capturing the emulation, the encoding happens on its own thread.
+ *
+ * @param video_path Where to write the video, YUV4MPEG2 for `.y4m` files and an animated GIF for `.gif` files. It can
+ *  be NULL to only capture the audio.
+ * @param audio_path Where to write the audio as WAV. It can be NULL to only capture the video.
+ * @return The pointer to the capture or a NULL pointer if an error occurs.
+ *  The capture should be stopped and freed using the function `delete_capture()`.
+ */
+struct Capture* create_capture(const char* video_path, const char* audio_path)
+{
+    struct Capture* capture = calloc(1, sizeof(struct Capture));
+    if (capture == NULL) {
+        error("Malloc 'capture' failed");
+        return NULL;
+    }
+
+    capture->ring = malloc(CAPTURE_RING_SIZE * sizeof(struct CaptureFrame));
+    if (capture->ring == NULL) {
+        error("Malloc 'capture->ring' failed");
+        goto ring_failed;
+    }
+
+    if (video_path != NULL) {
+        if (get_capture_format(video_path, &capture->format) != 0) {
+            error("Unknown capture format of '%s', it should be .y4m or .gif", video_path);
+            goto video_failed;
+        }
+
+        if (capture->format == CAPTURE_FORMAT_GIF) {
+            capture->gif = malloc(sizeof(struct GifEncoder));
+            if (capture->gif == NULL) {
+                error("Malloc 'capture->gif' failed");
+                goto video_failed;
+            }
+        }
+
+        capture->video = fopen(video_path, "wb");
+        if (capture->video == NULL) {
+            error("Couldn't open the capture video '%s'", video_path);
+            goto video_failed;
+        }
+
+        switch (capture->format) {
+        case CAPTURE_FORMAT_Y4M:
+            start_y4m(capture);
+            break;
+        case CAPTURE_FORMAT_GIF:
+            start_gif(capture);
+            break;
+        }
+    }
+
+    if (audio_path != NULL) {
+        capture->audio = fopen(audio_path, "wb");
+        if (capture->audio == NULL) {
+            error("Couldn't open the capture audio '%s'", audio_path);
+            goto audio_failed;
+        }
+
+        start_wav(capture->audio);
+    }
+
+    atomic_init(&capture->written, 0);
+    atomic_init(&capture->encoded, 0);
+    atomic_init(&capture->dropped_frames, 0);
+    atomic_init(&capture->stopping, false);
+
+    capture->pending = SDL_CreateSemaphore(0);
+    if (capture->pending == NULL) {
+        error("Couldn't create the capture semaphore: %s", SDL_GetError());
+        goto semaphore_failed;
+    }
+
+    capture->thread = SDL_CreateThread(run_capture_encoder, "capture", capture);
+    if (capture->thread == NULL) {
+        error("Couldn't create the capture thread: %s", SDL_GetError());
+        goto thread_failed;
+    }
+
+    return capture;
+
+thread_failed:
+    SDL_DestroySemaphore(capture->pending);
+semaphore_failed:
+    if (capture->audio != NULL) {
+        fclose(capture->audio);
+    }
+audio_failed:
+    if (capture->video != NULL) {
+        fclose(capture->video);
+    }
+video_failed:
+    free(capture->gif);
+    free(capture->ring);
+ring_failed:
+    free(capture);
+
+    return NULL;
+}
+
+/**
+ * @brief Push a frame to be encoded. It never blocks, if the encoder is too far behind the frame is dropped.
+ *  Only the emulation thread should call it.
+ *
+ * @param capture The capture where the frame should be pushed.
+ * @param screen The screen at the end of the frame.
+ * @param sound If the beep was playing during the frame.
+ */
+void capture_frame(struct Capture* capture, const struct Screen* screen, bool sound)
+{
+    size_t written = atomic_load_explicit(&capture->written, memory_order_relaxed);
+    size_t encoded = atomic_load_explicit(&capture->encoded, memory_order_acquire);
+
+    if (written - encoded == CAPTURE_RING_SIZE) {
+        atomic_fetch_add_explicit(&capture->dropped_frames, 1, memory_order_relaxed);
+        return;
+    }
+
+    struct CaptureFrame* frame = &capture->ring[written % CAPTURE_RING_SIZE];
+    memcpy(&frame->screen, screen, sizeof(struct Screen));
+    frame->sound = sound;
+
+    atomic_store_explicit(&capture->written, written + 1, memory_order_release);
+    SDL_SemPost(capture->pending);
+}
+
+/**
+ * @brief Encode the frames left in the ring, finish the files and deallocate the capture.
+ *
+ * @param capture The capture to be deallocated.
+ * @return Return 0 on success or another number if the capture couldn't be fully written.
+ */
+uint8_t delete_capture(struct Capture* capture)
+{
+    atomic_store(&capture->stopping, true);
+    SDL_SemPost(capture->pending);
+
+    int failed;
+    SDL_WaitThread(capture->thread, &failed);
+    SDL_DestroySemaphore(capture->pending);
+
+    if (capture->video != NULL) {
+        if (capture->format == CAPTURE_FORMAT_GIF && failed == 0) {
+            finish_gif(capture);
+        }
+
+        if (fclose(capture->video) != 0) {
+            error("Couldn't close the captured video");
+            failed = 1;
+        }
+    }
+
+    if (capture->audio != NULL) {
+        finish_wav(capture->audio, capture->audio_samples);
+
+        if (fclose(capture->audio) != 0) {
+            error("Couldn't close the captured audio");
+            failed = 1;
+        }
+    }
+
+    info("Capture: %zu frames encoded, %lu dropped", atomic_load(&capture->encoded),
+        atomic_load(&capture->dropped_frames));
+
+    free(capture->gif);
+    free(capture->ring);
+    free(capture);
+
+    return failed != 0;
+}
@@ -0,0 +1,341 @@
+#include <SDL2/SDL.h>
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "configuration.h"
+#include "keys.h"
+#include "logging.h"
+#include "quirks.h"
+#include "scaler.h"
+
+static_assert(CONFIGURATION_SCANCODES == SDL_NUM_SCANCODES, "The scancode table must cover every SDL scancode");
+
+// The longest line of a configuration file, longer ones are reported
+static constexpr size_t CONFIGURATION_LINE_SIZE = 256;
+
+/**
+ * @brief Fill a configuration with the default settings.
+ *
+ * @param configuration The configuration to be filled.
+ */
+static void init_configuration(struct Configuration* configuration)
+{
+    configuration->opcodes_per_second = DEFAULT_OPCODES_PER_SECOND;
+    configuration->quirk_profile_set = false;
+    configuration->quirk_profile = QUIRK_PROFILE_COSMAC_VIP;
+    configuration->renderer[0] = '\0';
+    configuration->scaler = SCALER_NONE;
+    configuration->frame_skip = 0;
+    configuration->audio_buffer_samples = DEFAULT_AUDIO_BUFFER_SAMPLES;
+
+    for (uint8_t key = 0; key < 16; key++) {
+        configuration->keymap[key] = chip8_key_to_sdl_scancode[key];
+    }
+}
+
+/**
+ * @brief Parse a whole decimal number inside of a range.
+ *
+ * @param value The text of the number.
+ * @param min The lowest valid number.
+ * @param max The highest valid number.
+ * @param number Where the number will be stored.
+ * @return Return 0 on success or another number if it isn't a valid number.
+ */
+static uint8_t parse_number(const char* value, uint32_t min, uint32_t max, uint32_t* number)
+{
+    char* end;
+    errno = 0;
+    unsigned long parsed = strtoul(value, &end, 10);
+
+    if (errno != 0 || end == value || *end != '\0' || value[0] == '-' || parsed < min || parsed > max) {
+        return 1;
+    }
+
+    *number = (uint32_t)parsed;
+    return 0;
+}
+
+/**
+ * @brief Apply a single setting to a configuration.
+ *
+ * @param configuration The configuration to be updated.
+ * @param name The name of the setting.
+ * @param value The value of the setting.
+ * @return Return 0 on success, 1 if the setting is unknown or 2 if its value is invalid.
+ */
+static uint8_t apply_setting(struct Configuration* configuration, const char* name, const char* value)
+{
+    uint32_t number;
+
+    if (strcmp(name, "clock") == 0) {
+        if (parse_number(value, 1, UINT32_MAX / 60, &number) != 0) {
+            return 2;
+        }
+
+        configuration->opcodes_per_second = number;
+        return 0;
+    }
+
+    // Another way of setting the clock, what the ROM sees on each frame is easier to reason about for some games
+    if (strcmp(name, "instructions-per-frame") == 0) {
+        if (parse_number(value, 1, UINT32_MAX / 3600, &number) != 0) {
+            return 2;
+        }
+
+        configuration->opcodes_per_second = number * 60;
+        return 0;
+    }
+
+    if (strcmp(name, "quirks") == 0) {
+        if (parse_quirk_profile(value, &configuration->quirk_profile) != 0) {
+            return 2;
+        }
+
+        configuration->quirk_profile_set = true;
+        return 0;
+    }
+
+    if (strcmp(name, "renderer") == 0) {
+        if (strlen(value) >= sizeof(configuration->renderer)) {
+            return 2;
+        }
+
+        strcpy(configuration->renderer, value);
+        return 0;
+    }
+
+    if (strcmp(name, "scaler") == 0) {
+        return parse_scaler(value, &configuration->scaler) == 0 ? 0 : 2;
+    }
+
+    if (strcmp(name, "frame-skip") == 0) {
+        if (parse_number(value, 0, 59, &number) != 0) {
+            return 2;
+        }
+
+        configuration->frame_skip = number;
+        return 0;
+    }
+
+    if (strcmp(name, "audio-buffer") == 0) {
+        // SDL wants a power of two
+        if (parse_number(value, 64, 32768, &number) != 0 || (number & (number - 1)) != 0) {
+            return 2;
+        }
+
+        configuration->audio_buffer_samples = (uint16_t)number;
+        return 0;
+    }
+
+    // One setting per key, like `key.5 = Up`, the scancodes are named like SDL does
+    if (strncmp(name, "key.", 4) == 0 && isxdigit((unsigned char)name[4]) && name[5] == '\0') {
+        SDL_Scancode scancode = SDL_GetScancodeFromName(value);
+        if (scancode == SDL_SCANCODE_UNKNOWN) {
+            return 2;
+        }
+
+        configuration->keymap[strtoul(name + 4, NULL, 16)] = scancode;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Remove the spaces at both ends of a text.
+ *
+ * @param text The text, it is modified in place.
+ * @return The pointer to the first character that isn't a space.
+ */
+static char* trim(char* text)
+{
+    while (isspace((unsigned char)*text)) {
+        text++;
+    }
+
+    size_t length = strlen(text);
+    while (length > 0 && isspace((unsigned char)text[length - 1])) {
+        text[--length] = '\0';
+    }
+
+    return text;
+}
+
+/**
+ * @brief Check if the name of a section is the hash of the running ROM, as printed by the emulator.
+ */
+static bool is_rom_section(const char* section, uint64_t rom_hash)
+{
+    char* end;
+    unsigned long long hash = strtoull(section, &end, 16);
+
+    return end != section && *end == '\0' && hash == rom_hash;
+}
+
+/**
+ * @brief Apply the settings of a configuration file, either the ones before any section or the ones of the section of
+ *  the running ROM.
+ *
+ * @param configuration The configuration to be updated.
+ * @param file The configuration file, it is read from the start.
+ * @param path The path to the file, for the errors.
+ * @param rom_hash The hash of the content of the running ROM.
+ * @param rom_section If the settings of the section of the ROM are applied instead of the ones for every ROM.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t apply_configuration_file(struct Configuration* configuration, FILE* file, const char* path,
+    uint64_t rom_hash, bool rom_section)
+{
+    rewind(file);
+
+    char line[CONFIGURATION_LINE_SIZE];
+    size_t line_number = 0;
+
+    // The lines before the first section apply to every ROM
+    bool applying = !rom_section;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+
+        if (strchr(line, '\n') == NULL && !feof(file)) {
+            error("%s:%zu: the line is longer than %zu characters", path, line_number, CONFIGURATION_LINE_SIZE - 2);
+            return 1;
+        }
+
+        char* text = trim(line);
+
+        if (text[0] == '\0' || text[0] == '#' || text[0] == ';') {
+            continue;
+        }
+
+        if (text[0] == '[') {
+            char* close = strchr(text, ']');
+            if (close == NULL || close[1] != '\0') {
+                error("%s:%zu: the section isn't closed with ']'", path, line_number);
+                return 1;
+            }
+
+            *close = '\0';
+            applying = rom_section && is_rom_section(text + 1, rom_hash);
+            continue;
+        }
+
+        char* equals = strchr(text, '=');
+        if (equals == NULL) {
+            error("%s:%zu: expected a 'name = value' setting", path, line_number);
+            return 1;
+        }
+
+        *equals = '\0';
+        char* name = trim(text);
+        char* value = trim(equals + 1);
+
+        // Every section is checked, so a mistake in the section of another ROM is found too
+        struct Configuration ignored;
+        uint8_t result = apply_setting(applying ? configuration : &ignored, name, value);
+
+        if (result == 1) {
+            error("%s:%zu: unknown setting '%s'", path, line_number, name);
+            return 1;
+        }
+
+        if (result == 2) {
+            error("%s:%zu: invalid value '%s' for the setting '%s'", path, line_number, value, name);
+            return 1;
+        }
+    }
+
+    if (ferror(file) != 0) {
+        error("Reading the configuration file '%s' failed", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get the path of the default configuration file in the preferences directory.
+ *
+ * @return A pointer to the path or a NULL pointer if an error occurs. It should be `freed` after its use.
+ */
+static char* get_configuration_path()
+{
+    char* pref_path = SDL_GetPrefPath("kutu-dev", "och8S");
+    if (pref_path == NULL) {
+        return NULL;
+    }
+
+    const char* configuration_filename = "och8s.ini";
+
+    char* configuration_path = malloc(strlen(pref_path) + strlen(configuration_filename) + 1);
+
+    if (configuration_path != NULL) {
+        strcpy(configuration_path, pref_path);
+        strcat(configuration_path, configuration_filename);
+    }
+
+    SDL_free(pref_path);
+
+    return configuration_path;
+}
+
+/**
+ * @brief Load the configuration of a run: the defaults, then the settings for every ROM and then the ones of the
+ *  section named after the hash of the running ROM, like `[50d47cd02c7206d0]`.
+ *
+ * @param configuration Where the configuration will be stored.
+ * @param path The path to the configuration file or NULL for `och8s.ini` on the preferences directory, that may not
+ *  exist.
+ * @param rom_hash The hash of the content of the running ROM, as given by `hash_rom()`.
+ * @return Return 0 on success or another number on failure.
+ */
+uint8_t load_configuration(struct Configuration* configuration, const char* path, uint64_t rom_hash)
+{
+    init_configuration(configuration);
+
+    char* default_path = NULL;
+
+    if (path == NULL) {
+        default_path = get_configuration_path();
+        path = default_path;
+    }
+
+    FILE* file = path != NULL ? fopen(path, "r") : NULL;
+    uint8_t result = 0;
+
+    if (file == NULL) {
+        if (default_path == NULL) {
+            error("The configuration file '%s' is missing or access has been refused by permission configurations",
+                path);
+            result = 1;
+        }
+
+        goto file_missing;
+    }
+
+    debug("Loading the configuration from '%s'", path);
+
+    if (apply_configuration_file(configuration, file, path, rom_hash, false) != 0
+        || apply_configuration_file(configuration, file, path, rom_hash, true) != 0) {
+        result = 1;
+    }
+
+    fclose(file);
+
+file_missing:
+    free(default_path);
+
+    memset(configuration->scancode_keys, CONFIGURATION_UNMAPPED_KEY, sizeof(configuration->scancode_keys));
+
+    for (uint8_t key = 0; key < 16; key++) {
+        configuration->scancode_keys[configuration->keymap[key]] = key;
+    }
+
+    return result;
+}
@@ -0,0 +1,634 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debugger.h"
+#include "logging.h"
+#include "opcodes.h"
+#include "quirks.h"
+#include "virtual-machine.h"
+
+static const char* const comparison_operators[] = {
+    [DEBUGGER_EQUAL] = "==",
+    [DEBUGGER_NOT_EQUAL] = "!=",
+    [DEBUGGER_LESS] = "<",
+    [DEBUGGER_GREATER] = ">",
+};
+
+/**
+ * @brief Use the debugged interpreter only while anything can stop the CPU, so the rest of the time it runs at full
+ *  speed.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine whose interpreter is selected.
+ */
+static void update_interpreter(struct Debugger* debugger, struct VirtualMachine* vm)
+{
+    bool armed = debugger->breakpoint_count > 0 || debugger->watchpoint_count > 0 || debugger->stopped
+        || debugger->steps > 0 || debugger->traced;
+
+    vm->run_cpu = armed ? debugger->debugged_run_cpu : debugger->fast_run_cpu;
+}
+
+/**
+ * @brief Print the prompt of the console.
+ *
+ * @param debugger The debugger of the console.
+ */
+static void print_prompt(const struct Debugger* debugger)
+{
+    if (debugger->console) {
+        printf("(och8s) ");
+        fflush(stdout);
+    }
+}
+
+/**
+ * @brief Print the registers, the timers and the stack of the virtual machine.
+ *
+ * @param vm The virtual machine to inspect.
+ */
+static void print_registers(const struct VirtualMachine* vm)
+{
+    printf("PC %#05x (%02X%02X) I %#05x DT %02X ST %02X\n", vm->pc, read_memory(vm, vm->pc), read_memory(vm, vm->pc + 1),
+        vm->index_register, vm->delay_timer, vm->sound_timer);
+
+    for (size_t i = 0; i < 16; i++) {
+        printf("V%zX %02X%s", i, vm->v_registers[i], i == 15 ? "\n" : " ");
+    }
+
+    printf("Stack:");
+
+    for (size_t i = 0; i < vm->pc_stack_index; i++) {
+        printf(" %#05x", vm->pc_stack[i]);
+    }
+
+    printf("%s\n", vm->pc_stack_index == 0 ? " empty" : "");
+}
+
+/**
+ * @brief Print the memory as hexadecimal bytes, 16 per line.
+ *
+ * @param vm The virtual machine to get the memory from.
+ * @param address The first address.
+ * @param length The number of bytes.
+ */
+static void print_memory(const struct VirtualMachine* vm, uint16_t address, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        uint16_t current = address + i;
+
+        if (i % 16 == 0) {
+            printf("%s%#06x:", i == 0 ? "" : "\n", current);
+        }
+
+        printf(" %02X", read_memory(vm, current));
+    }
+
+    printf("\n");
+}
+
+/**
+ * @brief Print a breakpoint and its condition.
+ *
+ * @param breakpoint The breakpoint to print.
+ */
+static void print_breakpoint(const struct Breakpoint* breakpoint)
+{
+    printf("Breakpoint at %#05x", breakpoint->address);
+
+    if (breakpoint->register_index == DEBUGGER_INDEX_REGISTER) {
+        printf(" if I %s %X", comparison_operators[breakpoint->comparison], breakpoint->value);
+    } else if (breakpoint->register_index != DEBUGGER_NO_CONDITION) {
+        printf(" if V%X %s %X", breakpoint->register_index, comparison_operators[breakpoint->comparison],
+            breakpoint->value);
+    }
+
+    printf("\n");
+}
+
+/**
+ * @brief Check the condition of a breakpoint.
+ *
+ * @param breakpoint The breakpoint to check.
+ * @param vm The virtual machine to get the registers from.
+ * @return If the CPU should stop.
+ */
+static bool check_condition(const struct Breakpoint* breakpoint, const struct VirtualMachine* vm)
+{
+    if (breakpoint->register_index == DEBUGGER_NO_CONDITION) {
+        return true;
+    }
+
+    uint16_t value = breakpoint->register_index == DEBUGGER_INDEX_REGISTER
+        ? vm->index_register
+        : vm->v_registers[breakpoint->register_index];
+
+    switch (breakpoint->comparison) {
+    case DEBUGGER_EQUAL:
+        return value == breakpoint->value;
+    case DEBUGGER_NOT_EQUAL:
+        return value != breakpoint->value;
+    case DEBUGGER_LESS:
+        return value < breakpoint->value;
+    case DEBUGGER_GREATER:
+        return value > breakpoint->value;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Find a breakpoint at the PC whose condition holds.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine about to run the instruction at its PC.
+ * @return The first breakpoint found or a NULL pointer if the CPU shouldn't stop.
+ */
+const struct Breakpoint* find_breakpoint(const struct Debugger* debugger, const struct VirtualMachine* vm)
+{
+    for (size_t i = 0; i < debugger->breakpoint_count; i++) {
+        const struct Breakpoint* breakpoint = &debugger->breakpoints[i];
+
+        if (breakpoint->address == vm->pc && check_condition(breakpoint, vm)) {
+            return breakpoint;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Called by the CPU before running an instruction with a breakpoint at its address, it stops the CPU if the
+ *  condition of any of the breakpoints holds.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine about to run the instruction.
+ * @return If the CPU was stopped.
+ */
+bool hit_breakpoint(struct Debugger* debugger, struct VirtualMachine* vm)
+{
+    const struct Breakpoint* breakpoint = find_breakpoint(debugger, vm);
+    if (breakpoint == NULL) {
+        return false;
+    }
+
+    if (debugger->console) {
+        printf("\n");
+        print_breakpoint(breakpoint);
+        print_registers(vm);
+    }
+
+    stop_debugger(debugger, vm, DEBUGGER_STOP_BREAKPOINT);
+    return true;
+}
+
+/**
+ * @brief Called by the CPU when an instruction writes to a watched address, the CPU stops after the instruction.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine that wrote the memory.
+ * @param address The watched address.
+ */
+void hit_watchpoint(struct Debugger* debugger, struct VirtualMachine* vm, uint16_t address)
+{
+    if (debugger->console) {
+        // The PC already points to the next instruction
+        printf("\nWatchpoint at %#06x written with %02X by the instruction at %#05x\n", address, vm->memory[address],
+            (uint16_t)(vm->pc - 2));
+        print_registers(vm);
+    }
+
+    debugger->watched_address = address;
+    stop_debugger(debugger, vm, DEBUGGER_STOP_WATCHPOINT);
+}
+
+/**
+ * @brief Called by the CPU after the last instruction of a step command.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine that was stepped.
+ */
+void finish_step(struct Debugger* debugger, struct VirtualMachine* vm)
+{
+    if (debugger->console) {
+        print_registers(vm);
+    }
+
+    stop_debugger(debugger, vm, DEBUGGER_STOP_STEP);
+}
+
+/**
+ * @brief Pick the debugged interpreter of a quirk profile.
+ *
+ * @param debugger The debugger whose debugged interpreter is picked.
+ * @param quirk_profile The quirk profile of the virtual machine.
+ */
+static void set_debugged_interpreter(struct Debugger* debugger, enum QuirkProfile quirk_profile)
+{
+    switch (quirk_profile) {
+    case QUIRK_PROFILE_COSMAC_VIP:
+        debugger->debugged_run_cpu = run_cpu_cosmac_vip_debugged;
+        break;
+    case QUIRK_PROFILE_SCHIP_LEGACY:
+        debugger->debugged_run_cpu = run_cpu_schip_legacy_debugged;
+        break;
+    case QUIRK_PROFILE_SCHIP_MODERN:
+        debugger->debugged_run_cpu = run_cpu_schip_modern_debugged;
+        break;
+    case QUIRK_PROFILE_XO_CHIP:
+        debugger->debugged_run_cpu = run_cpu_xo_chip_debugged;
+        break;
+    }
+}
+
+/**
+ * @brief Create a debugger for a virtual machine, with nothing armed. It runs until a breakpoint or watchpoint is
+ *  added or it is stopped.
+ *
+ * @param vm The virtual machine to debug.
+ * @param quirk_profile The quirk profile of the virtual machine, to pick its debugged interpreter.
+ * @return The pointer to the debugger or a NULL pointer if an error occurs.
+ *  The debugger should be freed using the function `delete_debugger()`.
+ */
+struct Debugger* create_debugger(struct VirtualMachine* vm, enum QuirkProfile quirk_profile)
+{
+    struct Debugger* debugger = calloc(1, sizeof(struct Debugger));
+    if (debugger == NULL) {
+        error("Malloc 'debugger' failed");
+        return NULL;
+    }
+
+    debugger->fast_run_cpu = vm->run_cpu;
+    set_debugged_interpreter(debugger, quirk_profile);
+
+    debugger->console = true;
+    vm->debugger = debugger;
+
+    return debugger;
+}
+
+/**
+ * @brief Switch the interpreters of the debugger to another quirk profile, when the virtual machine is reset with
+ *  another ROM. The breakpoints and watchpoints are kept.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine being debugged.
+ * @param fast_run_cpu The interpreter of the new quirk profile.
+ * @param quirk_profile The new quirk profile, to pick its debugged interpreter.
+ */
+void retarget_debugger(struct Debugger* debugger, struct VirtualMachine* vm,
+    uint8_t (*fast_run_cpu)(struct VirtualMachine* vm, struct Screen* screen, size_t steps),
+    enum QuirkProfile quirk_profile)
+{
+    debugger->fast_run_cpu = fast_run_cpu;
+    set_debugged_interpreter(debugger, quirk_profile);
+
+    update_interpreter(debugger, vm);
+}
+
+/**
+ * @brief Add a breakpoint, many of them can be at the same address with different conditions.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine being debugged.
+ * @param breakpoint The breakpoint to add.
+ * @return Return 0 on success or another number on failure.
+ */
+uint8_t add_breakpoint(struct Debugger* debugger, struct VirtualMachine* vm, struct Breakpoint breakpoint)
+{
+    if (debugger->breakpoint_count == DEBUGGER_MAX_BREAKPOINTS) {
+        error("Only %zu breakpoints can be added", DEBUGGER_MAX_BREAKPOINTS);
+        return 1;
+    }
+
+    debugger->breakpoints[debugger->breakpoint_count++] = breakpoint;
+    debugger->breakpoint_addresses[breakpoint.address / 64] |= (uint64_t)1 << (breakpoint.address % 64);
+
+    update_interpreter(debugger, vm);
+
+    return 0;
+}
+
+/**
+ * @brief Remove all the breakpoints at an address.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine being debugged.
+ * @param address The address of the breakpoints.
+ */
+void remove_breakpoints(struct Debugger* debugger, struct VirtualMachine* vm, uint16_t address)
+{
+    size_t kept = 0;
+
+    for (size_t i = 0; i < debugger->breakpoint_count; i++) {
+        if (debugger->breakpoints[i].address != address) {
+            debugger->breakpoints[kept++] = debugger->breakpoints[i];
+        }
+    }
+
+    debugger->breakpoint_count = kept;
+    debugger->breakpoint_addresses[address / 64] &= ~((uint64_t)1 << (address % 64));
+
+    update_interpreter(debugger, vm);
+}
+
+/**
+ * @brief Remove all the breakpoints and watchpoints.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine being debugged.
+ */
+void remove_all_breakpoints(struct Debugger* debugger, struct VirtualMachine* vm)
+{
+    memset(debugger->breakpoint_addresses, 0, sizeof(debugger->breakpoint_addresses));
+    memset(debugger->watchpoint_addresses, 0, sizeof(debugger->watchpoint_addresses));
+    debugger->breakpoint_count = 0;
+    debugger->watchpoint_count = 0;
+
+    update_interpreter(debugger, vm);
+}
+
+/**
+ * @brief Watch or stop watching the writes to a range of memory.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine being debugged.
+ * @param address The first address of the range.
+ * @param length The number of bytes of the range.
+ * @param watched If the range is watched.
+ */
+void set_watchpoints(struct Debugger* debugger, struct VirtualMachine* vm, uint16_t address, size_t length,
+    bool watched)
+{
+    for (size_t i = 0; i < length; i++) {
+        uint16_t current = address + i;
+        uint64_t bit = (uint64_t)1 << (current % 64);
+
+        if (is_watchpoint(debugger, current) == watched) {
+            continue;
+        }
+
+        debugger->watchpoint_addresses[current / 64] ^= bit;
+        debugger->watchpoint_count += watched ? 1 : -1;
+    }
+
+    update_interpreter(debugger, vm);
+}
+
+/**
+ * @brief Stop the CPU before the next instruction.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine being debugged.
+ * @param reason Why the CPU stopped, reported to the GDB clients.
+ */
+void stop_debugger(struct Debugger* debugger, struct VirtualMachine* vm, enum DebuggerStopReason reason)
+{
+    debugger->stopped = true;
+    debugger->stop_reason = reason;
+    debugger->steps = 0;
+
+    // The instruction the CPU stopped at has already been reported, so a breakpoint on it doesn't stop it again
+    debugger->resuming = true;
+
+    update_interpreter(debugger, vm);
+    print_prompt(debugger);
+}
+
+/**
+ * @brief Run the CPU again.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine being debugged.
+ * @param steps The instructions to run before stopping again or 0 to run until something stops it.
+ */
+void resume_debugger(struct Debugger* debugger, struct VirtualMachine* vm, uint64_t steps)
+{
+    debugger->stopped = false;
+    debugger->steps = steps;
+
+    update_interpreter(debugger, vm);
+}
+
+/**
+ * @brief Parse a condition like `v3==1F`, `vA<10` or `i!=300`, all the numbers being hexadecimal.
+ *
+ * @param text The condition.
+ * @param breakpoint The breakpoint where the condition is stored.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t parse_condition(const char* text, struct Breakpoint* breakpoint)
+{
+    char* end;
+
+    if (text[0] == 'v' || text[0] == 'V') {
+        breakpoint->register_index = strtol(text + 1, &end, 16);
+
+        if (end != text + 2 || breakpoint->register_index > 0xF) {
+            return 1;
+        }
+    } else if (text[0] == 'i' || text[0] == 'I') {
+        breakpoint->register_index = DEBUGGER_INDEX_REGISTER;
+        end = (char*)text + 1;
+    } else {
+        return 2;
+    }
+
+    size_t comparison = 0;
+    for (; comparison < sizeof(comparison_operators) / sizeof(comparison_operators[0]); comparison++) {
+        size_t length = strlen(comparison_operators[comparison]);
+
+        if (strncmp(end, comparison_operators[comparison], length) == 0) {
+            end += length;
+            break;
+        }
+    }
+
+    if (comparison == sizeof(comparison_operators) / sizeof(comparison_operators[0]) || *end == '\0') {
+        return 3;
+    }
+
+    breakpoint->comparison = (enum DebuggerComparison)comparison;
+    breakpoint->value = strtoul(end, &end, 16);
+
+    return *end == '\0' ? 0 : 4;
+}
+
+/**
+ * @brief Print the breakpoints and the watched ranges.
+ *
+ * @param debugger The debugger to list.
+ */
+static void print_armed(const struct Debugger* debugger)
+{
+    for (size_t i = 0; i < debugger->breakpoint_count; i++) {
+        print_breakpoint(&debugger->breakpoints[i]);
+    }
+
+    for (size_t address = 0; address < 0x10000; address++) {
+        if (!is_watchpoint(debugger, address)) {
+            continue;
+        }
+
+        size_t end = address;
+        while (end + 1 < 0x10000 && is_watchpoint(debugger, end + 1)) {
+            end++;
+        }
+
+        printf("Watchpoint at %#06zx-%#06zx\n", address, end);
+        address = end;
+    }
+
+    if (debugger->breakpoint_count == 0 && debugger->watchpoint_count == 0) {
+        printf("Nothing armed\n");
+    }
+}
+
+/**
+ * @brief Print the commands of the console.
+ */
+static void print_commands()
+{
+    puts("All the numbers are hexadecimal.");
+    puts("  c                    Continue");
+    puts("  s [count]            Run one or the given number of instructions");
+    puts("  p                    Stop the CPU");
+    puts("  i                    Inspect the registers and the stack");
+    puts("  m <address> [length] Print the memory");
+    puts("  b <address> [cond]   Add a breakpoint, optionally with a condition like v3==1F, vA<10, vF!=0 or i>300");
+    puts("  db <address>         Delete the breakpoints at an address");
+    puts("  w <address> [length] Stop after any write to the memory range (FX33 and FX55)");
+    puts("  dw <address> [length] Stop watching the memory range");
+    puts("  l                    List the breakpoints and the watchpoints");
+    puts("  h                    Show this help");
+}
+
+/**
+ * @brief Run a command of the console.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine being debugged.
+ * @param line The command and its arguments.
+ */
+static void run_command(struct Debugger* debugger, struct VirtualMachine* vm, char* line)
+{
+    char* save;
+    char* command = strtok_r(line, " \t", &save);
+    char* argument_1 = strtok_r(NULL, " \t", &save);
+    char* argument_2 = strtok_r(NULL, " \t", &save);
+
+    if (command == NULL) {
+        print_prompt(debugger);
+        return;
+    }
+
+    // The commands that need an address
+    bool needs_address = strcmp(command, "m") == 0 || strcmp(command, "b") == 0 || strcmp(command, "db") == 0
+        || strcmp(command, "w") == 0 || strcmp(command, "dw") == 0;
+
+    uint16_t address = argument_1 != NULL ? strtoul(argument_1, NULL, 16) : 0;
+    size_t length = argument_2 != NULL ? strtoul(argument_2, NULL, 16) : 1;
+
+    if (needs_address && argument_1 == NULL) {
+        printf("The command '%s' needs an address\n", command);
+    } else if (strcmp(command, "c") == 0) {
+        resume_debugger(debugger, vm, 0);
+        return;
+    } else if (strcmp(command, "s") == 0) {
+        uint64_t steps = argument_1 != NULL ? strtoull(argument_1, NULL, 16) : 1;
+        resume_debugger(debugger, vm, steps != 0 ? steps : 1);
+        return;
+    } else if (strcmp(command, "p") == 0) {
+        print_registers(vm);
+        stop_debugger(debugger, vm, DEBUGGER_STOP_PAUSE);
+        return;
+    } else if (strcmp(command, "i") == 0) {
+        print_registers(vm);
+    } else if (strcmp(command, "m") == 0) {
+        print_memory(vm, address, argument_2 != NULL ? length : 0x40);
+    } else if (strcmp(command, "b") == 0) {
+        struct Breakpoint breakpoint = { address, DEBUGGER_NO_CONDITION, DEBUGGER_EQUAL, 0 };
+
+        if (argument_2 != NULL && parse_condition(argument_2, &breakpoint) != 0) {
+            printf("Invalid condition '%s'\n", argument_2);
+        } else if (add_breakpoint(debugger, vm, breakpoint) == 0) {
+            print_breakpoint(&breakpoint);
+        }
+    } else if (strcmp(command, "db") == 0) {
+        remove_breakpoints(debugger, vm, address);
+    } else if (strcmp(command, "w") == 0) {
+        set_watchpoints(debugger, vm, address, length, true);
+    } else if (strcmp(command, "dw") == 0) {
+        set_watchpoints(debugger, vm, address, length, false);
+    } else if (strcmp(command, "l") == 0) {
+        print_armed(debugger);
+    } else if (strcmp(command, "h") == 0) {
+        print_commands();
+    } else {
+        printf("Unknown command '%s', type h for help\n", command);
+    }
+
+    print_prompt(debugger);
+}
+
+/**
+ * @brief Run the commands typed on the console since the last call, without waiting for new ones. It should be called
+ *  between the runs of the CPU, from the thread running it.
+ *
+ * @param debugger The debugger of the virtual machine.
+ * @param vm The virtual machine being debugged.
+ */
+void poll_debugger_console(struct Debugger* debugger, struct VirtualMachine* vm)
+{
+    struct pollfd input = { STDIN_FILENO, POLLIN, 0 };
+
+    while (debugger->console && poll(&input, 1, 0) > 0) {
+        ssize_t count = read(STDIN_FILENO, debugger->line + debugger->line_length,
+            sizeof(debugger->line) - 1 - debugger->line_length);
+
+        if (count <= 0) {
+            warning("The debugger console was closed");
+            debugger->console = false;
+            break;
+        }
+
+        debugger->line_length += count;
+
+        // Run every complete line, a partial one waits for the rest
+        char* newline;
+        while ((newline = memchr(debugger->line, '\n', debugger->line_length)) != NULL) {
+            *newline = '\0';
+            size_t line_length = newline - debugger->line + 1;
+
+            run_command(debugger, vm, debugger->line);
+
+            memmove(debugger->line, debugger->line + line_length, debugger->line_length - line_length);
+            debugger->line_length -= line_length;
+        }
+
+        // A line longer than the buffer is dropped
+        if (debugger->line_length == sizeof(debugger->line) - 1) {
+            debugger->line_length = 0;
+        }
+    }
+}
+
+/**
+ * @brief Remove the debugger from a virtual machine, going back to its fast interpreter.
+ *
+ * @param debugger The debugger to be deallocated.
+ * @param vm The virtual machine being debugged.
+ */
+void delete_debugger(struct Debugger* debugger, struct VirtualMachine* vm)
+{
+    vm->run_cpu = debugger->fast_run_cpu;
+    vm->debugger = NULL;
+
+    free(debugger);
+}
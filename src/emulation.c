@@ -0,0 +1,415 @@
+#include <SDL2/SDL.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio.h"
+#include "capture.h"
+#include "configuration.h"
+#include "debugger.h"
+#include "emulation.h"
+#include "frame-pacing.h"
+#include "gdb-stub.h"
+#include "latency-probe.h"
+#include "logging.h"
+#include "metrics.h"
+#include "perf-counters.h"
+#include "rom-analysis.h"
+#include "save-state.h"
+#include "screen.h"
+#include "shared-screen.h"
+#include "trace.h"
+#include "triple-buffer.h"
+#include "virtual-machine.h"
+
+/**
+ * @brief Prepare the shared state of the emulation with the default settings.
+ *
+ * @param emulation The emulation to be prepared.
+ * @param vm The virtual machine to be run.
+ * @param screen The screen of the virtual machine.
+ * @param audio_sample_counter The progression of the sound, as given to `setup_audio()`.
+ */
+void init_emulation(struct Emulation* emulation, struct VirtualMachine* vm, struct Screen* screen, uint32_t* audio_sample_counter)
+{
+    emulation->vm = vm;
+    emulation->screen = screen;
+    init_triple_buffer(&emulation->frames);
+
+    emulation->opcodes_per_second = DEFAULT_OPCODES_PER_SECOND;
+    emulation->benchmark_frames = 0;
+
+    emulation->audio_sample_counter = audio_sample_counter;
+    emulation->audio_opened = false;
+    emulation->audio_buffer_samples = DEFAULT_AUDIO_BUFFER_SAMPLES;
+    emulation->audio_trace = NULL;
+    emulation->capture = NULL;
+    emulation->shared_screen = NULL;
+    emulation->metrics = NULL;
+    emulation->perf_counters = NULL;
+    emulation->gdb_stub = NULL;
+    emulation->trace = NULL;
+    emulation->latency_probe = NULL;
+
+    atomic_init(&emulation->quit, false);
+    atomic_init(&emulation->failed, false);
+    atomic_init(&emulation->save_requested, false);
+    atomic_init(&emulation->load_requested, false);
+    atomic_init(&emulation->swap_requested, NULL);
+
+    emulation->emulated_frames = 0;
+    emulation->requested_steps = 0;
+    emulation->benchmark_time = 0;
+}
+
+/**
+ * @brief Stop both threads because of an error.
+ *
+ * @param emulation The emulation that failed.
+ */
+static void fail_emulation(struct Emulation* emulation)
+{
+    atomic_store(&emulation->failed, true);
+    atomic_store(&emulation->quit, true);
+}
+
+/**
+ * @brief Open the audio device the first time the ROM plays a sound. If it can't be opened the emulation goes on
+ *  muted, it is never tried again.
+ *
+ * @param emulation The emulation that plays the sound.
+ */
+static void open_audio(struct Emulation* emulation)
+{
+    emulation->audio_opened = true;
+
+    uint64_t start = get_monotonic_timestamp();
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        warning("Initializing SDL audio failed, running muted: %s", SDL_GetError());
+        return;
+    }
+
+    if (setup_audio(emulation->audio_sample_counter, emulation->audio_buffer_samples, emulation->metrics,
+            emulation->audio_trace)
+        != 0) {
+        warning("Opening the audio device failed, running muted");
+        return;
+    }
+
+    debug("Audio device opened in %.2fms", (get_monotonic_timestamp() - start) / 1000000.0);
+}
+
+/**
+ * @brief Load the ROM of a swap request on the running virtual machine, keeping the window, the audio device and
+ *  every attached tool.
+ *
+ * @param emulation The emulation to load the ROM on.
+ * @param swap The requested ROM.
+ */
+static void swap_rom(struct Emulation* emulation, struct RomSwap* swap)
+{
+    load_rom(emulation->vm, swap->rom, swap->rom_size, swap->quirk_profile);
+    seed_idle_loops(emulation->vm, swap->idle_loops);
+
+    reset_screen(emulation->screen);
+    emulation->opcodes_per_second = swap->opcodes_per_second;
+
+    SDL_PauseAudio(1);
+    *emulation->audio_sample_counter = 0;
+
+    info("Running '%s' (%s quirks, %u opcodes/s)", swap->rom_path, get_quirk_profile_name(swap->quirk_profile),
+        swap->opcodes_per_second);
+}
+
+/**
+ * @brief Run the virtual machine paced at 60 frames per second until the emulation quits. It is the entry point of the emulation thread.
+ *
+ * @param data The `struct Emulation` to run.
+ * @return Return 0 on success or another number on failure.
+ */
+int run_emulation(void* data)
+{
+    struct Emulation* emulation = data;
+    struct VirtualMachine* vm = emulation->vm;
+    struct Screen* screen = emulation->screen;
+
+    bool benchmark = emulation->benchmark_frames != 0;
+
+    // The emulation is never synced to the display, only the window thread is
+    if (start_frame_pacer(&emulation->pacer, 60, false) != 0) {
+        fail_emulation(emulation);
+        return 1;
+    }
+
+    debug("Frame pacer started");
+
+    // The counters only count the thread that opens them
+    if (emulation->perf_counters != NULL) {
+        open_perf_counters(emulation->perf_counters);
+    }
+
+    // Accumulates the fractions of opcode left when the clock isn't a multiple of 60
+    uint32_t pending_opcodes = 0;
+
+    uint64_t benchmark_start = get_monotonic_timestamp();
+
+    debug("Starting the emulation loop");
+    while (!atomic_load_explicit(&emulation->quit, memory_order_relaxed)) {
+        // On benchmark the frames are never waited, when the program idles it jumps straight to the next timer tick
+        uint32_t frames = benchmark ? 1 : wait_next_frame(&emulation->pacer);
+
+        struct TraceBuffer* trace = emulation->trace;
+
+        if (atomic_exchange(&emulation->save_requested, false)) {
+            uint64_t start = start_trace_event(trace);
+
+            if (save_state(vm, screen) != 0) {
+                fail_emulation(emulation);
+                return 1;
+            }
+
+            finish_trace_event(trace, "save state", start);
+        }
+
+        if (atomic_exchange(&emulation->load_requested, false)) {
+            uint64_t start = start_trace_event(trace);
+
+            // A missing or rejected savestate leaves the machine untouched, the ROM keeps running
+            if (load_state(vm, screen) != 0) {
+                warning("The savestate wasn't loaded, the running state is kept");
+            }
+
+            finish_trace_event(trace, "load state", start);
+        }
+
+        struct RomSwap* swap = atomic_exchange(&emulation->swap_requested, NULL);
+
+        if (swap != NULL) {
+            uint64_t start = start_trace_event(trace);
+
+            swap_rom(emulation, swap);
+            delete_rom_swap(swap);
+
+            finish_trace_event(trace, "swap rom", start);
+        }
+
+        if (vm->debugger != NULL) {
+            poll_debugger_console(vm->debugger, vm);
+        }
+
+        if (emulation->gdb_stub != NULL) {
+            poll_gdb_stub(emulation->gdb_stub, vm, screen);
+        }
+
+        for (uint32_t frame = 0; frame < frames; frame++) {
+            // The whole machine is frozen while the debugger has it stopped
+            if (vm->debugger != NULL && vm->debugger->stopped) {
+                continue;
+            }
+
+            uint64_t timers_start = start_trace_event(trace);
+
+            if (vm->delay_timer > 0) {
+                vm->delay_timer--;
+            }
+
+            if (vm->sound_timer > 0) {
+                vm->sound_timer--;
+            }
+
+            finish_trace_event(trace, "timers", timers_start);
+
+            // Taken after the timers tick, so going back to it and running the same instructions gives the same state
+            if (emulation->gdb_stub != NULL) {
+                record_gdb_snapshot(emulation->gdb_stub, vm, screen);
+            }
+
+            pending_opcodes += emulation->opcodes_per_second;
+            uint32_t steps = pending_opcodes / 60;
+            pending_opcodes %= 60;
+
+            uint64_t idle_steps = vm->idle_steps;
+
+            if (emulation->perf_counters != NULL) {
+                start_perf_sample(emulation->perf_counters);
+            }
+
+            uint64_t cpu_start = start_trace_event(trace);
+
+            if (vm->run_cpu(vm, screen, steps) != 0) {
+                fail_emulation(emulation);
+                return 1;
+            }
+
+            finish_trace_event(trace, "run cpu", cpu_start);
+
+            if (emulation->latency_probe != NULL) {
+                observe_latency_probe(emulation->latency_probe, vm);
+            }
+
+            if (emulation->perf_counters != NULL) {
+                finish_perf_sample(emulation->perf_counters, emulation->emulated_frames + frame,
+                    steps - (vm->idle_steps - idle_steps));
+            }
+
+            emulation->requested_steps += steps;
+
+            if (emulation->capture != NULL) {
+                capture_frame(emulation->capture, screen, vm->sound_timer > 1);
+            }
+        }
+
+        emulation->emulated_frames += frames;
+
+        if (emulation->metrics != NULL) {
+            atomic_store_explicit(&emulation->metrics->instructions, emulation->requested_steps - vm->idle_steps,
+                memory_order_relaxed);
+            atomic_store_explicit(&emulation->metrics->emulated_frames, emulation->emulated_frames,
+                memory_order_relaxed);
+        }
+
+        if (emulation->shared_screen != NULL) {
+            publish_shared_screen(emulation->shared_screen, vm, screen, emulation->emulated_frames);
+        }
+
+        if (vm->exited) {
+            debug("Exit opcode executed, closing the emulator");
+            atomic_store(&emulation->quit, true);
+        }
+
+        if (benchmark) {
+            if (emulation->emulated_frames >= emulation->benchmark_frames) {
+                atomic_store(&emulation->quit, true);
+            }
+
+            continue;
+        }
+
+        // The original CHIP-8 spec specify that the sound should start with more that one set in the timer
+        if (vm->sound_timer > 1 && (vm->debugger == NULL || !vm->debugger->stopped)) {
+            if (!emulation->audio_opened) {
+                open_audio(emulation);
+            }
+
+            SDL_PauseAudio(0);
+        } else {
+            SDL_PauseAudio(1);
+            *emulation->audio_sample_counter = 0;
+        }
+
+        // Publish at most once per frame no matter how many times the buffer changed
+        if (screen->dirty) {
+            uint64_t start = start_trace_event(trace);
+
+            publish_frame(&emulation->frames, screen);
+            screen->dirty = false;
+
+            finish_trace_event(trace, "publish frame", start);
+        }
+    }
+
+    emulation->benchmark_time = get_monotonic_timestamp() - benchmark_start;
+
+    return 0;
+}
+
+/**
+ * @brief Print the statistics of a finished emulation.
+ *
+ * @param emulation The emulation to get the statistics from.
+ */
+void report_emulation(struct Emulation* emulation)
+{
+    if (emulation->benchmark_frames == 0) {
+        report_frame_pacing(&emulation->pacer);
+        return;
+    }
+
+    double elapsed = emulation->benchmark_time / 1000000000.0;
+    uint64_t frames = emulation->emulated_frames;
+    uint64_t idle_steps = emulation->vm->idle_steps;
+
+    info("Benchmark: %lu frames in %.3fs (%.0f frames/s, %.1fx real time)",
+        frames, elapsed, frames / elapsed, frames / elapsed / 60.0);
+    info("Benchmark: %lu opcodes executed, %lu idle opcodes skipped",
+        emulation->requested_steps - idle_steps, idle_steps);
+}
+
+/**
+ * @brief Ask the emulation thread to load a ROM on the running virtual machine between frames, a request not handled
+ *  yet is replaced. The ROM is read here, so once this succeeds the ROM is loaded for sure.
+ *
+ * @param emulation The emulation to load the ROM on.
+ * @param rom_path The path to the ROM, it is copied.
+ * @param quirk_profile The quirks to run the ROM with.
+ * @param opcodes_per_second The clock to run the ROM at.
+ * @param idle_loops The `idle_loops` bitmap of the analysis of the ROM, it is copied, or NULL when it wasn't analyzed.
+ * @return Return 0 on success or another number on failure, when the ROM can't be read or doesn't fit the platform.
+ */
+uint8_t request_rom_swap(struct Emulation* emulation, const char* rom_path, enum QuirkProfile quirk_profile,
+    uint32_t opcodes_per_second, const uint64_t* idle_loops)
+{
+    struct RomSwap* swap = malloc(sizeof(struct RomSwap));
+    if (swap == NULL) {
+        error("Malloc 'swap' failed");
+        return 1;
+    }
+
+    swap->rom_path = malloc(strlen(rom_path) + 1);
+    if (swap->rom_path == NULL) {
+        error("Malloc 'swap->rom_path' failed");
+        goto rom_path_malloc_failed;
+    }
+
+    swap->idle_loops = NULL;
+    if (idle_loops != NULL) {
+        swap->idle_loops = malloc(ROM_ANALYSIS_BITMAP_WORDS * sizeof(uint64_t));
+        if (swap->idle_loops == NULL) {
+            error("Malloc 'swap->idle_loops' failed");
+            goto idle_loops_malloc_failed;
+        }
+
+        memcpy(swap->idle_loops, idle_loops, ROM_ANALYSIS_BITMAP_WORDS * sizeof(uint64_t));
+    }
+
+    swap->rom = read_rom_file(rom_path, quirk_profile, &swap->rom_size);
+    if (swap->rom == NULL) {
+        goto read_rom_failed;
+    }
+
+    strcpy(swap->rom_path, rom_path);
+    swap->quirk_profile = quirk_profile;
+    swap->opcodes_per_second = opcodes_per_second;
+
+    struct RomSwap* replaced = atomic_exchange(&emulation->swap_requested, swap);
+    if (replaced != NULL) {
+        delete_rom_swap(replaced);
+    }
+
+    return 0;
+
+read_rom_failed:
+    free(swap->idle_loops);
+idle_loops_malloc_failed:
+    free(swap->rom_path);
+rom_path_malloc_failed:
+    free(swap);
+
+    return 1;
+}
+
+/**
+ * @brief Safely free a swap request.
+ *
+ * @param swap The request to be freed.
+ */
+void delete_rom_swap(struct RomSwap* swap)
+{
+    free(swap->idle_loops);
+    free(swap->rom);
+    free(swap->rom_path);
+    free(swap);
+}
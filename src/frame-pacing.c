@@ -0,0 +1,123 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "frame-pacing.h"
+#include "logging.h"
+
+static constexpr uint64_t NANOSECONDS_PER_SECOND = 1000000000;
+
+// Frames that can be caught up at once after a stall, past that the pacer drops them and starts again from now
+static constexpr uint32_t MAX_CATCH_UP_FRAMES = 4;
+
+/**
+ * @brief Get in nanoseconds a timestamp of the monotonic clock, that unlike the UTC time never jumps.
+ *
+ * @return The timestamp in nanoseconds or 0 on failure.
+ */
+uint64_t get_monotonic_timestamp()
+{
+    struct timespec timestamp;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &timestamp) != 0) {
+        error("Can't get the monotonic timestamp");
+        return 0;
+    }
+
+    return (uint64_t)timestamp.tv_sec * NANOSECONDS_PER_SECOND + timestamp.tv_nsec;
+}
+
+/**
+ * @brief Start pacing frames from now.
+ *
+ * @param pacer The pacer to be started.
+ * @param frames_per_second The rate of the frames.
+ * @param vsync If the presentation is synced to the display, then the pacer never sleeps and only counts the frames that are due.
+ * @return Return 0 on success or another number on failure.
+ */
+uint8_t start_frame_pacer(struct FramePacer* pacer, uint32_t frames_per_second, bool vsync)
+{
+    uint64_t now = get_monotonic_timestamp();
+    if (now == 0) {
+        return 1;
+    }
+
+    pacer->frame_period = NANOSECONDS_PER_SECOND / frames_per_second;
+    pacer->next_deadline = now + pacer->frame_period;
+    pacer->vsync = vsync;
+
+    pacer->frames = 0;
+    pacer->total_jitter = 0;
+    pacer->max_jitter = 0;
+    pacer->missed_frames = 0;
+
+    return 0;
+}
+
+/**
+ * @brief Sleep until the next frame deadline, without busy waiting.
+ *
+ * @param pacer The pacer to wait on.
+ * @return The number of frames that are due, usually 1. It can be more after a stall or 0 when the display refresh rate is faster than the pacer.
+ */
+uint32_t wait_next_frame(struct FramePacer* pacer)
+{
+    if (!pacer->vsync) {
+        struct timespec deadline = {
+            .tv_sec = pacer->next_deadline / NANOSECONDS_PER_SECOND,
+            .tv_nsec = pacer->next_deadline % NANOSECONDS_PER_SECOND,
+        };
+
+        // The deadline is absolute so being interrupted doesn't drift the sleep
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) { }
+    }
+
+    uint64_t now = get_monotonic_timestamp();
+
+    if (now < pacer->next_deadline) {
+        return 0;
+    }
+
+    uint64_t jitter = now - pacer->next_deadline;
+
+    pacer->total_jitter += jitter;
+    if (jitter > pacer->max_jitter) {
+        pacer->max_jitter = jitter;
+    }
+
+    uint32_t frames = 1 + (now - pacer->next_deadline) / pacer->frame_period;
+
+    if (frames > MAX_CATCH_UP_FRAMES) {
+        pacer->missed_frames += frames - 1;
+        pacer->next_deadline = now + pacer->frame_period;
+
+        frames = 1;
+    } else {
+        pacer->missed_frames += frames - 1;
+        pacer->next_deadline += frames * pacer->frame_period;
+    }
+
+    pacer->frames += frames;
+
+    return frames;
+}
+
+/**
+ * @brief Print the statistics of the frame pacing.
+ *
+ * @param pacer The pacer to get the statistics from.
+ */
+void report_frame_pacing(struct FramePacer* pacer)
+{
+    if (pacer->frames == 0) {
+        return;
+    }
+
+    info("Frame pacing: %lu frames, jitter mean %.3fms max %.3fms, %lu frames caught up",
+        pacer->frames,
+        (double)pacer->total_jitter / pacer->frames / 1000000.0,
+        (double)pacer->max_jitter / 1000000.0,
+        pacer->missed_frames);
+}
@@ -0,0 +1,1052 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "debugger.h"
+#include "gdb-stub.h"
+#include "logging.h"
+#include "screen.h"
+#include "virtual-machine.h"
+
+// While the CPU is stopped the frames do nothing, so the stub waits this long for the next request of the client
+// instead of answering one per frame
+static constexpr int GDB_STOPPED_POLL_MILLISECONDS = 10;
+
+// V0-VF, I, PC, SP, DT and ST
+static constexpr size_t GDB_REGISTER_COUNT = 21;
+
+static const uint8_t register_sizes[GDB_REGISTER_COUNT] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 1, 1, 1,
+};
+
+// Names the registers in the order of the `g` packet, so the clients don't need to know about the CHIP-8
+static const char target_description[] =
+    "<?xml version=\"1.0\"?>\n"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+    "<target version=\"1.0\">\n"
+    "  <feature name=\"org.och8s.chip8\">\n"
+    "    <reg name=\"v0\" bitsize=\"8\" regnum=\"0\"/>\n"
+    "    <reg name=\"v1\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v2\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v3\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v4\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v5\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v6\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v7\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v8\" bitsize=\"8\"/>\n"
+    "    <reg name=\"v9\" bitsize=\"8\"/>\n"
+    "    <reg name=\"va\" bitsize=\"8\"/>\n"
+    "    <reg name=\"vb\" bitsize=\"8\"/>\n"
+    "    <reg name=\"vc\" bitsize=\"8\"/>\n"
+    "    <reg name=\"vd\" bitsize=\"8\"/>\n"
+    "    <reg name=\"ve\" bitsize=\"8\"/>\n"
+    "    <reg name=\"vf\" bitsize=\"8\"/>\n"
+    "    <reg name=\"i\" bitsize=\"16\" type=\"data_ptr\"/>\n"
+    "    <reg name=\"pc\" bitsize=\"16\" type=\"code_ptr\"/>\n"
+    "    <reg name=\"sp\" bitsize=\"8\"/>\n"
+    "    <reg name=\"dt\" bitsize=\"8\"/>\n"
+    "    <reg name=\"st\" bitsize=\"8\"/>\n"
+    "  </feature>\n"
+    "</target>\n";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/**
+ * @brief Open the socket where the clients connect.
+ *
+ * @param stub The stub that listens.
+ * @param address A TCP port on localhost or, when it has a slash, the path of a Unix socket.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t open_listener(struct GdbStub* stub, const char* address)
+{
+    if (strchr(address, '/') != NULL) {
+        struct sockaddr_un unix_address = { .sun_family = AF_UNIX };
+
+        if (strlen(address) >= sizeof(unix_address.sun_path)) {
+            error("The socket path '%s' is too long", address);
+            return 1;
+        }
+
+        strcpy(unix_address.sun_path, address);
+
+        // A socket left by a previous run is replaced, any other file is kept
+        struct stat file;
+        if (stat(address, &file) == 0 && S_ISSOCK(file.st_mode)) {
+            unlink(address);
+        }
+
+        stub->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (stub->listener == -1 || bind(stub->listener, (struct sockaddr*)&unix_address, sizeof(unix_address)) != 0) {
+            error("Couldn't listen on the socket '%s': %s", address, strerror(errno));
+            return 2;
+        }
+
+        stub->socket_path = strdup(address);
+        if (stub->socket_path == NULL) {
+            error("Malloc 'stub->socket_path' failed");
+            return 3;
+        }
+    } else {
+        char* end;
+        unsigned long port = strtoul(address, &end, 10);
+
+        if (*end != '\0' || port == 0 || port > 0xFFFF) {
+            error("Invalid port '%s'", address);
+            return 4;
+        }
+
+        // Only reachable from this host, the protocol has no authentication
+        struct sockaddr_in inet_address = {
+            .sin_family = AF_INET,
+            .sin_port = htons(port),
+            .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+        };
+
+        int reuse = 1;
+
+        stub->listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (stub->listener == -1 || setsockopt(stub->listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+            || bind(stub->listener, (struct sockaddr*)&inet_address, sizeof(inet_address)) != 0) {
+            error("Couldn't listen on the port %lu: %s", port, strerror(errno));
+            return 5;
+        }
+    }
+
+    if (listen(stub->listener, 1) != 0 || fcntl(stub->listener, F_SETFL, O_NONBLOCK) != 0) {
+        error("Couldn't listen on '%s': %s", address, strerror(errno));
+        return 6;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Create a GDB stub waiting for a client. The virtual machine should have a debugger before it is polled.
+ *
+ * @param address A TCP port on localhost, like `1234`, or the path of a Unix socket, like `/tmp/och8s.sock`.
+ * @return The pointer to the stub or a NULL pointer if an error occurs.
+ *  The stub should be freed using the function `delete_gdb_stub()`.
+ */
+struct GdbStub* create_gdb_stub(const char* address)
+{
+    struct GdbStub* stub = calloc(1, sizeof(struct GdbStub));
+    if (stub == NULL) {
+        error("Malloc 'stub' failed");
+        return NULL;
+    }
+
+    stub->listener = -1;
+    stub->client = -1;
+
+    if (open_listener(stub, address) != 0) {
+        goto listener_failed;
+    }
+
+    return stub;
+
+listener_failed:
+    if (stub->listener != -1) {
+        close(stub->listener);
+    }
+
+    if (stub->socket_path != NULL) {
+        unlink(stub->socket_path);
+        free(stub->socket_path);
+    }
+
+    free(stub);
+
+    return NULL;
+}
+
+/**
+ * @brief Get a snapshot of the history, from the oldest to the newest.
+ *
+ * @param stub The stub with the history.
+ * @param index The position of the snapshot, 0 being the oldest.
+ * @return The snapshot.
+ */
+static struct GdbSnapshot* get_snapshot(struct GdbStub* stub, size_t index)
+{
+    return &stub->history[(stub->history_start + index) % GDB_HISTORY_FRAMES];
+}
+
+/**
+ * @brief Save the state of the machine at the start of a frame, the oldest snapshot is replaced once the history is
+ *  full. It does nothing while no client is attached.
+ *
+ * @param stub The stub keeping the history.
+ * @param vm The virtual machine, with a debugger.
+ * @param screen The screen of the virtual machine.
+ */
+void record_gdb_snapshot(struct GdbStub* stub, const struct VirtualMachine* vm, const struct Screen* screen)
+{
+    if (stub->client == -1) {
+        return;
+    }
+
+    if (stub->history_count == GDB_HISTORY_FRAMES) {
+        stub->history_start = (stub->history_start + 1) % GDB_HISTORY_FRAMES;
+        stub->history_count--;
+    }
+
+    struct GdbSnapshot* snapshot = get_snapshot(stub, stub->history_count++);
+
+    snapshot->executed = vm->debugger->executed;
+    memcpy(&snapshot->vm, vm, sizeof(struct VirtualMachine));
+    snapshot->screen = *screen;
+}
+
+/**
+ * @brief Go back to a snapshot of the history.
+ *
+ * @param snapshot The snapshot to restore.
+ * @param vm The virtual machine, with a debugger.
+ * @param screen The screen of the virtual machine.
+ */
+static void restore_snapshot(const struct GdbSnapshot* snapshot, struct VirtualMachine* vm, struct Screen* screen)
+{
+    // The interpreter, the debugger and the keys are the current ones, not the ones of the snapshot
+    struct Debugger* debugger = vm->debugger;
+    uint8_t (*run_cpu)(struct VirtualMachine* vm, struct Screen* screen, size_t steps) = vm->run_cpu;
+    uint16_t pressed_keys = atomic_load(&vm->pressed_keys);
+    uint16_t released_keys = atomic_load(&vm->released_keys);
+
+    memcpy(vm, &snapshot->vm, sizeof(struct VirtualMachine));
+
+    vm->debugger = debugger;
+    vm->run_cpu = run_cpu;
+    atomic_store(&vm->pressed_keys, pressed_keys);
+    atomic_store(&vm->released_keys, released_keys);
+
+    *screen = snapshot->screen;
+    screen->dirty = true;
+
+    debugger->executed = snapshot->executed;
+}
+
+/**
+ * @brief Bring the machine to the state it had before running an instruction, by restoring the last snapshot taken
+ *  before it and running again the instructions in between. The snapshots after it are dropped.
+ *
+ * @param stub The stub with the history.
+ * @param vm The virtual machine, with a debugger.
+ * @param screen The screen of the virtual machine.
+ * @param executed The number of instructions executed at the wanted state.
+ * @return Return 0 on success or another number if the history doesn't reach it.
+ */
+static uint8_t replay_history(struct GdbStub* stub, struct VirtualMachine* vm, struct Screen* screen,
+    uint64_t executed)
+{
+    size_t index = stub->history_count;
+    while (index > 0 && get_snapshot(stub, index - 1)->executed > executed) {
+        index--;
+    }
+
+    if (index == 0) {
+        return 1;
+    }
+
+    restore_snapshot(get_snapshot(stub, index - 1), vm, screen);
+    stub->history_count = index;
+
+    // No timer ticks between two snapshots, so running the same instructions gives the same state. The fast
+    // interpreter doesn't stop at the breakpoints nor count the instructions.
+    while (vm->debugger->executed < executed) {
+        vm->debugger->fast_run_cpu(vm, screen, 1);
+        vm->debugger->executed++;
+    }
+
+    // The breakpoint the machine is left at doesn't stop it again when continued
+    vm->debugger->resuming = true;
+
+    return 0;
+}
+
+/**
+ * @brief Find the last instruction, before the current one, that stopped at a breakpoint. It runs again every frame
+ *  of the history from the newest to the oldest until one has a breakpoint.
+ *
+ * @param stub The stub with the history.
+ * @param vm The virtual machine, with a debugger.
+ * @param screen The screen of the virtual machine.
+ * @param executed Where the number of instructions executed before the breakpoint is stored.
+ * @return Return 0 on success or another number if no breakpoint is in the history.
+ */
+static uint8_t find_previous_breakpoint(struct GdbStub* stub, struct VirtualMachine* vm, struct Screen* screen,
+    uint64_t* executed)
+{
+    struct Debugger* debugger = vm->debugger;
+    uint64_t current = debugger->executed;
+
+    for (size_t index = stub->history_count; index > 0; index--) {
+        const struct GdbSnapshot* snapshot = get_snapshot(stub, index - 1);
+
+        if (snapshot->executed >= current) {
+            continue;
+        }
+
+        uint64_t end = index < stub->history_count ? get_snapshot(stub, index)->executed : current;
+        if (end > current) {
+            end = current;
+        }
+
+        restore_snapshot(snapshot, vm, screen);
+
+        bool found = false;
+
+        while (debugger->executed < end) {
+            if (is_breakpoint(debugger, vm->pc) && find_breakpoint(debugger, vm) != NULL) {
+                *executed = debugger->executed;
+                found = true;
+            }
+
+            debugger->fast_run_cpu(vm, screen, 1);
+            debugger->executed++;
+        }
+
+        if (found) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Write all the bytes to the client, waiting while its socket is full.
+ *
+ * @param stub The stub with the client.
+ * @param data The bytes to write.
+ * @param length The number of bytes.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t write_client(struct GdbStub* stub, const char* data, size_t length)
+{
+    while (length > 0) {
+        // A client gone while writing to it is detected from the error, without raising SIGPIPE
+        ssize_t written = send(stub->client, data, length, MSG_NOSIGNAL);
+
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd output = { stub->client, POLLOUT, 0 };
+            poll(&output, 1, -1);
+            continue;
+        }
+
+        if (written <= 0) {
+            return 1;
+        }
+
+        data += written;
+        length -= written;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Send a packet to the client, adding its framing and checksum.
+ *
+ * @param stub The stub with the client.
+ * @param data The content of the packet.
+ * @param length The number of bytes of the content.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t send_packet_data(struct GdbStub* stub, const char* data, size_t length)
+{
+    uint8_t checksum = 0;
+    for (size_t i = 0; i < length; i++) {
+        checksum += (uint8_t)data[i];
+    }
+
+    char trailer[3] = { '#', hex_digits[checksum >> 4], hex_digits[checksum & 0xF] };
+
+    if (write_client(stub, "$", 1) != 0 || write_client(stub, data, length) != 0
+        || write_client(stub, trailer, sizeof(trailer)) != 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Send a text packet to the client.
+ *
+ * @param stub The stub with the client.
+ * @param data The content of the packet.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t send_packet(struct GdbStub* stub, const char* data)
+{
+    return send_packet_data(stub, data, strlen(data));
+}
+
+/**
+ * @brief Encode bytes as hexadecimal.
+ *
+ * @param output Where the two digits of every byte are written, followed by a null terminator.
+ * @param data The bytes to encode.
+ * @param length The number of bytes.
+ */
+static void encode_hex(char* output, const uint8_t* data, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        output[i * 2] = hex_digits[data[i] >> 4];
+        output[i * 2 + 1] = hex_digits[data[i] & 0xF];
+    }
+
+    output[length * 2] = '\0';
+}
+
+/**
+ * @brief Decode the value of a hexadecimal digit.
+ *
+ * @param digit The digit.
+ * @return The value or -1 if it isn't a hexadecimal digit.
+ */
+static int8_t decode_hex_digit(char digit)
+{
+    if (digit >= '0' && digit <= '9') {
+        return digit - '0';
+    }
+
+    if (digit >= 'a' && digit <= 'f') {
+        return digit - 'a' + 10;
+    }
+
+    if (digit >= 'A' && digit <= 'F') {
+        return digit - 'A' + 10;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Decode bytes written as hexadecimal.
+ *
+ * @param output Where the bytes are written.
+ * @param text The hexadecimal digits, two per byte.
+ * @param length The number of bytes.
+ * @return Return 0 on success or another number if any digit is missing or invalid.
+ */
+static uint8_t decode_hex(uint8_t* output, const char* text, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        int8_t high = decode_hex_digit(text[i * 2]);
+        int8_t low = high >= 0 ? decode_hex_digit(text[i * 2 + 1]) : -1;
+
+        if (low < 0) {
+            return 1;
+        }
+
+        output[i] = high << 4 | low;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Get the value of a register, in the order of the `g` packet.
+ *
+ * @param vm The virtual machine to get the register from.
+ * @param index The number of the register.
+ * @return The value of the register.
+ */
+static uint16_t get_register(const struct VirtualMachine* vm, size_t index)
+{
+    if (index < 16) {
+        return vm->v_registers[index];
+    }
+
+    switch (index) {
+    case 16:
+        return vm->index_register;
+    case 17:
+        return vm->pc;
+    case 18:
+        return vm->pc_stack_index;
+    case 19:
+        return vm->delay_timer;
+    default:
+        return vm->sound_timer;
+    }
+}
+
+/**
+ * @brief Set the value of a register, in the order of the `g` packet.
+ *
+ * @param vm The virtual machine to set the register on.
+ * @param index The number of the register.
+ * @param value The value of the register.
+ */
+static void set_register(struct VirtualMachine* vm, size_t index, uint16_t value)
+{
+    if (index < 16) {
+        vm->v_registers[index] = value;
+        return;
+    }
+
+    switch (index) {
+    case 16:
+        vm->index_register = value;
+        break;
+    case 17:
+        vm->pc = value;
+        break;
+    case 18:
+        if (value <= sizeof(vm->pc_stack) / sizeof(vm->pc_stack[0])) {
+            vm->pc_stack_index = value;
+        }
+        break;
+    case 19:
+        vm->delay_timer = value;
+        break;
+    default:
+        vm->sound_timer = value;
+        break;
+    }
+}
+
+/**
+ * @brief Encode a register as hexadecimal in the little endian order of the target.
+ *
+ * @param output Where the digits are written, followed by a null terminator.
+ * @param vm The virtual machine to get the register from.
+ * @param index The number of the register.
+ * @return The number of digits written.
+ */
+static size_t encode_register(char* output, const struct VirtualMachine* vm, size_t index)
+{
+    uint16_t value = get_register(vm, index);
+    uint8_t bytes[2] = { value & 0xFF, value >> 8 };
+
+    encode_hex(output, bytes, register_sizes[index]);
+
+    return register_sizes[index] * 2;
+}
+
+/**
+ * @brief Decode a register written as hexadecimal in the little endian order of the target.
+ *
+ * @param text The digits of the register.
+ * @param vm The virtual machine to set the register on.
+ * @param index The number of the register.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t decode_register(const char* text, struct VirtualMachine* vm, size_t index)
+{
+    uint8_t bytes[2] = { 0, 0 };
+
+    if (decode_hex(bytes, text, register_sizes[index]) != 0) {
+        return 1;
+    }
+
+    set_register(vm, index, bytes[0] | bytes[1] << 8);
+
+    return 0;
+}
+
+/**
+ * @brief Send the reason why the CPU stopped.
+ *
+ * @param stub The stub with the client.
+ * @param debugger The debugger of the virtual machine.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t send_stop_reply(struct GdbStub* stub, const struct Debugger* debugger)
+{
+    char reply[32];
+
+    switch (debugger->stop_reason) {
+    case DEBUGGER_STOP_BREAKPOINT:
+        return send_packet(stub, "T05swbreak:;");
+    case DEBUGGER_STOP_WATCHPOINT:
+        snprintf(reply, sizeof(reply), "T05watch:%x;", debugger->watched_address);
+        return send_packet(stub, reply);
+    case DEBUGGER_STOP_STEP:
+        return send_packet(stub, "S05");
+    case DEBUGGER_STOP_PAUSE:
+        break;
+    }
+
+    // Interrupted by the client
+    return send_packet(stub, "S02");
+}
+
+/**
+ * @brief Attach a waiting client, stopping the CPU so it can inspect it.
+ *
+ * @param stub The stub listening.
+ * @param vm The virtual machine, with a debugger.
+ */
+static void accept_client(struct GdbStub* stub, struct VirtualMachine* vm)
+{
+    int client = accept(stub->listener, NULL, NULL);
+    if (client == -1) {
+        return;
+    }
+
+    stub->history = malloc(GDB_HISTORY_FRAMES * sizeof(struct GdbSnapshot));
+    if (stub->history == NULL) {
+        error("Malloc 'stub->history' failed");
+        close(client);
+        return;
+    }
+
+    // The requests are small and answered one at a time, so they are sent right away
+    int no_delay = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    fcntl(client, F_SETFL, O_NONBLOCK);
+
+    stub->client = client;
+    stub->no_acknowledgment = false;
+    stub->running = false;
+    stub->input_length = 0;
+    stub->history_start = 0;
+    stub->history_count = 0;
+
+    info("GDB client attached");
+
+    vm->debugger->traced = true;
+    stop_debugger(vm->debugger, vm, DEBUGGER_STOP_PAUSE);
+}
+
+/**
+ * @brief Detach the client, the CPU runs again at full speed.
+ *
+ * @param stub The stub with the client.
+ * @param vm The virtual machine, with a debugger.
+ * @param lost If the connection was lost, so the breakpoints of the client are still inserted.
+ */
+static void detach_client(struct GdbStub* stub, struct VirtualMachine* vm, bool lost)
+{
+    if (lost) {
+        warning("GDB client disconnected, its breakpoints and watchpoints are removed");
+        remove_all_breakpoints(vm->debugger, vm);
+    } else {
+        info("GDB client detached");
+    }
+
+    close(stub->client);
+    stub->client = -1;
+
+    free(stub->history);
+    stub->history = NULL;
+
+    vm->debugger->traced = false;
+    resume_debugger(vm->debugger, vm, 0);
+}
+
+/**
+ * @brief Answer a `qXfer:features:read` request with a chunk of the target description.
+ *
+ * @param stub The stub with the client.
+ * @param annex The rest of the request, like `target.xml:0,fff`.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t send_target_description(struct GdbStub* stub, const char* annex)
+{
+    unsigned long offset;
+    unsigned long length;
+
+    if (sscanf(annex, "target.xml:%lx,%lx", &offset, &length) != 2) {
+        return send_packet(stub, "E00");
+    }
+
+    size_t size = sizeof(target_description) - 1;
+    if (offset > size) {
+        offset = size;
+    }
+
+    if (length > size - offset) {
+        length = size - offset;
+    }
+
+    if (length > GDB_PACKET_SIZE - 5) {
+        length = GDB_PACKET_SIZE - 5;
+    }
+
+    char reply[GDB_PACKET_SIZE];
+
+    // 'l' marks the last chunk, 'm' that there is more to read
+    reply[0] = offset + length == size ? 'l' : 'm';
+    memcpy(reply + 1, target_description + offset, length);
+
+    return send_packet_data(stub, reply, length + 1);
+}
+
+/**
+ * @brief Answer a `Z` or `z` request, inserting or removing a breakpoint or a write watchpoint.
+ *
+ * @param stub The stub with the client.
+ * @param vm The virtual machine, with a debugger.
+ * @param packet The request.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t change_breakpoint(struct GdbStub* stub, struct VirtualMachine* vm, const char* packet)
+{
+    bool insert = packet[0] == 'Z';
+    unsigned int type;
+    unsigned long address;
+    unsigned long length;
+
+    if (sscanf(packet + 1, "%x,%lx,%lx", &type, &address, &length) != 3 || address > 0xFFFF) {
+        return send_packet(stub, "E00");
+    }
+
+    // Software and hardware breakpoints are the same thing here, only the writes are watched
+    if (type == 0 || type == 1) {
+        if (!insert) {
+            remove_breakpoints(vm->debugger, vm, address);
+        } else if (add_breakpoint(vm->debugger, vm,
+                       (struct Breakpoint) { address, DEBUGGER_NO_CONDITION, DEBUGGER_EQUAL, 0 })
+            != 0) {
+            return send_packet(stub, "E01");
+        }
+
+        return send_packet(stub, "OK");
+    }
+
+    if (type == 2) {
+        set_watchpoints(vm->debugger, vm, address, length, insert);
+        return send_packet(stub, "OK");
+    }
+
+    return send_packet(stub, "");
+}
+
+/**
+ * @brief Answer a `bs` or `bc` request, running backwards through the history.
+ *
+ * @param stub The stub with the client.
+ * @param vm The virtual machine, with a debugger.
+ * @param screen The screen of the virtual machine.
+ * @param continuing If it runs back to the previous breakpoint instead of a single instruction.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t run_backwards(struct GdbStub* stub, struct VirtualMachine* vm, struct Screen* screen, bool continuing)
+{
+    struct Debugger* debugger = vm->debugger;
+    uint64_t executed;
+
+    if (continuing && find_previous_breakpoint(stub, vm, screen, &executed) == 0) {
+        replay_history(stub, vm, screen, executed);
+        return send_packet(stub, "T05swbreak:;");
+    }
+
+    if (!continuing && debugger->executed > 0 && replay_history(stub, vm, screen, debugger->executed - 1) == 0) {
+        return send_packet(stub, "S05");
+    }
+
+    // Nothing older is kept, so it stops at the oldest snapshot
+    if (stub->history_count > 0) {
+        replay_history(stub, vm, screen, get_snapshot(stub, 0)->executed);
+    }
+
+    return send_packet(stub, "T05replaylog:begin;");
+}
+
+/**
+ * @brief Answer a request of the client.
+ *
+ * @param stub The stub with the client.
+ * @param vm The virtual machine, with a debugger.
+ * @param screen The screen of the virtual machine.
+ * @param packet The content of the request, null terminated.
+ * @return Return 0 on success, 1 if the client is lost or killed the program and 2 if it detached.
+ */
+static uint8_t handle_packet(struct GdbStub* stub, struct VirtualMachine* vm, struct Screen* screen, char* packet)
+{
+    struct Debugger* debugger = vm->debugger;
+    char reply[GDB_PACKET_SIZE];
+
+    unsigned long address;
+    unsigned long length;
+    unsigned long index;
+    int offset;
+
+    switch (packet[0]) {
+    case '?':
+        return send_packet(stub, "S05");
+    case 'g': {
+        size_t written = 0;
+        for (size_t i = 0; i < GDB_REGISTER_COUNT; i++) {
+            written += encode_register(reply + written, vm, i);
+        }
+
+        return send_packet(stub, reply);
+    }
+    case 'G': {
+        const char* text = packet + 1;
+        for (size_t i = 0; i < GDB_REGISTER_COUNT && *text != '\0'; i++) {
+            if (decode_register(text, vm, i) != 0) {
+                return send_packet(stub, "E00");
+            }
+
+            text += register_sizes[i] * 2;
+        }
+
+        return send_packet(stub, "OK");
+    }
+    case 'p':
+        if (sscanf(packet + 1, "%lx", &index) != 1 || index >= GDB_REGISTER_COUNT) {
+            return send_packet(stub, "E00");
+        }
+
+        encode_register(reply, vm, index);
+        return send_packet(stub, reply);
+    case 'P':
+        if (sscanf(packet + 1, "%lx=%n", &index, &offset) != 1 || index >= GDB_REGISTER_COUNT
+            || decode_register(packet + 1 + offset, vm, index) != 0) {
+            return send_packet(stub, "E00");
+        }
+
+        return send_packet(stub, "OK");
+    case 'm':
+        if (sscanf(packet + 1, "%lx,%lx", &address, &length) != 2 || address > 0xFFFF) {
+            return send_packet(stub, "E00");
+        }
+
+        // Reads past the end of the memory or bigger than a packet are cut short, as the protocol allows
+        if (length > XO_CHIP_MEMORY_SIZE - address) {
+            length = XO_CHIP_MEMORY_SIZE - address;
+        }
+
+        if (length > (GDB_PACKET_SIZE - 1) / 2) {
+            length = (GDB_PACKET_SIZE - 1) / 2;
+        }
+
+        encode_hex(reply, vm->memory + address, length);
+        return send_packet(stub, reply);
+    case 'M':
+        if (sscanf(packet + 1, "%lx,%lx:%n", &address, &length, &offset) != 2 || address > 0xFFFF
+            || length > XO_CHIP_MEMORY_SIZE - address || decode_hex(vm->memory + address, packet + 1 + offset, length) != 0) {
+            return send_packet(stub, "E00");
+        }
+
+        return send_packet(stub, "OK");
+    case 'c':
+    case 's':
+        if (sscanf(packet + 1, "%lx", &address) == 1) {
+            vm->pc = address;
+        }
+
+        // Replied once the CPU stops
+        stub->running = true;
+        resume_debugger(debugger, vm, packet[0] == 's' ? 1 : 0);
+        return 0;
+    case 'b':
+        if (packet[1] == 's' || packet[1] == 'c') {
+            return run_backwards(stub, vm, screen, packet[1] == 'c');
+        }
+
+        return send_packet(stub, "");
+    case 'Z':
+    case 'z':
+        return change_breakpoint(stub, vm, packet);
+    case 'H':
+        return send_packet(stub, "OK");
+    case 'D':
+        return send_packet(stub, "OK") == 0 ? 2 : 1;
+    case 'k':
+        return 1;
+    case 'q':
+        if (strncmp(packet, "qSupported", strlen("qSupported")) == 0) {
+            snprintf(reply, sizeof(reply),
+                "PacketSize=%zx;qXfer:features:read+;QStartNoAckMode+;swbreak+;ReverseStep+;ReverseContinue+",
+                GDB_PACKET_SIZE);
+            return send_packet(stub, reply);
+        }
+
+        if (strncmp(packet, "qXfer:features:read:", strlen("qXfer:features:read:")) == 0) {
+            return send_target_description(stub, packet + strlen("qXfer:features:read:"));
+        }
+
+        if (strcmp(packet, "qAttached") == 0) {
+            return send_packet(stub, "1");
+        }
+
+        return send_packet(stub, "");
+    case 'Q':
+        if (strcmp(packet, "QStartNoAckMode") == 0) {
+            uint8_t result = send_packet(stub, "OK");
+            stub->no_acknowledgment = true;
+            return result;
+        }
+
+        return send_packet(stub, "");
+    default:
+        // An empty reply tells the client that the request isn't supported
+        return send_packet(stub, "");
+    }
+}
+
+/**
+ * @brief Run the requests complete in the input buffer and drop them from it.
+ *
+ * @param stub The stub with the client.
+ * @param vm The virtual machine, with a debugger.
+ * @param screen The screen of the virtual machine.
+ * @return Return 0 on success, 1 if the client is lost or killed the program and 2 if it detached.
+ */
+static uint8_t handle_input(struct GdbStub* stub, struct VirtualMachine* vm, struct Screen* screen)
+{
+    size_t position = 0;
+
+    while (position < stub->input_length) {
+        char byte = stub->input[position];
+
+        // Ctrl+C on the client
+        if (byte == 0x03) {
+            if (stub->running && !vm->debugger->stopped) {
+                stop_debugger(vm->debugger, vm, DEBUGGER_STOP_PAUSE);
+            }
+
+            position++;
+            continue;
+        }
+
+        // Acknowledgments and noise between packets
+        if (byte != '$') {
+            position++;
+            continue;
+        }
+
+        char* end = memchr(stub->input + position, '#', stub->input_length - position);
+        if (end == NULL || end + 2 >= stub->input + stub->input_length) {
+            break;
+        }
+
+        char* packet = stub->input + position + 1;
+        size_t packet_length = end - packet;
+
+        uint8_t checksum = 0;
+        for (size_t i = 0; i < packet_length; i++) {
+            checksum += (uint8_t)packet[i];
+        }
+
+        uint8_t expected;
+        bool valid = decode_hex(&expected, end + 1, 1) == 0 && expected == checksum;
+
+        position = end + 3 - stub->input;
+
+        if (!stub->no_acknowledgment && write_client(stub, valid ? "+" : "-", 1) != 0) {
+            return 1;
+        }
+
+        if (!valid) {
+            continue;
+        }
+
+        *end = '\0';
+
+        uint8_t result = handle_packet(stub, vm, screen, packet);
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    memmove(stub->input, stub->input + position, stub->input_length - position);
+    stub->input_length -= position;
+
+    // A packet bigger than the buffer can't be answered
+    if (stub->input_length == sizeof(stub->input)) {
+        stub->input_length = 0;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Attach a waiting client, run its requests and report when the CPU stops, without waiting while the CPU runs.
+ *  It should be called between the runs of the CPU, from the thread running it.
+ *
+ * @param stub The stub to poll.
+ * @param vm The virtual machine, with a debugger.
+ * @param screen The screen of the virtual machine.
+ */
+void poll_gdb_stub(struct GdbStub* stub, struct VirtualMachine* vm, struct Screen* screen)
+{
+    if (stub->client == -1) {
+        accept_client(stub, vm);
+
+        if (stub->client == -1) {
+            return;
+        }
+    }
+
+    while (true) {
+        if (stub->running && vm->debugger->stopped) {
+            stub->running = false;
+
+            if (send_stop_reply(stub, vm->debugger) != 0) {
+                detach_client(stub, vm, true);
+                return;
+            }
+        }
+
+        struct pollfd input = { stub->client, POLLIN, 0 };
+        if (poll(&input, 1, vm->debugger->stopped ? GDB_STOPPED_POLL_MILLISECONDS : 0) <= 0) {
+            return;
+        }
+
+        ssize_t count = read(stub->client, stub->input + stub->input_length,
+            sizeof(stub->input) - stub->input_length);
+
+        if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            continue;
+        }
+
+        if (count <= 0) {
+            detach_client(stub, vm, true);
+            return;
+        }
+
+        stub->input_length += count;
+
+        uint8_t result = handle_input(stub, vm, screen);
+        if (result != 0) {
+            detach_client(stub, vm, result == 1);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Detach the client and stop listening.
+ *
+ * @param stub The stub to be deallocated.
+ * @param vm The virtual machine, with a debugger.
+ */
+void delete_gdb_stub(struct GdbStub* stub, struct VirtualMachine* vm)
+{
+    if (stub->client != -1) {
+        // Tell the client that the program is gone
+        send_packet(stub, vm->exited ? "W00" : "X09");
+        detach_client(stub, vm, false);
+    }
+
+    close(stub->listener);
+
+    if (stub->socket_path != NULL) {
+        unlink(stub->socket_path);
+        free(stub->socket_path);
+    }
+
+    free(stub);
+}
@@ -0,0 +1,230 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame-pacing.h"
+#include "latency-probe.h"
+#include "logging.h"
+#include "screen.h"
+#include "virtual-machine.h"
+
+/**
+ * @brief Create a probe, the first press happens after a press interval so the ROM has time to start.
+ *
+ * @param presses The number of presses to measure before it is done.
+ * @return The pointer to the probe or a NULL pointer if an error occurs.
+ *  The probe should be freed using the function `delete_latency_probe()`.
+ */
+struct LatencyProbe* create_latency_probe(size_t presses)
+{
+    struct LatencyProbe* probe = calloc(1, sizeof(struct LatencyProbe));
+    if (probe == NULL) {
+        error("Malloc 'probe' failed");
+        return NULL;
+    }
+
+    probe->observation_latencies = malloc(presses * sizeof(uint64_t));
+    if (probe->observation_latencies == NULL) {
+        error("Malloc 'probe->observation_latencies' failed");
+        goto observation_latencies_failed;
+    }
+
+    probe->present_latencies = malloc(presses * sizeof(uint64_t));
+    if (probe->present_latencies == NULL) {
+        error("Malloc 'probe->present_latencies' failed");
+        goto present_latencies_failed;
+    }
+
+    probe->presses = presses;
+    probe->state = LATENCY_PROBE_WAITING;
+    probe->next_press = get_monotonic_timestamp() + LATENCY_PROBE_INTERVAL;
+    atomic_init(&probe->observed_at, 0);
+
+    return probe;
+
+present_latencies_failed:
+    free(probe->observation_latencies);
+observation_latencies_failed:
+    free(probe);
+
+    return NULL;
+}
+
+/**
+ * @brief Press the key once it is time to, like a key event would. It should be called from the window thread right
+ *  after polling the events.
+ *
+ * @param probe The probe of the window thread.
+ * @param vm The virtual machine to press the key of.
+ */
+void inject_latency_probe(struct LatencyProbe* probe, struct VirtualMachine* vm)
+{
+    if (probe->state != LATENCY_PROBE_WAITING) {
+        return;
+    }
+
+    uint64_t now = get_monotonic_timestamp();
+
+    if (now < probe->next_press) {
+        return;
+    }
+
+    set_key_state(vm, LATENCY_PROBE_KEY, true);
+
+    probe->injected_at = now;
+    probe->state = LATENCY_PROBE_PRESSED;
+}
+
+/**
+ * @brief Timestamp the moment the ROM sees the key, detected by its counter register. It should be called from the
+ *  emulation thread after every run of the CPU.
+ *
+ * @param probe The probe, only its observation is updated.
+ * @param vm The virtual machine that just run.
+ */
+void observe_latency_probe(struct LatencyProbe* probe, const struct VirtualMachine* vm)
+{
+    uint8_t count = vm->v_registers[LATENCY_PROBE_COUNTER];
+
+    if (count != probe->observed_count) {
+        probe->observed_count = count;
+        atomic_store_explicit(&probe->observed_at, get_monotonic_timestamp(), memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Take a sample when the presented frame is the first one changed since the press, then release the key. It
+ *  should be called from the window thread right after presenting a frame.
+ *
+ * @param probe The probe of the window thread.
+ * @param vm The virtual machine to release the key of.
+ * @param frame The frame that was just presented.
+ */
+void present_latency_probe(struct LatencyProbe* probe, struct VirtualMachine* vm, const struct Screen* frame)
+{
+    if (probe->state == LATENCY_PROBE_DONE) {
+        return;
+    }
+
+    uint64_t now = get_monotonic_timestamp();
+
+    if (probe->state == LATENCY_PROBE_WAITING) {
+        memcpy(probe->reference, frame->buffer, sizeof(probe->reference));
+        return;
+    }
+
+    bool changed = memcmp(probe->reference, frame->buffer, sizeof(probe->reference)) != 0;
+    uint64_t observed_at = atomic_load_explicit(&probe->observed_at, memory_order_relaxed);
+
+    if (changed && observed_at >= probe->injected_at) {
+        probe->observation_latencies[probe->samples] = observed_at - probe->injected_at;
+        probe->present_latencies[probe->samples] = now - probe->injected_at;
+        probe->samples++;
+    } else if (now - probe->injected_at > LATENCY_PROBE_TIMEOUT) {
+        warning("No change of the screen presented after pressing the key %X, is the ROM the latency probe one?",
+            LATENCY_PROBE_KEY);
+        probe->lost++;
+    } else {
+        return;
+    }
+
+    set_key_state(vm, LATENCY_PROBE_KEY, false);
+    memcpy(probe->reference, frame->buffer, sizeof(probe->reference));
+
+    probe->state = probe->samples + probe->lost < probe->presses ? LATENCY_PROBE_WAITING : LATENCY_PROBE_DONE;
+    probe->next_press = now + LATENCY_PROBE_INTERVAL + (uint64_t)rand() % LATENCY_PROBE_JITTER;
+}
+
+/**
+ * @brief Compare two latencies for `qsort()`.
+ */
+static int compare_latencies(const void* a, const void* b)
+{
+    uint64_t first = *(const uint64_t*)a;
+    uint64_t second = *(const uint64_t*)b;
+
+    return (first > second) - (first < second);
+}
+
+/**
+ * @brief Print the distribution of a list of latencies.
+ *
+ * @param name What the latencies measure.
+ * @param latencies The latencies, they are sorted.
+ * @param count The number of latencies.
+ * @return The 99th percentile in milliseconds.
+ */
+static double print_distribution(const char* name, uint64_t* latencies, size_t count)
+{
+    qsort(latencies, count, sizeof(uint64_t), compare_latencies);
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += latencies[i];
+    }
+
+    // Nearest rank percentiles
+    double p50 = latencies[(count * 50 + 99) / 100 - 1] / 1000000.0;
+    double p90 = latencies[(count * 90 + 99) / 100 - 1] / 1000000.0;
+    double p99 = latencies[(count * 99 + 99) / 100 - 1] / 1000000.0;
+
+    info("Latency probe, %s: min %.2fms, mean %.2fms, p50 %.2fms, p90 %.2fms, p99 %.2fms, max %.2fms", name,
+        latencies[0] / 1000000.0, total / 1000000.0 / count, p50, p90, p99, latencies[count - 1] / 1000000.0);
+
+    return p99;
+}
+
+/**
+ * @brief Print the distributions of the latencies from the key press to the observation and to the present.
+ *
+ * @param probe The probe to report, its samples are sorted.
+ * @param budget The highest 99th percentile of the latency to the present in milliseconds, or 0 for no limit.
+ * @return Return 0 on success or another number when the latency went over the budget or no sample was taken.
+ */
+uint8_t report_latency_probe(const struct LatencyProbe* probe, double budget)
+{
+    info("Latency probe: %zu samples, %zu presses lost", probe->samples, probe->lost);
+
+    if (probe->samples == 0) {
+        error("The latency probe took no sample");
+        return 1;
+    }
+
+    // The observation is a single timestamp on the emulation thread, what follows it is the frame it lands on being
+    // published, acquired and presented
+    uint64_t* observation_to_present = malloc(probe->samples * sizeof(uint64_t));
+    if (observation_to_present != NULL) {
+        for (size_t i = 0; i < probe->samples; i++) {
+            observation_to_present[i] = probe->present_latencies[i] - probe->observation_latencies[i];
+        }
+    }
+
+    print_distribution("key to observation", probe->observation_latencies, probe->samples);
+
+    if (observation_to_present != NULL) {
+        print_distribution("observation to present", observation_to_present, probe->samples);
+        free(observation_to_present);
+    }
+
+    double p99 = print_distribution("key to present", probe->present_latencies, probe->samples);
+
+    if (budget != 0 && p99 > budget) {
+        error("The 99th percentile of the latency, %.2fms, is over the budget of %.2fms", p99, budget);
+        return 2;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Safely deallocate a probe.
+ *
+ * @param probe The probe to be deallocated.
+ */
+void delete_latency_probe(struct LatencyProbe* probe)
+{
+    free(probe->observation_latencies);
+    free(probe->present_latencies);
+    free(probe);
+}
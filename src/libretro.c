@@ -0,0 +1,549 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "beep.h"
+#include "libretro.h"
+#include "logging.h"
+#include "quirks.h"
+#include "screen.h"
+#include "serialization.h"
+#include "virtual-machine.h"
+
+static constexpr unsigned FRAMES_PER_SECOND = 60;
+static constexpr size_t AUDIO_FRAMES_PER_FRAME = AUDIO_SAMPLE_RATE / FRAMES_PER_SECOND;
+
+/**
+ * @brief Maps a CHIP-8 key (the index of the array) with a libretro keyboard key, the same layout as the window.
+ */
+static const unsigned chip8_key_to_retro_key[] = {
+    RETROK_x, // 0
+    RETROK_1, // 1
+    RETROK_2, // 2
+    RETROK_3, // 3
+    RETROK_q, // 4
+    RETROK_w, // 5
+    RETROK_e, // 6
+    RETROK_a, // 7
+    RETROK_s, // 8
+    RETROK_d, // 9
+    RETROK_z, // A
+    RETROK_c, // B
+    RETROK_4, // C
+    RETROK_r, // D
+    RETROK_f, // E
+    RETROK_v // F
+};
+
+/**
+ * @brief Maps a joypad button (the index of the array) with a CHIP-8 key. The directions are the 2/4/6/8 keys most
+ *  games move with and A is the 5 key between them.
+ */
+static const uint8_t retro_button_to_chip8_key[] = {
+    [RETRO_DEVICE_ID_JOYPAD_B] = 0x0,
+    [RETRO_DEVICE_ID_JOYPAD_Y] = 0x1,
+    [RETRO_DEVICE_ID_JOYPAD_SELECT] = 0xE,
+    [RETRO_DEVICE_ID_JOYPAD_START] = 0xF,
+    [RETRO_DEVICE_ID_JOYPAD_UP] = 0x2,
+    [RETRO_DEVICE_ID_JOYPAD_DOWN] = 0x8,
+    [RETRO_DEVICE_ID_JOYPAD_LEFT] = 0x4,
+    [RETRO_DEVICE_ID_JOYPAD_RIGHT] = 0x6,
+    [RETRO_DEVICE_ID_JOYPAD_A] = 0x5,
+    [RETRO_DEVICE_ID_JOYPAD_X] = 0x3,
+    [RETRO_DEVICE_ID_JOYPAD_L] = 0x7,
+    [RETRO_DEVICE_ID_JOYPAD_R] = 0x9,
+};
+
+static struct retro_variable core_options[] = {
+    { "och8s_quirk_profile", "Quirk profile (restart); vip|schip-legacy|schip-modern|xo-chip" },
+    { "och8s_clock", "Opcodes per second; 700|1000|1500|2000|3000|5000|10000|20000|50000|200|300|500" },
+    { NULL, NULL },
+};
+
+/**
+ * @brief The state of the core, libretro cores are singletons driven by the frontend through the `retro_*` functions.
+ */
+struct Core {
+    retro_environment_t environment;
+    retro_video_refresh_t video_refresh;
+    retro_audio_sample_batch_t audio_sample_batch;
+    retro_input_poll_t input_poll;
+    retro_input_state_t input_state;
+
+    // The frontend can show the previous frame again when none is given, so unchanged screens aren't converted
+    bool can_dupe;
+
+    char* rom_path;
+    enum QuirkProfile quirk_profile;
+    uint32_t opcodes_per_second;
+
+    struct VirtualMachine* vm;
+    struct Screen* screen;
+
+    // The memory size of the running machine, the quirk profile option only applies on the next reset
+    size_t memory_size;
+
+    // Bitmask of the keys pressed on the previous frame, only the changes are sent to the virtual machine
+    uint16_t pressed_keys;
+
+    // Accumulates the fractions of opcode left when the clock isn't a multiple of 60
+    uint32_t pending_opcodes;
+
+    uint32_t audio_sample_counter;
+
+    uint8_t indexes[SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_HIGH_RESOLUTION_WIDTH];
+    uint32_t pixels[SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_HIGH_RESOLUTION_WIDTH];
+    int16_t audio[AUDIO_FRAMES_PER_FRAME * 2];
+};
+
+static struct Core core;
+
+RETRO_API void retro_set_environment(retro_environment_t callback)
+{
+    core.environment = callback;
+    callback(RETRO_ENVIRONMENT_SET_VARIABLES, core_options);
+}
+
+RETRO_API void retro_set_video_refresh(retro_video_refresh_t callback)
+{
+    core.video_refresh = callback;
+}
+
+RETRO_API void retro_set_audio_sample(retro_audio_sample_t callback)
+{
+    // Only the batched callback is used
+    (void)callback;
+}
+
+RETRO_API void retro_set_audio_sample_batch(retro_audio_sample_batch_t callback)
+{
+    core.audio_sample_batch = callback;
+}
+
+RETRO_API void retro_set_input_poll(retro_input_poll_t callback)
+{
+    core.input_poll = callback;
+}
+
+RETRO_API void retro_set_input_state(retro_input_state_t callback)
+{
+    core.input_state = callback;
+}
+
+RETRO_API void retro_init(void)
+{
+    core.quirk_profile = QUIRK_PROFILE_COSMAC_VIP;
+    core.opcodes_per_second = 700;
+}
+
+RETRO_API void retro_deinit(void)
+{
+}
+
+RETRO_API unsigned retro_api_version(void)
+{
+    return RETRO_API_VERSION;
+}
+
+RETRO_API void retro_get_system_info(struct retro_system_info* info)
+{
+    memset(info, 0, sizeof(struct retro_system_info));
+
+    info->library_name = "och8S";
+    info->library_version = "1.0.0";
+    info->valid_extensions = "ch8|sc8|xo8|c8";
+
+    // The virtual machine loads the ROM from its path
+    info->need_fullpath = true;
+}
+
+RETRO_API void retro_get_system_av_info(struct retro_system_av_info* info)
+{
+    // Low resolution screens are doubled, so the size never changes
+    info->geometry.base_width = SCREEN_HIGH_RESOLUTION_WIDTH;
+    info->geometry.base_height = SCREEN_HIGH_RESOLUTION_HEIGHT;
+    info->geometry.max_width = SCREEN_HIGH_RESOLUTION_WIDTH;
+    info->geometry.max_height = SCREEN_HIGH_RESOLUTION_HEIGHT;
+    info->geometry.aspect_ratio = 2.0f;
+
+    info->timing.fps = FRAMES_PER_SECOND;
+    info->timing.sample_rate = AUDIO_SAMPLE_RATE;
+}
+
+RETRO_API void retro_set_controller_port_device(unsigned port, unsigned device)
+{
+    (void)port;
+    (void)device;
+}
+
+/**
+ * @brief Apply the core options set on the frontend.
+ */
+static void read_core_options()
+{
+    struct retro_variable variable = { "och8s_quirk_profile", NULL };
+
+    if (core.environment(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) && variable.value != NULL
+        && parse_quirk_profile(variable.value, &core.quirk_profile) != 0) {
+        warning("Unknown quirk profile '%s'", variable.value);
+    }
+
+    variable = (struct retro_variable) { "och8s_clock", NULL };
+
+    if (core.environment(RETRO_ENVIRONMENT_GET_VARIABLE, &variable) && variable.value != NULL) {
+        uint32_t opcodes_per_second = strtoul(variable.value, NULL, 10);
+
+        if (opcodes_per_second != 0) {
+            core.opcodes_per_second = opcodes_per_second;
+        }
+    }
+}
+
+/**
+ * @brief Create the screen and the virtual machine of the loaded ROM, or reset them in place when they already exist.
+ *
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t start_machine()
+{
+    if (core.vm != NULL) {
+        // The keys held on the virtual machine are kept, so they stay in sync with `core.pressed_keys`
+        if (reset_virtual_machine(core.vm, core.rom_path, core.quirk_profile) != 0) {
+            return 2;
+        }
+
+        reset_screen(core.screen);
+    } else {
+        core.screen = create_screen();
+        if (core.screen == NULL) {
+            return 1;
+        }
+
+        core.vm = create_virtual_machine(core.rom_path, core.quirk_profile);
+        if (core.vm == NULL) {
+            delete_screen(core.screen);
+            core.screen = NULL;
+            return 2;
+        }
+
+        core.pressed_keys = 0;
+    }
+
+    core.memory_size = core.vm->address_mask + 1;
+
+    core.pending_opcodes = 0;
+    core.audio_sample_counter = 0;
+
+    // The first frame is always sent
+    core.screen->dirty = true;
+
+    return 0;
+}
+
+/**
+ * @brief Restart the ROM from scratch, applying the quirk profile core option.
+ */
+RETRO_API void retro_reset(void)
+{
+    if (core.rom_path != NULL && start_machine() != 0) {
+        error("The ROM wasn't able to be reloaded");
+    }
+}
+
+/**
+ * @brief Send to the virtual machine the keys that changed since the last frame, from the keyboard and the first joypad.
+ */
+static void poll_keys()
+{
+    core.input_poll();
+
+    uint16_t pressed_keys = 0;
+
+    for (uint8_t key = 0; key < 16; key++) {
+        if (core.input_state(0, RETRO_DEVICE_KEYBOARD, 0, chip8_key_to_retro_key[key]) != 0) {
+            pressed_keys |= 1 << key;
+        }
+    }
+
+    for (unsigned button = 0; button < sizeof(retro_button_to_chip8_key); button++) {
+        if (core.input_state(0, RETRO_DEVICE_JOYPAD, 0, button) != 0) {
+            pressed_keys |= 1 << retro_button_to_chip8_key[button];
+        }
+    }
+
+    uint16_t changed_keys = pressed_keys ^ core.pressed_keys;
+
+    for (uint8_t key = 0; key < 16; key++) {
+        if ((changed_keys >> key) & 1) {
+            set_key_state(core.vm, key, (pressed_keys >> key) & 1);
+        }
+    }
+
+    core.pressed_keys = pressed_keys;
+}
+
+/**
+ * @brief Send the screen to the frontend, or ask it to repeat the previous frame if nothing was drawn.
+ */
+static void refresh_video()
+{
+    struct Screen* screen = core.screen;
+
+    if (!screen->dirty && core.can_dupe) {
+        core.video_refresh(NULL, SCREEN_HIGH_RESOLUTION_WIDTH, SCREEN_HIGH_RESOLUTION_HEIGHT, 0);
+        return;
+    }
+
+    get_screen_palette_indexes(screen, core.indexes);
+
+    for (size_t y = 0; y < SCREEN_HIGH_RESOLUTION_HEIGHT; y++) {
+        for (size_t x = 0; x < SCREEN_HIGH_RESOLUTION_WIDTH; x++) {
+            // XRGB8888 ignores the alpha of the palette
+            core.pixels[y][x] = SCREEN_PALETTE[core.indexes[y][x]];
+        }
+    }
+
+    core.video_refresh(core.pixels, SCREEN_HIGH_RESOLUTION_WIDTH, SCREEN_HIGH_RESOLUTION_HEIGHT,
+        sizeof(core.pixels[0]));
+    screen->dirty = false;
+}
+
+/**
+ * @brief Send the samples of a frame to the frontend, the beep on both channels or silence.
+ */
+static void render_audio()
+{
+    int16_t samples[AUDIO_FRAMES_PER_FRAME];
+
+    // The original CHIP-8 spec specify that the sound should start with more that one set in the timer
+    if (core.vm->sound_timer > 1) {
+        generate_beep(samples, AUDIO_FRAMES_PER_FRAME, &core.audio_sample_counter);
+    } else {
+        memset(samples, 0, sizeof(samples));
+        core.audio_sample_counter = 0;
+    }
+
+    for (size_t i = 0; i < AUDIO_FRAMES_PER_FRAME; i++) {
+        core.audio[i * 2] = samples[i];
+        core.audio[i * 2 + 1] = samples[i];
+    }
+
+    core.audio_sample_batch(core.audio, AUDIO_FRAMES_PER_FRAME);
+}
+
+/**
+ * @brief Emulate a frame: tick the timers, run the opcodes of 1/60 of a second and send the video and audio.
+ */
+RETRO_API void retro_run(void)
+{
+    struct VirtualMachine* vm = core.vm;
+
+    bool options_updated = false;
+    if (core.environment(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &options_updated) && options_updated) {
+        read_core_options();
+    }
+
+    poll_keys();
+
+    if (vm->delay_timer > 0) {
+        vm->delay_timer--;
+    }
+
+    if (vm->sound_timer > 0) {
+        vm->sound_timer--;
+    }
+
+    core.pending_opcodes += core.opcodes_per_second;
+    uint32_t steps = core.pending_opcodes / FRAMES_PER_SECOND;
+    core.pending_opcodes %= FRAMES_PER_SECOND;
+
+    // The frontend keeps calling `retro_run()` until it handles the shutdown, the machine is left stopped
+    if (!vm->exited && vm->run_cpu(vm, core.screen, steps) != 0) {
+        error("The virtual machine failed, stopping the core");
+        vm->exited = true;
+        core.environment(RETRO_ENVIRONMENT_SHUTDOWN, NULL);
+    } else if (vm->exited) {
+        core.environment(RETRO_ENVIRONMENT_SHUTDOWN, NULL);
+    }
+
+    refresh_video();
+    render_audio();
+}
+
+RETRO_API size_t retro_serialize_size(void)
+{
+    // The fraction of opcode pending is saved too, or the machine would run a different number of steps after loading
+    return get_state_size() + sizeof(core.pending_opcodes);
+}
+
+/**
+ * @brief Save the state in the same format as the savestate files, plus the opcodes pending of the frame.
+ *
+ * @param data Where the state is written.
+ * @param size The size of `data`, at least `retro_serialize_size()`.
+ * @return If the state was saved.
+ */
+RETRO_API bool retro_serialize(void* data, size_t size)
+{
+    if (size < retro_serialize_size()) {
+        return false;
+    }
+
+    FILE* f = fmemopen(data, size, "wb");
+    if (f == NULL) {
+        error("The serialization buffer wasn't able to be opened");
+        return false;
+    }
+
+    uint8_t result = write_state(core.vm, core.screen, f);
+
+    if (result == 0 && fwrite(&core.pending_opcodes, sizeof(core.pending_opcodes), 1, f) < 1) {
+        error("The pending opcodes weren't able to be fully written into the state");
+        result = 1;
+    }
+
+    return fclose(f) == 0 && result == 0;
+}
+
+/**
+ * @brief Load a state saved by `retro_serialize()`.
+ *
+ * @param data The saved state.
+ * @param size The size of `data`.
+ * @return If the state was loaded.
+ */
+RETRO_API bool retro_unserialize(const void* data, size_t size)
+{
+    if (size < retro_serialize_size()) {
+        return false;
+    }
+
+    // The buffer is only read
+    FILE* f = fmemopen((void*)data, size, "rb");
+    if (f == NULL) {
+        error("The serialization buffer wasn't able to be opened");
+        return false;
+    }
+
+    // Frontends expect a failed unserialize to change nothing, the run-ahead and the rewind depend on it, so the state
+    // is only replaced once it was fully read and validated
+    uint8_t result = read_state(core.vm, core.screen, f);
+
+    if (result == 0 && fread(&core.pending_opcodes, sizeof(core.pending_opcodes), 1, f) < 1) {
+        error("The pending opcodes weren't able to be fully read from the state");
+        result = 1;
+    }
+
+    fclose(f);
+
+    if (result != 0) {
+        return false;
+    }
+
+    // The restored screen must be sent even if the frontend could repeat the last frame
+    core.screen->dirty = true;
+
+    return true;
+}
+
+RETRO_API void retro_cheat_reset(void)
+{
+}
+
+RETRO_API void retro_cheat_set(unsigned index, bool enabled, const char* code)
+{
+    (void)index;
+    (void)enabled;
+    (void)code;
+}
+
+/**
+ * @brief Start the virtual machine with the ROM found on the path given by the frontend.
+ *
+ * @param game The ROM to load.
+ * @return If the ROM was loaded.
+ */
+RETRO_API bool retro_load_game(const struct retro_game_info* game)
+{
+    if (game == NULL || game->path == NULL) {
+        error("The core can't run without a ROM");
+        return false;
+    }
+
+    enum retro_pixel_format pixel_format = RETRO_PIXEL_FORMAT_XRGB8888;
+    if (!core.environment(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &pixel_format)) {
+        error("The frontend doesn't support the XRGB8888 pixel format");
+        return false;
+    }
+
+    core.can_dupe = false;
+    core.environment(RETRO_ENVIRONMENT_GET_CAN_DUPE, &core.can_dupe);
+
+    read_core_options();
+
+    core.rom_path = strdup(game->path);
+    if (core.rom_path == NULL) {
+        error("Malloc 'core.rom_path' failed");
+        return false;
+    }
+
+    if (start_machine() != 0) {
+        free(core.rom_path);
+        core.rom_path = NULL;
+        return false;
+    }
+
+    info("Quirk profile: %s", get_quirk_profile_name(core.quirk_profile));
+
+    return true;
+}
+
+RETRO_API bool retro_load_game_special(unsigned game_type, const struct retro_game_info* info, size_t num_info)
+{
+    (void)game_type;
+    (void)info;
+    (void)num_info;
+
+    return false;
+}
+
+RETRO_API void retro_unload_game(void)
+{
+    if (core.vm != NULL) {
+        free(core.vm);
+        delete_screen(core.screen);
+    }
+
+    free(core.rom_path);
+
+    core.vm = NULL;
+    core.screen = NULL;
+    core.rom_path = NULL;
+}
+
+RETRO_API unsigned retro_get_region(void)
+{
+    return RETRO_REGION_NTSC;
+}
+
+RETRO_API void* retro_get_memory_data(unsigned id)
+{
+    if (id != RETRO_MEMORY_SYSTEM_RAM || core.vm == NULL) {
+        return NULL;
+    }
+
+    return core.vm->memory;
+}
+
+RETRO_API size_t retro_get_memory_size(unsigned id)
+{
+    if (id != RETRO_MEMORY_SYSTEM_RAM || core.vm == NULL) {
+        return 0;
+    }
+
+    // Only XO-CHIP programs can address past the first 4KB
+    return core.memory_size;
+}
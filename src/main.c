@@ -1,32 +1,32 @@
 #include <SDL2/SDL.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "analysis-cache.h"
 #include "audio.h"
+#include "capture.h"
+#include "configuration.h"
+#include "debugger.h"
+#include "emulation.h"
+#include "frame-pacing.h"
+#include "gdb-stub.h"
 #include "keys.h"
+#include "latency-probe.h"
 #include "logging.h"
+#include "metrics.h"
+#include "perf-counters.h"
+#include "quirks.h"
 #include "render.h"
-#include "save-state.h"
+#include "scaler.h"
+#include "screen.h"
+#include "shared-screen.h"
+#include "terminal.h"
+#include "trace.h"
 #include "virtual-machine.h"
-
-/**
- * @brief Get in microseconds a timestamp of the current UTC time
- *
- * @return The timestamp in microseconds
- */
-uint64_t get_microsecond_timestamp()
-{
-    struct timespec timestamp;
-
-    if (timespec_get(&timestamp, TIME_UTC) == 0) {
-        error("Can't get timestamp");
-        return 0;
-    }
-
-    return timestamp.tv_sec * 100000 + timestamp.tv_nsec / 1000;
-}
+#include "wall.h"
 
 /**
  * @brief Print the help menu
@@ -37,26 +37,414 @@ void print_help(char* argv[]) {
   fprintf(stderr, "Usage: %s [options] <rom_path>...\n", argv[0]);
   puts("Options:");
   puts("  -d Enable the debug logs");
-  puts("  -s Enable manual stepping pressing the key ENTER on the terminal");
+  puts("  -s Start stopped on the debugger, its commands are typed on the terminal (h lists them)");
+  puts("  -g <address> Serve the GDB remote protocol on a localhost TCP port, like 1234, or a Unix socket path");
+  puts("  -i <path> Load the settings from the given configuration file instead of och8s.ini on the preferences directory");
+  puts("  -q <profile> Set the quirks of the platform: vip, schip-legacy, schip-modern or xo-chip, by default the configured or detected one");
+  puts("  -y Sync the presentation to the display refresh rate (vsync)");
+  puts("  -f <filter> Upscale the screen with a filter: none (default), scale2x, scale3x, epx or scanlines");
+  puts("  -b <frames> Run the given number of frames as fast as possible without presenting them and report the speed");
+  puts("  -r <path> Record the video of the emulation, as YUV4MPEG2 to a .y4m file or as an animated GIF to a .gif file");
+  puts("  -w <path> Record the audio of the emulation to a WAV file");
+  puts("  -o <name> Publish the screen and the registers every frame to the POSIX shared memory with the given name, like /och8s");
+  puts("  -p Print the runtime metrics every second, F3 shows them over the screen");
+  puts("  -j <path> Serve the runtime metrics as JSON on a Unix socket, like /tmp/och8s-metrics.sock");
+  puts("  -c <path> Sample the hardware counters around the emulation and the presentation of every frame, logging them as CSV to the file");
+  puts("  -e <path> Trace the phases of every frame on each thread, writing them on exit as Chrome trace event JSON viewable on Perfetto");
+  puts("  -n Run without any video output, the frames are acquired but never drawn (null video backend)");
+  puts("  -l <presses> Measure the latency from a key press to its observation and to the present with build/examples/latency-probe.ch8");
+  puts("  -m <ms> Fail when the 99th percentile of the latency measured by -l from the key press to the present goes over it");
+  puts("  -t <charset> Draw the screen on the terminal instead of a window: half-block or braille");
+  puts("  -u Report the time each phase of the startup takes until the first frame is presented and quit");
   puts("  -h Show this info message");
   puts("  -v Show the version installed of the emulator");
   puts("");
+  puts("While running F5 resets the ROM and dropping another ROM on the window switches to it.");
+  puts("Given many ROMs they run together on a grid of the window (only -d, -i, -q, -y, -p and -j apply to them),");
+  puts("Tab or a click chooses the one that gets the keys.");
+  puts("");
   puts("Created with ❤️ by Jorge \"Kutu\" Dobón Blanco.");
 }
 
+/**
+ * @brief Switch the running virtual machine to a ROM dropped on the window, with its own configuration section and
+ *  detected quirks. The window, its scaler and the audio device are kept.
+ *
+ * @param emulation The emulation to switch the ROM of.
+ * @param rom_path The path to the dropped ROM.
+ * @param configuration_path The path to the configuration file or NULL for the default one.
+ * @param given_quirk_profile The quirks given by the command line, that win over the rest, or NULL.
+ * @param configuration The configuration of the running ROM, replaced by the one of the dropped ROM.
+ * @param analysis The analysis of the running ROM, replaced by the one of the dropped ROM.
+ * @return Return 0 on success or another number on failure, the running ROM is kept on failure.
+ */
+static uint8_t swap_dropped_rom(struct Emulation* emulation, const char* rom_path, const char* configuration_path,
+    const enum QuirkProfile* given_quirk_profile, struct Configuration* configuration,
+    const struct RomAnalysis** analysis)
+{
+    const struct RomAnalysis* dropped_analysis = load_rom_analysis(rom_path);
+    if (dropped_analysis == NULL) {
+        warning("The dropped file '%s' can't be run as a ROM", rom_path);
+        return 1;
+    }
+
+    struct Configuration dropped_configuration;
+    if (load_configuration(&dropped_configuration, configuration_path, dropped_analysis->rom_hash) != 0) {
+        goto configuration_failed;
+    }
+
+    bool quirk_profile_detected = given_quirk_profile == NULL && !dropped_configuration.quirk_profile_set;
+
+    if (given_quirk_profile != NULL) {
+        dropped_configuration.quirk_profile = *given_quirk_profile;
+    } else if (quirk_profile_detected) {
+        dropped_configuration.quirk_profile = dropped_analysis->quirk_profile;
+    }
+
+    if (request_rom_swap(emulation, rom_path, dropped_configuration.quirk_profile,
+            dropped_configuration.opcodes_per_second, dropped_analysis->idle_loops)
+        != 0) {
+        warning("The dropped ROM '%s' can't be loaded, the running one is kept", rom_path);
+        goto swap_failed;
+    }
+
+    info("ROM hash: %016llx%s", (unsigned long long)dropped_analysis->rom_hash,
+        quirk_profile_detected ? " (quirks detected)" : "");
+
+    // The settings only read at startup, like the renderer or the scaler, stay as they were until the next launch
+    dropped_configuration.scaler = configuration->scaler;
+    *configuration = dropped_configuration;
+
+    if (*analysis != NULL) {
+        unload_rom_analysis(*analysis);
+    }
+
+    *analysis = dropped_analysis;
+
+    return 0;
+
+swap_failed:
+configuration_failed:
+    unload_rom_analysis(dropped_analysis);
+
+    return 1;
+}
+
+/**
+ * @brief Report how long each phase of the startup took, from the start of the process to the first presented frame.
+ *
+ * @param start The moment the process started.
+ * @param configuration_ready The moment the ROM was analyzed and the configuration loaded.
+ * @param sdl_ready The moment SDL was initialized.
+ * @param window_ready The moment the window was created.
+ * @param emulation_ready The moment the emulation thread was started.
+ * @param benchmark If it is reported as the result of `-u` or as a debug log.
+ */
+static void report_startup(uint64_t start, uint64_t configuration_ready, uint64_t sdl_ready, uint64_t window_ready,
+    uint64_t emulation_ready, bool benchmark)
+{
+    uint64_t first_frame = get_monotonic_timestamp();
+
+    char report[256];
+    snprintf(report, sizeof(report),
+        "%.2fms to the first frame (analysis and configuration %.2fms, SDL %.2fms, window %.2fms, virtual machine "
+        "%.2fms, first frame %.2fms)",
+        (first_frame - start) / 1000000.0, (configuration_ready - start) / 1000000.0,
+        (sdl_ready - configuration_ready) / 1000000.0, (window_ready - sdl_ready) / 1000000.0,
+        (emulation_ready - window_ready) / 1000000.0, (first_frame - emulation_ready) / 1000000.0);
+
+    if (benchmark) {
+        info("Startup: %s", report);
+    } else {
+        debug("Startup: %s", report);
+    }
+}
+
+/**
+ * @brief Give the keys to another tile of a wall, releasing the ones held on the previous tile.
+ *
+ * @param wall The wall.
+ * @param focused The tile that gets the keys, updated to the new one.
+ * @param tile The new tile, ignored when there isn't any ROM on it.
+ */
+static void focus_wall_tile(struct Wall* wall, size_t* focused, size_t tile)
+{
+    if (tile >= wall->count || tile == *focused) {
+        return;
+    }
+
+    struct VirtualMachine* vm = wall->instances[*focused].vm;
+    uint16_t pressed_keys = atomic_load_explicit(&vm->pressed_keys, memory_order_relaxed);
+
+    for (uint8_t key = 0; key < 16; key++) {
+        if ((pressed_keys >> key) & 1) {
+            set_key_state(vm, key, false);
+        }
+    }
+
+    *focused = tile;
+}
+
+/**
+ * @brief Run many ROMs together on a wall, each one on a tile of a single window and all of them on a single
+ *  emulation thread. Only the focused tile gets the keys.
+ *
+ * @param rom_paths The paths to the ROMs.
+ * @param count The number of ROMs.
+ * @param configuration_path The path to the configuration file or NULL for the default one.
+ * @param given_quirk_profile The quirks given by the command line or NULL.
+ * @param vsync If presenting the wall should wait for the display refresh.
+ * @param print_metrics If the runtime metrics are printed every second.
+ * @param metrics_socket_path The path of the socket where the metrics are served or NULL.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t run_wall_window(char** rom_paths, size_t count, const char* configuration_path,
+    const enum QuirkProfile* given_quirk_profile, bool vsync, bool print_metrics, const char* metrics_socket_path)
+{
+    struct Wall* wall = create_wall(rom_paths, count, configuration_path, given_quirk_profile);
+    if (wall == NULL) {
+        return 1;
+    }
+
+    // The audio is initialized by the emulation thread the first time any of the ROMs plays a sound
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        error("Cound't initialze SDL: %s", SDL_GetError());
+        goto sdl_failed;
+    }
+
+    struct Metrics metrics;
+    init_metrics(&metrics);
+    wall->metrics = &metrics;
+
+    struct Window* window = create_wall_window(vsync, wall->columns, wall->rows);
+    if (window == NULL) {
+        goto window_failed;
+    }
+
+    debug("Wall window created with %zux%zu tiles", wall->columns, wall->rows);
+
+    if (metrics_socket_path != NULL) {
+        if (open_metrics_socket(&metrics, metrics_socket_path) != 0) {
+            goto metrics_socket_failed;
+        }
+
+        info("Serving the metrics on '%s'", metrics_socket_path);
+    }
+
+    struct FramePacer pacer;
+    if (start_frame_pacer(&pacer, 60, vsync) != 0) {
+        goto frame_pacer_failed;
+    }
+
+    SDL_Thread* emulation_thread = SDL_CreateThread(run_wall, "emulation", wall);
+    if (emulation_thread == NULL) {
+        error("Couldn't create the emulation thread: %s", SDL_GetError());
+        goto emulation_thread_failed;
+    }
+
+    size_t focused = 0;
+    uint64_t iteration_start = 0;
+
+    const struct Screen* tiles[WALL_MAX_INSTANCES];
+
+    debug("Starting the wall mainloop");
+    while (!atomic_load_explicit(&wall->quit, memory_order_relaxed)) {
+        if (iteration_start != 0) {
+            record_latency(&metrics.event_loop_times, get_monotonic_timestamp() - iteration_start);
+        }
+
+        wait_next_frame(&pacer);
+        iteration_start = get_monotonic_timestamp();
+
+        bool redraw = false;
+
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                debug("Quit event detected, closing the emulator");
+                atomic_store(&wall->quit, true);
+            }
+
+            if (event.type == SDL_WINDOWEVENT) {
+                if (event.window.event == SDL_WINDOWEVENT_RESIZED || event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                    redraw = true;
+                }
+            }
+
+            // The renderer gives the position on the grid, as it has a logical size, the clicks on the borders of the
+            // letterbox are outside of it
+            if (event.type == SDL_MOUSEBUTTONDOWN && event.button.x >= 0 && event.button.y >= 0
+                && (size_t)event.button.x < window->width && (size_t)event.button.y < window->height) {
+                size_t tile = (size_t)event.button.y / SCREEN_HIGH_RESOLUTION_HEIGHT * wall->columns
+                    + (size_t)event.button.x / SCREEN_HIGH_RESOLUTION_WIDTH;
+
+                focus_wall_tile(wall, &focused, tile);
+                redraw = true;
+            }
+
+            if (event.type == SDL_KEYDOWN) {
+                if (event.key.keysym.scancode == SDL_SCANCODE_TAB) {
+                    focus_wall_tile(wall, &focused, (focused + 1) % wall->count);
+                    redraw = true;
+                    continue;
+                }
+
+                if (event.key.keysym.scancode == SDL_SCANCODE_F5) {
+                    atomic_store(&wall->instances[focused].reset_requested, true);
+                }
+            }
+
+            if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
+                struct WallInstance* instance = &wall->instances[focused];
+
+                set_key_state(instance->vm, instance->configuration.scancode_keys[event.key.keysym.scancode],
+                    event.type == SDL_KEYDOWN);
+            }
+        }
+
+        if (update_metrics(&metrics) && print_metrics) {
+            char line[512];
+            format_metrics_line(&metrics.report, line, sizeof(line));
+            info("Metrics: %s", line);
+        }
+
+        serve_metrics_socket(&metrics);
+
+        // Only the tiles of the new frames are composed again
+        bool new_frames = false;
+
+        for (size_t index = 0; index < wall->count; index++) {
+            bool new_frame;
+            const struct Screen* frame = acquire_frame(&wall->instances[index].frames, &new_frame);
+
+            tiles[index] = new_frame ? frame : NULL;
+            new_frames = new_frames || new_frame;
+        }
+
+        // With vsync the present is what blocks the loop so it always happens
+        if (!new_frames && !redraw && !vsync) {
+            continue;
+        }
+
+        uint64_t present_start = get_monotonic_timestamp();
+
+        if (draw_wall(window, tiles, wall->count, focused) != 0) {
+            atomic_store(&wall->failed, true);
+            atomic_store(&wall->quit, true);
+        }
+
+        record_latency(&metrics.present_times, get_monotonic_timestamp() - present_start);
+    }
+
+    SDL_WaitThread(emulation_thread, NULL);
+    debug("Emulation thread finished");
+
+    bool failed = atomic_load(&wall->failed);
+
+    if (!failed) {
+        report_frame_pacing(&wall->pacer);
+    }
+
+    close_metrics(&metrics);
+    delete_window(window);
+
+    // Closed before the wall, that holds the mixer
+    SDL_CloseAudio();
+    delete_wall(wall);
+
+    info("Goodbye!");
+
+    SDL_Quit();
+
+    return failed ? 1 : 0;
+
+emulation_thread_failed:
+frame_pacer_failed:
+    close_metrics(&metrics);
+metrics_socket_failed:
+    delete_window(window);
+window_failed:
+    SDL_Quit();
+sdl_failed:
+    delete_wall(wall);
+
+    return 1;
+}
+
 int main(int argc, char* argv[])
 {
+    // The startup is measured from here to the first presented frame
+    uint64_t startup_start = get_monotonic_timestamp();
+
     char* rom_path = NULL;
-    bool manual_step = false;
+
+    // More than one runs them all on a wall
+    char* rom_paths[WALL_MAX_INSTANCES];
+    size_t rom_count = 0;
+    bool debugging = false;
+    bool vsync = false;
+    enum Scaler scaler = SCALER_NONE;
+    bool scaler_given = false;
+
+    // When NULL `och8s.ini` on the preferences directory is used if it exists
+    char* configuration_path = NULL;
+
+    // When not 0 run this number of frames as fast as possible and report the speed
+    uint64_t benchmark_frames = 0;
+    enum QuirkProfile quirk_profile = QUIRK_PROFILE_COSMAC_VIP;
+
+    // Without a quirk profile given the one of the configuration or the one detected by the analysis of the ROM is used
+    bool quirk_profile_given = false;
+
+    // When not NULL the emulation is recorded to these files
+    char* capture_video_path = NULL;
+    char* capture_audio_path = NULL;
+
+    // When not NULL the screen is exported to the shared memory with this name
+    char* shared_screen_name = NULL;
+
+    // Draw on the terminal instead of opening a window
+    bool terminal_mode = false;
+    enum TerminalCharset terminal_charset = TERMINAL_CHARSET_HALF_BLOCK;
+
+    // When not NULL a GDB client can attach on this port or socket path
+    char* gdb_address = NULL;
+
+    bool print_metrics = false;
+    char* metrics_socket_path = NULL;
+
+    // When not NULL the hardware counters are sampled and logged to this file
+    char* perf_log_path = NULL;
+
+    // When not NULL the phases of the frames are traced and written to this file
+    char* trace_path = NULL;
+
+    // Headless without the terminal either, nothing is drawn
+    bool null_video = false;
+
+    // When not 0 the latency of this number of key presses is measured, failing when its p99 goes over the budget
+    size_t latency_presses = 0;
+    double latency_budget = 0;
+
+    // Quit after the first presented frame, reporting how long each phase of the startup took
+    bool startup_benchmark = false;
 
     while (optind < argc) {
-        int option = getopt(argc, argv, "dshv");
+        int option = getopt(argc, argv, "dsg:q:yf:b:r:w:o:pj:c:e:nl:m:t:i:uhv");
 
+        // The options are moved before the ROMs by getopt, so every argument left is a ROM
         if (option == -1)
         {
-          rom_path = argv[optind];
-          
-          optind++;
+          if (argc - optind > (int)WALL_MAX_INSTANCES) {
+              error("At most %zu ROMs can be run at the same time", WALL_MAX_INSTANCES);
+              return 1;
+          }
+
+          for (; optind < argc; optind++) {
+              rom_paths[rom_count++] = argv[optind];
+          }
+
+          rom_path = rom_paths[0];
           continue;
         }
 
@@ -65,7 +453,91 @@ int main(int argc, char* argv[])
             debug_enable = true;
             break;
         case 's':
-            manual_step = true;
+            debugging = true;
+            break;
+        case 'g':
+            gdb_address = optarg;
+            break;
+        case 'y':
+            vsync = true;
+            break;
+        case 'f':
+            if (parse_scaler(optarg, &scaler) != 0) {
+                error("Unknown filter '%s'", optarg);
+                return 1;
+            }
+
+            scaler_given = true;
+            break;
+        case 'b':
+            benchmark_frames = strtoull(optarg, NULL, 10);
+
+            if (benchmark_frames == 0) {
+                error("Invalid number of benchmark frames '%s'", optarg);
+                return 1;
+            }
+            break;
+        case 'r':
+            capture_video_path = optarg;
+            break;
+        case 'w':
+            capture_audio_path = optarg;
+            break;
+        case 'o':
+            shared_screen_name = optarg;
+            break;
+        case 'p':
+            print_metrics = true;
+            break;
+        case 'j':
+            metrics_socket_path = optarg;
+            break;
+        case 'c':
+            perf_log_path = optarg;
+            break;
+        case 'e':
+            trace_path = optarg;
+            break;
+        case 'i':
+            configuration_path = optarg;
+            break;
+        case 'n':
+            null_video = true;
+            break;
+        case 'l':
+            latency_presses = strtoull(optarg, NULL, 10);
+
+            if (latency_presses == 0) {
+                error("Invalid number of latency probe presses '%s'", optarg);
+                return 1;
+            }
+            break;
+        case 'm':
+            latency_budget = strtod(optarg, NULL);
+
+            if (latency_budget <= 0) {
+                error("Invalid latency budget '%s'", optarg);
+                return 1;
+            }
+            break;
+        case 't':
+            if (parse_terminal_charset(optarg, &terminal_charset) != 0) {
+                error("Unknown terminal charset '%s'", optarg);
+                return 1;
+            }
+
+            terminal_mode = true;
+            break;
+        case 'u':
+            startup_benchmark = true;
+            break;
+        case 'q':
+            if (parse_quirk_profile(optarg, &quirk_profile) != 0) {
+                error("Unknown quirk profile '%s'", optarg);
+                return 1;
+            }
+
+            quirk_profile_given = true;
             break;
       case 'h':
         print_help(argv);
@@ -89,165 +561,604 @@ int main(int argc, char* argv[])
       return 1;
     }
 
-    if (manual_step) {
-      warning("Manual step is enabled, press ENTER on the terminal to step once the CPU");
+    if (rom_count > 1) {
+        bool single_rom_options = debugging || gdb_address != NULL || scaler_given || benchmark_frames != 0
+            || capture_video_path != NULL || capture_audio_path != NULL || shared_screen_name != NULL || terminal_mode
+            || null_video || perf_log_path != NULL || trace_path != NULL || latency_presses != 0 || startup_benchmark;
+
+        if (single_rom_options) {
+            error("Only -d, -i, -q, -y, -p and -j can be used while running many ROMs");
+            return 1;
+        }
+
+        return run_wall_window(rom_paths, rom_count, configuration_path, quirk_profile_given ? &quirk_profile : NULL,
+            vsync, print_metrics, metrics_socket_path);
     }
 
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
-        error("Cound't initialze SDL: %s", SDL_GetError());
+    if (debugging && terminal_mode) {
+        error("The debugger reads its commands from the terminal, it can't be used while drawing on it");
         return 1;
     }
 
-    uint32_t audio_sample_counter = 0;
-    if (setup_audio(&audio_sample_counter) != 0) {
-        goto audio_failed;
+    if (latency_presses != 0 && benchmark_frames != 0) {
+        error("The benchmark never presents the frames, the latency can't be measured while it runs");
+        return 1;
+    }
+
+    if (startup_benchmark && benchmark_frames != 0) {
+        error("The benchmark never presents the frames, the startup can't be measured while it runs");
+        return 1;
+    }
+
+    // Without a window, like on the terminal
+    bool headless = terminal_mode || null_video;
+
+    // Mapped from the cache after the first launch with the ROM, a ROM that can't be read is reported when the
+    // virtual machine loads it
+    const struct RomAnalysis* analysis = load_rom_analysis(rom_path);
+
+    if (analysis != NULL) {
+        debug("ROM analysis: %u instructions, %u basic blocks, %u idle loops", analysis->instruction_count,
+            analysis->block_count, analysis->idle_loop_count);
+    }
+
+    // Parsed once here, the running threads only read the resulting settings
+    struct Configuration configuration;
+    if (load_configuration(&configuration, configuration_path, analysis != NULL ? analysis->rom_hash : 0) != 0) {
+        goto configuration_failed;
+    }
+
+    // The command line wins over the configuration, that wins over the detected platform
+    if (scaler_given) {
+        configuration.scaler = scaler;
     }
 
-    uint16_t opcodes_per_second = 700;
+    if (quirk_profile_given) {
+        configuration.quirk_profile = quirk_profile;
+        configuration.quirk_profile_set = true;
+    }
+
+    bool quirk_profile_detected = !configuration.quirk_profile_set && analysis != NULL;
+
+    if (quirk_profile_detected) {
+        configuration.quirk_profile = analysis->quirk_profile;
+    }
+
+    quirk_profile = configuration.quirk_profile;
+    scaler = configuration.scaler;
+
+    uint64_t configuration_ready = get_monotonic_timestamp();
+
+    // The audio is initialized by the emulation thread the first time the ROM plays a sound
+    if (SDL_Init(headless ? 0 : SDL_INIT_VIDEO) != 0) {
+        error("Cound't initialze SDL: %s", SDL_GetError());
+        goto sdl_failed;
+    }
+
+    uint64_t sdl_ready = get_monotonic_timestamp();
+
+    // Counted from the start, so the audio callback can update it as soon as the device is opened
+    struct Metrics metrics;
+    init_metrics(&metrics);
+
+    // Each thread records on its own buffer, the audio one is given to the callback when the device is opened
+    struct Trace* trace = NULL;
+    struct TraceBuffer* audio_trace = NULL;
+
+    if (trace_path != NULL) {
+        trace = create_trace();
+        if (trace == NULL) {
+            goto trace_failed;
+        }
+
+        audio_trace = &trace->buffers[TRACE_THREAD_AUDIO];
+    }
+
+    uint32_t audio_sample_counter = 0;
 
     info("Welcome to och8S emulator!");
-    info("CPU Clock: %ldHz", opcodes_per_second);
+
+    if (analysis != NULL) {
+        info("ROM hash: %016llx", (unsigned long long)analysis->rom_hash);
+    }
+
+    info("CPU Clock: %uHz", configuration.opcodes_per_second);
+    info("Quirk profile: %s%s", get_quirk_profile_name(quirk_profile), quirk_profile_detected ? " (detected)" : "");
+    info("Filter: %s", get_scaler_name(scaler));
 
     srand(time(NULL));
 
-    struct Screen* screen = create_screen(32, 64);
+    struct Window* window = NULL;
+
+    if (!headless) {
+        if (configuration.renderer[0] != '\0') {
+            SDL_SetHint(SDL_HINT_RENDER_DRIVER, configuration.renderer);
+        }
+
+        window = create_window(vsync, scaler);
+        if (window == NULL) {
+            goto window_failed;
+        }
+
+        if (trace != NULL) {
+            window->trace = &trace->buffers[TRACE_THREAD_WINDOW];
+        }
+
+        debug("Window created");
+    }
+
+    uint64_t window_ready = get_monotonic_timestamp();
+
+    struct Screen* screen = create_screen();
     if (screen == NULL) {
-        return 1;
+        goto screen_failed;
     }
 
     debug("Screen created");
 
-    draw_screen(screen);
+    if (window != NULL) {
+        draw_screen(window, screen);
+    }
 
-    struct VirtualMachine* vm = create_virtual_machine(rom_path);
+    struct VirtualMachine* vm = create_virtual_machine(rom_path, quirk_profile);
     if (vm == NULL) {
         goto virtual_machine_failed;
     }
 
+    if (analysis != NULL) {
+        seed_idle_loops(vm, analysis->idle_loops);
+    }
+
     debug("Virtual machine created");
 
-    uint64_t cpu_old_time = get_microsecond_timestamp();
-    if (cpu_old_time == 0) {
-        goto cpu_old_time_failed;
+    if (debugging || gdb_address != NULL) {
+        if (create_debugger(vm, quirk_profile) == NULL) {
+            goto debugger_failed;
+        }
+
+        // The console is only read when asked for, a GDB client may be using the terminal
+        vm->debugger->console = debugging;
     }
 
-    uint64_t timers_old_time = get_microsecond_timestamp();
-    if (timers_old_time == 0) {
-        goto timers_old_time_failed;
+    if (debugging) {
+        info("Debugger stopped at the start of the ROM, type h on the terminal to list its commands");
+        stop_debugger(vm->debugger, vm, DEBUGGER_STOP_PAUSE);
     }
 
-    debug("Timers set");
+    struct Emulation emulation;
+    init_emulation(&emulation, vm, screen, &audio_sample_counter);
 
-    bool quit = false;
+    emulation.opcodes_per_second = configuration.opcodes_per_second;
+    emulation.benchmark_frames = benchmark_frames;
+    emulation.metrics = &metrics;
+    emulation.audio_buffer_samples = configuration.audio_buffer_samples;
+    emulation.audio_trace = audio_trace;
 
-    debug("Starting the mainloop");
-    while (!quit) {
-        uint64_t cpu_new_time = get_microsecond_timestamp();
-        if (cpu_new_time == 0) {
-            goto cpu_new_time_failed;
+    if (trace != NULL) {
+        emulation.trace = &trace->buffers[TRACE_THREAD_EMULATION];
+    }
+
+    if (capture_video_path != NULL || capture_audio_path != NULL) {
+        emulation.capture = create_capture(capture_video_path, capture_audio_path);
+        if (emulation.capture == NULL) {
+            goto capture_failed;
+        }
+
+        debug("Capture started");
+    }
+
+    if (gdb_address != NULL) {
+        emulation.gdb_stub = create_gdb_stub(gdb_address);
+        if (emulation.gdb_stub == NULL) {
+            goto gdb_stub_failed;
         }
 
-        uint64_t timers_new_time = get_microsecond_timestamp();
-        if (timers_new_time == 0) {
-            goto timers_new_time_failed;
+        info("Waiting for GDB clients on '%s'", gdb_address);
+    }
+
+    if (metrics_socket_path != NULL) {
+        if (open_metrics_socket(&metrics, metrics_socket_path) != 0) {
+            goto metrics_socket_failed;
         }
 
-        uint64_t cpu_delta = cpu_new_time - cpu_old_time;
-        uint64_t timers_delta = timers_new_time - timers_old_time;
+        info("Serving the metrics on '%s'", metrics_socket_path);
+    }
+
+    // The emulation thread opens its own counters, the presentation ones belong to this thread
+    FILE* perf_log = NULL;
+    struct PerfCounters emulation_counters;
+    struct PerfCounters presentation_counters;
 
-        // The original CHIP-8 spec specify that the sound should start with more that one set in the timer
-        if (vm->sound_timer > 1) {
-            SDL_PauseAudio(0);
-        } else {
-            SDL_PauseAudio(1);
-            audio_sample_counter = 0;
+    if (perf_log_path != NULL) {
+        perf_log = create_perf_log(perf_log_path);
+        if (perf_log == NULL) {
+            goto perf_log_failed;
         }
 
-        if (timers_delta >= 1.0 / 60.0 * 1000000) {
-            if (vm->delay_timer > 0) {
-                vm->delay_timer--;
-            }
+        init_perf_counters(&emulation_counters, "emulation", perf_log);
+        init_perf_counters(&presentation_counters, "presentation", perf_log);
+        open_perf_counters(&presentation_counters);
 
-            if (vm->sound_timer > 0) {
-                vm->sound_timer--;
-            }
+        emulation.perf_counters = &emulation_counters;
+    }
 
-            timers_old_time = timers_new_time;
+    if (shared_screen_name != NULL) {
+        emulation.shared_screen = create_shared_screen(shared_screen_name);
+        if (emulation.shared_screen == NULL) {
+            goto shared_screen_failed;
+        }
+
+        info("Exporting the screen to the shared memory '%s'", shared_screen_name);
+    }
+
+    struct LatencyProbe* latency_probe = NULL;
+
+    if (latency_presses != 0) {
+        latency_probe = create_latency_probe(latency_presses);
+        if (latency_probe == NULL) {
+            goto latency_probe_failed;
+        }
+
+        emulation.latency_probe = latency_probe;
+        info("Measuring the latency of %zu presses of the key %X", latency_presses, LATENCY_PROBE_KEY);
+    }
+
+    // Created the last so the errors of the rest are printed before switching to the alternate screen
+    struct Terminal* terminal = NULL;
+
+    if (terminal_mode) {
+        terminal = create_terminal(terminal_charset);
+        if (terminal == NULL) {
+            goto terminal_failed;
+        }
+    }
+
+    struct FramePacer pacer;
+    if (start_frame_pacer(&pacer, 60, vsync && window != NULL && benchmark_frames == 0) != 0) {
+        goto frame_pacer_failed;
+    }
+
+    // The emulation runs on its own thread so a slow present or a window resize never stalls it
+    SDL_Thread* emulation_thread = SDL_CreateThread(run_emulation, "emulation", &emulation);
+    if (emulation_thread == NULL) {
+        error("Couldn't create the emulation thread: %s", SDL_GetError());
+        goto emulation_thread_failed;
+    }
+
+    debug("Emulation thread started");
+
+    uint64_t emulation_ready = get_monotonic_timestamp();
+
+    // Owned by SDL, the path of the last ROM dropped on the window while it runs
+    char* dropped_rom_path = NULL;
+
+    // Toggled with F3
+    bool show_overlay = false;
+
+    // The time of an iteration doesn't include the wait for the next frame, so it starts after it
+    uint64_t iteration_start = 0;
+
+    uint64_t presented_frames = 0;
+
+    // Counts the new frames, only one of every `frame_skip + 1` of them is presented
+    uint64_t acquired_frames = 0;
+
+    struct TraceBuffer* window_trace = trace != NULL ? &trace->buffers[TRACE_THREAD_WINDOW] : NULL;
+
+    debug("Starting the mainloop");
+    while (!atomic_load_explicit(&emulation.quit, memory_order_relaxed)) {
+        if (iteration_start != 0) {
+            record_latency(&metrics.event_loop_times, get_monotonic_timestamp() - iteration_start);
+        }
+
+        wait_next_frame(&pacer);
+        iteration_start = get_monotonic_timestamp();
+
+        bool redraw = false;
+        uint64_t poll_start = start_trace_event(window_trace);
+
+        if (terminal != NULL && poll_terminal_keys(terminal, vm)) {
+            debug("Ctrl+C typed on the terminal, closing the emulator");
+            atomic_store(&emulation.quit, true);
         }
 
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
             if (event.type == SDL_QUIT) {
                 debug("Quit event detected, closing the emulator");
-                quit = true;
+                atomic_store(&emulation.quit, true);
             }
 
             if (event.type == SDL_WINDOWEVENT) {
                 if (event.window.event == SDL_WINDOWEVENT_RESIZED || event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
-                    draw_screen(screen);
+                    redraw = true;
                 }
             }
 
             if (event.type == SDL_KEYDOWN) {
                 if (event.key.keysym.scancode == SDL_SCANCODE_N) {
-                    if (save_state(vm, screen) != 0) {
-                        return 1;
-                    }
+                    atomic_store(&emulation.save_requested, true);
                 }
 
                 if (event.key.keysym.scancode == SDL_SCANCODE_M) {
-                    if (load_state(vm, screen) > 1) {
-                        return 1;
+                    atomic_store(&emulation.load_requested, true);
+                }
+
+                // Only the virtual machine is reset, the window and the audio device are kept
+                if (event.key.keysym.scancode == SDL_SCANCODE_F5
+                    && request_rom_swap(&emulation, rom_path, configuration.quirk_profile,
+                           configuration.opcodes_per_second, analysis != NULL ? analysis->idle_loops : NULL)
+                        != 0) {
+                    warning("The ROM '%s' can't be loaded again, it keeps running", rom_path);
+                }
+
+                if (event.key.keysym.scancode == SDL_SCANCODE_F3 && window != NULL) {
+                    show_overlay = !show_overlay;
+                    window->overlay[0] = '\0';
+
+                    if (show_overlay) {
+                        format_metrics_overlay(&metrics.report, window->overlay, sizeof(window->overlay));
                     }
+
+                    redraw = true;
                 }
+
+                set_key_state(vm, configuration.scancode_keys[event.key.keysym.scancode], true);
+            }
+
+            if (event.type == SDL_KEYUP) {
+                set_key_state(vm, configuration.scancode_keys[event.key.keysym.scancode], false);
             }
 
-            if (event.type == SDL_KEYUP && vm->wait_key == -1) {
-                vm->wait_key = sdl_scancode_to_chip8_key(event.key.keysym.scancode);
+            if (event.type == SDL_DROPFILE) {
+                if (swap_dropped_rom(&emulation, event.drop.file, configuration_path,
+                        quirk_profile_given ? &quirk_profile : NULL, &configuration, &analysis)
+                    == 0) {
+                    SDL_free(dropped_rom_path);
+                    dropped_rom_path = event.drop.file;
+                    rom_path = dropped_rom_path;
+                } else {
+                    SDL_free(event.drop.file);
+                }
             }
         }
 
-        if (manual_step) {
-          getchar();
+        finish_trace_event(window_trace, "poll events", poll_start);
+
+        if (latency_probe != NULL) {
+            inject_latency_probe(latency_probe, vm);
         }
-    
-        if (cpu_delta >= (1.0 / opcodes_per_second) * 1000000) {
-            if (step_cpu(vm, screen) != 0) {
-                goto step_cpu_failed;
+
+        if (update_metrics(&metrics)) {
+            if (print_metrics) {
+                char line[512];
+                format_metrics_line(&metrics.report, line, sizeof(line));
+                info("Metrics: %s", line);
             }
 
-            cpu_old_time = cpu_new_time;
+            if (show_overlay) {
+                format_metrics_overlay(&metrics.report, window->overlay, sizeof(window->overlay));
+                redraw = true;
+            }
+        }
+
+        serve_metrics_socket(&metrics);
+
+        if (benchmark_frames != 0) {
+            continue;
         }
 
-        SDL_Delay(1);
+        bool new_frame;
+        const struct Screen* frame = acquire_frame(&emulation.frames, &new_frame);
+
+        if (new_frame && acquired_frames++ % (configuration.frame_skip + 1) != 0) {
+            new_frame = false;
+        }
+
+        // With vsync the present is what blocks the loop so it always happens
+        if (window == NULL ? !new_frame : !new_frame && !redraw && !vsync) {
+            continue;
+        }
+
+        uint64_t present_start = get_monotonic_timestamp();
+
+        if (emulation.perf_counters != NULL) {
+            start_perf_sample(&presentation_counters);
+        }
+
+        // The window traces its drawing and its present on its own
+        uint64_t draw_start = start_trace_event(terminal != NULL ? window_trace : NULL);
+
+        // Without a window nor a terminal the frame is just acquired, the null video backend
+        uint8_t result = terminal != NULL ? draw_terminal(terminal, frame) : window != NULL ? draw_screen(window, frame) : 0;
+
+        if (result != 0) {
+            atomic_store(&emulation.failed, true);
+            atomic_store(&emulation.quit, true);
+        }
+
+        finish_trace_event(terminal != NULL ? window_trace : NULL, "draw terminal", draw_start);
+
+        if (emulation.perf_counters != NULL) {
+            finish_perf_sample(&presentation_counters, presented_frames, 1);
+        }
+
+        presented_frames++;
+        record_latency(&metrics.present_times, get_monotonic_timestamp() - present_start);
+
+        if (presented_frames == 1) {
+            report_startup(startup_start, configuration_ready, sdl_ready, window_ready, emulation_ready,
+                startup_benchmark);
+
+            if (startup_benchmark) {
+                atomic_store(&emulation.quit, true);
+            }
+        }
+
+        if (latency_probe != NULL) {
+            present_latency_probe(latency_probe, vm, frame);
+
+            if (latency_probe->state == LATENCY_PROBE_DONE) {
+                debug("Latency probe done, closing the emulator");
+                atomic_store(&emulation.quit, true);
+            }
+        }
+    }
+
+    SDL_WaitThread(emulation_thread, NULL);
+    debug("Emulation thread finished");
+
+    // A swap requested right before quitting is never handled
+    struct RomSwap* swap = atomic_exchange(&emulation.swap_requested, NULL);
+    if (swap != NULL) {
+        delete_rom_swap(swap);
+    }
+
+    SDL_free(dropped_rom_path);
+
+    // Back to the normal screen before reporting anything
+    if (terminal != NULL) {
+        delete_terminal(terminal);
+        terminal = NULL;
+    }
+
+    if (atomic_load(&emulation.failed)) {
+        goto emulation_failed;
+    }
+
+    report_emulation(&emulation);
+
+    if (emulation.perf_counters != NULL) {
+        report_perf_counters(&emulation_counters, "CHIP-8 instruction");
+        report_perf_counters(&presentation_counters, "presented frame");
+    }
+
+    // Reported as a failure of the whole run, so a latency regression fails the benchmark running it
+    bool latency_regressed = false;
+
+    if (latency_probe != NULL) {
+        latency_regressed = report_latency_probe(latency_probe, latency_budget) != 0;
+        delete_latency_probe(latency_probe);
+    }
+
+    // The audio callback is the only thread still recording, it waits while the trace is written. A failed write is
+    // already reported and the emulation itself went fine, so the exit continues normally.
+    if (trace != NULL) {
+        SDL_LockAudio();
+        write_trace(trace, trace_path);
+        SDL_UnlockAudio();
+    }
+
+    if (emulation.shared_screen != NULL) {
+        delete_shared_screen(emulation.shared_screen);
+    }
+
+    if (perf_log != NULL) {
+        close_perf_counters(&emulation_counters);
+        close_perf_counters(&presentation_counters);
+        fclose(perf_log);
+    }
+
+    close_metrics(&metrics);
+
+    if (emulation.gdb_stub != NULL) {
+        delete_gdb_stub(emulation.gdb_stub, vm);
+    }
+
+    if (emulation.capture != NULL && delete_capture(emulation.capture) != 0) {
+        goto capture_delete_failed;
     }
 
     delete_screen(screen);
     debug("Deallocated the screen");
 
+    if (vm->debugger != NULL) {
+        delete_debugger(vm->debugger, vm);
+    }
+
     free(vm);
     debug("Deallocated the virtual machine");
+
+    if (window != NULL) {
+        delete_window(window);
+        debug("Deallocated the window");
+    }
+
     info("Goodbye!");
 
     SDL_CloseAudio();
+
+    if (trace != NULL) {
+        delete_trace(trace);
+    }
+
     SDL_Quit();
 
-    return 0;
+    if (analysis != NULL) {
+        unload_rom_analysis(analysis);
+    }
+
+    return latency_regressed ? 1 : 0;
 
-step_cpu_failed:
-cpu_new_time_failed:
-timers_new_time_failed:
-cpu_old_time_failed:
-timers_old_time_failed:
+emulation_failed:
+emulation_thread_failed:
+frame_pacer_failed:
+    if (terminal != NULL) {
+        delete_terminal(terminal);
+    }
+terminal_failed:
+    if (latency_probe != NULL) {
+        delete_latency_probe(latency_probe);
+    }
+latency_probe_failed:
+    if (emulation.shared_screen != NULL) {
+        delete_shared_screen(emulation.shared_screen);
+    }
+shared_screen_failed:
+    if (perf_log != NULL) {
+        close_perf_counters(&emulation_counters);
+        close_perf_counters(&presentation_counters);
+        fclose(perf_log);
+    }
+perf_log_failed:
+    close_metrics(&metrics);
+metrics_socket_failed:
+    if (emulation.gdb_stub != NULL) {
+        delete_gdb_stub(emulation.gdb_stub, vm);
+    }
+gdb_stub_failed:
+    if (emulation.capture != NULL) {
+        delete_capture(emulation.capture);
+    }
+capture_delete_failed:
+capture_failed:
+    if (vm->debugger != NULL) {
+        delete_debugger(vm->debugger, vm);
+    }
+debugger_failed:
     free(vm);
     debug("Deallocated the virtual machine");
 virtual_machine_failed:
     delete_screen(screen);
     debug("Deallocated the screen");
-
+screen_failed:
+    if (window != NULL) {
+        delete_window(window);
+        debug("Deallocated the window");
+    }
+window_failed:
     SDL_CloseAudio();
-audio_failed:
+
+    if (trace != NULL) {
+        delete_trace(trace);
+    }
+trace_failed:
     SDL_Quit();
+sdl_failed:
+configuration_failed:
+    if (analysis != NULL) {
+        unload_rom_analysis(analysis);
+    }
 
     return 1;
 }
@@ -0,0 +1,323 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "frame-pacing.h"
+#include "logging.h"
+#include "metrics.h"
+
+/**
+ * @brief Prepare the counters, the reports start from the moment it is called.
+ *
+ * @param metrics The metrics to be prepared.
+ */
+void init_metrics(struct Metrics* metrics)
+{
+    memset(metrics, 0, sizeof(struct Metrics));
+
+    metrics->start_time = get_monotonic_timestamp();
+    metrics->report_time = metrics->start_time;
+    metrics->listener = -1;
+}
+
+/**
+ * @brief Listen on a Unix socket where every client that connects gets the last report as JSON.
+ *
+ * @param metrics The metrics to serve.
+ * @param path The path of the socket, like `/tmp/och8s-metrics.sock`.
+ * @return Return 0 on success or another number on failure.
+ */
+uint8_t open_metrics_socket(struct Metrics* metrics, const char* path)
+{
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        error("The socket path '%s' is too long", path);
+        return 1;
+    }
+
+    strcpy(address.sun_path, path);
+
+    // A socket left by a previous run is replaced, any other file is kept
+    struct stat file;
+    if (stat(path, &file) == 0 && S_ISSOCK(file.st_mode)) {
+        unlink(path);
+    }
+
+    metrics->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (metrics->listener == -1) {
+        error("Couldn't create the metrics socket: %s", strerror(errno));
+        return 2;
+    }
+
+    if (bind(metrics->listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(metrics->listener, 4) != 0
+        || fcntl(metrics->listener, F_SETFL, O_NONBLOCK) != 0) {
+        error("Couldn't listen on the socket '%s': %s", path, strerror(errno));
+        goto listen_failed;
+    }
+
+    metrics->socket_path = strdup(path);
+    if (metrics->socket_path == NULL) {
+        error("Malloc 'metrics->socket_path' failed");
+        goto path_failed;
+    }
+
+    return 0;
+
+path_failed:
+    unlink(path);
+listen_failed:
+    close(metrics->listener);
+    metrics->listener = -1;
+
+    return 3;
+}
+
+/**
+ * @brief Count a call of the audio callback, and an underrun if it came later than the device needed it.
+ *
+ * @param metrics The metrics to update, only from the audio callback.
+ * @param buffer_period The nanoseconds of sound in the buffer filled on each call.
+ * @param resumed If the sound was paused before this call, so the time since the previous call doesn't count.
+ */
+void record_audio_callback(struct Metrics* metrics, uint64_t buffer_period, bool resumed)
+{
+    uint64_t now = get_monotonic_timestamp();
+
+    // SDL doesn't report the underruns, but the device runs dry when the next buffer is asked later than it lasts.
+    // Half a buffer of slack hides the scheduling noise of the audio thread.
+    if (!resumed && metrics->last_audio_callback != 0 && now - metrics->last_audio_callback > buffer_period * 3 / 2) {
+        atomic_fetch_add_explicit(&metrics->audio_underruns, 1, memory_order_relaxed);
+    }
+
+    metrics->last_audio_callback = now;
+    atomic_fetch_add_explicit(&metrics->audio_callbacks, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Get the highest duration of a histogram bucket.
+ *
+ * @param bucket The index of the bucket.
+ * @return The duration in milliseconds.
+ */
+static double get_bucket_limit(size_t bucket)
+{
+    if (bucket < 4) {
+        return (bucket + 1) / 1000.0;
+    }
+
+    size_t exponent = bucket / 4 + 1;
+    uint64_t lower = (uint64_t)(4 + bucket % 4) << (exponent - 2);
+
+    return (lower + ((uint64_t)1 << (exponent - 2))) / 1000.0;
+}
+
+/**
+ * @brief Read the percentiles of the durations added to a histogram since the previous report.
+ *
+ * @param histogram The histogram, it keeps being updated.
+ * @param previous The buckets at the previous report, replaced with the current ones.
+ * @param p50 Where the median is stored.
+ * @param p90 Where the 90th percentile is stored.
+ * @param p99 Where the 99th percentile is stored.
+ * @return The number of durations added since the previous report.
+ */
+static uint64_t read_percentiles(struct LatencyHistogram* histogram, uint64_t previous[METRICS_HISTOGRAM_BUCKETS],
+    double* p50, double* p90, double* p99)
+{
+    uint64_t counts[METRICS_HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        uint64_t current = atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+
+        counts[i] = current - previous[i];
+        previous[i] = current;
+        total += counts[i];
+    }
+
+    *p50 = *p90 = *p99 = 0;
+
+    if (total == 0) {
+        return 0;
+    }
+
+    // The percentiles are the upper limits of the buckets they fall in, so they are never underestimated
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
+
+        seen += counts[i];
+
+        if (*p50 == 0 && seen * 100 >= total * 50) {
+            *p50 = get_bucket_limit(i);
+        }
+
+        if (*p90 == 0 && seen * 100 >= total * 90) {
+            *p90 = get_bucket_limit(i);
+        }
+
+        if (*p99 == 0 && seen * 100 >= total * 99) {
+            *p99 = get_bucket_limit(i);
+            break;
+        }
+    }
+
+    return total;
+}
+
+/**
+ * @brief Make a new report once a report period has passed since the previous one. It should only be called from the
+ *  window thread.
+ *
+ * @param metrics The metrics to report.
+ * @return If a new report was made.
+ */
+bool update_metrics(struct Metrics* metrics)
+{
+    uint64_t now = get_monotonic_timestamp();
+
+    if (now - metrics->report_time < METRICS_REPORT_PERIOD) {
+        return false;
+    }
+
+    struct MetricsReport* report = &metrics->report;
+    double elapsed = (now - metrics->report_time) / 1000000000.0;
+
+    uint64_t instructions = atomic_load_explicit(&metrics->instructions, memory_order_relaxed);
+    uint64_t emulated_frames = atomic_load_explicit(&metrics->emulated_frames, memory_order_relaxed);
+
+    report->uptime = (now - metrics->start_time) / 1000000000.0;
+    report->instructions_per_second = (instructions - metrics->report_instructions) / elapsed;
+    report->emulated_frames_per_second = (emulated_frames - metrics->report_emulated_frames) / elapsed;
+
+    uint64_t presents = read_percentiles(&metrics->present_times, metrics->report_present_times,
+        &report->present_p50, &report->present_p90, &report->present_p99);
+    uint64_t iterations = read_percentiles(&metrics->event_loop_times, metrics->report_event_loop_times,
+        &report->event_loop_p50, &report->event_loop_p90, &report->event_loop_p99);
+
+    report->presents_per_second = presents / elapsed;
+    report->host_frames_per_second = iterations / elapsed;
+
+    report->audio_callbacks = atomic_load_explicit(&metrics->audio_callbacks, memory_order_relaxed);
+    report->audio_underruns = atomic_load_explicit(&metrics->audio_underruns, memory_order_relaxed);
+
+    metrics->report_time = now;
+    metrics->report_instructions = instructions;
+    metrics->report_emulated_frames = emulated_frames;
+
+    return true;
+}
+
+/**
+ * @brief Write a report as a single line of text.
+ *
+ * @param report The report to write.
+ * @param text Where the line is written.
+ * @param size The size of the text buffer.
+ */
+void format_metrics_line(const struct MetricsReport* report, char* text, size_t size)
+{
+    snprintf(text, size,
+        "%.0f IPS, %.1f/%.1f emulated/host FPS, %.1f presents/s, present p50/p90/p99 %.2f/%.2f/%.2fms, "
+        "event loop p50/p90/p99 %.2f/%.2f/%.2fms, %lu audio underruns",
+        report->instructions_per_second, report->emulated_frames_per_second, report->host_frames_per_second,
+        report->presents_per_second, report->present_p50, report->present_p90, report->present_p99,
+        report->event_loop_p50, report->event_loop_p90, report->event_loop_p99, report->audio_underruns);
+}
+
+/**
+ * @brief Write a report as the short lines of the overlay, that fit in the width of the low resolution screen.
+ *
+ * @param report The report to write.
+ * @param text Where the lines are written.
+ * @param size The size of the text buffer.
+ */
+void format_metrics_overlay(const struct MetricsReport* report, char* text, size_t size)
+{
+    snprintf(text, size, "IPS %.0f\nFPS %.0f/%.0f\nDRAW %.1f/%.1f\nLOOP %.1f/%.1f\nXRUN %lu",
+        report->instructions_per_second, report->emulated_frames_per_second, report->host_frames_per_second,
+        report->present_p50, report->present_p99, report->event_loop_p50, report->event_loop_p99,
+        report->audio_underruns);
+}
+
+/**
+ * @brief Write a report as a JSON object.
+ *
+ * @param report The report to write.
+ * @param text Where the object is written.
+ * @param size The size of the text buffer.
+ * @return The length of the object.
+ */
+static size_t format_metrics_json(const struct MetricsReport* report, char* text, size_t size)
+{
+    int length = snprintf(text, size,
+        "{\"uptime_seconds\":%.3f,\"instructions_per_second\":%.1f,\"emulated_frames_per_second\":%.2f,"
+        "\"host_frames_per_second\":%.2f,\"presents_per_second\":%.2f,"
+        "\"present_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f},"
+        "\"event_loop_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f},"
+        "\"audio_callbacks\":%lu,\"audio_underruns\":%lu}\n",
+        report->uptime, report->instructions_per_second, report->emulated_frames_per_second,
+        report->host_frames_per_second, report->presents_per_second, report->present_p50, report->present_p90,
+        report->present_p99, report->event_loop_p50, report->event_loop_p90, report->event_loop_p99,
+        report->audio_callbacks, report->audio_underruns);
+
+    return length < 0 ? 0 : (size_t)length < size ? (size_t)length : size - 1;
+}
+
+/**
+ * @brief Send the last report to the clients waiting on the metrics socket, without blocking.
+ *
+ * @param metrics The metrics to serve.
+ */
+void serve_metrics_socket(struct Metrics* metrics)
+{
+    if (metrics->listener == -1) {
+        return;
+    }
+
+    int client;
+    while ((client = accept(metrics->listener, NULL, NULL)) != -1) {
+        char json[1024];
+        size_t length = format_metrics_json(&metrics->report, json, sizeof(json));
+
+        // A fresh socket buffer always fits the whole object, a client that closed early is just ignored
+        if (send(client, json, length, MSG_NOSIGNAL) != (ssize_t)length) {
+            debug("Couldn't send the metrics to a client");
+        }
+
+        close(client);
+    }
+}
+
+/**
+ * @brief Stop serving the metrics, removing the socket.
+ *
+ * @param metrics The metrics to close.
+ */
+void close_metrics(struct Metrics* metrics)
+{
+    if (metrics->listener == -1) {
+        return;
+    }
+
+    close(metrics->listener);
+    metrics->listener = -1;
+
+    unlink(metrics->socket_path);
+    free(metrics->socket_path);
+    metrics->socket_path = NULL;
+}
@@ -0,0 +1,681 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "och8s-env.h"
+#include "quirks.h"
+#include "screen.h"
+#include "virtual-machine.h"
+
+static constexpr uint32_t FRAMES_PER_SECOND = 60;
+
+/**
+ * @brief A range of memory whose changes are given as reward.
+ */
+struct RewardWatch {
+    uint16_t address;
+
+    // Bytes of the value, read as a big endian number like the CHIP-8 programs store them
+    uint8_t size;
+
+    float weight;
+};
+
+/**
+ * @brief A memory byte that ends the episode when it takes a value.
+ */
+struct DoneWatch {
+    uint16_t address;
+    uint8_t value;
+};
+
+/**
+ * @brief What an environment keeps between steps besides its virtual machine and screen.
+ */
+struct EnvState {
+    // Bitmask of the keys pressed on the previous step, only the changes are sent to the virtual machine
+    uint16_t pressed_keys;
+
+    // Accumulates the fractions of opcode left when the clock isn't a multiple of 60
+    uint32_t pending_opcodes;
+
+    uint64_t resets;
+    bool done;
+
+    // The values of the reward watches at the end of the previous step
+    uint32_t watched_values[OCH8S_ENV_MAX_WATCHES];
+};
+
+enum EnvJob {
+    ENV_JOB_STEP,
+    ENV_JOB_RESET,
+    ENV_JOB_QUIT,
+};
+
+/**
+ * @brief A thread of the pool, it always works on the same range of environments to keep them in its cache.
+ */
+struct EnvWorker {
+    pthread_t thread;
+    struct Och8sEnv* env;
+    size_t index;
+};
+
+struct Och8sEnv {
+    size_t environments;
+    uint32_t opcodes_per_second;
+    uint8_t planes;
+    uint64_t seed;
+
+    // Only the memory that the platform can address is copied on resets, 4KB instead of 64KB for most ROMs
+    size_t memory_size;
+
+    // The machine right after loading the ROM, copied to reset the environments without reading the ROM again
+    struct VirtualMachine* initial_vm;
+    struct Screen* initial_screen;
+
+    struct VirtualMachine* vms;
+    struct Screen* screens;
+    struct EnvState* states;
+
+    struct RewardWatch reward_watches[OCH8S_ENV_MAX_WATCHES];
+    size_t reward_watch_count;
+    struct DoneWatch done_watches[OCH8S_ENV_MAX_WATCHES];
+    size_t done_watch_count;
+
+    // Set by the first reset, the watches can't change after it
+    bool started;
+
+    // Provided by the caller, one entry per environment
+    uint64_t* observations;
+    float* rewards;
+    uint8_t* dones;
+
+    // The worker 0 is the thread calling the library, only the others are created
+    struct EnvWorker* workers;
+    size_t worker_count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t job_started;
+    pthread_cond_t job_finished;
+
+    // Incremented for every job, the workers wait until it changes
+    uint64_t generation;
+    size_t pending_workers;
+
+    enum EnvJob job;
+    const uint16_t* actions;
+    uint32_t frames;
+    const uint8_t* mask;
+};
+
+/**
+ * @brief Read the value of a reward watch.
+ *
+ * @param vm The virtual machine to read from.
+ * @param watch The watch to read.
+ * @return The value of the watched bytes.
+ */
+static uint32_t read_reward_watch(const struct VirtualMachine* vm, const struct RewardWatch* watch)
+{
+    uint32_t value = 0;
+
+    for (uint8_t i = 0; i < watch->size; i++) {
+        value = value << 8 | read_memory(vm, watch->address + i);
+    }
+
+    return value;
+}
+
+/**
+ * @brief Copy the screen of an environment into its observation.
+ *
+ * @param env The environment batch.
+ * @param index The index of the environment.
+ */
+static void write_observation(struct Och8sEnv* env, size_t index)
+{
+    size_t words = env->planes * OCH8S_ENV_PLANE_WORDS;
+
+    // The planes are contiguous on the screen buffer
+    memcpy(env->observations + index * words, env->screens[index].buffer, words * sizeof(uint64_t));
+}
+
+/**
+ * @brief Put an environment back to the start of the ROM, with a new seed for the random numbers.
+ *
+ * @param env The environment batch.
+ * @param index The index of the environment.
+ */
+static void reset_environment(struct Och8sEnv* env, size_t index)
+{
+    struct VirtualMachine* vm = &env->vms[index];
+    struct EnvState* state = &env->states[index];
+
+    // Everything after the memory is copied whole
+    size_t registers_offset = offsetof(struct VirtualMachine, pc);
+
+    memcpy(vm->memory, env->initial_vm->memory, env->memory_size);
+    memcpy((uint8_t*)vm + registers_offset, (const uint8_t*)env->initial_vm + registers_offset,
+        sizeof(struct VirtualMachine) - registers_offset);
+    memcpy(&env->screens[index], env->initial_screen, sizeof(struct Screen));
+
+    // SplitMix64 of the seed, the environment and the episode, so nearby values don't give related sequences
+    uint64_t mix = env->seed + (index << 32 | (state->resets & 0xFFFFFFFF)) * 0x9E3779B97F4A7C15;
+    mix = (mix ^ (mix >> 30)) * 0xBF58476D1CE4E5B9;
+    mix = (mix ^ (mix >> 27)) * 0x94D049BB133111EB;
+    mix ^= mix >> 31;
+
+    // Xorshift never leaves the state 0
+    vm->random_state = (uint32_t)mix | 1;
+
+    state->resets++;
+    state->pressed_keys = 0;
+    state->pending_opcodes = 0;
+    state->done = false;
+
+    for (size_t i = 0; i < env->reward_watch_count; i++) {
+        state->watched_values[i] = read_reward_watch(vm, &env->reward_watches[i]);
+    }
+
+    write_observation(env, index);
+    env->rewards[index] = 0;
+    env->dones[index] = 0;
+}
+
+/**
+ * @brief Run the frames of a step on an environment and write its observation, reward and done flag.
+ *
+ * @param env The environment batch.
+ * @param index The index of the environment.
+ */
+static void step_environment(struct Och8sEnv* env, size_t index)
+{
+    struct VirtualMachine* vm = &env->vms[index];
+    struct Screen* screen = &env->screens[index];
+    struct EnvState* state = &env->states[index];
+
+    // A finished episode stays frozen until it is reset
+    if (state->done) {
+        env->rewards[index] = 0;
+        return;
+    }
+
+    uint16_t pressed_keys = env->actions[index];
+    uint16_t changed_keys = pressed_keys ^ state->pressed_keys;
+
+    for (uint8_t key = 0; key < 16; key++) {
+        if ((changed_keys >> key) & 1) {
+            set_key_state(vm, key, (pressed_keys >> key) & 1);
+        }
+    }
+
+    state->pressed_keys = pressed_keys;
+
+    for (uint32_t frame = 0; frame < env->frames && !state->done; frame++) {
+        if (vm->delay_timer > 0) {
+            vm->delay_timer--;
+        }
+
+        if (vm->sound_timer > 0) {
+            vm->sound_timer--;
+        }
+
+        state->pending_opcodes += env->opcodes_per_second;
+        uint32_t steps = state->pending_opcodes / FRAMES_PER_SECOND;
+        state->pending_opcodes %= FRAMES_PER_SECOND;
+
+        // An invalid opcode ends the episode like exiting does
+        state->done = vm->run_cpu(vm, screen, steps) != 0 || vm->exited;
+    }
+
+    float reward = 0;
+
+    for (size_t i = 0; i < env->reward_watch_count; i++) {
+        uint32_t value = read_reward_watch(vm, &env->reward_watches[i]);
+
+        reward += env->reward_watches[i].weight * ((double)value - (double)state->watched_values[i]);
+        state->watched_values[i] = value;
+    }
+
+    for (size_t i = 0; i < env->done_watch_count; i++) {
+        if (read_memory(vm, env->done_watches[i].address) == env->done_watches[i].value) {
+            state->done = true;
+        }
+    }
+
+    write_observation(env, index);
+    env->rewards[index] = reward;
+    env->dones[index] = state->done;
+}
+
+/**
+ * @brief Run the current job on the range of environments of a worker.
+ *
+ * @param env The environment batch.
+ * @param worker The index of the worker.
+ */
+static void run_job(struct Och8sEnv* env, size_t worker)
+{
+    size_t start = worker * env->environments / env->worker_count;
+    size_t end = (worker + 1) * env->environments / env->worker_count;
+
+    for (size_t i = start; i < end; i++) {
+        if (env->job == ENV_JOB_STEP) {
+            step_environment(env, i);
+        } else if (env->mask == NULL || env->mask[i] != 0) {
+            reset_environment(env, i);
+        }
+    }
+}
+
+/**
+ * @brief Wait for jobs and run them until told to quit. It is the entry point of the worker threads.
+ *
+ * @param data The `struct EnvWorker` of the thread.
+ * @return Always NULL.
+ */
+static void* run_worker(void* data)
+{
+    struct EnvWorker* worker = data;
+    struct Och8sEnv* env = worker->env;
+
+    uint64_t generation = 0;
+
+    while (true) {
+        pthread_mutex_lock(&env->mutex);
+
+        while (env->generation == generation) {
+            pthread_cond_wait(&env->job_started, &env->mutex);
+        }
+
+        generation = env->generation;
+        enum EnvJob job = env->job;
+
+        pthread_mutex_unlock(&env->mutex);
+
+        if (job == ENV_JOB_QUIT) {
+            return NULL;
+        }
+
+        run_job(env, worker->index);
+
+        pthread_mutex_lock(&env->mutex);
+
+        if (--env->pending_workers == 0) {
+            pthread_cond_signal(&env->job_finished);
+        }
+
+        pthread_mutex_unlock(&env->mutex);
+    }
+}
+
+/**
+ * @brief Run a job on all the workers, the calling thread being one of them, and wait until all of them finish.
+ *
+ * @param env The environment batch.
+ * @param job The job to run, its arguments should already be set on the batch.
+ */
+static void dispatch_job(struct Och8sEnv* env, enum EnvJob job)
+{
+    pthread_mutex_lock(&env->mutex);
+
+    env->job = job;
+    env->generation++;
+    env->pending_workers = env->worker_count - 1;
+
+    pthread_cond_broadcast(&env->job_started);
+    pthread_mutex_unlock(&env->mutex);
+
+    if (job == ENV_JOB_QUIT) {
+        return;
+    }
+
+    run_job(env, 0);
+
+    pthread_mutex_lock(&env->mutex);
+
+    while (env->pending_workers > 0) {
+        pthread_cond_wait(&env->job_finished, &env->mutex);
+    }
+
+    pthread_mutex_unlock(&env->mutex);
+}
+
+/**
+ * @brief Start the worker threads of the pool.
+ *
+ * @param env The environment batch, with `worker_count` already set.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t start_workers(struct Och8sEnv* env)
+{
+    env->workers = calloc(env->worker_count, sizeof(struct EnvWorker));
+    if (env->workers == NULL) {
+        error("Malloc 'env->workers' failed");
+        return 1;
+    }
+
+    env->generation = 0;
+
+    pthread_mutex_init(&env->mutex, NULL);
+    pthread_cond_init(&env->job_started, NULL);
+    pthread_cond_init(&env->job_finished, NULL);
+
+    for (size_t i = 1; i < env->worker_count; i++) {
+        env->workers[i].env = env;
+        env->workers[i].index = i;
+
+        if (pthread_create(&env->workers[i].thread, NULL, run_worker, &env->workers[i]) != 0) {
+            error("Couldn't create the worker thread %zu", i);
+
+            // Only the threads already created are told to quit
+            env->worker_count = i;
+            goto thread_failed;
+        }
+    }
+
+    return 0;
+
+thread_failed:
+    dispatch_job(env, ENV_JOB_QUIT);
+
+    for (size_t i = 1; i < env->worker_count; i++) {
+        pthread_join(env->workers[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&env->job_finished);
+    pthread_cond_destroy(&env->job_started);
+    pthread_mutex_destroy(&env->mutex);
+    free(env->workers);
+
+    return 2;
+}
+
+/**
+ * @brief Create a batch of environments running the same ROM.
+ *
+ * @param environments The number of environments.
+ * @param rom_path The path of the ROM.
+ * @param options The settings of the batch or a NULL pointer to use the defaults.
+ * @return The pointer to the batch or a NULL pointer if an error occurs.
+ *  The batch should be freed using the function `och8s_env_delete()`.
+ *  The buffers must be given with `och8s_env_set_buffers()` and the environments reset before the first step.
+ */
+OCH8S_ENV_API struct Och8sEnv* och8s_env_create(size_t environments, const char* rom_path,
+    const struct Och8sEnvOptions* options)
+{
+    struct Och8sEnvOptions defaults = { 0 };
+    if (options == NULL) {
+        options = &defaults;
+    }
+
+    if (environments == 0) {
+        error("At least one environment is needed");
+        return NULL;
+    }
+
+    enum QuirkProfile quirk_profile = QUIRK_PROFILE_COSMAC_VIP;
+
+    if (options->quirk_profile != NULL && parse_quirk_profile(options->quirk_profile, &quirk_profile) != 0) {
+        error("Unknown quirk profile '%s'", options->quirk_profile);
+        return NULL;
+    }
+
+    if (options->planes > SCREEN_PLANES) {
+        error("The screen only has %zu planes", SCREEN_PLANES);
+        return NULL;
+    }
+
+    struct Och8sEnv* env = calloc(1, sizeof(struct Och8sEnv));
+    if (env == NULL) {
+        error("Malloc 'env' failed");
+        return NULL;
+    }
+
+    env->environments = environments;
+    env->opcodes_per_second = options->opcodes_per_second != 0 ? options->opcodes_per_second : 700;
+    env->planes = options->planes != 0 ? options->planes : 1;
+    env->seed = options->seed;
+
+    size_t threads = options->threads;
+    if (threads == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = online > 0 ? (size_t)online : 1;
+    }
+
+    env->worker_count = threads < environments ? threads : environments;
+
+    env->initial_screen = create_screen();
+    if (env->initial_screen == NULL) {
+        goto screen_failed;
+    }
+
+    // The virtual machine only reads the path
+    env->initial_vm = create_virtual_machine((char*)rom_path, quirk_profile);
+    if (env->initial_vm == NULL) {
+        goto virtual_machine_failed;
+    }
+
+    env->memory_size = env->initial_vm->address_mask + 1;
+
+    // Only the address space of the platform is copied on reset, the rest of the memory, that the idle loop detection
+    // can read past the end, stays zeroed
+    env->vms = calloc(environments, sizeof(struct VirtualMachine));
+    if (env->vms == NULL) {
+        error("Malloc 'env->vms' failed");
+        goto vms_failed;
+    }
+
+    env->screens = malloc(environments * sizeof(struct Screen));
+    if (env->screens == NULL) {
+        error("Malloc 'env->screens' failed");
+        goto screens_failed;
+    }
+
+    env->states = calloc(environments, sizeof(struct EnvState));
+    if (env->states == NULL) {
+        error("Malloc 'env->states' failed");
+        goto states_failed;
+    }
+
+    if (start_workers(env) != 0) {
+        goto workers_failed;
+    }
+
+    return env;
+
+workers_failed:
+    free(env->states);
+states_failed:
+    free(env->screens);
+screens_failed:
+    free(env->vms);
+vms_failed:
+    free(env->initial_vm);
+virtual_machine_failed:
+    delete_screen(env->initial_screen);
+screen_failed:
+    free(env);
+
+    return NULL;
+}
+
+/**
+ * @brief Get the size of the observation of an environment.
+ *
+ * @param env The environment batch.
+ * @return The number of 64 bits words of the observation of every environment, `OCH8S_ENV_PLANE_WORDS` for each
+ *  plane.
+ */
+OCH8S_ENV_API size_t och8s_env_get_observation_words(const struct Och8sEnv* env)
+{
+    return env->planes * OCH8S_ENV_PLANE_WORDS;
+}
+
+/**
+ * @brief Give the buffers where the results of the steps and resets are written. They must be kept until the batch
+ *  is deleted or other buffers are given.
+ *
+ * @param env The environment batch.
+ * @param observations The observations of all the environments one after the other, `och8s_env_get_observation_words()`
+ *  words each.
+ * @param rewards The reward of every environment on the last step.
+ * @param dones If every environment finished its episode, its steps do nothing until it is reset.
+ * @return Return 0 on success or another number on failure.
+ */
+OCH8S_ENV_API uint8_t och8s_env_set_buffers(struct Och8sEnv* env, uint64_t* observations, float* rewards,
+    uint8_t* dones)
+{
+    if (observations == NULL || rewards == NULL || dones == NULL) {
+        error("All the buffers are needed");
+        return 1;
+    }
+
+    env->observations = observations;
+    env->rewards = rewards;
+    env->dones = dones;
+
+    return 0;
+}
+
+/**
+ * @brief Give as reward the change of a value in memory, like a score. The reward of a step is the sum of the changes
+ *  of all the watches multiplied by their weights.
+ *
+ * @param env The environment batch, before its first reset.
+ * @param address The address of the first byte of the value.
+ * @param size The bytes of the value, from 1 to 4, read as a big endian number.
+ * @param weight The reward given for every unit the value increases, negative to penalize it.
+ * @return Return 0 on success or another number on failure.
+ */
+OCH8S_ENV_API uint8_t och8s_env_add_reward_watch(struct Och8sEnv* env, uint16_t address, uint8_t size, float weight)
+{
+    if (env->started) {
+        error("The watches must be added before the first reset");
+        return 3;
+    }
+
+    if (env->reward_watch_count == OCH8S_ENV_MAX_WATCHES) {
+        error("Only %zu reward watches can be added", OCH8S_ENV_MAX_WATCHES);
+        return 1;
+    }
+
+    if (size == 0 || size > sizeof(uint32_t)) {
+        error("The reward watches must be from 1 to 4 bytes long");
+        return 2;
+    }
+
+    env->reward_watches[env->reward_watch_count++] = (struct RewardWatch) { address, size, weight };
+
+    return 0;
+}
+
+/**
+ * @brief End the episode when a memory byte takes a value, like the lives reaching 0. Episodes also end when the
+ *  program exits or fails.
+ *
+ * @param env The environment batch, before its first reset.
+ * @param address The address of the byte.
+ * @param value The value that ends the episode.
+ * @return Return 0 on success or another number on failure.
+ */
+OCH8S_ENV_API uint8_t och8s_env_add_done_watch(struct Och8sEnv* env, uint16_t address, uint8_t value)
+{
+    if (env->started) {
+        error("The watches must be added before the first reset");
+        return 2;
+    }
+
+    if (env->done_watch_count == OCH8S_ENV_MAX_WATCHES) {
+        error("Only %zu done watches can be added", OCH8S_ENV_MAX_WATCHES);
+        return 1;
+    }
+
+    env->done_watches[env->done_watch_count++] = (struct DoneWatch) { address, value };
+
+    return 0;
+}
+
+/**
+ * @brief Restart the episodes of some environments and write their first observation.
+ *
+ * @param env The environment batch.
+ * @param mask One byte per environment, the ones that aren't 0 are reset. A NULL pointer resets all of them.
+ * @return Return 0 on success or another number on failure.
+ */
+OCH8S_ENV_API uint8_t och8s_env_reset(struct Och8sEnv* env, const uint8_t* mask)
+{
+    if (env->observations == NULL) {
+        error("The buffers must be given before resetting the environments");
+        return 1;
+    }
+
+    // Until every environment has been reset once, some of them don't have a machine
+    if (!env->started && mask != NULL) {
+        error("The first reset must reset all the environments");
+        return 2;
+    }
+
+    env->started = true;
+    env->mask = mask;
+    dispatch_job(env, ENV_JOB_RESET);
+
+    return 0;
+}
+
+/**
+ * @brief Press the keys of every environment, run them for some frames and write their observations, rewards and
+ *  done flags.
+ *
+ * @param env The environment batch.
+ * @param actions One bitmask of pressed keys per environment, the bit N being the key N. The keys are held during all
+ *  the frames.
+ * @param frames The frames run by each environment, usually called frame skip.
+ * @return Return 0 on success or another number on failure.
+ */
+OCH8S_ENV_API uint8_t och8s_env_step(struct Och8sEnv* env, const uint16_t* actions, uint32_t frames)
+{
+    if (!env->started) {
+        error("The environments must be reset before the first step");
+        return 1;
+    }
+
+    env->actions = actions;
+    env->frames = frames;
+    dispatch_job(env, ENV_JOB_STEP);
+
+    return 0;
+}
+
+/**
+ * @brief Stop the threads and deallocate a batch of environments.
+ *
+ * @param env The environment batch to be deallocated.
+ */
+OCH8S_ENV_API void och8s_env_delete(struct Och8sEnv* env)
+{
+    dispatch_job(env, ENV_JOB_QUIT);
+
+    for (size_t i = 1; i < env->worker_count; i++) {
+        pthread_join(env->workers[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&env->job_finished);
+    pthread_cond_destroy(&env->job_started);
+    pthread_mutex_destroy(&env->mutex);
+    free(env->workers);
+
+    free(env->states);
+    free(env->screens);
+    free(env->vms);
+    free(env->initial_vm);
+    delete_screen(env->initial_screen);
+    free(env);
+}
@@ -1,29 +1,87 @@
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include "debugger.h"
 #include "logging.h"
 #include "opcodes.h"
+#include "quirks.h"
+#include "screen.h"
 #include "virtual-machine.h"
 
-uint8_t opcode_0(struct Opcode opcode, struct VirtualMachine* vm, struct Screen* screen)
+/**
+ * @brief Get the mask of the address space of the platform.
+ *
+ * @param quirks The quirks of the running platform.
+ * @return The mask, a compile time constant.
+ */
+[[gnu::always_inline]] static inline size_t memory_mask(const struct Quirks quirks)
 {
+    return (quirks.xo_chip ? XO_CHIP_MEMORY_SIZE : MEMORY_SIZE) - 1;
+}
+
+/**
+ * @brief Get a byte of the memory, the address wraps around the address space of the platform.
+ *
+ * @param vm The virtual machine to access the memory of.
+ * @param address Any address, only its bits inside the address space are used.
+ * @param quirks The quirks of the running platform, the mask is a compile time constant.
+ * @return The pointer to the byte.
+ */
+[[gnu::always_inline]] static inline uint8_t* memory_at(struct VirtualMachine* vm, size_t address, const struct Quirks quirks)
+{
+    return &vm->memory[address & memory_mask(quirks)];
+}
+
+/**
+ * @brief Skip the instruction located at the PC of the Virtual Machine.
+ *
+ * @param vm The virtual machine whose PC should be moved.
+ * @param quirks The quirks of the running platform.
+ */
+[[gnu::always_inline]] static inline void skip_instruction(struct VirtualMachine* vm, const struct Quirks quirks)
+{
+    // The XO-CHIP long load F000 NNNN takes 4 bytes
+    if (quirks.xo_chip && *memory_at(vm, vm->pc, quirks) == 0xF0 && *memory_at(vm, vm->pc + 1, quirks) == 0x00) {
+        vm->pc += 4;
+        return;
+    }
+
+    vm->pc += 2;
+}
+
+[[gnu::always_inline]] static inline uint8_t opcode_0(struct Opcode opcode, struct VirtualMachine* vm, struct Screen* screen, const struct Quirks quirks)
+{
+    if (opcode.nibble_2 == 0x0 && opcode.nibble_3 == 0xC) {
+        debug("Scrolling the screen %d rows down", opcode.nibble_4);
+        scroll_screen_down(screen, opcode.nibble_4);
+
+        return 0;
+    }
+
+    // Only XO-CHIP scrolls up, on the other platforms it is a machine language routine
+    if (quirks.xo_chip && opcode.nibble_2 == 0x0 && opcode.nibble_3 == 0xD) {
+        debug("Scrolling the screen %d rows up", opcode.nibble_4);
+        scroll_screen_up(screen, opcode.nibble_4);
+
+        return 0;
+    }
+
     switch (opcode.nibbles_2_3_4) {
     case 0x0E0:
         debug("Cleaning the screen");
-
-        for (size_t y = 0; y < screen->height; y++) {
-            for (size_t x = 0; x < screen->width; x++) {
-                screen->buffer[y][x] = false;
-            }
-        }
-
-        if (draw_screen(screen) != 0) {
-            return 1;
-        }
+        clear_screen(screen);
 
         return 0;
         break;
     case 0x0EE:
+        if (vm->pc_stack_index == 0) {
+            error("Returning from a subroutine at %#05x with an empty stack", vm->pc - 2);
+            return 1;
+        }
+
         vm->pc = vm->pc_stack[vm->pc_stack_index - 1];
         debug("Jumping back from subroutine to %#05x", vm->pc);
 
@@ -32,6 +90,43 @@ uint8_t opcode_0(struct Opcode opcode, struct VirtualMachine* vm, struct Screen*
         return 0;
         break;
 
+    case 0x0FB:
+        debug("Scrolling the screen 4 pixels to the right");
+        scroll_screen_right(screen);
+
+        return 0;
+        break;
+
+    case 0x0FC:
+        debug("Scrolling the screen 4 pixels to the left");
+        scroll_screen_left(screen);
+
+        return 0;
+        break;
+
+    case 0x0FD:
+        debug("Exiting the interpreter");
+        vm->exited = true;
+
+        return 0;
+        break;
+
+    case 0x0FE:
+        debug("Switching to low resolution");
+
+        set_screen_resolution(screen, false);
+
+        return 0;
+        break;
+
+    case 0x0FF:
+        debug("Switching to high resolution");
+
+        set_screen_resolution(screen, true);
+
+        return 0;
+        break;
+
     default:
         info("Execute machine language routine opcode detected, skipping it (This game may not be compatible with the emulator!)");
         break;
@@ -40,26 +135,56 @@ uint8_t opcode_0(struct Opcode opcode, struct VirtualMachine* vm, struct Screen*
     return 0;
 }
 
-void opcode_3_4(struct Opcode opcode, struct VirtualMachine* vm, bool should_be_equal)
+[[gnu::always_inline]] static inline void opcode_3_4(struct Opcode opcode, struct VirtualMachine* vm, bool should_be_equal, const struct Quirks quirks)
 {
     if ((vm->v_registers[opcode.nibble_2] == opcode.byte_2) == should_be_equal) {
         debug("Skipped");
-        vm->pc += 2;
+        skip_instruction(vm, quirks);
     }
 }
 
-void opcode_5_9(struct Opcode opcode, struct VirtualMachine* vm, bool should_be_equal)
+[[gnu::always_inline]] static inline void opcode_5_9(struct Opcode opcode, struct VirtualMachine* vm, bool should_be_equal, const struct Quirks quirks)
 {
     uint8_t register_1 = vm->v_registers[opcode.nibble_2];
     uint8_t register_2 = vm->v_registers[opcode.nibble_3];
 
     if ((register_1 == register_2) == should_be_equal) {
         debug("Skipped");
-        vm->pc += 2;
+        skip_instruction(vm, quirks);
     }
 }
 
-void opcode_8(struct Opcode opcode, struct VirtualMachine* vm)
+[[gnu::always_inline]] static inline void opcode_5_2_3(struct Opcode opcode, struct VirtualMachine* vm, bool should_save, const struct Quirks quirks, const bool debugged)
+{
+    uint8_t first_register = opcode.nibble_2;
+    uint8_t last_register = opcode.nibble_3;
+
+    // The range can be given in reverse order, the registers are then stored in memory from vY down to vX
+    int8_t direction = first_register <= last_register ? 1 : -1;
+    size_t count = (direction == 1 ? last_register - first_register : first_register - last_register) + 1;
+
+    if (should_save) {
+        debug("Saving registers v%x to v%x to memory", first_register, last_register);
+    } else {
+        debug("Loading registers v%x to v%x from memory", first_register, last_register);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t register_index = first_register + direction * (int8_t)i;
+
+        if (should_save) {
+            *memory_at(vm, vm->index_register + i, quirks) = vm->v_registers[register_index];
+        } else {
+            vm->v_registers[register_index] = *memory_at(vm, vm->index_register + i, quirks);
+        }
+    }
+
+    if (should_save && debugged) {
+        check_watchpoints(vm, vm->index_register, count, memory_mask(quirks));
+    }
+}
+
+[[gnu::always_inline]] static inline void opcode_8(struct Opcode opcode, struct VirtualMachine* vm, const struct Quirks quirks)
 {
     uint8_t register_1_index = opcode.nibble_2;
     uint8_t register_2_index = opcode.nibble_3;
@@ -77,19 +202,28 @@ void opcode_8(struct Opcode opcode, struct VirtualMachine* vm)
         debug("Setting v%d equal to v%d | v%d", register_1_index, register_1_index, register_2_index);
 
         *register_1 |= *register_2;
-        vm->v_registers[15] = 0;
+
+        if (quirks.vf_reset) {
+            vm->v_registers[15] = 0;
+        }
         break;
     case 2:
         debug("Setting v%d equal to v%d & v%d", register_1_index, register_1_index, register_2_index);
 
         *register_1 &= *register_2;
-        vm->v_registers[15] = 0;
+
+        if (quirks.vf_reset) {
+            vm->v_registers[15] = 0;
+        }
         break;
     case 3:
         debug("Setting v%d equal to v%d ^ v%d", register_1_index, register_1_index, register_2_index);
 
         *register_1 ^= *register_2;
-        vm->v_registers[15] = 0;
+
+        if (quirks.vf_reset) {
+            vm->v_registers[15] = 0;
+        }
         break;
     case 4: {
         debug("Setting v%d equal to v%d + v%d", register_1_index, register_1_index, register_2_index);
@@ -136,9 +270,12 @@ void opcode_8(struct Opcode opcode, struct VirtualMachine* vm)
         break;
     }
     case 6: {
-        debug("Setting v%d equal to v%d and shifting it once to the right", register_1_index, register_2_index);
+        debug("Setting v%d equal to v%d and shifting it once to the right", register_1_index, quirks.shift_vx ? register_1_index : register_2_index);
+
+        if (!quirks.shift_vx) {
+            *register_1 = *register_2;
+        }
 
-        *register_1 = *register_2;
         uint8_t unshift_register_1 = *register_1;
 
         *register_1 >>= 1;
@@ -147,9 +284,12 @@ void opcode_8(struct Opcode opcode, struct VirtualMachine* vm)
         break;
     }
     case 0x0E: {
-        debug("Setting v%d equal to v%d and shifting it once to the left", register_1_index, register_2_index);
+        debug("Setting v%d equal to v%d and shifting it once to the left", register_1_index, quirks.shift_vx ? register_1_index : register_2_index);
+
+        if (!quirks.shift_vx) {
+            *register_1 = *register_2;
+        }
 
-        *register_1 = *register_2;
         uint8_t unshift_register_1 = *register_1;
 
         *register_1 <<= 1;
@@ -160,53 +300,73 @@ void opcode_8(struct Opcode opcode, struct VirtualMachine* vm)
     }
 }
 
-uint8_t opcode_d(struct Opcode opcode, struct VirtualMachine* vm, struct Screen* screen)
+[[gnu::always_inline]] static inline uint8_t opcode_d(struct Opcode opcode, struct VirtualMachine* vm, struct Screen* screen, const struct Quirks quirks)
 {
     uint8_t x = vm->v_registers[opcode.nibble_2] % screen->width;
     uint8_t y = vm->v_registers[opcode.nibble_3] % screen->height;
 
-    debug("Drawing sprite at (%d, %d)", x, y);
+    // The SUPER-CHIP DXY0 draws a 16x16 sprite made of 2 bytes per row
+    size_t sprite_height = opcode.nibble_4 == 0 ? 16 : opcode.nibble_4;
+    size_t sprite_width = opcode.nibble_4 == 0 ? 16 : 8;
 
-    uint8_t vf_register_value = 0;
+    debug("Drawing %dx%d sprite at (%d, %d)", sprite_width, sprite_height, x, y);
 
-    for (size_t height = 0; height < opcode.nibble_4 && y + height < screen->height; height++) {
-        uint8_t row_data = vm->memory[vm->index_register + height];
+    // The sprite is copied so its bytes wrap around the end of the memory too, with the bytes of every selected
+    // plane one after the other
+    uint8_t sprite[32 * SCREEN_PLANES];
+    size_t sprite_size = sprite_height * sprite_width / 8 * __builtin_popcount(screen->selected_planes);
 
-        int bit_pos = 0;
-        while (bit_pos < 8) {
-            if (row_data & 0x80) {
-                // If the next pixel is over the right of the screen just clip it
-                if ((size_t)(x + bit_pos) >= screen->width) {
-                    bit_pos = 8;
-                    continue;
-                }
-
-                // If originally the pixel was on set to vF that it was set off
-                if (screen->buffer[y + height][x + bit_pos]) {
-                    debug("Pixel that was on set off, setting vf flag");
-                    vf_register_value = 1;
-                }
+    for (size_t i = 0; i < sprite_size; i++) {
+        sprite[i] = *memory_at(vm, vm->index_register + i, quirks);
+    }
 
-                screen->buffer[y + height][x + bit_pos] = !screen->buffer[y + height][x + bit_pos];
-            }
+    size_t collided_rows = draw_sprite(screen, sprite, sprite_height, sprite_width, x, y, !quirks.clip_sprites);
 
-            row_data = row_data << 1;
-            bit_pos++;
-        }
+    if (collided_rows > 0) {
+        debug("Pixel that was on set off, setting vf flag");
     }
 
-    vm->v_registers[15] = vf_register_value;
+    if (quirks.count_collided_rows && screen->high_resolution) {
+        size_t clipped_rows = y + sprite_height > screen->height ? y + sprite_height - screen->height : 0;
+        vm->v_registers[15] = collided_rows + clipped_rows;
 
-    if (draw_screen(screen) != 0) {
-        return 1;
+        return 0;
     }
 
+    vm->v_registers[15] = collided_rows > 0;
+
     return 0;
 }
 
-void opcode_f(struct Opcode opcode, struct VirtualMachine* vm)
+[[gnu::always_inline]] static inline void opcode_f(struct Opcode opcode, struct VirtualMachine* vm, struct Screen* screen, const struct Quirks quirks, const bool debugged)
 {
     switch (opcode.byte_2) {
+    case 0x00:
+        if (!quirks.xo_chip || opcode.nibble_2 != 0x0) {
+            break;
+        }
+
+        vm->index_register = *memory_at(vm, vm->pc, quirks) << 8 | *memory_at(vm, vm->pc + 1, quirks);
+        vm->pc += 2;
+
+        debug("Setting register i to the long value %#06x", vm->index_register);
+        break;
+
+    case 0x01:
+        // Only XO-CHIP has bit planes, on the other platforms it is an unknown opcode
+        if (!quirks.xo_chip) {
+            debug("Unknown opcode, reading data from the ROM?");
+            break;
+        }
+
+        debug("Selecting the drawing planes %x", opcode.nibble_2);
+        screen->selected_planes = opcode.nibble_2;
+        break;
+
+    case 0x02:
+        debug("XO-CHIP audio pattern opcode detected, skipping it (Audio patterns are not supported)");
+        break;
+
     case 0x07:
         debug("Setting v%d to %d (delay timer)", opcode.nibble_2, vm->delay_timer);
         vm->v_registers[opcode.nibble_2] = vm->delay_timer;
@@ -231,21 +391,26 @@ void opcode_f(struct Opcode opcode, struct VirtualMachine* vm)
         if (vm->wait_key == -2) {
             debug("Waiting to key to be pressed");
 
+            // Only the keys released from now on count
+            atomic_store_explicit(&vm->released_keys, 0, memory_order_relaxed);
             vm->wait_key = -1;
-            vm->pc -= 2;
-
-            return;
         }
 
-        if (vm->wait_key == -1) {
+        uint16_t released_keys = atomic_exchange_explicit(&vm->released_keys, 0, memory_order_relaxed);
+
+        if (released_keys == 0) {
             vm->pc -= 2;
+            vm->idle = true;
 
             return;
         }
 
-        vm->v_registers[opcode.nibble_2] = vm->wait_key;
+        // The release order isn't kept, when several keys were released since the last check the lowest one is taken
+        vm->v_registers[opcode.nibble_2] = __builtin_ctz(released_keys);
         vm->wait_key = -2;
 
+        debug("Key %x released", vm->v_registers[opcode.nibble_2]);
+
         break;
     }
 
@@ -255,7 +420,18 @@ void opcode_f(struct Opcode opcode, struct VirtualMachine* vm)
         debug("Pointing the register i to the character %x", character);
 
         // Multiply the key by the number of bytes each int takes in memory
-        vm->index_register = 0x50 + character * 5;
+        vm->index_register = FONT_ADDRESS + character * 5;
+
+        break;
+    }
+
+    case 0x30: {
+        uint8_t character = vm->v_registers[opcode.nibble_2] & 0x0F;
+
+        debug("Pointing the register i to the big character %x", character);
+
+        // Each big character takes 10 bytes in memory
+        vm->index_register = BIG_FONT_ADDRESS + character * 10;
 
         break;
     }
@@ -265,28 +441,323 @@ void opcode_f(struct Opcode opcode, struct VirtualMachine* vm)
 
         debug("Converting binary number %b to decimal", register_1);
 
-        vm->memory[vm->index_register] = register_1 / 100;
-        vm->memory[vm->index_register + 1] = (register_1 / 10) % 10;
-        vm->memory[vm->index_register + 2] = register_1 % 10;
+        *memory_at(vm, vm->index_register, quirks) = register_1 / 100;
+        *memory_at(vm, vm->index_register + 1, quirks) = (register_1 / 10) % 10;
+        *memory_at(vm, vm->index_register + 2, quirks) = register_1 % 10;
+
+        if (debugged) {
+            check_watchpoints(vm, vm->index_register, 3, memory_mask(quirks));
+        }
         break;
     }
 
     case 0x55:
         debug("Saving all registers v to memory");
         for (size_t i = 0; i <= opcode.nibble_2; i++) {
-            vm->memory[vm->index_register + i] = vm->v_registers[i];
+            *memory_at(vm, vm->index_register + i, quirks) = vm->v_registers[i];
         }
 
-        vm->index_register += opcode.nibble_2 + 1;
+        if (debugged) {
+            check_watchpoints(vm, vm->index_register, opcode.nibble_2 + 1, memory_mask(quirks));
+        }
+
+        if (quirks.increment_index) {
+            vm->index_register += opcode.nibble_2 + 1;
+        }
         break;
 
     case 0x65:
         debug("Loading all registers v from memory");
         for (size_t i = 0; i <= opcode.nibble_2; i++) {
-            vm->v_registers[i] = vm->memory[vm->index_register + i];
+            vm->v_registers[i] = *memory_at(vm, vm->index_register + i, quirks);
+        }
+
+        if (quirks.increment_index) {
+            vm->index_register += opcode.nibble_2 + 1;
         }
+        break;
+
+    case 0x75:
+        debug("Saving registers v0 to v%x to the RPL user flags", opcode.nibble_2);
+        memcpy(vm->rpl_flags, vm->v_registers, opcode.nibble_2 + 1);
+        break;
 
-        vm->index_register += opcode.nibble_2 + 1;
+    case 0x85:
+        debug("Loading registers v0 to v%x from the RPL user flags", opcode.nibble_2);
+        memcpy(vm->v_registers, vm->rpl_flags, opcode.nibble_2 + 1);
         break;
     }
 }
+
+/**
+ * @brief Detect if a jump just executed is closing a loop that will do nothing until the next timer tick, then mark the virtual machine as idle.
+ *  Two loops are detected: a jump to itself and the delay timer wait `FX07; 3X00; 1NNN` (when the jump is reached vX wasn't 0 yet).
+ *
+ * @param vm The virtual machine that just jumped.
+ * @param quirks The quirks of the running platform.
+ */
+[[gnu::always_inline]] static inline void detect_idle_loop(struct VirtualMachine* vm, const struct Quirks quirks)
+{
+    uint16_t target = vm->pc;
+
+    // The pattern is read past the masked address, near the end of the memory it runs into the guard
+    const uint8_t* loop = memory_at(vm, target, quirks);
+
+    // Jumping to itself, the opcode 1NNN is always 2 bytes long
+    if (loop[0] == (0x10 | target >> 8) && loop[1] == (target & 0xFF)) {
+        debug("Jump to itself detected, idling until the next frame");
+        vm->idle = true;
+        return;
+    }
+
+    uint8_t x = loop[0] & 0x0F;
+
+    if ((loop[0] & 0xF0) == 0xF0 && loop[1] == 0x07
+        && loop[2] == (0x30 | x) && loop[3] == 0x00
+        && loop[4] == (0x10 | target >> 8) && loop[5] == (target & 0xFF)) {
+        debug("Delay timer wait loop detected, idling until the next frame");
+        vm->idle = true;
+    }
+}
+
+/**
+ * @brief Execute the opcode located at the PC of the virtual machine.
+ *
+ * @param vm The virtual machine of whose cpu should be step.
+ * @param screen The screen where virtual machine state changes may be reflected.
+ * @param quirks The quirks of the running platform, always a compile time constant so the checks are optimized away.
+ * @param debugged If the debugger is armed, also a compile time constant.
+ * @return Return 0 on success or another number on failure.
+ */
+[[gnu::always_inline]] static inline uint8_t execute_opcode(struct VirtualMachine* vm, struct Screen* screen, const struct Quirks quirks, const bool debugged)
+{
+    struct Opcode opcode = get_opcode(vm);
+    vm->pc += 2;
+
+    debug("Opcode: %x, X: %x, Y: %x, N: %x, NN: %02x, NNN: %03x", opcode.nibble_1, opcode.nibble_2, opcode.nibble_3, opcode.nibble_4, opcode.byte_2, opcode.nibbles_2_3_4);
+
+    switch (opcode.nibble_1) {
+    case 0x0:
+        if (opcode_0(opcode, vm, screen, quirks) != 0) {
+            return 1;
+        }
+
+        break;
+
+    case 0x1: {
+        uint16_t address = vm->pc - 2;
+
+        vm->pc = opcode.nibbles_2_3_4;
+        debug("Jumping to %#05x", vm->pc);
+
+        // A jump the analysis of the ROM found closing an idle loop idles right away. A ROM that rewrites the loop can
+        // only be slowed down, idling just ends the batch of the frame early.
+        if ((vm->idle_jumps[address / 64] >> (address % 64)) & 1) {
+            debug("Known idle loop, idling until the next frame");
+            vm->idle = true;
+            break;
+        }
+
+        detect_idle_loop(vm, quirks);
+        break;
+    }
+
+    case 0x2:
+        if (vm->pc_stack_index == sizeof(vm->pc_stack) / sizeof(vm->pc_stack[0])) {
+            error("Calling a subroutine at %#05x with a full stack", vm->pc - 2);
+            return 1;
+        }
+
+        vm->pc_stack[vm->pc_stack_index] = vm->pc;
+        vm->pc_stack_index++;
+
+        vm->pc = opcode.nibbles_2_3_4 / sizeof(vm->memory[0]);
+        debug("Jumping to subroutine at %#05x", vm->pc);
+
+        break;
+
+    case 0x3:
+        debug("Skipping if vX equals NN");
+        opcode_3_4(opcode, vm, true, quirks);
+        break;
+
+    case 0x4:
+        debug("Skipping if vX not equals NN");
+        opcode_3_4(opcode, vm, false, quirks);
+        break;
+
+    case 0x5: {
+        // The register ranges are XO-CHIP only, the other platforms ignore the last nibble
+        if (quirks.xo_chip && opcode.nibble_4 == 0x2) {
+            opcode_5_2_3(opcode, vm, true, quirks, debugged);
+            break;
+        }
+
+        if (quirks.xo_chip && opcode.nibble_4 == 0x3) {
+            opcode_5_2_3(opcode, vm, false, quirks, debugged);
+            break;
+        }
+
+        debug("Skipping if vX equals vY");
+        opcode_5_9(opcode, vm, true, quirks);
+        break;
+    }
+
+    case 0x6:
+        debug("Setting register v%x to value %#04x", opcode.nibble_2, opcode.byte_2);
+        vm->v_registers[opcode.nibble_2] = opcode.byte_2;
+
+        break;
+
+    case 0x7:
+        debug("Adding %d to register v%x", opcode.byte_2, opcode.nibble_2);
+        vm->v_registers[opcode.nibble_2] += opcode.byte_2;
+
+        break;
+
+    case 0x8:
+        opcode_8(opcode, vm, quirks);
+        break;
+
+    case 0x9:
+        debug("Skipping if vX not equals vY");
+        opcode_5_9(opcode, vm, false, quirks);
+        break;
+
+    case 0xA:
+        debug("Setting register i to value %#05x", opcode.nibbles_2_3_4);
+        vm->index_register = opcode.nibbles_2_3_4;
+
+        break;
+
+    case 0xB: {
+        uint8_t offset_register = quirks.jump_vx ? opcode.nibble_2 : 0;
+
+        vm->pc = opcode.nibbles_2_3_4 + vm->v_registers[offset_register];
+        debug("Jumping to %#05x (%#05x + v%x)", vm->pc, opcode.nibbles_2_3_4, offset_register);
+
+        break;
+    }
+
+    case 0xC:
+        debug("Generating a random number an setting it to v%d", opcode.nibble_2);
+        vm->random_state ^= vm->random_state << 13;
+        vm->random_state ^= vm->random_state >> 17;
+        vm->random_state ^= vm->random_state << 5;
+
+        vm->v_registers[opcode.nibble_2] = (vm->random_state >> 24) & opcode.byte_2;
+
+        break;
+
+    case 0x0D:
+        if (opcode_d(opcode, vm, screen, quirks) != 0) {
+            return 1;
+        }
+
+        break;
+
+    case 0x0E: {
+        uint8_t requested_key = vm->v_registers[opcode.nibble_2] & 0x0F;
+        uint16_t pressed_keys = atomic_load_explicit(&vm->pressed_keys, memory_order_relaxed);
+
+        if (opcode.byte_2 == 0x9E) {
+            debug("If key '%x' is being pressed skip", requested_key);
+            if (pressed_keys & (1 << requested_key)) {
+                debug("Skipped");
+                skip_instruction(vm, quirks);
+            }
+        }
+
+        if (opcode.byte_2 == 0xA1) {
+            debug("If key '%x' is not being pressed skip", requested_key);
+            if (!(pressed_keys & (1 << requested_key))) {
+                debug("Skipped");
+                skip_instruction(vm, quirks);
+            }
+        }
+        break;
+    }
+
+    case 0x0F:
+        opcode_f(opcode, vm, screen, quirks, debugged);
+        break;
+
+    default:
+        debug("Unknown opcode, reading data from the ROM?");
+        break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Run the cpu of the virtual machine for a number of steps.
+ *
+ * @param vm The virtual machine of whose cpu should be run.
+ * @param screen The screen where virtual machine state changes may be reflected.
+ * @param steps The number of opcodes to execute, the run stops earlier if the program exits or becomes idle.
+ * @param quirks The quirks of the running platform, always a compile time constant so the checks are optimized away.
+ * @param debugged If the breakpoints, watchpoints and steps of the debugger are checked, also a compile time constant.
+ * @return Return 0 on success or another number on failure.
+ */
+[[gnu::always_inline]] static inline uint8_t run_cpu(struct VirtualMachine* vm, struct Screen* screen, size_t steps, const struct Quirks quirks, const bool debugged)
+{
+    vm->idle = false;
+
+    size_t i = 0;
+    for (; i < steps && !vm->exited && !vm->idle; i++) {
+        if (debugged) {
+            struct Debugger* debugger = vm->debugger;
+
+            if (debugger->stopped) {
+                break;
+            }
+
+            // The instruction the CPU stopped at runs once when resuming
+            if (is_breakpoint(debugger, vm->pc) && !debugger->resuming && hit_breakpoint(debugger, vm)) {
+                break;
+            }
+
+            debugger->resuming = false;
+        }
+
+        if (execute_opcode(vm, screen, quirks, debugged) != 0) {
+            return 1;
+        }
+
+        if (debugged) {
+            vm->debugger->executed++;
+        }
+
+        if (debugged && vm->debugger->steps > 0 && --vm->debugger->steps == 0) {
+            finish_step(vm->debugger, vm);
+        }
+    }
+
+    // Nothing can change until the next timer tick or key event, so the rest of the steps are skipped. A run cut short
+    // by the exit opcode or the debugger didn't skip anything.
+    if (vm->idle) {
+        vm->idle_steps += steps - i;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Define an interpreter specialized for a quirk profile, each one is a separated copy of the whole dispatch with the quirks known at compile time.
+ *  Every profile also gets a debugged copy that checks the debugger, only used while something is armed on it.
+ */
+#define DEFINE_INTERPRETER(name, quirks)                                                    \
+    uint8_t name(struct VirtualMachine* vm, struct Screen* screen, size_t steps)            \
+    {                                                                                      \
+        return run_cpu(vm, screen, steps, quirks, false);                                   \
+    }                                                                                      \
+                                                                                           \
+    uint8_t name##_debugged(struct VirtualMachine* vm, struct Screen* screen, size_t steps) \
+    {                                                                                      \
+        return run_cpu(vm, screen, steps, quirks, true);                                    \
+    }
+
+DEFINE_INTERPRETER(run_cpu_cosmac_vip, COSMAC_VIP_QUIRKS)
+DEFINE_INTERPRETER(run_cpu_schip_legacy, SCHIP_LEGACY_QUIRKS)
+DEFINE_INTERPRETER(run_cpu_schip_modern, SCHIP_MODERN_QUIRKS)
+DEFINE_INTERPRETER(run_cpu_xo_chip, XO_CHIP_QUIRKS)
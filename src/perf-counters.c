@@ -0,0 +1,275 @@
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include "frame-pacing.h"
+#include "logging.h"
+#include "perf-counters.h"
+
+static const char* const event_names[PERF_EVENT_COUNT] = {
+    [PERF_EVENT_CYCLES] = "cycles",
+    [PERF_EVENT_INSTRUCTIONS] = "instructions",
+    [PERF_EVENT_BRANCH_MISSES] = "branch_misses",
+    [PERF_EVENT_L1D_MISSES] = "l1d_misses",
+};
+
+#ifdef __linux__
+static const struct {
+    uint32_t type;
+    uint64_t config;
+} event_configs[PERF_EVENT_COUNT] = {
+    [PERF_EVENT_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    [PERF_EVENT_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    [PERF_EVENT_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    [PERF_EVENT_L1D_MISSES] = { PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+};
+
+/**
+ * @brief Open a counter of the calling thread on any CPU, only counting the user space.
+ *
+ * @param event The event to count.
+ * @param group The leader of the group or -1 to open a new leader.
+ * @return The file descriptor of the counter or -1 on failure.
+ */
+static int open_event(enum PerfEvent event, int group)
+{
+    struct perf_event_attr attributes = {
+        .type = event_configs[event].type,
+        .size = sizeof(struct perf_event_attr),
+        .config = event_configs[event].config,
+        .read_format = PERF_FORMAT_GROUP,
+        .exclude_kernel = 1,
+        .exclude_hv = 1,
+    };
+
+    return syscall(SYS_perf_event_open, &attributes, 0, -1, group, PERF_FLAG_FD_CLOEXEC);
+}
+#endif
+
+/**
+ * @brief Create the file where every sample of the counters is written, as CSV with a header.
+ *
+ * @param path The path of the file.
+ * @return The file or a NULL pointer if an error occurs. It should be closed with `fclose()` after the counters.
+ */
+FILE* create_perf_log(const char* path)
+{
+    FILE* log = fopen(path, "w");
+    if (log == NULL) {
+        error("Couldn't create the file '%s': %s", path, strerror(errno));
+        return NULL;
+    }
+
+    fprintf(log, "phase,frame,nanoseconds,units");
+
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        fprintf(log, ",%s", event_names[i]);
+    }
+
+    fprintf(log, "\n");
+
+    return log;
+}
+
+/**
+ * @brief Prepare the counters without opening them, so they can be closed even if they never were.
+ *
+ * @param counters The counters to prepare.
+ * @param phase The name of the measured phase, for the reports.
+ * @param log Where every sample is written or NULL.
+ */
+void init_perf_counters(struct PerfCounters* counters, const char* phase, FILE* log)
+{
+    memset(counters, 0, sizeof(struct PerfCounters));
+
+    counters->phase = phase;
+    counters->log = log;
+    counters->group = -1;
+
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        counters->descriptors[i] = -1;
+    }
+}
+
+/**
+ * @brief Open the counters of the calling thread, falling back to the clock when they are unavailable. Only the
+ *  thread that opened them can take samples.
+ *
+ * @param counters The counters to open, prepared by `init_perf_counters()`.
+ */
+void open_perf_counters(struct PerfCounters* counters)
+{
+    const char* phase = counters->phase;
+
+#ifdef __linux__
+    counters->group = open_event(PERF_EVENT_CYCLES, -1);
+    if (counters->group == -1) {
+        warning("Hardware counters unavailable for the %s (%s), timing it with the clock only", phase,
+            strerror(errno));
+        return;
+    }
+
+    counters->descriptors[PERF_EVENT_CYCLES] = counters->group;
+
+    for (size_t i = PERF_EVENT_CYCLES + 1; i < PERF_EVENT_COUNT; i++) {
+        counters->descriptors[i] = open_event(i, counters->group);
+
+        if (counters->descriptors[i] == -1) {
+            warning("The CPU doesn't count the %s of the %s", event_names[i], phase);
+        }
+    }
+#else
+    warning("Hardware counters unavailable on this system, timing the %s with the clock only", phase);
+#endif
+}
+
+/**
+ * @brief Read all the counters at once.
+ *
+ * @param counters The counters to read.
+ * @param values Where the value of every event is stored, 0 for the unavailable ones.
+ */
+static void read_counters(const struct PerfCounters* counters, uint64_t values[PERF_EVENT_COUNT])
+{
+    memset(values, 0, PERF_EVENT_COUNT * sizeof(uint64_t));
+
+    if (counters->group == -1) {
+        return;
+    }
+
+    // The group is read as its number of counters followed by their values, in the order they were opened
+    uint64_t buffer[1 + PERF_EVENT_COUNT];
+    if (read(counters->group, buffer, sizeof(buffer)) < (ssize_t)sizeof(uint64_t)) {
+        return;
+    }
+
+    size_t position = 0;
+
+    for (size_t i = 0; i < PERF_EVENT_COUNT && position < buffer[0]; i++) {
+        if (counters->descriptors[i] != -1) {
+            values[i] = buffer[1 + position++];
+        }
+    }
+}
+
+/**
+ * @brief Start a sample, right before running the measured phase.
+ *
+ * @param counters The counters of the calling thread.
+ */
+void start_perf_sample(struct PerfCounters* counters)
+{
+    read_counters(counters, counters->start_values);
+    counters->start_time = get_monotonic_timestamp();
+}
+
+/**
+ * @brief Finish a sample, right after running the measured phase, adding it to the totals and to the log.
+ *
+ * @param counters The counters of the calling thread.
+ * @param frame The number of the frame of the sample.
+ * @param units The CHIP-8 instructions or the frames the phase went through.
+ */
+void finish_perf_sample(struct PerfCounters* counters, uint64_t frame, uint64_t units)
+{
+    uint64_t time = get_monotonic_timestamp() - counters->start_time;
+
+    uint64_t values[PERF_EVENT_COUNT];
+    read_counters(counters, values);
+
+    counters->samples++;
+    counters->total_time += time;
+    counters->units += units;
+
+    if (counters->log != NULL) {
+        fprintf(counters->log, "%s,%lu,%lu,%lu", counters->phase, frame, time, units);
+    }
+
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        uint64_t delta = values[i] - counters->start_values[i];
+        counters->totals[i] += delta;
+
+        if (counters->log == NULL) {
+            continue;
+        }
+
+        // The unavailable events are left empty
+        if (counters->descriptors[i] != -1) {
+            fprintf(counters->log, ",%lu", delta);
+        } else {
+            fprintf(counters->log, ",");
+        }
+    }
+
+    if (counters->log != NULL) {
+        fprintf(counters->log, "\n");
+    }
+}
+
+/**
+ * @brief Print the totals of the counters, normalized by the units the phase went through.
+ *
+ * @param counters The counters to report.
+ * @param unit The name of the unit, like "CHIP-8 instruction".
+ */
+void report_perf_counters(const struct PerfCounters* counters, const char* unit)
+{
+    if (counters->samples == 0) {
+        return;
+    }
+
+    double units = counters->units != 0 ? counters->units : 1;
+
+    info("Perf counters, %s: %lu samples, %lu %ss, %.3fms in total, %.1fns per %s", counters->phase,
+        counters->samples, counters->units, unit, counters->total_time / 1000000.0, counters->total_time / units,
+        unit);
+
+    if (counters->group == -1) {
+        return;
+    }
+
+    char line[256];
+    size_t length = 0;
+
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (counters->descriptors[i] != -1) {
+            length += snprintf(line + length, sizeof(line) - length, "%s%.2f %s", length == 0 ? "" : ", ",
+                counters->totals[i] / units, event_names[i]);
+        }
+    }
+
+    info("Perf counters, %s: %s per %s", counters->phase, line, unit);
+
+    if (counters->totals[PERF_EVENT_CYCLES] != 0 && counters->descriptors[PERF_EVENT_INSTRUCTIONS] != -1) {
+        info("Perf counters, %s: %.2f host instructions per cycle", counters->phase,
+            (double)counters->totals[PERF_EVENT_INSTRUCTIONS] / counters->totals[PERF_EVENT_CYCLES]);
+    }
+}
+
+/**
+ * @brief Close the counters, the totals are kept.
+ *
+ * @param counters The counters to close.
+ */
+void close_perf_counters(struct PerfCounters* counters)
+{
+    // The group leader is closed the last
+    for (size_t i = PERF_EVENT_COUNT; i-- > 0;) {
+        if (counters->descriptors[i] != -1) {
+            close(counters->descriptors[i]);
+            counters->descriptors[i] = -1;
+        }
+    }
+
+    counters->group = -1;
+}
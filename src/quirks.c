@@ -0,0 +1,44 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "quirks.h"
+
+/**
+ * @brief The names of the quirk profiles, indexed by `enum QuirkProfile`.
+ */
+static const char* const quirk_profile_names[] = {
+    "vip",
+    "schip-legacy",
+    "schip-modern",
+    "xo-chip",
+};
+
+/**
+ * @brief Get the quirk profile with the given name.
+ *
+ * @param name The name of the profile.
+ * @param profile Where the found profile will be stored.
+ * @return Return 0 on success or another number if no profile has the given name.
+ */
+uint8_t parse_quirk_profile(const char* name, enum QuirkProfile* profile)
+{
+    for (size_t i = 0; i < sizeof(quirk_profile_names) / sizeof(quirk_profile_names[0]); i++) {
+        if (strcmp(name, quirk_profile_names[i]) == 0) {
+            *profile = (enum QuirkProfile)i;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Get the name of a quirk profile.
+ *
+ * @param profile The profile to get its name from.
+ * @return The name of the profile.
+ */
+const char* get_quirk_profile_name(enum QuirkProfile profile)
+{
+    return quirk_profile_names[profile];
+}
@@ -3,8 +3,9 @@
 
 #include "logging.h"
 #include "render.h"
+#include "scaler.h"
 
-struct Screen;
+struct Window;
 
 /**
  * @brief Clear the renderer.
@@ -28,135 +29,335 @@ uint8_t clear_renderer(SDL_Renderer* renderer)
 }
 
 /**
- * @brief Draw a "virtual pixeL" (a 1:1 aspect ratio rectangle) to the render.
+ * @brief Write the pixels of the screen to the texture without upscaling them.
  *
- * @param x The x position of the pixel.
- * @param y The y position of the pixel.
- * @param renderer The renderer where the pixel should be draw.
+ * @param screen The screen to get the pixels from.
+ * @param pixels The pixels of the texture.
+ * @param pitch The length in bytes of a row of the texture.
+ */
+static void compose_screen(const struct Screen* screen, uint32_t* pixels, size_t pitch)
+{
+    size_t words = screen->width / 64;
+
+    for (size_t y = 0; y < screen->height; y++) {
+        uint32_t* pixel_row = (uint32_t*)((uint8_t*)pixels + y * pitch);
+
+        for (size_t i = 0; i < words; i++) {
+            uint64_t plane_words[SCREEN_PLANES];
+
+            for (size_t plane = 0; plane < SCREEN_PLANES; plane++) {
+                plane_words[plane] = screen->buffer[plane][y][i];
+            }
+
+            for (size_t bit = 0; bit < 64; bit++) {
+                size_t color = 0;
+
+                for (size_t plane = 0; plane < SCREEN_PLANES; plane++) {
+                    color |= ((plane_words[plane] >> (63 - bit)) & 1) << plane;
+                }
+
+                pixel_row[i * 64 + bit] = SCREEN_PALETTE[color];
+            }
+        }
+    }
+}
+
+// Glyphs of 3x5 pixels for the overlay, a row per number with the leftmost pixel as its highest bit. Only the
+// characters of the metrics are drawn, the rest are left blank.
+static const uint8_t overlay_font[0x60 - ' '][5] = {
+    ['0' - ' '] = { 7, 5, 5, 5, 7 },
+    ['1' - ' '] = { 2, 6, 2, 2, 7 },
+    ['2' - ' '] = { 7, 1, 7, 4, 7 },
+    ['3' - ' '] = { 7, 1, 7, 1, 7 },
+    ['4' - ' '] = { 5, 5, 7, 1, 1 },
+    ['5' - ' '] = { 7, 4, 7, 1, 7 },
+    ['6' - ' '] = { 7, 4, 7, 5, 7 },
+    ['7' - ' '] = { 7, 1, 1, 1, 1 },
+    ['8' - ' '] = { 7, 5, 7, 5, 7 },
+    ['9' - ' '] = { 7, 5, 7, 1, 7 },
+    ['.' - ' '] = { 0, 0, 0, 0, 2 },
+    ['/' - ' '] = { 1, 1, 2, 4, 4 },
+    ['-' - ' '] = { 0, 0, 7, 0, 0 },
+    ['A' - ' '] = { 2, 5, 7, 5, 5 },
+    ['D' - ' '] = { 6, 5, 5, 5, 6 },
+    ['F' - ' '] = { 7, 4, 6, 4, 4 },
+    ['I' - ' '] = { 7, 2, 2, 2, 7 },
+    ['L' - ' '] = { 4, 4, 4, 4, 7 },
+    ['N' - ' '] = { 6, 5, 5, 5, 5 },
+    ['O' - ' '] = { 2, 5, 5, 5, 2 },
+    ['P' - ' '] = { 6, 5, 6, 4, 4 },
+    ['R' - ' '] = { 6, 5, 6, 5, 5 },
+    ['S' - ' '] = { 3, 4, 2, 1, 6 },
+    ['U' - ' '] = { 5, 5, 5, 5, 7 },
+    ['W' - ' '] = { 5, 5, 7, 7, 5 },
+    ['X' - ' '] = { 5, 5, 2, 5, 5 },
+};
+
+/**
+ * @brief Fill a rectangle of the texture, clipped to the visible part of the screen.
+ *
+ * @param pixels The pixels of the texture.
+ * @param pitch The length in bytes of a row of the texture.
+ * @param width The visible width of the texture.
+ * @param height The visible height of the texture.
+ * @param rectangle The rectangle to fill.
+ * @param color The ARGB color of the rectangle.
+ */
+static void fill_texture(uint32_t* pixels, size_t pitch, size_t width, size_t height, SDL_Rect rectangle,
+    uint32_t color)
+{
+    for (size_t y = rectangle.y; y < (size_t)(rectangle.y + rectangle.h) && y < height; y++) {
+        uint32_t* pixel_row = (uint32_t*)((uint8_t*)pixels + y * pitch);
+
+        for (size_t x = rectangle.x; x < (size_t)(rectangle.x + rectangle.w) && x < width; x++) {
+            pixel_row[x] = color;
+        }
+    }
+}
+
+/**
+ * @brief Draw the lines of the overlay over the top left corner of the texture, on a black background.
+ *
+ * @param text The lines to draw, separated by newlines.
+ * @param pixels The pixels of the texture.
+ * @param pitch The length in bytes of a row of the texture.
+ * @param width The visible width of the texture.
+ * @param height The visible height of the texture.
+ * @param factor The upscaling factor of the texture, every pixel of the font is a square of this side.
+ */
+static void draw_overlay(const char* text, uint32_t* pixels, size_t pitch, size_t width, size_t height, size_t factor)
+{
+    size_t line = 0;
+    size_t column = 0;
+
+    for (const char* character = text; *character != '\0'; character++) {
+        if (*character == '\n') {
+            line++;
+            column = 0;
+            continue;
+        }
+
+        // Every character takes 4x6 pixels with its spacing, plus a margin of one pixel around the text
+        int x = (1 + column * 4) * factor;
+        int y = (1 + line * 6) * factor;
+
+        SDL_Rect background = { x - factor, y - factor, 4 * factor, 6 * factor };
+        fill_texture(pixels, pitch, width, height, background, 0xFF000000);
+
+        uint8_t index = (uint8_t)*character - ' ';
+        const uint8_t* glyph = overlay_font[index < sizeof(overlay_font) / sizeof(overlay_font[0]) ? index : 0];
+
+        for (size_t row = 0; row < 5; row++) {
+            for (size_t bit = 0; bit < 3; bit++) {
+                if ((glyph[row] >> (2 - bit)) & 1) {
+                    SDL_Rect pixel = { x + bit * factor, y + row * factor, factor, factor };
+                    fill_texture(pixels, pitch, width, height, pixel, 0xFFFFFF00);
+                }
+            }
+        }
+
+        column++;
+    }
+}
+
+/**
+ * @brief Draw to the window the pixel defined in the screen buffer, composing all the planes through the palette and
+ *  upscaling them with the scaler of the window.
+ *
+ * @param window The window where the pixels should be draw.
+ * @param screen The screen to get the pixels from.
  * @return Return 0 on success or another number on failure.
  */
-uint8_t draw_pixel(uint8_t x, uint8_t y, SDL_Renderer* renderer)
+uint8_t draw_screen(struct Window* window, const struct Screen* screen)
 {
-    SDL_Rect pixel;
+    if (window->width != screen->width || window->height != screen->height) {
+        if (SDL_RenderSetLogicalSize(window->renderer, screen->width, screen->height) != 0) {
+            error("Couldn't set the render logical size: %s", SDL_GetError());
+            return 4;
+        }
 
-    pixel.x = x;
-    pixel.y = y;
-    pixel.w = 1;
-    pixel.h = 1;
+        window->width = screen->width;
+        window->height = screen->height;
+    }
 
-    if (SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF) != 0) {
-        error("Couldn't set the draw color: %s", SDL_GetError());
+    uint64_t draw_start = start_trace_event(window->trace);
+
+    uint32_t* pixels;
+    int pitch;
+
+    if (SDL_LockTexture(window->texture, NULL, (void**)&pixels, &pitch) != 0) {
+        error("Couldn't lock the screen texture: %s", SDL_GetError());
         return 1;
     }
 
-    if (SDL_RenderDrawRect(renderer, &pixel) != 0) {
-        error("Couldn't create pixel: %s", SDL_GetError());
+    size_t factor = get_scaler_factor(window->scaler);
+
+    if (window->scaler != SCALER_NONE) {
+        scale_screen(screen, window->scaler, SCREEN_PALETTE, pixels, pitch);
+    } else {
+        compose_screen(screen, pixels, pitch);
+    }
+
+    if (window->overlay[0] != '\0') {
+        draw_overlay(window->overlay, pixels, pitch, screen->width * factor, screen->height * factor, factor);
+    }
+
+    SDL_UnlockTexture(window->texture);
+
+    if (clear_renderer(window->renderer) != 0) {
         return 2;
     }
 
+    SDL_Rect source = { 0, 0, (int)(screen->width * factor), (int)(screen->height * factor) };
+
+    if (SDL_RenderCopy(window->renderer, window->texture, &source, NULL) != 0) {
+        error("Couldn't copy the screen texture: %s", SDL_GetError());
+        return 3;
+    }
+
+    finish_trace_event(window->trace, "draw screen", draw_start);
+
+    uint64_t present_start = start_trace_event(window->trace);
+    SDL_RenderPresent(window->renderer);
+    finish_trace_event(window->trace, "present", present_start);
+
     return 0;
 }
 
 /**
- * @brief Draw to the screen the pixel defined in the buffer.
+ * @brief Draw the screens of a wall to its window through the atlas, composing only the tiles that changed since the
+ *  last draw and uploading the whole atlas once.
  *
- * @param screen The screen to be the pixels draw.
+ * @param window The window of the wall, made by `create_wall_window()`.
+ * @param tiles The screen of every tile, or NULL for the ones that didn't change since the last draw.
+ * @param count The number of tiles.
+ * @param focused The tile that gets the keys, it is outlined.
  * @return Return 0 on success or another number on failure.
  */
-uint8_t draw_screen(struct Screen* screen)
+uint8_t draw_wall(struct Window* window, const struct Screen** tiles, size_t count, size_t focused)
 {
-    clear_renderer(screen->renderer);
+    uint64_t draw_start = start_trace_event(window->trace);
 
-    for (size_t y = 0; y < screen->height; y++) {
-        for (size_t x = 0; x < screen->width; x++) {
-            if (!screen->buffer[y][x]) {
-                continue;
-            }
+    size_t atlas_width = window->columns * SCREEN_HIGH_RESOLUTION_WIDTH;
+    bool changed = false;
 
-            if (draw_pixel(x, y, screen->renderer) != 0) {
-                return 1;
+    for (size_t tile = 0; tile < count; tile++) {
+        if (tiles[tile] == NULL) {
+            continue;
+        }
+
+        // The low resolution screens are doubled, so every tile has the same size
+        uint8_t indexes[SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_HIGH_RESOLUTION_WIDTH];
+        get_screen_palette_indexes(tiles[tile], indexes);
+
+        uint32_t* pixels = window->atlas + tile / window->columns * SCREEN_HIGH_RESOLUTION_HEIGHT * atlas_width
+            + tile % window->columns * SCREEN_HIGH_RESOLUTION_WIDTH;
+
+        for (size_t y = 0; y < SCREEN_HIGH_RESOLUTION_HEIGHT; y++) {
+            for (size_t x = 0; x < SCREEN_HIGH_RESOLUTION_WIDTH; x++) {
+                pixels[y * atlas_width + x] = SCREEN_PALETTE[indexes[y][x]];
             }
         }
+
+        changed = true;
     }
 
-    SDL_RenderPresent(screen->renderer);
+    if (changed && SDL_UpdateTexture(window->texture, NULL, window->atlas, atlas_width * sizeof(uint32_t)) != 0) {
+        error("Couldn't upload the atlas texture: %s", SDL_GetError());
+        return 1;
+    }
+
+    if (clear_renderer(window->renderer) != 0) {
+        return 2;
+    }
+
+    if (SDL_RenderCopy(window->renderer, window->texture, NULL, NULL) != 0) {
+        error("Couldn't copy the atlas texture: %s", SDL_GetError());
+        return 3;
+    }
+
+    SDL_Rect outline = {
+        (int)(focused % window->columns * SCREEN_HIGH_RESOLUTION_WIDTH),
+        (int)(focused / window->columns * SCREEN_HIGH_RESOLUTION_HEIGHT),
+        SCREEN_HIGH_RESOLUTION_WIDTH,
+        SCREEN_HIGH_RESOLUTION_HEIGHT,
+    };
+
+    if (SDL_SetRenderDrawColor(window->renderer, 0xFF, 0xFF, 0x00, 0xFF) != 0
+        || SDL_RenderDrawRect(window->renderer, &outline) != 0) {
+        error("Couldn't outline the focused tile: %s", SDL_GetError());
+        return 4;
+    }
+
+    finish_trace_event(window->trace, "draw wall", draw_start);
+
+    uint64_t present_start = start_trace_event(window->trace);
+    SDL_RenderPresent(window->renderer);
+    finish_trace_event(window->trace, "present", present_start);
+
     return 0;
 }
 
 /**
- * @brief Create a new screen. Caution!: `SDL_Init()` should have been called beforehand.
+ * @brief Create a new window. Caution!: `SDL_Init()` should have been called beforehand.
  *
- * @param screen_height The height of the screen to create.
- * @param screen_width The width of the screen to create.
- * @return The pointer to the screen or a NULL pointer if an error occurs.
- *  The screen should be freed using the function `delete_screen()`.
+ * @param vsync If presenting the screen should wait for the display refresh.
+ * @param scaler The filter used to upscale the screen before uploading it.
+ * @return The pointer to the window or a NULL pointer if an error occurs.
+ *  The window should be freed using the function `delete_window()`.
  */
-struct Screen* create_screen(size_t screen_height, size_t screen_width)
+struct Window* create_window(bool vsync, enum Scaler scaler)
 {
     SDL_Window* window = SDL_CreateWindow("och8S", SDL_WINDOWPOS_UNDEFINED,
-        SDL_WINDOWPOS_UNDEFINED, screen_width * 16, screen_height * 16, 0);
+        SDL_WINDOWPOS_UNDEFINED, SCREEN_HIGH_RESOLUTION_WIDTH * 8, SCREEN_HIGH_RESOLUTION_HEIGHT * 8, 0);
     if (window == NULL) {
         error("Couldn't create window: %s", SDL_GetError());
         return NULL;
     }
 
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
     if (renderer == NULL) {
         error("Couldn't create renderer: %s", SDL_GetError());
         goto renderer_failed;
     }
 
-    if (SDL_RenderSetLogicalSize(renderer, screen_width, screen_height)) {
-        error("Couldn't set the render logical size", SDL_GetError());
-        goto set_logical_size_failed;
+    // The texture is always big enough for the upscaled high resolution, only its top left corner is used on low
+    // resolution
+    size_t factor = get_scaler_factor(scaler);
+    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+        SCREEN_HIGH_RESOLUTION_WIDTH * factor, SCREEN_HIGH_RESOLUTION_HEIGHT * factor);
+    if (texture == NULL) {
+        error("Couldn't create texture: %s", SDL_GetError());
+        goto texture_failed;
     }
 
-    struct Screen* screen = malloc(sizeof(struct Screen));
-    if (screen == NULL) {
-        error("Malloc 'screen' failed");
-        goto screen_failed;
+    struct Window* sdl_window = malloc(sizeof(struct Window));
+    if (sdl_window == NULL) {
+        error("Malloc 'sdl_window' failed");
+        goto sdl_window_failed;
     }
 
-    screen->window = window;
-    screen->renderer = renderer;
+    sdl_window->window = window;
+    sdl_window->renderer = renderer;
+    sdl_window->texture = texture;
+    sdl_window->scaler = scaler;
 
-    screen->height = screen_height;
-    screen->width = screen_width;
+    // Forces the logical size to be set on the first draw
+    sdl_window->width = 0;
+    sdl_window->height = 0;
 
-    screen->buffer = malloc(sizeof(bool*) * (screen_height));
-    if (screen->buffer == NULL) {
-        error("Malloc 'screen_buffer->buffer' failed");
-        goto buffer_failed;
-    }
-
-    size_t successfully_allocated_buffer_subarrays = 0;
+    sdl_window->overlay[0] = '\0';
+    sdl_window->trace = NULL;
 
-    for (size_t i = 0; i < screen_height; i++) {
-        screen->buffer[i] = malloc(sizeof(bool) * (screen_width));
-        if (screen->buffer[i] == NULL) {
-            error("Malloc 'screen->buffer[i]' failed");
-            goto buffer_subarray_failed;
-        }
+    sdl_window->atlas = NULL;
+    sdl_window->columns = 1;
+    sdl_window->rows = 1;
 
-        successfully_allocated_buffer_subarrays++;
+    return sdl_window;
 
-        for (size_t j = 0; j < screen_width; j++) {
-            screen->buffer[i][j] = false;
-        }
-    }
-
-    return screen;
-
-buffer_subarray_failed:
-    for (size_t i = 0; i < successfully_allocated_buffer_subarrays; i++) {
-        free(screen->buffer[i]);
-    }
-
-    free(screen->buffer);
-buffer_failed:
-    free(screen);
-screen_failed:
-set_logical_size_failed:
+sdl_window_failed:
+    SDL_DestroyTexture(texture);
+texture_failed:
     SDL_DestroyRenderer(renderer);
 renderer_failed:
     SDL_DestroyWindow(window);
@@ -165,22 +366,73 @@ renderer_failed:
 }
 
 /**
- * @brief Safely deallocated a screen.
+ * @brief Create a new window for a wall of screens, drawn through a texture atlas with a tile for each of them.
+ *  Caution!: `SDL_Init()` should have been called beforehand.
  *
- * @param screen The screen to be deallocated.
+ * @param vsync If presenting the screen should wait for the display refresh.
+ * @param columns The number of tiles on each row of the grid.
+ * @param rows The number of rows of the grid.
+ * @return The pointer to the window or a NULL pointer if an error occurs.
+ *  The window should be freed using the function `delete_window()`.
  */
-void delete_screen(struct Screen* screen)
+struct Window* create_wall_window(bool vsync, size_t columns, size_t rows)
 {
-    for (size_t y = 0; y < screen->height; y++) {
-        free(screen->buffer[y]);
+    struct Window* window = create_window(vsync, SCALER_NONE);
+    if (window == NULL) {
+        return NULL;
+    }
+
+    size_t width = columns * SCREEN_HIGH_RESOLUTION_WIDTH;
+    size_t height = rows * SCREEN_HIGH_RESOLUTION_HEIGHT;
+
+    // Replaces the texture of a single screen
+    SDL_Texture* atlas_texture = SDL_CreateTexture(window->renderer, SDL_PIXELFORMAT_ARGB8888,
+        SDL_TEXTUREACCESS_STREAMING, width, height);
+    if (atlas_texture == NULL) {
+        error("Couldn't create the atlas texture: %s", SDL_GetError());
+        goto atlas_texture_failed;
+    }
+
+    SDL_DestroyTexture(window->texture);
+    window->texture = atlas_texture;
+
+    window->atlas = calloc(width * height, sizeof(uint32_t));
+    if (window->atlas == NULL) {
+        error("Calloc 'window->atlas' failed");
+        goto atlas_texture_failed;
     }
 
-    free(screen->buffer);
+    window->columns = columns;
+    window->rows = rows;
+
+    // The grid never changes its size, unlike a single screen
+    if (SDL_RenderSetLogicalSize(window->renderer, width, height) != 0) {
+        error("Couldn't set the render logical size: %s", SDL_GetError());
+        goto atlas_texture_failed;
+    }
 
-    SDL_DestroyRenderer(screen->renderer);
-    SDL_DestroyWindow(screen->window);
+    window->width = width;
+    window->height = height;
 
-    free(screen);
+    return window;
+
+atlas_texture_failed:
+    delete_window(window);
+
+    return NULL;
+}
+
+/**
+ * @brief Safely deallocated a window.
+ *
+ * @param window The window to be deallocated.
+ */
+void delete_window(struct Window* window)
+{
+    SDL_DestroyTexture(window->texture);
+    SDL_DestroyRenderer(window->renderer);
+    SDL_DestroyWindow(window->window);
 
-    SDL_Quit();
+    free(window->atlas);
+    free(window);
 }
@@ -0,0 +1,460 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+#include "quirks.h"
+#include "rom-analysis.h"
+#include "virtual-machine.h"
+
+static constexpr char ROM_ANALYSIS_MAGIC[8] = "OCH8SRA";
+
+static constexpr uint16_t ROM_START = 0x200;
+
+/**
+ * @brief Set a bit of one of the bitmaps of an analysis.
+ *
+ * @param bitmap The bitmap.
+ * @param address The address of the bit.
+ */
+static inline void set_analysis_bit(uint64_t bitmap[ROM_ANALYSIS_BITMAP_WORDS], uint16_t address)
+{
+    bitmap[address / 64] |= (uint64_t)1 << (address % 64);
+}
+
+/**
+ * @brief Hash the content of a ROM with 64 bits FNV-1a, it identifies the ROM whatever its file is named.
+ *
+ * @param rom The content of the ROM.
+ * @param size The size of the ROM in bytes.
+ * @return The hash.
+ */
+uint64_t hash_rom(const uint8_t* rom, size_t size)
+{
+    uint64_t hash = 0xCBF29CE484222325;
+
+    for (size_t i = 0; i < size; i++) {
+        hash ^= rom[i];
+        hash *= 0x100000001B3;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Get the size of an analysis with all its basic blocks.
+ *
+ * @param analysis The analysis.
+ * @return The size in bytes.
+ */
+size_t get_rom_analysis_size(const struct RomAnalysis* analysis)
+{
+    return sizeof(struct RomAnalysis) + analysis->block_count * sizeof(struct BasicBlock);
+}
+
+/**
+ * @brief Check that a block of memory, like a mapped cache file, holds an analysis made by this version.
+ *
+ * @param analysis The block of memory.
+ * @param size The size of the block of memory in bytes.
+ * @return If it is a valid analysis.
+ */
+bool is_rom_analysis_valid(const struct RomAnalysis* analysis, size_t size)
+{
+    if (size < sizeof(struct RomAnalysis)) {
+        return false;
+    }
+
+    if (memcmp(analysis->magic, ROM_ANALYSIS_MAGIC, sizeof(ROM_ANALYSIS_MAGIC)) != 0
+        || analysis->version != ROM_ANALYSIS_VERSION) {
+        return false;
+    }
+
+    return get_rom_analysis_size(analysis) == size;
+}
+
+/**
+ * @brief Check if an opcode is the 4 bytes long F000 NNNN of XO-CHIP.
+ */
+static inline bool is_long_opcode(const uint8_t* memory, uint16_t address)
+{
+    return memory[address] == 0xF0 && memory[(uint16_t)(address + 1)] == 0x00;
+}
+
+/**
+ * @brief Check if a jump closes a loop the interpreter idles on, the same patterns as the ones it detects when
+ *  running.
+ *
+ * @param memory The memory of the ROM.
+ * @param target The target of the jump.
+ * @param address The address of the jump.
+ * @return If the jump closes an idle loop.
+ */
+static bool is_idle_loop(const uint8_t* memory, uint16_t target, uint16_t address)
+{
+    if (target == address) {
+        return true;
+    }
+
+    uint8_t x = memory[target] & 0x0F;
+
+    return address == (uint16_t)(target + 4)
+        && (memory[target] & 0xF0) == 0xF0 && memory[(uint16_t)(target + 1)] == 0x07
+        && memory[(uint16_t)(target + 2)] == (0x30 | x) && memory[(uint16_t)(target + 3)] == 0x00;
+}
+
+/**
+ * @brief Get the platform an opcode belongs to.
+ *
+ * @param opcode The opcode.
+ * @return The first quirk profile that can run it.
+ */
+static enum QuirkProfile get_opcode_platform(struct Opcode opcode)
+{
+    switch (opcode.nibble_1) {
+    case 0x0:
+        if (opcode.nibble_2 != 0x0) {
+            break;
+        }
+
+        if (opcode.nibble_3 == 0xD) {
+            return QUIRK_PROFILE_XO_CHIP;
+        }
+
+        if (opcode.nibble_3 == 0xC || opcode.byte_2 >= 0xFB) {
+            return QUIRK_PROFILE_SCHIP_MODERN;
+        }
+
+        break;
+
+    case 0x5:
+        if (opcode.nibble_4 == 0x2 || opcode.nibble_4 == 0x3) {
+            return QUIRK_PROFILE_XO_CHIP;
+        }
+
+        break;
+
+    case 0xD:
+        if (opcode.nibble_4 == 0x0) {
+            return QUIRK_PROFILE_SCHIP_MODERN;
+        }
+
+        break;
+
+    case 0xF:
+        if ((opcode.nibble_2 == 0x0 && (opcode.byte_2 == 0x00 || opcode.byte_2 == 0x02)) || opcode.byte_2 == 0x01
+            || opcode.byte_2 == 0x3A) {
+            return QUIRK_PROFILE_XO_CHIP;
+        }
+
+        if (opcode.byte_2 == 0x30 || opcode.byte_2 == 0x75 || opcode.byte_2 == 0x85) {
+            return QUIRK_PROFILE_SCHIP_MODERN;
+        }
+
+        break;
+    }
+
+    return QUIRK_PROFILE_COSMAC_VIP;
+}
+
+/**
+ * @brief Follow every instruction reachable from the entry point, marking the code, the data and the leaders of the
+ *  basic blocks.
+ *
+ * @param analysis The analysis to fill, its bitmaps must be cleared.
+ * @param memory The memory with the ROM loaded.
+ * @param size The size of the ROM in bytes.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t walk_rom(struct RomAnalysis* analysis, const uint8_t* memory, size_t size)
+{
+    // Every instruction is pushed at most once, so the whole address space is enough
+    uint16_t* pending = malloc(XO_CHIP_MEMORY_SIZE * sizeof(uint16_t));
+    if (pending == NULL) {
+        error("Malloc 'pending' failed");
+        return 1;
+    }
+
+    size_t pending_count = 0;
+    enum QuirkProfile profile = QUIRK_PROFILE_COSMAC_VIP;
+
+    pending[pending_count++] = ROM_START;
+    set_analysis_bit(analysis->instructions, ROM_START);
+    set_analysis_bit(analysis->leaders, ROM_START);
+
+    while (pending_count > 0) {
+        uint16_t address = pending[--pending_count];
+
+        struct Opcode opcode = decode_opcode(memory[address], memory[(uint16_t)(address + 1)]);
+        uint8_t length = is_long_opcode(memory, address) ? 4 : 2;
+        uint16_t next = address + length;
+
+        analysis->instruction_count++;
+
+        for (uint8_t i = 0; i < length; i++) {
+            set_analysis_bit(analysis->code, address + i);
+        }
+
+        enum QuirkProfile platform = get_opcode_platform(opcode);
+        if (platform > profile) {
+            profile = platform;
+        }
+
+        uint16_t successors[2];
+        uint8_t successor_count = 0;
+
+        switch (opcode.nibble_1) {
+        case 0x0:
+            // Returning and exiting end the path, everything else goes on
+            if (opcode.nibbles_2_3_4 != 0x0EE && opcode.nibbles_2_3_4 != 0x0FD) {
+                successors[successor_count++] = next;
+            }
+
+            break;
+
+        case 0x1:
+            successors[successor_count++] = opcode.nibbles_2_3_4;
+
+            if (is_idle_loop(memory, opcode.nibbles_2_3_4, address)) {
+                set_analysis_bit(analysis->idle_loops, address);
+                analysis->idle_loop_count++;
+            }
+
+            break;
+
+        case 0x2:
+            successors[successor_count++] = opcode.nibbles_2_3_4;
+            successors[successor_count++] = next;
+            break;
+
+        case 0x3:
+        case 0x4:
+        case 0x5:
+        case 0x9:
+        case 0xE:
+            successors[successor_count++] = next;
+            successors[successor_count++] = next + (is_long_opcode(memory, next) ? 4 : 2);
+            break;
+
+        case 0xA:
+            set_analysis_bit(analysis->data, opcode.nibbles_2_3_4);
+            successors[successor_count++] = next;
+            break;
+
+        case 0xB:
+            // The target depends on a register, so the path can't be followed
+            break;
+
+        default:
+            if (length == 4) {
+                uint16_t target = memory[(uint16_t)(address + 2)] << 8 | memory[(uint16_t)(address + 3)];
+                set_analysis_bit(analysis->data, target);
+            }
+
+            successors[successor_count++] = next;
+            break;
+        }
+
+        // Anything but going on with the next instruction starts new basic blocks
+        bool branches = successor_count != 1 || successors[0] != next;
+
+        for (uint8_t i = 0; i < successor_count; i++) {
+            uint16_t successor = successors[i];
+
+            if (branches) {
+                set_analysis_bit(analysis->leaders, successor);
+            }
+
+            // Outside of the ROM there is only the interpreter area and empty memory
+            if (successor < ROM_START || successor >= ROM_START + size) {
+                continue;
+            }
+
+            // Marked when pushed, so every instruction is walked once
+            if (!test_analysis_bit(analysis->instructions, successor)) {
+                set_analysis_bit(analysis->instructions, successor);
+                pending[pending_count++] = successor;
+            }
+        }
+    }
+
+    analysis->quirk_profile = profile;
+
+    free(pending);
+
+    return 0;
+}
+
+/**
+ * @brief Fill the basic block ending with the instruction at an address with its successors.
+ *
+ * @param block The block, its start and end are already set.
+ * @param memory The memory with the ROM loaded.
+ * @param address The address of the last instruction of the block.
+ * @param size The size of the ROM in bytes.
+ * @param idle_loops The jumps closing idle loops.
+ */
+static void finish_basic_block(struct BasicBlock* block, const uint8_t* memory, uint16_t address, size_t size,
+    const uint64_t idle_loops[ROM_ANALYSIS_BITMAP_WORDS])
+{
+    struct Opcode opcode = decode_opcode(memory[address], memory[(uint16_t)(address + 1)]);
+    uint16_t next = block->end;
+
+    block->successor_count = 0;
+    block->flags = 0;
+
+    switch (opcode.nibble_1) {
+    case 0x0:
+        if (opcode.nibbles_2_3_4 == 0x0EE) {
+            block->flags |= BASIC_BLOCK_RETURN;
+        } else if (opcode.nibbles_2_3_4 == 0x0FD) {
+            block->flags |= BASIC_BLOCK_EXIT;
+        } else {
+            block->successors[block->successor_count++] = next;
+        }
+
+        break;
+
+    case 0x1:
+        block->successors[block->successor_count++] = opcode.nibbles_2_3_4;
+
+        if (test_analysis_bit(idle_loops, address)) {
+            block->flags |= BASIC_BLOCK_IDLE_LOOP;
+        }
+
+        break;
+
+    case 0x2:
+        block->successors[block->successor_count++] = opcode.nibbles_2_3_4;
+        block->successors[block->successor_count++] = next;
+        block->flags |= BASIC_BLOCK_CALL;
+        break;
+
+    case 0x3:
+    case 0x4:
+    case 0x5:
+    case 0x9:
+    case 0xE:
+        block->successors[block->successor_count++] = next;
+        block->successors[block->successor_count++] = next + (is_long_opcode(memory, next) ? 4 : 2);
+        break;
+
+    case 0xB:
+        block->flags |= BASIC_BLOCK_INDIRECT;
+        break;
+
+    default:
+        block->successors[block->successor_count++] = next;
+        break;
+    }
+
+    for (uint8_t i = 0; i < block->successor_count; i++) {
+        if (block->successors[i] < ROM_START || block->successors[i] >= ROM_START + size) {
+            block->flags |= BASIC_BLOCK_EXTERNAL;
+        }
+    }
+}
+
+/**
+ * @brief Split the walked instructions into basic blocks.
+ *
+ * @param analysis The walked analysis, it must have room for a block per byte of the ROM.
+ * @param memory The memory with the ROM loaded.
+ * @param size The size of the ROM in bytes.
+ */
+static void build_basic_blocks(struct RomAnalysis* analysis, const uint8_t* memory, size_t size)
+{
+    analysis->block_count = 0;
+
+    for (size_t start = ROM_START; start < ROM_START + size; start++) {
+        if (!test_analysis_bit(analysis->leaders, start) || !test_analysis_bit(analysis->instructions, start)) {
+            continue;
+        }
+
+        struct BasicBlock* block = &analysis->blocks[analysis->block_count++];
+        uint16_t address = start;
+
+        // Grow the block until an instruction that branches or the start of another block
+        while (true) {
+            uint16_t next = address + (is_long_opcode(memory, address) ? 4 : 2);
+            uint8_t nibble_1 = memory[address] >> 4;
+            uint16_t nibbles_2_3_4 = (memory[address] & 0x0F) << 8 | memory[(uint16_t)(address + 1)];
+
+            bool branches = nibble_1 == 0x1 || nibble_1 == 0x2 || nibble_1 == 0x3 || nibble_1 == 0x4
+                || nibble_1 == 0x5 || nibble_1 == 0x9 || nibble_1 == 0xB || nibble_1 == 0xE
+                || (nibble_1 == 0x0 && (nibbles_2_3_4 == 0x0EE || nibbles_2_3_4 == 0x0FD));
+
+            if (branches || next < ROM_START || next >= ROM_START + size || test_analysis_bit(analysis->leaders, next)
+                || !test_analysis_bit(analysis->instructions, next)) {
+                block->start = start;
+                block->end = next;
+                finish_basic_block(block, memory, address, size, analysis->idle_loops);
+                break;
+            }
+
+            address = next;
+        }
+    }
+}
+
+/**
+ * @brief Analyze a ROM without running it: its control flow graph, which bytes are code and which data, the loops
+ *  the interpreter idles on and the platform its instructions belong to.
+ *
+ * @param rom The content of the ROM, loaded at 0x200 like the virtual machine does.
+ * @param size The size of the ROM in bytes.
+ * @return The analysis or a NULL pointer if an error occurs. It can (and MUST) be deallocated after its use with
+ *  `free()`.
+ */
+struct RomAnalysis* analyze_rom(const uint8_t* rom, size_t size)
+{
+    if (size > XO_CHIP_MEMORY_SIZE - ROM_START) {
+        error("ROM size too big for the memory! Are you sure it is valid for this system?");
+        return NULL;
+    }
+
+    // Every address is wrapped to 16 bits, so reading past the ROM only finds empty memory
+    uint8_t* memory = calloc(XO_CHIP_MEMORY_SIZE, sizeof(uint8_t));
+    if (memory == NULL) {
+        error("Malloc 'memory' failed");
+        return NULL;
+    }
+
+    memcpy(memory + ROM_START, rom, size);
+
+    // There can't be more basic blocks than instructions, nor more instructions than bytes
+    struct RomAnalysis* analysis = calloc(1, sizeof(struct RomAnalysis) + size * sizeof(struct BasicBlock));
+    if (analysis == NULL) {
+        error("Malloc 'analysis' failed");
+        goto analysis_failed;
+    }
+
+    memcpy(analysis->magic, ROM_ANALYSIS_MAGIC, sizeof(ROM_ANALYSIS_MAGIC));
+    analysis->version = ROM_ANALYSIS_VERSION;
+    analysis->rom_size = (uint32_t)size;
+    analysis->rom_hash = hash_rom(rom, size);
+
+    if (size > 0) {
+        if (walk_rom(analysis, memory, size) != 0) {
+            goto walk_failed;
+        }
+
+        build_basic_blocks(analysis, memory, size);
+    }
+
+    struct RomAnalysis* shrunk = realloc(analysis, get_rom_analysis_size(analysis));
+    if (shrunk != NULL) {
+        analysis = shrunk;
+    }
+
+    free(memory);
+
+    return analysis;
+
+walk_failed:
+    free(analysis);
+analysis_failed:
+    free(memory);
+
+    return NULL;
+}
@@ -0,0 +1,385 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "scaler.h"
+#include "screen.h"
+
+/**
+ * @brief The names of the scalers, indexed by `enum Scaler`.
+ */
+static const char* const scaler_names[] = {
+    "none",
+    "scale2x",
+    "scale3x",
+    "epx",
+    "scanlines",
+};
+
+/**
+ * @brief How many times each scaler multiplies the width and height of the screen, indexed by `enum Scaler`.
+ */
+static constexpr size_t scaler_factors[] = { 1, 2, 3, 2, SCALER_MAX_FACTOR };
+
+// Number of pixels processed at once by the kernels, on targets without 256 bits registers the compiler splits every
+// operation in two of 128 bits (SSE2 on x86-64, NEON on ARM64)
+static constexpr size_t VECTOR_SIZE = 32;
+
+typedef int8_t Pixels __attribute__((vector_size(VECTOR_SIZE)));
+
+// The rows of the palette index image leave room on both sides for the neighbours of the edge pixels and for the
+// kernels to read a whole vector past the end of the screen
+static constexpr size_t IMAGE_OFFSET = VECTOR_SIZE;
+static constexpr size_t IMAGE_STRIDE = IMAGE_OFFSET + SCREEN_HIGH_RESOLUTION_WIDTH + 2 * VECTOR_SIZE;
+
+#define LOAD_PIXELS(pixels, source) memcpy(&(pixels), (source), sizeof(Pixels))
+#define STORE_PIXELS(destination, pixels) memcpy((destination), &(pixels), sizeof(Pixels))
+
+// Pick every pixel from `a` where the mask is set and from `b` where it is not
+#define SELECT_PIXELS(mask, a, b) (((a) & (mask)) | ((b) & ~(mask)))
+
+/**
+ * @brief Get the palette index of every pixel of the screen, repeating the pixels at the edges on the border around it.
+ *
+ * @param screen The screen to get the pixels from.
+ * @param image Where to store the indexes, the pixel (x, y) is stored at `image[y + 1][IMAGE_OFFSET + x]`.
+ */
+static void compose_palette_indexes(const struct Screen* screen, uint8_t image[][IMAGE_STRIDE])
+{
+    size_t words = screen->width / 64;
+
+    for (size_t y = 0; y < screen->height; y++) {
+        uint8_t* row = image[y + 1] + IMAGE_OFFSET;
+
+        for (size_t i = 0; i < words; i++) {
+            for (size_t bit = 0; bit < 64; bit++) {
+                uint8_t color = 0;
+
+                for (size_t plane = 0; plane < SCREEN_PLANES; plane++) {
+                    color |= ((screen->buffer[plane][y][i] >> (63 - bit)) & 1) << plane;
+                }
+
+                row[i * 64 + bit] = color;
+            }
+        }
+
+        row[-1] = row[0];
+        row[screen->width] = row[screen->width - 1];
+    }
+
+    memcpy(image[0], image[1], IMAGE_STRIDE);
+    memcpy(image[screen->height + 1], image[screen->height], IMAGE_STRIDE);
+}
+
+/**
+ * @brief Scale2x one row of the image, every pixel E is replaced by a 2x2 block computed from its neighbours:
+ *     B         E0 E1
+ *   D E F  ->   E2 E3
+ *     H
+ *
+ * @param above The row above, starting at the first pixel.
+ * @param row The row to scale, starting at the first pixel.
+ * @param below The row below, starting at the first pixel.
+ * @param width The number of pixels of the row.
+ * @param output The rows where the subpixels E0 to E3 are stored.
+ */
+[[gnu::always_inline]] static inline void scale2x_row(const uint8_t* above, const uint8_t* row, const uint8_t* below,
+    size_t width, uint8_t output[][IMAGE_STRIDE])
+{
+    for (size_t x = 0; x < width; x += VECTOR_SIZE) {
+        Pixels b, d, e, f, h;
+        LOAD_PIXELS(b, above + x);
+        LOAD_PIXELS(d, row + x - 1);
+        LOAD_PIXELS(e, row + x);
+        LOAD_PIXELS(f, row + x + 1);
+        LOAD_PIXELS(h, below + x);
+
+        Pixels d_b = d == b;
+        Pixels b_f = b == f;
+        Pixels d_h = d == h;
+        Pixels h_f = h == f;
+
+        Pixels e0 = SELECT_PIXELS(d_b & ~b_f & ~d_h, d, e);
+        Pixels e1 = SELECT_PIXELS(b_f & ~d_b & ~h_f, f, e);
+        Pixels e2 = SELECT_PIXELS(d_h & ~d_b & ~h_f, d, e);
+        Pixels e3 = SELECT_PIXELS(h_f & ~d_h & ~b_f, f, e);
+
+        STORE_PIXELS(output[0] + x, e0);
+        STORE_PIXELS(output[1] + x, e1);
+        STORE_PIXELS(output[2] + x, e2);
+        STORE_PIXELS(output[3] + x, e3);
+    }
+}
+
+/**
+ * @brief Scale3x one row of the image, every pixel E is replaced by a 3x3 block computed from its neighbours:
+ *   A B C       E0 E1 E2
+ *   D E F  ->   E3 E4 E5
+ *   G H I       E6 E7 E8
+ *
+ * @param above The row above, starting at the first pixel.
+ * @param row The row to scale, starting at the first pixel.
+ * @param below The row below, starting at the first pixel.
+ * @param width The number of pixels of the row.
+ * @param output The rows where the subpixels E0 to E8 are stored.
+ */
+[[gnu::always_inline]] static inline void scale3x_row(const uint8_t* above, const uint8_t* row, const uint8_t* below,
+    size_t width, uint8_t output[][IMAGE_STRIDE])
+{
+    for (size_t x = 0; x < width; x += VECTOR_SIZE) {
+        Pixels a, b, c, d, e, f, g, h, i;
+        LOAD_PIXELS(a, above + x - 1);
+        LOAD_PIXELS(b, above + x);
+        LOAD_PIXELS(c, above + x + 1);
+        LOAD_PIXELS(d, row + x - 1);
+        LOAD_PIXELS(e, row + x);
+        LOAD_PIXELS(f, row + x + 1);
+        LOAD_PIXELS(g, below + x - 1);
+        LOAD_PIXELS(h, below + x);
+        LOAD_PIXELS(i, below + x + 1);
+
+        Pixels d_b = d == b;
+        Pixels b_f = b == f;
+        Pixels d_h = d == h;
+        Pixels h_f = h == f;
+
+        Pixels e_a = e == a;
+        Pixels e_c = e == c;
+        Pixels e_g = e == g;
+        Pixels e_i = e == i;
+
+        // The same corner conditions used by Scale2x
+        Pixels top_left = d_b & ~b_f & ~d_h;
+        Pixels top_right = b_f & ~d_b & ~h_f;
+        Pixels bottom_left = d_h & ~d_b & ~h_f;
+        Pixels bottom_right = h_f & ~d_h & ~b_f;
+
+        Pixels e0 = SELECT_PIXELS(top_left, d, e);
+        Pixels e1 = SELECT_PIXELS((top_left & ~e_c) | (top_right & ~e_a), b, e);
+        Pixels e2 = SELECT_PIXELS(top_right, f, e);
+        Pixels e3 = SELECT_PIXELS((top_left & ~e_g) | (bottom_left & ~e_a), d, e);
+        Pixels e5 = SELECT_PIXELS((top_right & ~e_i) | (bottom_right & ~e_c), f, e);
+        Pixels e6 = SELECT_PIXELS(bottom_left, d, e);
+        Pixels e7 = SELECT_PIXELS((bottom_left & ~e_i) | (bottom_right & ~e_g), h, e);
+        Pixels e8 = SELECT_PIXELS(bottom_right, f, e);
+
+        STORE_PIXELS(output[0] + x, e0);
+        STORE_PIXELS(output[1] + x, e1);
+        STORE_PIXELS(output[2] + x, e2);
+        STORE_PIXELS(output[3] + x, e3);
+        STORE_PIXELS(output[4] + x, e);
+        STORE_PIXELS(output[5] + x, e5);
+        STORE_PIXELS(output[6] + x, e6);
+        STORE_PIXELS(output[7] + x, e7);
+        STORE_PIXELS(output[8] + x, e8);
+    }
+}
+
+typedef void (*ScaleRow)(const uint8_t* above, const uint8_t* row, const uint8_t* below, size_t width,
+    uint8_t output[][IMAGE_STRIDE]);
+
+/**
+ * @brief The kernels compiled for one instruction set.
+ */
+struct ScalerKernels {
+    ScaleRow scale2x_row;
+    ScaleRow scale3x_row;
+};
+
+/**
+ * @brief Instantiate the kernels with the given function attributes, the always inlined rows are compiled again for
+ *  every instantiation.
+ *
+ * @param name The suffix of the kernels.
+ * @param ... The attributes of the kernels, like the instruction set to target.
+ */
+#define DEFINE_SCALER_KERNELS(name, ...)                                                                          \
+    __VA_ARGS__ static void scale2x_row_##name(const uint8_t* above, const uint8_t* row, const uint8_t* below,    \
+        size_t width, uint8_t output[][IMAGE_STRIDE])                                                             \
+    {                                                                                                             \
+        scale2x_row(above, row, below, width, output);                                                            \
+    }                                                                                                             \
+                                                                                                                  \
+    __VA_ARGS__ static void scale3x_row_##name(const uint8_t* above, const uint8_t* row, const uint8_t* below,    \
+        size_t width, uint8_t output[][IMAGE_STRIDE])                                                             \
+    {                                                                                                             \
+        scale3x_row(above, row, below, width, output);                                                            \
+    }                                                                                                             \
+                                                                                                                  \
+    static const struct ScalerKernels name##_kernels = {                                                          \
+        .scale2x_row = scale2x_row_##name,                                                                        \
+        .scale3x_row = scale3x_row_##name,                                                                        \
+    };
+
+// Uses the baseline instruction set of the target, SSE2 on x86-64
+DEFINE_SCALER_KERNELS(generic)
+
+#if defined(__x86_64__) || defined(__i386__)
+DEFINE_SCALER_KERNELS(avx2, [[gnu::target("avx2")]])
+#endif
+
+/**
+ * @brief Get the fastest kernels supported by the running CPU.
+ *
+ * @return The kernels to use.
+ */
+static const struct ScalerKernels* get_scaler_kernels()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        return &avx2_kernels;
+    }
+#endif
+
+    return &generic_kernels;
+}
+
+/**
+ * @brief Write the subpixels of one row of the screen to the texture through the palette.
+ *
+ * @param subpixels The rows of subpixels, with the subpixel (i, j) of the block stored at `subpixels[j * factor + i]`.
+ * @param factor The width and height of the block of subpixels of every pixel.
+ * @param width The number of pixels of the row.
+ * @param palette The ARGB color of each palette index.
+ * @param pixels The first texture row where the block is written.
+ * @param pitch The length in bytes of a row of the texture.
+ */
+static void write_subpixels(const uint8_t subpixels[][IMAGE_STRIDE], size_t factor, size_t width,
+    const uint32_t palette[SCREEN_PALETTE_SIZE], uint32_t* pixels, size_t pitch)
+{
+    for (size_t j = 0; j < factor; j++) {
+        uint32_t* pixel_row = (uint32_t*)((uint8_t*)pixels + j * pitch);
+
+        for (size_t x = 0; x < width; x++) {
+            for (size_t i = 0; i < factor; i++) {
+                pixel_row[x * factor + i] = palette[subpixels[j * factor + i][x]];
+            }
+        }
+    }
+}
+
+/**
+ * @brief Write one row of the screen to the texture as blocks of pixels with the last row darkened to half of its
+ *  brightness, simulating the gaps between the scanlines of a CRT.
+ *
+ * @param row The palette indexes of the row.
+ * @param width The number of pixels of the row.
+ * @param palette The ARGB color of each palette index.
+ * @param pixels The first texture row where the block is written.
+ * @param pitch The length in bytes of a row of the texture.
+ */
+static void write_scanlines(const uint8_t* row, size_t width, const uint32_t palette[SCREEN_PALETTE_SIZE],
+    uint32_t* pixels, size_t pitch)
+{
+    uint32_t* pixel_row = pixels;
+
+    for (size_t x = 0; x < width; x++) {
+        for (size_t i = 0; i < SCALER_MAX_FACTOR; i++) {
+            pixel_row[x * SCALER_MAX_FACTOR + i] = palette[row[x]];
+        }
+    }
+
+    for (size_t j = 1; j < SCALER_MAX_FACTOR - 1; j++) {
+        memcpy((uint8_t*)pixels + j * pitch, pixel_row, width * SCALER_MAX_FACTOR * sizeof(uint32_t));
+    }
+
+    uint32_t* gap_row = (uint32_t*)((uint8_t*)pixels + (SCALER_MAX_FACTOR - 1) * pitch);
+
+    for (size_t x = 0; x < width * SCALER_MAX_FACTOR; x++) {
+        gap_row[x] = ((pixel_row[x] >> 1) & 0x007F7F7F) | 0xFF000000;
+    }
+}
+
+/**
+ * @brief Get the scaler with the given name.
+ *
+ * @param name The name of the scaler.
+ * @param scaler Where the found scaler will be stored.
+ * @return Return 0 on success or another number if no scaler has the given name.
+ */
+uint8_t parse_scaler(const char* name, enum Scaler* scaler)
+{
+    for (size_t i = 0; i < sizeof(scaler_names) / sizeof(scaler_names[0]); i++) {
+        if (strcmp(name, scaler_names[i]) == 0) {
+            *scaler = (enum Scaler)i;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Get the name of a scaler.
+ *
+ * @param scaler The scaler to get its name from.
+ * @return The name of the scaler.
+ */
+const char* get_scaler_name(enum Scaler scaler)
+{
+    return scaler_names[scaler];
+}
+
+/**
+ * @brief Get how many times a scaler multiplies the width and height of the screen.
+ *
+ * @param scaler The scaler to get its factor from.
+ * @return The factor of the scaler.
+ */
+size_t get_scaler_factor(enum Scaler scaler)
+{
+    return scaler_factors[scaler];
+}
+
+/**
+ * @brief Upscale the screen with a filter, writing the result to a texture of at least
+ *  `get_scaler_factor(scaler)` times the resolution of the screen.
+ *  EPX is the original name of the Scale2x algorithm, both produce the same image.
+ *
+ * @param screen The screen to upscale.
+ * @param scaler The filter to upscale the screen with.
+ * @param palette The ARGB color of each palette index.
+ * @param pixels The pixels of the texture.
+ * @param pitch The length in bytes of a row of the texture.
+ */
+void scale_screen(const struct Screen* screen, enum Scaler scaler, const uint32_t palette[SCREEN_PALETTE_SIZE],
+    uint32_t* pixels, size_t pitch)
+{
+    static const struct ScalerKernels* kernels = NULL;
+    if (kernels == NULL) {
+        kernels = get_scaler_kernels();
+    }
+
+    uint8_t image[SCREEN_HIGH_RESOLUTION_HEIGHT + 2][IMAGE_STRIDE] = {};
+    uint8_t subpixels[SCALER_MAX_FACTOR * SCALER_MAX_FACTOR][IMAGE_STRIDE];
+
+    compose_palette_indexes(screen, image);
+
+    size_t factor = get_scaler_factor(scaler);
+
+    for (size_t y = 0; y < screen->height; y++) {
+        const uint8_t* above = image[y] + IMAGE_OFFSET;
+        const uint8_t* row = image[y + 1] + IMAGE_OFFSET;
+        const uint8_t* below = image[y + 2] + IMAGE_OFFSET;
+
+        uint32_t* block = (uint32_t*)((uint8_t*)pixels + y * factor * pitch);
+
+        switch (scaler) {
+        case SCALER_SCALE2X:
+        case SCALER_EPX:
+            kernels->scale2x_row(above, row, below, screen->width, subpixels);
+            write_subpixels(subpixels, factor, screen->width, palette, block, pitch);
+            break;
+        case SCALER_SCALE3X:
+            kernels->scale3x_row(above, row, below, screen->width, subpixels);
+            write_subpixels(subpixels, factor, screen->width, palette, block, pitch);
+            break;
+        case SCALER_SCANLINES:
+            write_scanlines(row, screen->width, palette, block, pitch);
+            break;
+        case SCALER_NONE:
+            memcpy(subpixels[0], row, screen->width);
+            write_subpixels(subpixels, factor, screen->width, palette, block, pitch);
+            break;
+        }
+    }
+}
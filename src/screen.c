@@ -0,0 +1,319 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+#include "screen.h"
+
+/**
+ * @brief Turn off all the pixels of the selected planes of the screen.
+ *
+ * @param screen The screen to be cleared.
+ */
+void clear_screen(struct Screen* screen)
+{
+    for (size_t plane = 0; plane < SCREEN_PLANES; plane++) {
+        if (screen->selected_planes & (1 << plane)) {
+            memset(screen->buffer[plane], 0, sizeof(screen->buffer[plane]));
+        }
+    }
+
+    screen->dirty = true;
+}
+
+/**
+ * @brief Switch the screen between the CHIP-8 low resolution (64x32) and the SUPER-CHIP high resolution (128x64). All the planes are cleared on the switch.
+ *
+ * @param screen The screen to be switched.
+ * @param high_resolution If the high resolution should be used.
+ */
+void set_screen_resolution(struct Screen* screen, bool high_resolution)
+{
+    screen->high_resolution = high_resolution;
+
+    screen->width = high_resolution ? SCREEN_HIGH_RESOLUTION_WIDTH : SCREEN_LOW_RESOLUTION_WIDTH;
+    screen->height = high_resolution ? SCREEN_HIGH_RESOLUTION_HEIGHT : SCREEN_LOW_RESOLUTION_HEIGHT;
+
+    memset(screen->buffer, 0, sizeof(screen->buffer));
+    screen->dirty = true;
+}
+
+/**
+ * @brief Scroll the selected planes of the screen down moving whole rows, the rows uncovered on the top are cleared.
+ *
+ * @param screen The screen to be scrolled.
+ * @param rows The number of rows to scroll.
+ */
+void scroll_screen_down(struct Screen* screen, size_t rows)
+{
+    if (rows > screen->height) {
+        rows = screen->height;
+    }
+
+    for (size_t plane = 0; plane < SCREEN_PLANES; plane++) {
+        if (!(screen->selected_planes & (1 << plane))) {
+            continue;
+        }
+
+        memmove(screen->buffer[plane][rows], screen->buffer[plane][0], (screen->height - rows) * sizeof(screen->buffer[plane][0]));
+        memset(screen->buffer[plane][0], 0, rows * sizeof(screen->buffer[plane][0]));
+    }
+
+    screen->dirty = true;
+}
+
+/**
+ * @brief Scroll the selected planes of the screen up moving whole rows, the rows uncovered on the bottom are cleared.
+ *
+ * @param screen The screen to be scrolled.
+ * @param rows The number of rows to scroll.
+ */
+void scroll_screen_up(struct Screen* screen, size_t rows)
+{
+    if (rows > screen->height) {
+        rows = screen->height;
+    }
+
+    for (size_t plane = 0; plane < SCREEN_PLANES; plane++) {
+        if (!(screen->selected_planes & (1 << plane))) {
+            continue;
+        }
+
+        memmove(screen->buffer[plane][0], screen->buffer[plane][rows], (screen->height - rows) * sizeof(screen->buffer[plane][0]));
+        memset(screen->buffer[plane][screen->height - rows], 0, rows * sizeof(screen->buffer[plane][0]));
+    }
+
+    screen->dirty = true;
+}
+
+/**
+ * @brief Scroll the selected planes of the screen 4 pixels to the right, the pixels uncovered on the left are cleared.
+ *
+ * @param screen The screen to be scrolled.
+ */
+void scroll_screen_right(struct Screen* screen)
+{
+    size_t words = screen->width / 64;
+
+    for (size_t plane = 0; plane < SCREEN_PLANES; plane++) {
+        if (!(screen->selected_planes & (1 << plane))) {
+            continue;
+        }
+
+        for (size_t y = 0; y < screen->height; y++) {
+            uint64_t* row = screen->buffer[plane][y];
+
+            for (size_t i = words; i-- > 0;) {
+                row[i] = (row[i] >> 4) | (i > 0 ? row[i - 1] << 60 : 0);
+            }
+        }
+    }
+
+    screen->dirty = true;
+}
+
+/**
+ * @brief Scroll the selected planes of the screen 4 pixels to the left, the pixels uncovered on the right are cleared.
+ *
+ * @param screen The screen to be scrolled.
+ */
+void scroll_screen_left(struct Screen* screen)
+{
+    size_t words = screen->width / 64;
+
+    for (size_t plane = 0; plane < SCREEN_PLANES; plane++) {
+        if (!(screen->selected_planes & (1 << plane))) {
+            continue;
+        }
+
+        for (size_t y = 0; y < screen->height; y++) {
+            uint64_t* row = screen->buffer[plane][y];
+
+            for (size_t i = 0; i < words; i++) {
+                row[i] = (row[i] << 4) | (i + 1 < words ? row[i + 1] >> 60 : 0);
+            }
+        }
+    }
+
+    screen->dirty = true;
+}
+
+/**
+ * @brief XOR a sprite into one plane of the screen buffer.
+ *
+ * @param screen The screen where the sprite should be drawn.
+ * @param plane The plane where the sprite should be drawn.
+ * @param sprite The sprite data, each row is made of `sprite_width / 8` bytes with the leftmost pixel as the most significant bit.
+ * @param sprite_height The number of rows of the sprite.
+ * @param sprite_width The width in pixels of the sprite, 8 or 16.
+ * @param x The x position of the sprite, it should be inside the screen.
+ * @param y The y position of the sprite, it should be inside the screen.
+ * @param wrap If the parts of the sprite outside of the screen should wrap around to the opposite edge instead of being clipped.
+ * @return The number of rows where a pixel that was on has been turned off.
+ */
+static size_t draw_sprite_plane(struct Screen* screen, size_t plane, const uint8_t* sprite, size_t sprite_height, size_t sprite_width, size_t x, size_t y, bool wrap)
+{
+    size_t sprite_row_bytes = sprite_width / 8;
+    size_t words = screen->width / 64;
+
+    // Number of pixels of each row that go past the right edge
+    size_t overflow = x + sprite_width > screen->width ? x + sprite_width - screen->width : 0;
+
+    size_t collided_rows = 0;
+
+    for (size_t row = 0; row < sprite_height; row++) {
+        size_t screen_y = y + row;
+
+        if (screen_y >= screen->height) {
+            if (!wrap) {
+                break;
+            }
+
+            screen_y -= screen->height;
+        }
+
+        uint64_t row_data = 0;
+
+        for (size_t i = 0; i < sprite_row_bytes; i++) {
+            row_data = row_data << 8 | sprite[row * sprite_row_bytes + i];
+        }
+
+        // Align the sprite row with the packed row and shift it to its position, anything shifted past the last word is clipped
+        uint64_t bits[SCREEN_ROW_WORDS] = { row_data << (64 - sprite_width), 0 };
+
+        if (x >= 64) {
+            bits[1] = bits[0] >> (x - 64);
+            bits[0] = 0;
+        } else if (x > 0) {
+            bits[1] = bits[0] << (64 - x);
+            bits[0] >>= x;
+        }
+
+        // The clipped pixels are the lowest bits of the row, move them to the left edge
+        if (wrap && overflow > 0) {
+            bits[0] |= (row_data & ((1ULL << overflow) - 1)) << (64 - overflow);
+        }
+
+        uint64_t* screen_row = screen->buffer[plane][screen_y];
+        bool collision = false;
+
+        for (size_t i = 0; i < words; i++) {
+            if (screen_row[i] & bits[i]) {
+                collision = true;
+            }
+
+            screen_row[i] ^= bits[i];
+        }
+
+        collided_rows += collision;
+    }
+
+    return collided_rows;
+}
+
+/**
+ * @brief XOR a sprite into the selected planes of the screen buffer.
+ *
+ * @param screen The screen where the sprite should be drawn.
+ * @param sprite The sprite data, each row is made of `sprite_width / 8` bytes with the leftmost pixel as the most significant bit.
+ *  When more than one plane is selected the data of each plane follows the previous one.
+ * @param sprite_height The number of rows of the sprite.
+ * @param sprite_width The width in pixels of the sprite, 8 or 16.
+ * @param x The x position of the sprite, it should be inside the screen.
+ * @param y The y position of the sprite, it should be inside the screen.
+ * @param wrap If the parts of the sprite outside of the screen should wrap around to the opposite edge instead of being clipped.
+ * @return The number of rows where a pixel that was on has been turned off, the highest of all the planes.
+ */
+size_t draw_sprite(struct Screen* screen, const uint8_t* sprite, size_t sprite_height, size_t sprite_width, size_t x, size_t y, bool wrap)
+{
+    size_t sprite_size = sprite_height * sprite_width / 8;
+
+    size_t collided_rows = 0;
+
+    for (size_t plane = 0; plane < SCREEN_PLANES; plane++) {
+        if (!(screen->selected_planes & (1 << plane))) {
+            continue;
+        }
+
+        size_t plane_collided_rows = draw_sprite_plane(screen, plane, sprite, sprite_height, sprite_width, x, y, wrap);
+
+        if (plane_collided_rows > collided_rows) {
+            collided_rows = plane_collided_rows;
+        }
+
+        sprite += sprite_size;
+    }
+
+    screen->dirty = true;
+
+    return collided_rows;
+}
+
+/**
+ * @brief Get the palette index of every pixel of the screen, always at high resolution so a low resolution screen is
+ *  doubled on both axes.
+ *
+ * @param screen The screen to get the pixels from.
+ * @param indexes Where the palette indexes are stored.
+ */
+void get_screen_palette_indexes(const struct Screen* screen,
+    uint8_t indexes[SCREEN_HIGH_RESOLUTION_HEIGHT][SCREEN_HIGH_RESOLUTION_WIDTH])
+{
+    size_t scale = screen->high_resolution ? 1 : 2;
+
+    for (size_t y = 0; y < SCREEN_HIGH_RESOLUTION_HEIGHT; y++) {
+        size_t row = y / scale;
+
+        for (size_t x = 0; x < SCREEN_HIGH_RESOLUTION_WIDTH; x++) {
+            size_t column = x / scale;
+            uint8_t color = 0;
+
+            for (size_t plane = 0; plane < SCREEN_PLANES; plane++) {
+                color |= ((screen->buffer[plane][row][column / 64] >> (63 - column % 64)) & 1) << plane;
+            }
+
+            indexes[y][x] = color;
+        }
+    }
+}
+
+/**
+ * @brief Create a new screen in low resolution mode with all its pixels off.
+ *
+ * @return The pointer to the screen or a NULL pointer if an error occurs.
+ *  The screen should be freed using the function `delete_screen()`.
+ */
+struct Screen* create_screen()
+{
+    struct Screen* screen = malloc(sizeof(struct Screen));
+    if (screen == NULL) {
+        error("Malloc 'screen' failed");
+        return NULL;
+    }
+
+    reset_screen(screen);
+
+    return screen;
+}
+
+/**
+ * @brief Put the screen back to its power-on state: low resolution, only the first plane selected and all cleared.
+ *
+ * @param screen The screen to be reset.
+ */
+void reset_screen(struct Screen* screen)
+{
+    screen->selected_planes = 0x1;
+    set_screen_resolution(screen, false);
+}
+
+/**
+ * @brief Safely deallocated a screen.
+ *
+ * @param screen The screen to be deallocated.
+ */
+void delete_screen(struct Screen* screen)
+{
+    free(screen);
+}
@@ -0,0 +1,298 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+#include "quirks.h"
+#include "screen.h"
+#include "serialization.h"
+#include "virtual-machine.h"
+
+// Every state starts with the magic, the version of the layout and the quirk profile of the machine, so files from
+// other versions or platforms are rejected before anything is read
+static constexpr uint8_t STATE_MAGIC[4] = { 'O', 'C', '8', 'S' };
+
+// Bumped on every change of the layout, the states written before the header existed have none
+static constexpr uint16_t STATE_VERSION = 1;
+
+/**
+ * @brief Get the size in bytes of a serialized state.
+ *
+ * @return The number of bytes written by `write_state()`.
+ */
+size_t get_state_size()
+{
+    struct VirtualMachine* vm = NULL;
+    struct Screen* screen = NULL;
+
+    return sizeof(STATE_MAGIC) + sizeof(STATE_VERSION) + sizeof(uint8_t) + XO_CHIP_MEMORY_SIZE + sizeof(vm->pc) + sizeof(vm->pc_stack) + sizeof(vm->pc_stack_index)
+        + sizeof(vm->index_register) + sizeof(vm->v_registers) + sizeof(vm->delay_timer) + sizeof(vm->sound_timer)
+        + sizeof(vm->wait_key) + sizeof(vm->rpl_flags) + sizeof(vm->random_state) + sizeof(screen->high_resolution)
+        + sizeof(screen->selected_planes) + sizeof(screen->buffer);
+}
+
+/**
+ * @brief Write the virtual machine and screen state to a file, field by field in a fixed order.
+ *
+ * @param vm The virtual machine to get its data from.
+ * @param screen The screen to get its pixel data from.
+ * @param f The file where the state is written, it can be a memory stream.
+ * @return Return 0 on success or another number on failure.
+ */
+uint8_t write_state(struct VirtualMachine* vm, struct Screen* screen, FILE* f)
+{
+    uint16_t version = STATE_VERSION;
+    uint8_t quirk_profile = vm->quirk_profile;
+
+    if (fwrite(STATE_MAGIC, sizeof(STATE_MAGIC), 1, f) < 1 || fwrite(&version, sizeof(version), 1, f) < 1
+        || fwrite(&quirk_profile, sizeof(quirk_profile), 1, f) < 1) {
+        error("The header wasn't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    // The whole 64KB address space is saved for every profile, the guard isn't
+    if (fwrite(vm->memory, sizeof(vm->memory[0]), XO_CHIP_MEMORY_SIZE, f) < XO_CHIP_MEMORY_SIZE) {
+        error("The memory wasn't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(&vm->pc, sizeof(vm->pc), 1, f) < 1) {
+        error("The PC wasn't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(vm->pc_stack, sizeof(vm->pc_stack), 1, f) < 1) {
+        error("The PC stack wasn't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(&vm->pc_stack_index, sizeof(vm->pc_stack_index), 1, f) < 1) {
+        error("The PC stack index wasn't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(&vm->index_register, sizeof(vm->index_register), 1, f) < 1) {
+        error("The register i wasn't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(vm->v_registers, sizeof(vm->v_registers[0]), sizeof(vm->v_registers), f) < sizeof(vm->v_registers)) {
+        error("The registers v stack weren't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(&vm->delay_timer, sizeof(vm->delay_timer), 1, f) < 1) {
+        error("The delay timer wasn't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(&vm->sound_timer, sizeof(vm->sound_timer), 1, f) < 1) {
+        error("The sound timer wasn't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(&vm->wait_key, sizeof(vm->wait_key), 1, f) < 1) {
+        error("The wait key wasn't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(vm->rpl_flags, sizeof(vm->rpl_flags[0]), sizeof(vm->rpl_flags), f) < sizeof(vm->rpl_flags)) {
+        error("The RPL user flags weren't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(&vm->random_state, sizeof(vm->random_state), 1, f) < 1) {
+        error("The random number generator wasn't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(&screen->high_resolution, sizeof(screen->high_resolution), 1, f) < 1) {
+        error("The screen resolution wasn't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(&screen->selected_planes, sizeof(screen->selected_planes), 1, f) < 1) {
+        error("The screen selected planes weren't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    if (fwrite(screen->buffer, sizeof(screen->buffer), 1, f) < 1) {
+        error("The screen wasn't able to be fully written into the state");
+        goto write_failed;
+    }
+
+    return 0;
+
+write_failed:
+    return 1;
+}
+
+/**
+ * @brief Read a state written by `write_state()` into the virtual machine and screen. The whole state is read and
+ *  validated first, so on failure the virtual machine and the screen are left untouched.
+ *
+ * @param vm The virtual machine where the data should be written to.
+ * @param screen The screen where the pixel data should be written to.
+ * @param f The file where the state is read from, it can be a memory stream.
+ * @return Return 0 on success or another number on failure.
+ */
+uint8_t read_state(struct VirtualMachine* vm, struct Screen* screen, FILE* f)
+{
+    uint8_t magic[sizeof(STATE_MAGIC)];
+    uint16_t version;
+    uint8_t quirk_profile;
+
+    if (fread(magic, sizeof(magic), 1, f) < 1 || fread(&version, sizeof(version), 1, f) < 1
+        || fread(&quirk_profile, sizeof(quirk_profile), 1, f) < 1) {
+        error("The header wasn't able to be fully read from the state");
+        return 1;
+    }
+
+    if (memcmp(magic, STATE_MAGIC, sizeof(STATE_MAGIC)) != 0) {
+        error("The state isn't an och8S state, or it was saved before the states had a header");
+        return 1;
+    }
+
+    if (version != STATE_VERSION) {
+        error("The state was saved with the layout version %u, this version of och8S reads %u", version,
+            STATE_VERSION);
+        return 1;
+    }
+
+    if (quirk_profile != vm->quirk_profile) {
+        error("The state was saved with another quirk profile than the running one (%s)",
+            get_quirk_profile_name(vm->quirk_profile));
+        return 1;
+    }
+
+    struct VirtualMachine* state = malloc(sizeof(struct VirtualMachine));
+    if (state == NULL) {
+        error("Malloc 'state' failed");
+        return 1;
+    }
+
+    struct Screen* state_screen = malloc(sizeof(struct Screen));
+    if (state_screen == NULL) {
+        error("Malloc 'state_screen' failed");
+        goto state_screen_malloc_failed;
+    }
+
+    if (fread(state->memory, sizeof(state->memory[0]), XO_CHIP_MEMORY_SIZE, f) < XO_CHIP_MEMORY_SIZE) {
+        error("The memory wasn't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    if (fread(&state->pc, sizeof(state->pc), 1, f) < 1) {
+        error("The PC wasn't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    if (fread(state->pc_stack, sizeof(state->pc_stack), 1, f) < 1) {
+        error("The PC stack wasn't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    if (fread(&state->pc_stack_index, sizeof(state->pc_stack_index), 1, f) < 1) {
+        error("The PC stack index wasn't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    if (state->pc_stack_index > sizeof(state->pc_stack) / sizeof(state->pc_stack[0])) {
+        error("The PC stack index %zu of the state is out of the stack", state->pc_stack_index);
+        goto read_failed;
+    }
+
+    if (fread(&state->index_register, sizeof(state->index_register), 1, f) < 1) {
+        error("The register i wasn't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    if (fread(state->v_registers, sizeof(state->v_registers[0]), sizeof(state->v_registers), f) < sizeof(state->v_registers)) {
+        error("The registers v stack weren't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    if (fread(&state->delay_timer, sizeof(state->delay_timer), 1, f) < 1) {
+        error("The delay timer wasn't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    if (fread(&state->sound_timer, sizeof(state->sound_timer), 1, f) < 1) {
+        error("The sound timer wasn't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    if (fread(&state->wait_key, sizeof(state->wait_key), 1, f) < 1) {
+        error("The wait key wasn't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    // -2 when FX0A isn't running, -1 while it waits for a key
+    if (state->wait_key != -2 && state->wait_key != -1) {
+        error("The wait key %d of the state is invalid", state->wait_key);
+        goto read_failed;
+    }
+
+    if (fread(state->rpl_flags, sizeof(state->rpl_flags[0]), sizeof(state->rpl_flags), f) < sizeof(state->rpl_flags)) {
+        error("The RPL user flags weren't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    if (fread(&state->random_state, sizeof(state->random_state), 1, f) < 1) {
+        error("The random number generator wasn't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    // Read as a byte, a bool holding anything other than 0 or 1 is undefined behaviour
+    uint8_t high_resolution;
+
+    if (fread(&high_resolution, sizeof(high_resolution), 1, f) < 1) {
+        error("The screen resolution wasn't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    if (high_resolution > 1) {
+        error("The screen resolution %u of the state is invalid", high_resolution);
+        goto read_failed;
+    }
+
+    if (fread(&state_screen->selected_planes, sizeof(state_screen->selected_planes), 1, f) < 1) {
+        error("The screen selected planes weren't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    if (fread(state_screen->buffer, sizeof(state_screen->buffer), 1, f) < 1) {
+        error("The screen wasn't able to be fully read from the state");
+        goto read_failed;
+    }
+
+    // The whole state is valid, only now the running machine is replaced
+    memcpy(vm->memory, state->memory, XO_CHIP_MEMORY_SIZE);
+    vm->pc = state->pc;
+    memcpy(vm->pc_stack, state->pc_stack, sizeof(vm->pc_stack));
+    vm->pc_stack_index = state->pc_stack_index;
+    vm->index_register = state->index_register;
+    memcpy(vm->v_registers, state->v_registers, sizeof(vm->v_registers));
+    vm->delay_timer = state->delay_timer;
+    vm->sound_timer = state->sound_timer;
+    vm->wait_key = state->wait_key;
+    memcpy(vm->rpl_flags, state->rpl_flags, sizeof(vm->rpl_flags));
+    vm->random_state = state->random_state;
+
+    set_screen_resolution(screen, high_resolution == 1);
+    screen->selected_planes = state_screen->selected_planes;
+    memcpy(screen->buffer, state_screen->buffer, sizeof(screen->buffer));
+
+    free(state_screen);
+    free(state);
+
+    return 0;
+
+read_failed:
+    free(state_screen);
+state_screen_malloc_failed:
+    free(state);
+
+    return 1;
+}
@@ -0,0 +1,121 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "screen.h"
+#include "shared-screen.h"
+#include "virtual-machine.h"
+
+/**
+ * @brief Create a POSIX shared memory region where the state of the emulator is published every frame.
+ *
+ * @param name The name of the region, like `/och8s`. Other processes map it with `shm_open()` and the same name.
+ * @return The pointer to the export or a NULL pointer if an error occurs.
+ *  The export should be freed using the function `delete_shared_screen()`, that also removes the region.
+ */
+struct SharedScreenExport* create_shared_screen(const char* name)
+{
+    struct SharedScreenExport* export = malloc(sizeof(struct SharedScreenExport));
+    if (export == NULL) {
+        error("Malloc 'export' failed");
+        return NULL;
+    }
+
+    export->name = strdup(name);
+    if (export->name == NULL) {
+        error("Malloc 'export->name' failed");
+        goto name_failed;
+    }
+
+    export->file_descriptor = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (export->file_descriptor == -1) {
+        error("Couldn't create the shared memory '%s'", name);
+        goto open_failed;
+    }
+
+    if (ftruncate(export->file_descriptor, sizeof(struct SharedScreen)) != 0) {
+        error("Couldn't resize the shared memory '%s'", name);
+        goto truncate_failed;
+    }
+
+    export->shared = mmap(NULL, sizeof(struct SharedScreen), PROT_READ | PROT_WRITE, MAP_SHARED,
+        export->file_descriptor, 0);
+    if (export->shared == MAP_FAILED) {
+        error("Couldn't map the shared memory '%s'", name);
+        goto map_failed;
+    }
+
+    // The new region is zeroed, so the sequence starts even and the state blank
+    export->shared->magic = SHARED_SCREEN_MAGIC;
+    export->shared->version = SHARED_SCREEN_VERSION;
+
+    return export;
+
+map_failed:
+truncate_failed:
+    close(export->file_descriptor);
+    shm_unlink(name);
+open_failed:
+    free(export->name);
+name_failed:
+    free(export);
+
+    return NULL;
+}
+
+/**
+ * @brief Publish the state of the emulator at the end of a frame. Only one thread should call it.
+ *
+ * @param export The export where the state is published.
+ * @param vm The virtual machine to get the registers from.
+ * @param screen The screen to get the pixels from.
+ * @param frame The number of frames emulated.
+ */
+void publish_shared_screen(struct SharedScreenExport* export, const struct VirtualMachine* vm,
+    const struct Screen* screen, uint64_t frame)
+{
+    struct SharedScreen* shared = export->shared;
+    struct SharedScreenState* state = &shared->state;
+
+    uint64_t sequence = atomic_load_explicit(&shared->sequence, memory_order_relaxed);
+
+    // Odd while writing, the fence keeps the writes of the state from being seen before it
+    atomic_store_explicit(&shared->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    state->frame = frame;
+    state->high_resolution = screen->high_resolution;
+    state->exited = vm->exited;
+
+    state->pc = vm->pc;
+    state->index_register = vm->index_register;
+    memcpy(state->v_registers, vm->v_registers, sizeof(state->v_registers));
+    state->delay_timer = vm->delay_timer;
+    state->sound_timer = vm->sound_timer;
+
+    memcpy(state->buffer, screen->buffer, sizeof(state->buffer));
+
+    atomic_store_explicit(&shared->sequence, sequence + 2, memory_order_release);
+}
+
+/**
+ * @brief Unmap and remove the shared memory region, the readers that still have it mapped keep the last state.
+ *
+ * @param export The export to be deallocated.
+ */
+void delete_shared_screen(struct SharedScreenExport* export)
+{
+    munmap(export->shared, sizeof(struct SharedScreen));
+    close(export->file_descriptor);
+    shm_unlink(export->name);
+
+    free(export->name);
+    free(export);
+}
@@ -0,0 +1,429 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "screen.h"
+#include "terminal.h"
+#include "virtual-machine.h"
+
+// Enough for every cell of a full redraw with a cursor move, both colors and the character
+static constexpr size_t TERMINAL_OUTPUT_SIZE = TERMINAL_MAX_ROWS * TERMINAL_MAX_COLUMNS * 64 + 64;
+
+// How long a key stays pressed after the terminal sends it, longer than the delay of the key repeat of most terminals
+// so holding a key doesn't release it between the repeats
+static constexpr uint8_t TERMINAL_KEY_FRAMES = 12;
+
+// The byte sent by Ctrl+C, the signals are disabled while reading the keys so it must be handled to quit
+static constexpr char TERMINAL_INTERRUPT = 0x03;
+
+/**
+ * @brief The characters of the CHIP-8 keys (the index of the array), with the same layout as the window.
+ */
+static const char terminal_keys[] = "x123qweasdzc4rfv";
+
+/**
+ * @brief The names of the charsets, indexed by `enum TerminalCharset`.
+ */
+static const char* const terminal_charset_names[] = {
+    "half-block",
+    "braille",
+};
+
+/**
+ * @brief Get the charset with the given name.
+ *
+ * @param name The name of the charset.
+ * @param charset Where the found charset will be stored.
+ * @return Return 0 on success or another number if no charset has the given name.
+ */
+uint8_t parse_terminal_charset(const char* name, enum TerminalCharset* charset)
+{
+    for (size_t i = 0; i < sizeof(terminal_charset_names) / sizeof(terminal_charset_names[0]); i++) {
+        if (strcmp(name, terminal_charset_names[i]) == 0) {
+            *charset = (enum TerminalCharset)i;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Write all the given bytes to the standard output, retrying on partial writes.
+ *
+ * @param data The bytes to be written.
+ * @param length The number of bytes.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t write_terminal(const char* data, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, length);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            error("Couldn't write to the terminal: %s", strerror(errno));
+            return 1;
+        }
+
+        data += written;
+        length -= written;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Append a string to the output of the frame.
+ *
+ * @param terminal The terminal to append to.
+ * @param string The string to be appended.
+ */
+static void append_string(struct Terminal* terminal, const char* string)
+{
+    size_t length = strlen(string);
+
+    memcpy(terminal->output + terminal->output_length, string, length);
+    terminal->output_length += length;
+}
+
+/**
+ * @brief Append a number in decimal to the output of the frame.
+ *
+ * @param terminal The terminal to append to.
+ * @param number The number to be appended.
+ */
+static void append_number(struct Terminal* terminal, uint32_t number)
+{
+    char digits[10];
+    size_t length = 0;
+
+    do {
+        digits[length++] = '0' + number % 10;
+        number /= 10;
+    } while (number > 0);
+
+    while (length > 0) {
+        terminal->output[terminal->output_length++] = digits[--length];
+    }
+}
+
+/**
+ * @brief Append the escape sequence that sets the foreground or the background to a palette color.
+ *
+ * @param terminal The terminal to append to.
+ * @param background If the background should be set instead of the foreground.
+ * @param color The palette index of the color.
+ */
+static void append_color(struct Terminal* terminal, bool background, uint8_t color)
+{
+    uint32_t argb = SCREEN_PALETTE[color];
+
+    append_string(terminal, background ? "\x1B[48;2;" : "\x1B[38;2;");
+    append_number(terminal, (argb >> 16) & 0xFF);
+    append_string(terminal, ";");
+    append_number(terminal, (argb >> 8) & 0xFF);
+    append_string(terminal, ";");
+    append_number(terminal, argb & 0xFF);
+    append_string(terminal, "m");
+}
+
+/**
+ * @brief Append a code point encoded as UTF-8 to the output of the frame.
+ *
+ * @param terminal The terminal to append to.
+ * @param code_point The code point to be appended, it should take 3 bytes.
+ */
+static void append_code_point(struct Terminal* terminal, uint16_t code_point)
+{
+    terminal->output[terminal->output_length++] = 0xE0 | (code_point >> 12);
+    terminal->output[terminal->output_length++] = 0x80 | ((code_point >> 6) & 0x3F);
+    terminal->output[terminal->output_length++] = 0x80 | (code_point & 0x3F);
+}
+
+/**
+ * @brief Get the palette index of a pixel of the screen.
+ *
+ * @param screen The screen to get the pixel from.
+ * @param x The column of the pixel.
+ * @param y The row of the pixel.
+ * @return The palette index of the pixel.
+ */
+static uint8_t get_pixel(const struct Screen* screen, size_t x, size_t y)
+{
+    uint8_t color = 0;
+
+    for (size_t plane = 0; plane < SCREEN_PLANES; plane++) {
+        color |= ((screen->buffer[plane][y][x / 64] >> (63 - x % 64)) & 1) << plane;
+    }
+
+    return color;
+}
+
+/**
+ * @brief Get the contents of a cell drawn with a half block, the top pixel in the low nibble and the bottom one in the
+ *  high nibble.
+ *
+ * @param screen The screen to get the pixels from.
+ * @param row The row of the cell.
+ * @param column The column of the cell.
+ * @return The contents of the cell.
+ */
+static uint16_t get_half_block_cell(const struct Screen* screen, size_t row, size_t column)
+{
+    return get_pixel(screen, column, row * 2) | get_pixel(screen, column, row * 2 + 1) << 4;
+}
+
+/**
+ * @brief Get the contents of a cell drawn with braille dots, the dots in the low byte (with the bit order of the
+ *  Unicode braille patterns) and the highest palette index of the lit pixels in the high byte.
+ *
+ * @param screen The screen to get the pixels from.
+ * @param row The row of the cell.
+ * @param column The column of the cell.
+ * @return The contents of the cell.
+ */
+static uint16_t get_braille_cell(const struct Screen* screen, size_t row, size_t column)
+{
+    // The bit of the dot of each pixel, indexed by its row and column inside the cell
+    static constexpr uint8_t dot_bits[4][2] = { { 0x01, 0x08 }, { 0x02, 0x10 }, { 0x04, 0x20 }, { 0x40, 0x80 } };
+
+    uint8_t dots = 0;
+    uint8_t color = 0;
+
+    for (size_t y = 0; y < 4; y++) {
+        for (size_t x = 0; x < 2; x++) {
+            uint8_t pixel = get_pixel(screen, column * 2 + x, row * 4 + y);
+
+            if (pixel != 0) {
+                dots |= dot_bits[y][x];
+                color = pixel > color ? pixel : color;
+            }
+        }
+    }
+
+    return dots | color << 8;
+}
+
+/**
+ * @brief Draw the screen to the terminal, only the cells that changed since the previous call are written.
+ *  All the output of the frame is sent with a single `write()`.
+ *
+ * @param terminal The terminal where the screen should be drawn.
+ * @param screen The screen to get the pixels from.
+ * @return Return 0 on success or another number on failure.
+ */
+uint8_t draw_terminal(struct Terminal* terminal, const struct Screen* screen)
+{
+    terminal->output_length = 0;
+
+    if (terminal->high_resolution != screen->high_resolution) {
+        terminal->high_resolution = screen->high_resolution;
+        terminal->invalidated = true;
+    }
+
+    if (terminal->invalidated) {
+        append_string(terminal, "\x1B[0m\x1B[2J");
+        terminal->foreground = -1;
+        terminal->background = -1;
+    }
+
+    bool braille = terminal->charset == TERMINAL_CHARSET_BRAILLE;
+    size_t rows = screen->height / (braille ? 4 : 2);
+    size_t columns = screen->width / (braille ? 2 : 1);
+
+    // The position of the cursor is only sent when it changes, the cursor moves right after every character so
+    // contiguous cells don't need moves
+    size_t cursor_row = SIZE_MAX;
+    size_t cursor_column = SIZE_MAX;
+
+    for (size_t row = 0; row < rows; row++) {
+        for (size_t column = 0; column < columns; column++) {
+            uint16_t cell = braille ? get_braille_cell(screen, row, column) : get_half_block_cell(screen, row, column);
+
+            if (!terminal->invalidated && terminal->cells[row][column] == cell) {
+                continue;
+            }
+
+            terminal->cells[row][column] = cell;
+
+            if (cursor_row != row || cursor_column != column) {
+                append_string(terminal, "\x1B[");
+                append_number(terminal, row + 1);
+                append_string(terminal, ";");
+                append_number(terminal, column + 1);
+                append_string(terminal, "H");
+            }
+
+            cursor_row = row;
+            cursor_column = column + 1;
+
+            uint8_t cell_foreground = braille ? cell >> 8 : cell & 0xF;
+            uint8_t cell_background = braille ? 0 : cell >> 4;
+
+            if (cell_background != terminal->background) {
+                append_color(terminal, true, cell_background);
+                terminal->background = cell_background;
+            }
+
+            // An empty cell only needs the background
+            bool empty = braille ? (cell & 0xFF) == 0 : cell_foreground == cell_background;
+
+            if (empty) {
+                append_string(terminal, " ");
+                continue;
+            }
+
+            if (cell_foreground != terminal->foreground) {
+                append_color(terminal, false, cell_foreground);
+                terminal->foreground = cell_foreground;
+            }
+
+            append_code_point(terminal, braille ? 0x2800 | (cell & 0xFF) : 0x2580);
+        }
+    }
+
+    terminal->invalidated = false;
+    terminal->frames++;
+
+    if (terminal->output_length == 0) {
+        return 0;
+    }
+
+    terminal->written_bytes += terminal->output_length;
+
+    return write_terminal(terminal->output, terminal->output_length);
+}
+
+/**
+ * @brief Read the keys typed on the terminal and update the keypad, releasing the keys that haven't been repeated.
+ *  It should be called once per frame.
+ *
+ * @param terminal The terminal to read the keys from.
+ * @param vm The virtual machine whose keypad is updated.
+ * @return If Ctrl+C was typed and the emulator should quit.
+ */
+bool poll_terminal_keys(struct Terminal* terminal, struct VirtualMachine* vm)
+{
+    for (uint8_t key = 0; key < 16; key++) {
+        if (terminal->key_frames[key] > 0 && --terminal->key_frames[key] == 0) {
+            set_key_state(vm, key, false);
+        }
+    }
+
+    if (!terminal->raw_input) {
+        return false;
+    }
+
+    char typed[64];
+    ssize_t length = read(STDIN_FILENO, typed, sizeof(typed));
+
+    for (ssize_t i = 0; i < length; i++) {
+        if (typed[i] == TERMINAL_INTERRUPT) {
+            return true;
+        }
+
+        char lowercase = typed[i] >= 'A' && typed[i] <= 'Z' ? typed[i] - 'A' + 'a' : typed[i];
+        const char* found = lowercase != '\0' ? strchr(terminal_keys, lowercase) : NULL;
+
+        if (found != NULL) {
+            uint8_t key = found - terminal_keys;
+
+            set_key_state(vm, key, true);
+            terminal->key_frames[key] = TERMINAL_KEY_FRAMES;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Switch the terminal to an alternate screen where the emulator is drawn and read the keys as they are typed.
+ *
+ * @param charset The characters used to draw the pixels.
+ * @return The pointer to the terminal or a NULL pointer if an error occurs.
+ *  The terminal should be restored and freed using the function `delete_terminal()`.
+ */
+struct Terminal* create_terminal(enum TerminalCharset charset)
+{
+    if (!isatty(STDOUT_FILENO)) {
+        error("The standard output isn't a terminal");
+        return NULL;
+    }
+
+    struct Terminal* terminal = calloc(1, sizeof(struct Terminal));
+    if (terminal == NULL) {
+        error("Malloc 'terminal' failed");
+        return NULL;
+    }
+
+    terminal->output = malloc(TERMINAL_OUTPUT_SIZE);
+    if (terminal->output == NULL) {
+        error("Malloc 'terminal->output' failed");
+        goto output_failed;
+    }
+
+    terminal->charset = charset;
+    terminal->invalidated = true;
+
+    // Without a terminal on the input the keypad is just never pressed, like when the output is watched over a pipe
+    if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &terminal->original_attributes) == 0) {
+        struct termios attributes = terminal->original_attributes;
+
+        attributes.c_lflag &= ~(ICANON | ECHO | ISIG);
+        attributes.c_cc[VMIN] = 0;
+        attributes.c_cc[VTIME] = 0;
+
+        terminal->raw_input = tcsetattr(STDIN_FILENO, TCSANOW, &attributes) == 0;
+    }
+
+    // Alternate screen without cursor
+    static const char enter[] = "\x1B[?1049h\x1B[?25l";
+    if (write_terminal(enter, sizeof(enter) - 1) != 0) {
+        goto write_failed;
+    }
+
+    return terminal;
+
+write_failed:
+    if (terminal->raw_input) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &terminal->original_attributes);
+    }
+
+    free(terminal->output);
+output_failed:
+    free(terminal);
+
+    return NULL;
+}
+
+/**
+ * @brief Restore the terminal to how it was before `create_terminal()` and deallocate it.
+ *
+ * @param terminal The terminal to be deallocated.
+ */
+void delete_terminal(struct Terminal* terminal)
+{
+    static const char leave[] = "\x1B[0m\x1B[?25h\x1B[?1049l";
+    write_terminal(leave, sizeof(leave) - 1);
+
+    if (terminal->raw_input) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &terminal->original_attributes);
+    }
+
+    if (terminal->frames > 0) {
+        info("Terminal: %.0f bytes written per frame", (double)terminal->written_bytes / terminal->frames);
+    }
+
+    free(terminal->output);
+    free(terminal);
+}
@@ -0,0 +1,110 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frame-pacing.h"
+#include "logging.h"
+#include "trace.h"
+
+static const char* const thread_names[TRACE_THREADS] = {
+    [TRACE_THREAD_WINDOW] = "window",
+    [TRACE_THREAD_EMULATION] = "emulation",
+    [TRACE_THREAD_AUDIO] = "audio",
+};
+
+/**
+ * @brief Create the buffers of the traced threads, the timeline starts when it is called.
+ *
+ * @return The pointer to the trace or a NULL pointer if an error occurs.
+ *  The trace should be freed using the function `delete_trace()`.
+ */
+struct Trace* create_trace()
+{
+    struct Trace* trace = calloc(1, sizeof(struct Trace));
+    if (trace == NULL) {
+        error("Malloc 'trace' failed");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < TRACE_THREADS; i++) {
+        trace->buffers[i].events = malloc(TRACE_BUFFER_EVENTS * sizeof(struct TraceEvent));
+
+        if (trace->buffers[i].events == NULL) {
+            error("Malloc 'trace->buffers[%zu].events' failed", i);
+            delete_trace(trace);
+            return NULL;
+        }
+    }
+
+    trace->start_time = get_monotonic_timestamp();
+
+    return trace;
+}
+
+/**
+ * @brief Write the events as Chrome trace event JSON, that can be opened on Perfetto or `chrome://tracing`.
+ *  None of the traced threads should be recording while it is written.
+ *
+ * @param trace The trace to write.
+ * @param path The path of the JSON file.
+ * @return Return 0 on success or another number on failure.
+ */
+uint8_t write_trace(const struct Trace* trace, const char* path)
+{
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        error("Couldn't create the file '%s': %s", path, strerror(errno));
+        return 1;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"och8S\"}}");
+
+    uint64_t dropped = 0;
+
+    for (size_t thread = 0; thread < TRACE_THREADS; thread++) {
+        const struct TraceBuffer* buffer = &trace->buffers[thread];
+
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+            thread + 1, thread_names[thread]);
+
+        // Only the last events are kept, from the oldest to the newest
+        uint64_t first = buffer->count > TRACE_BUFFER_EVENTS ? buffer->count - TRACE_BUFFER_EVENTS : 0;
+        dropped += first;
+
+        for (uint64_t i = first; i < buffer->count; i++) {
+            const struct TraceEvent* event = &buffer->events[i & (TRACE_BUFFER_EVENTS - 1)];
+
+            // Complete events, with the time in microseconds from the start of the trace
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+                event->name, thread + 1, (event->start - trace->start_time) / 1000.0, event->duration / 1000.0);
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0) {
+        error("Couldn't write the file '%s': %s", path, strerror(errno));
+        return 2;
+    }
+
+    info("Trace written to '%s'%s", path, dropped > 0 ? ", only with the last events of every thread" : "");
+
+    return 0;
+}
+
+/**
+ * @brief Safely deallocate a trace.
+ *
+ * @param trace The trace to be deallocated.
+ */
+void delete_trace(struct Trace* trace)
+{
+    for (size_t i = 0; i < TRACE_THREADS; i++) {
+        free(trace->buffers[i].events);
+    }
+
+    free(trace);
+}
@@ -0,0 +1,56 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "screen.h"
+#include "triple-buffer.h"
+
+/**
+ * @brief Prepare a triple buffer with all the frames blank.
+ *
+ * @param buffer The triple buffer to be prepared.
+ */
+void init_triple_buffer(struct TripleBuffer* buffer)
+{
+    for (size_t i = 0; i < 3; i++) {
+        buffer->frames[i].selected_planes = 0x1;
+        set_screen_resolution(&buffer->frames[i], false);
+    }
+
+    buffer->writing = 0;
+    atomic_init(&buffer->shared, 1);
+    buffer->reading = 2;
+}
+
+/**
+ * @brief Copy a finished screen and make it the latest frame available to the reader. Only the writer thread should call it.
+ *
+ * @param buffer The triple buffer where the frame should be published.
+ * @param screen The screen to be copied.
+ */
+void publish_frame(struct TripleBuffer* buffer, const struct Screen* screen)
+{
+    memcpy(&buffer->frames[buffer->writing], screen, sizeof(struct Screen));
+
+    uint8_t previous = atomic_exchange_explicit(&buffer->shared, buffer->writing | TRIPLE_BUFFER_NEW_FRAME, memory_order_acq_rel);
+    buffer->writing = previous & ~TRIPLE_BUFFER_NEW_FRAME;
+}
+
+/**
+ * @brief Get the latest published frame. Only the reader thread should call it.
+ *
+ * @param buffer The triple buffer to get the frame from.
+ * @param new_frame Set to whether the returned frame hasn't been returned before.
+ * @return The latest frame, it is owned by the reader until the next call.
+ */
+const struct Screen* acquire_frame(struct TripleBuffer* buffer, bool* new_frame)
+{
+    *new_frame = atomic_load_explicit(&buffer->shared, memory_order_relaxed) & TRIPLE_BUFFER_NEW_FRAME;
+
+    if (*new_frame) {
+        uint8_t previous = atomic_exchange_explicit(&buffer->shared, buffer->reading, memory_order_acq_rel);
+        buffer->reading = previous & ~TRIPLE_BUFFER_NEW_FRAME;
+    }
+
+    return &buffer->frames[buffer->reading];
+}
@@ -3,10 +3,10 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "keys.h"
+#include "debugger.h"
 #include "logging.h"
 #include "opcodes.h"
-#include "render.h"
+#include "screen.h"
 #include "virtual-machine.h"
 
 struct VirtualMachine;
@@ -31,14 +31,34 @@ static constexpr uint8_t font_data[] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80, // F
 };
 
+static constexpr uint8_t big_font_data[] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0, // F
+};
+
 /**
  * @brief Create a new virtual machine.
  *
  * @param rom_path The path to the ROM to the loaded.
+ * @param quirk_profile The quirks of the platform the ROM was made for.
  *
  * @return The created virtual machine. It can (and MUST) be deallocated after its use with `free()`.
  */
-struct VirtualMachine* create_virtual_machine(char* rom_path)
+struct VirtualMachine* create_virtual_machine(char* rom_path, enum QuirkProfile quirk_profile)
 {
     struct VirtualMachine* vm = malloc(sizeof(struct VirtualMachine));
 
@@ -51,199 +71,223 @@ struct VirtualMachine* create_virtual_machine(char* rom_path)
     // Caution!: This will only work if the struct if made only of integer types
     memset(vm, 0, sizeof(struct VirtualMachine));
 
-    vm->pc = 0x200;
+    if (reset_virtual_machine(vm, rom_path, quirk_profile) != 0) {
+        free(vm);
+        return NULL;
+    }
 
-    memcpy(vm->memory + 0x50, font_data, sizeof(font_data));
+    return vm;
+}
 
-    FILE* rom = fopen(rom_path, "rb");
+/**
+ * @brief Get the size of the address space of a quirk profile minus 1.
+ *
+ * @param quirk_profile The quirks of the platform.
+ * @return The mask of the addresses.
+ */
+static uint16_t get_address_mask(enum QuirkProfile quirk_profile)
+{
+    return (quirk_profile == QUIRK_PROFILE_XO_CHIP ? XO_CHIP_MEMORY_SIZE : MEMORY_SIZE) - 1;
+}
 
-    if (rom == NULL) {
+/**
+ * @brief Read a whole ROM file, checking that it fits the memory of the platform. Nothing can fail once it is read, so
+ *  it can be read ahead on any thread and loaded later with `load_rom()`.
+ *
+ * @param rom_path The path to the ROM to be read.
+ * @param quirk_profile The quirks of the platform the ROM will be loaded on.
+ * @param size Where the size of the ROM in bytes is stored.
+ * @return The bytes of the ROM or NULL on failure. It can (and MUST) be deallocated after its use with `free()`.
+ */
+uint8_t* read_rom_file(const char* rom_path, enum QuirkProfile quirk_profile, size_t* size)
+{
+    FILE* file = fopen(rom_path, "rb");
+
+    if (file == NULL) {
         error("ROM file is missing or access has been refused by permission configurations");
         return NULL;
     }
 
     // Get the size of the file in bytes
-    fseek(rom, 0, SEEK_END);
-    size_t size = (size_t)ftell(rom);
-    rewind(rom);
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    rewind(file);
+
+    *size = (size_t)length;
 
-    if (size > sizeof(vm->memory) - 0x200) {
+    if (length < 0 || *size > (size_t)get_address_mask(quirk_profile) + 1 - 0x200) {
         error("ROM size too big for the memory! Are you sure it is valid for this system?");
         goto rom_size_too_big;
     }
 
-    size_t count = fread(vm->memory + 0x200, sizeof(vm->memory[0]), size, rom);
+    // One byte more so an empty ROM still gets a buffer
+    uint8_t* rom = malloc(*size + 1);
+    if (rom == NULL) {
+        error("Malloc 'rom' failed");
+        goto rom_malloc_failed;
+    }
 
-    if (count != size && ferror(rom) != 0) {
+    if (fread(rom, sizeof(rom[0]), *size, file) != *size) {
         error("Reading rom failed!");
         goto read_rom_failed;
     }
 
-    fclose(rom);
-
-    vm->wait_key = -2;
+    fclose(file);
 
-    return vm;
+    return rom;
 
-rom_size_too_big:
 read_rom_failed:
-    free(vm);
-    vm = NULL;
-
-    return vm;
-}
-
-/**
- * @brief Parse the opcode located at the PC of the Virtual Machine.
- *
- * @param vm The virtual machine to get from it the memory and PC.
- * @return The parsed opcode info.
- */
-struct Opcode get_opcode(struct VirtualMachine* vm)
-{
-    struct Opcode opcode;
-
-    opcode.nibble_1 = vm->memory[vm->pc] >> 4;
-    opcode.nibble_2 = vm->memory[vm->pc] & 0x0F;
-
-    opcode.byte_2 = vm->memory[vm->pc + 1];
-
-    opcode.nibble_3 = vm->memory[vm->pc + 1] >> 4;
-    opcode.nibble_4 = vm->memory[vm->pc + 1] & 0x0F;
-
-    opcode.nibbles_2_3_4 = opcode.nibble_2 << 8 | opcode.byte_2;
+    free(rom);
+rom_malloc_failed:
+rom_size_too_big:
+    fclose(file);
 
-    return opcode;
+    return NULL;
 }
 
 /**
- * @brief Step the cpu of the virtual machine one time.
+ * @brief Put the virtual machine back to its power-on state with a ROM read by `read_rom_file()` loaded. What lives
+ *  outside of the program is kept: the keypad, the RPL flags, the count of idle steps and the debugger.
  *
- * @param vm The virtual machine of whose cpu should be step.
- * @param screen The screen where virtual machine state changes may be reflected.
- * @return
+ * @param vm The virtual machine to be reset.
+ * @param rom The bytes of the ROM, they are copied.
+ * @param size The size of the ROM, it must fit the memory of the platform as checked by `read_rom_file()`.
+ * @param quirk_profile The quirks of the platform the ROM was made for.
  */
-uint8_t step_cpu(struct VirtualMachine* vm, struct Screen* screen)
+void load_rom(struct VirtualMachine* vm, const uint8_t* rom, size_t size, enum QuirkProfile quirk_profile)
 {
-    struct Opcode opcode = get_opcode(vm);
-    vm->pc += 2;
-
-    debug("Opcode: %x, X: %x, Y: %x, N: %x, NN: %02x, NNN: %03x", opcode.nibble_1, opcode.nibble_2, opcode.nibble_3, opcode.nibble_4, opcode.byte_2, opcode.nibbles_2_3_4);
-
-    switch (opcode.nibble_1) {
-    case 0x0:
-        if (opcode_0(opcode, vm, screen) != 0) {
-            return 1;
-        }
-
-        break;
-
-    case 0x1:
-        vm->pc = opcode.nibbles_2_3_4;
-        debug("Jumping to %#05x", vm->pc);
+    // The interpreter specialized for the quirks is selected once here, so the quirks cost nothing on each step
+    uint8_t (*run_cpu)(struct VirtualMachine* vm, struct Screen* screen, size_t steps) = NULL;
 
+    switch (quirk_profile) {
+    case QUIRK_PROFILE_COSMAC_VIP:
+        run_cpu = run_cpu_cosmac_vip;
         break;
-
-    case 0x2:
-        vm->pc_stack[vm->pc_stack_index] = vm->pc;
-        vm->pc_stack_index++;
-
-        vm->pc = opcode.nibbles_2_3_4 / sizeof(vm->memory[0]);
-        debug("Jumping to subroutine at %#05x", vm->pc);
-
+    case QUIRK_PROFILE_SCHIP_LEGACY:
+        run_cpu = run_cpu_schip_legacy;
         break;
-
-    case 0x3:
-        debug("Skipping if vX equals NN");
-        opcode_3_4(opcode, vm, true);
+    case QUIRK_PROFILE_SCHIP_MODERN:
+        run_cpu = run_cpu_schip_modern;
         break;
-
-    case 0x4:
-        debug("Skipping if vX not equals NN");
-        opcode_3_4(opcode, vm, false);
-        break;
-
-    case 0x5: {
-        debug("Skipping if vX equals vY");
-        opcode_5_9(opcode, vm, true);
+    case QUIRK_PROFILE_XO_CHIP:
+        run_cpu = run_cpu_xo_chip;
         break;
     }
 
-    case 0x6:
-        debug("Setting register v%x to value %#04x", opcode.nibble_2, opcode.byte_2);
-        vm->v_registers[opcode.nibble_2] = opcode.byte_2;
+    memset(vm->memory, 0, sizeof(vm->memory));
+    memset(vm->pc_stack, 0, sizeof(vm->pc_stack));
+    memset(vm->v_registers, 0, sizeof(vm->v_registers));
 
-        break;
-
-    case 0x7:
-        debug("Adding %d to register v%x", opcode.byte_2, opcode.nibble_2);
-        vm->v_registers[opcode.nibble_2] += opcode.byte_2;
-
-        break;
+    vm->pc = 0x200;
+    vm->pc_stack_index = 0;
+    vm->index_register = 0;
+    vm->delay_timer = 0;
+    vm->sound_timer = 0;
+    vm->exited = false;
+    vm->idle = false;
+    vm->quirk_profile = quirk_profile;
+    vm->address_mask = get_address_mask(quirk_profile);
+
+    // A debugger keeps choosing between its interpreters, they are picked again for the new profile
+    if (vm->debugger != NULL) {
+        retarget_debugger(vm->debugger, vm, run_cpu, quirk_profile);
+    } else {
+        vm->run_cpu = run_cpu;
+    }
 
-    case 0x8:
-        opcode_8(opcode, vm);
-        break;
+    memcpy(vm->memory + FONT_ADDRESS, font_data, sizeof(font_data));
+    memcpy(vm->memory + BIG_FONT_ADDRESS, big_font_data, sizeof(big_font_data));
+    memcpy(vm->memory + 0x200, rom, size);
 
-    case 0x9:
-        debug("Skipping if vX not equals vY");
-        opcode_5_9(opcode, vm, false);
-        break;
+    vm->wait_key = -2;
 
-    case 0xA:
-        debug("Setting register i to value %#05x", opcode.nibbles_2_3_4);
-        vm->index_register = opcode.nibbles_2_3_4;
+    // Xorshift never leaves the state 0
+    vm->random_state = (uint32_t)rand() | 1;
+}
 
-        break;
+/**
+ * @brief Put the virtual machine back to its power-on state with a ROM loaded, the same one to reset it or another one
+ *  to switch games without creating it again. What lives outside of the program is kept, see `load_rom()`.
+ *
+ * @param vm The virtual machine to be reset, it is left untouched if the ROM can't be opened, read or doesn't fit.
+ * @param rom_path The path to the ROM to the loaded.
+ * @param quirk_profile The quirks of the platform the ROM was made for.
+ * @return Return 0 on success or another number on failure.
+ */
+uint8_t reset_virtual_machine(struct VirtualMachine* vm, char* rom_path, enum QuirkProfile quirk_profile)
+{
+    // The ROM is read whole before touching the virtual machine, so one that can't be loaded leaves it as it was
+    size_t size;
+    uint8_t* rom = read_rom_file(rom_path, quirk_profile, &size);
+    if (rom == NULL) {
+        return 1;
+    }
 
-    case 0xB:
-        vm->pc = opcode.nibbles_2_3_4 + vm->v_registers[0];
-        debug("Jumping to %#05x (%#05x + %#05x)", vm->pc, opcode.nibbles_2_3_4, vm->v_registers[0]);
+    load_rom(vm, rom, size, quirk_profile);
+    free(rom);
 
-        break;
+    return 0;
+}
 
-    case 0xC:
-        debug("Generating a random number an setting it to v%d", opcode.nibble_2);
-        vm->v_registers[opcode.nibble_2] = rand() & opcode.byte_2;
+/**
+ * @brief Give the virtual machine the jumps closing idle loops found by the analysis of its ROM, so it idles on them
+ *  from the first frame without matching the patterns. `load_rom()` keeps them, so they must be seeded again or
+ *  cleared when another ROM is loaded.
+ *
+ * @param vm The virtual machine running the analyzed ROM.
+ * @param idle_loops The `idle_loops` bitmap of the analysis of the ROM, or NULL to clear them.
+ */
+void seed_idle_loops(struct VirtualMachine* vm, const uint64_t* idle_loops)
+{
+    if (idle_loops == NULL) {
+        memset(vm->idle_jumps, 0, sizeof(vm->idle_jumps));
+        return;
+    }
 
-        break;
+    memcpy(vm->idle_jumps, idle_loops, sizeof(vm->idle_jumps));
+}
 
-    case 0x0D:
-        if (opcode_d(opcode, vm, screen) != 0) {
-            return 1;
-        }
+/**
+ * @brief Parse the opcode located at the PC of the Virtual Machine.
+ *
+ * @param vm The virtual machine to get from it the memory and PC.
+ * @return The parsed opcode info.
+ */
+struct Opcode get_opcode(const struct VirtualMachine* vm)
+{
+    return decode_opcode(read_memory(vm, vm->pc), read_memory(vm, vm->pc + 1));
+}
 
-        break;
+/**
+ * @brief Press or release a key of the keypad, it can be called from any thread.
+ *
+ * @param vm The virtual machine whose keypad should be updated.
+ * @param key The CHIP-8 key, any value outside of the keypad is ignored.
+ * @param pressed If the key has been pressed or released.
+ */
+void set_key_state(struct VirtualMachine* vm, uint8_t key, bool pressed)
+{
+    if (key > 0xF) {
+        return;
+    }
 
-    case 0x0E: {
-        uint8_t requested_key = vm->v_registers[opcode.nibble_2];
-        const uint8_t* pressed_keys = SDL_GetKeyboardState(NULL);
-
-        if (opcode.byte_2 == 0x9E) {
-            debug("If key '%x' is being pressed skip", requested_key);
-            if (pressed_keys[chip8_key_to_sdl_scancode[requested_key]]) {
-                debug("Skipped");
-                vm->pc += 2;
-            }
-        }
-
-        if (opcode.byte_2 == 0xA1) {
-            debug("If key '%x' is not being pressed skip", requested_key);
-            if (!pressed_keys[chip8_key_to_sdl_scancode[requested_key]]) {
-                debug("Skipped");
-                vm->pc += 2;
-            }
-        }
-        break;
+    if (pressed) {
+        atomic_fetch_or_explicit(&vm->pressed_keys, 1 << key, memory_order_relaxed);
+        return;
     }
 
-    case 0x0F:
-        opcode_f(opcode, vm);
-        break;
+    atomic_fetch_and_explicit(&vm->pressed_keys, ~(1 << key), memory_order_relaxed);
+    atomic_fetch_or_explicit(&vm->released_keys, 1 << key, memory_order_relaxed);
+}
 
-    default:
-        debug("Unknown opcode, reading data from the ROM?");
-        break;
-    }
-    return 0;
+/**
+ * @brief Step the cpu of the virtual machine one time.
+ *
+ * @param vm The virtual machine of whose cpu should be step.
+ * @param screen The screen where virtual machine state changes may be reflected.
+ * @return Return 0 on success or another number on failure.
+ */
+uint8_t step_cpu(struct VirtualMachine* vm, struct Screen* screen)
+{
+    return vm->run_cpu(vm, screen, 1);
 }
@@ -0,0 +1,294 @@
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "analysis-cache.h"
+#include "audio.h"
+#include "configuration.h"
+#include "frame-pacing.h"
+#include "logging.h"
+#include "quirks.h"
+#include "screen.h"
+#include "triple-buffer.h"
+#include "virtual-machine.h"
+#include "wall.h"
+
+/**
+ * @brief Load the configuration of the ROM of an instance and create its virtual machine, with the quirks given by
+ *  the command line, the configured ones or the detected ones, in that order.
+ *
+ * @param instance The instance to be prepared.
+ * @param rom_path The path to its ROM.
+ * @param configuration_path The path to the configuration file or NULL for the default one.
+ * @param given_quirk_profile The quirks given by the command line or NULL.
+ * @return Return 0 on success or another number on failure.
+ */
+static uint8_t init_wall_instance(struct WallInstance* instance, char* rom_path, const char* configuration_path,
+    const enum QuirkProfile* given_quirk_profile)
+{
+    // Only the hash, the detected quirks and the idle loops are needed, the analysis is unloaded once they are used
+    const struct RomAnalysis* analysis = load_rom_analysis(rom_path);
+
+    struct Configuration* configuration = &instance->configuration;
+    if (load_configuration(configuration, configuration_path, analysis != NULL ? analysis->rom_hash : 0) != 0) {
+        goto configuration_failed;
+    }
+
+    if (given_quirk_profile != NULL) {
+        configuration->quirk_profile = *given_quirk_profile;
+    } else if (!configuration->quirk_profile_set && analysis != NULL) {
+        configuration->quirk_profile = analysis->quirk_profile;
+    }
+
+    instance->screen = create_screen();
+    if (instance->screen == NULL) {
+        goto screen_failed;
+    }
+
+    instance->vm = create_virtual_machine(rom_path, configuration->quirk_profile);
+    if (instance->vm == NULL) {
+        goto virtual_machine_failed;
+    }
+
+    // `load_rom()` keeps them, so they survive the resets of F5
+    if (analysis != NULL) {
+        seed_idle_loops(instance->vm, analysis->idle_loops);
+        unload_rom_analysis(analysis);
+    }
+
+    instance->rom_path = rom_path;
+    init_triple_buffer(&instance->frames);
+    instance->pending_opcodes = 0;
+    instance->stopped = false;
+    atomic_init(&instance->reset_requested, false);
+
+    return 0;
+
+virtual_machine_failed:
+    delete_screen(instance->screen);
+screen_failed:
+configuration_failed:
+    if (analysis != NULL) {
+        unload_rom_analysis(analysis);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Create a wall running many ROMs, on a grid as square as possible.
+ *
+ * @param rom_paths The paths to the ROMs, they should last as long as the wall.
+ * @param count The number of ROMs, up to `WALL_MAX_INSTANCES`.
+ * @param configuration_path The path to the configuration file or NULL for `och8s.ini` on the preferences directory.
+ * @param given_quirk_profile The quirks given by the command line for every ROM or NULL.
+ * @return The pointer to the wall or a NULL pointer if an error occurs.
+ *  The wall should be freed using the function `delete_wall()`.
+ */
+struct Wall* create_wall(char** rom_paths, size_t count, const char* configuration_path,
+    const enum QuirkProfile* given_quirk_profile)
+{
+    struct Wall* wall = malloc(sizeof(struct Wall));
+    if (wall == NULL) {
+        error("Malloc 'wall' failed");
+        return NULL;
+    }
+
+    wall->instances = malloc(count * sizeof(struct WallInstance));
+    if (wall->instances == NULL) {
+        error("Malloc 'wall->instances' failed");
+        goto instances_failed;
+    }
+
+    size_t created = 0;
+
+    for (; created < count; created++) {
+        if (init_wall_instance(&wall->instances[created], rom_paths[created], configuration_path,
+                given_quirk_profile)
+            != 0) {
+            goto instance_failed;
+        }
+
+        const struct Configuration* configuration = &wall->instances[created].configuration;
+
+        info("Tile %zu: '%s' (%s quirks, %u opcodes/s)", created + 1, rom_paths[created],
+            get_quirk_profile_name(configuration->quirk_profile), configuration->opcodes_per_second);
+    }
+
+    wall->count = count;
+    wall->columns = (size_t)ceil(sqrt((double)count));
+    wall->rows = (count + wall->columns - 1) / wall->columns;
+
+    wall->audio_opened = false;
+    wall->audio_ready = false;
+
+    // All the ROMs share the device, the first one sets its buffer
+    wall->audio_buffer_samples = wall->instances[0].configuration.audio_buffer_samples;
+    wall->metrics = NULL;
+
+    atomic_init(&wall->quit, false);
+    atomic_init(&wall->failed, false);
+
+    wall->emulated_frames = 0;
+    wall->instructions = 0;
+
+    return wall;
+
+instance_failed:
+    while (created-- > 0) {
+        free(wall->instances[created].vm);
+        delete_screen(wall->instances[created].screen);
+    }
+
+    free(wall->instances);
+instances_failed:
+    free(wall);
+
+    return NULL;
+}
+
+/**
+ * @brief Set up the audio mixer the first time any of the ROMs plays a sound. If it can't be opened the wall goes on
+ *  muted, it is never tried again.
+ *
+ * @param wall The wall that plays the sound.
+ */
+static void open_wall_audio(struct Wall* wall)
+{
+    wall->audio_opened = true;
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        warning("Initializing SDL audio failed, running muted: %s", SDL_GetError());
+        return;
+    }
+
+    if (setup_audio_mixer(&wall->mixer, wall->count, wall->audio_buffer_samples, wall->metrics, NULL) != 0) {
+        warning("Opening the audio device failed, running muted");
+        return;
+    }
+
+    wall->audio_ready = true;
+    debug("Audio mixer opened with %zu voices", wall->count);
+}
+
+/**
+ * @brief Run the slice of an instance for the elapsed frames. A ROM that exits or fails is stopped without stopping the
+ *  rest of the wall.
+ *
+ * @param wall The wall of the instance.
+ * @param index The index of the instance, its tile and its voice.
+ * @param frames The number of frames elapsed since the last run.
+ */
+static void run_wall_instance(struct Wall* wall, size_t index, uint32_t frames)
+{
+    struct WallInstance* instance = &wall->instances[index];
+    struct VirtualMachine* vm = instance->vm;
+
+    if (atomic_exchange(&instance->reset_requested, false)) {
+        // The ROM was loaded once, so it only fails when the file changed, then the instance is left as it was
+        if (reset_virtual_machine(vm, instance->rom_path, instance->configuration.quirk_profile) == 0) {
+            reset_screen(instance->screen);
+            instance->pending_opcodes = 0;
+            instance->stopped = false;
+        }
+    }
+
+    for (uint32_t frame = 0; frame < frames && !instance->stopped; frame++) {
+        if (vm->delay_timer > 0) {
+            vm->delay_timer--;
+        }
+
+        if (vm->sound_timer > 0) {
+            vm->sound_timer--;
+        }
+
+        instance->pending_opcodes += instance->configuration.opcodes_per_second;
+        uint32_t steps = instance->pending_opcodes / 60;
+        instance->pending_opcodes %= 60;
+
+        uint64_t idle_steps = vm->idle_steps;
+
+        if (vm->run_cpu(vm, instance->screen, steps) != 0) {
+            warning("The ROM of the tile %zu failed, it is stopped until it is reset", index + 1);
+            instance->stopped = true;
+        }
+
+        wall->instructions += steps - (vm->idle_steps - idle_steps);
+
+        if (vm->exited) {
+            info("The ROM of the tile %zu exited, it is stopped until it is reset", index + 1);
+            instance->stopped = true;
+        }
+    }
+
+    // The original CHIP-8 spec specify that the sound should start with more that one set in the timer
+    bool playing = !instance->stopped && vm->sound_timer > 1;
+
+    if (playing && !wall->audio_opened) {
+        open_wall_audio(wall);
+    }
+
+    if (wall->audio_ready) {
+        atomic_store_explicit(&wall->mixer.playing[index], playing, memory_order_relaxed);
+    }
+
+    // Publish at most once per frame no matter how many times the buffer changed
+    if (instance->screen->dirty) {
+        publish_frame(&instance->frames, instance->screen);
+        instance->screen->dirty = false;
+    }
+}
+
+/**
+ * @brief Run every virtual machine of the wall paced at 60 frames per second until the wall quits, one after the other
+ *  on each frame. It is the entry point of the emulation thread.
+ *
+ * @param data The `struct Wall` to run.
+ * @return Return 0 on success or another number on failure.
+ */
+int run_wall(void* data)
+{
+    struct Wall* wall = data;
+
+    if (start_frame_pacer(&wall->pacer, 60, false) != 0) {
+        atomic_store(&wall->failed, true);
+        atomic_store(&wall->quit, true);
+        return 1;
+    }
+
+    debug("Starting the wall loop");
+    while (!atomic_load_explicit(&wall->quit, memory_order_relaxed)) {
+        uint32_t frames = wait_next_frame(&wall->pacer);
+
+        for (size_t index = 0; index < wall->count; index++) {
+            run_wall_instance(wall, index, frames);
+        }
+
+        wall->emulated_frames += frames;
+
+        if (wall->metrics != NULL) {
+            atomic_store_explicit(&wall->metrics->instructions, wall->instructions, memory_order_relaxed);
+            atomic_store_explicit(&wall->metrics->emulated_frames, wall->emulated_frames, memory_order_relaxed);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Safely deallocate a wall and every instance of it. The emulation thread should have finished.
+ *
+ * @param wall The wall to be deallocated.
+ */
+void delete_wall(struct Wall* wall)
+{
+    for (size_t index = 0; index < wall->count; index++) {
+        free(wall->instances[index].vm);
+        delete_screen(wall->instances[index].screen);
+    }
+
+    free(wall->instances);
+    free(wall);
+}